@@ -73,6 +73,46 @@ aes3k_assemble_image (unsigned char *input, size_t width, size_t height,
     }
 }
 
+typedef struct
+{
+  FpiDeviceAes3kClass *cls;
+  unsigned char       *data;
+} Aes3kCapture;
+
+static void
+aes3k_capture_free (Aes3kCapture *capture)
+{
+  g_free (capture->data);
+  g_free (capture);
+}
+
+static FpImage *
+process_capture (gpointer data, GCancellable *cancellable, GError **error)
+{
+  Aes3kCapture *capture = data;
+  FpiDeviceAes3kClass *cls = capture->cls;
+  unsigned char *ptr = capture->data;
+  g_autoptr(FpImage) tmp = NULL;
+  int i;
+
+  tmp = fp_image_new (cls->frame_width, cls->frame_width);
+  tmp->width = cls->frame_width;
+  tmp->height = cls->frame_width;
+  tmp->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED | FPI_IMAGE_H_FLIPPED |
+               FPI_IMAGE_PARALLEL_DETECTION;
+  for (i = 0; i < cls->frame_number; i++)
+    {
+      fp_dbg ("frame header byte %02x", *ptr);
+      ptr++;
+      aes3k_assemble_image (ptr, cls->frame_width, AES3K_FRAME_HEIGHT, tmp->data + (i * cls->frame_width * AES3K_FRAME_HEIGHT));
+      ptr += cls->frame_size;
+    }
+
+  /* FIXME: this is an ugly hack to make the image big enough for NBIS
+   * to process reliably */
+  return fpi_image_resize (tmp, cls->enlarge_factor, cls->enlarge_factor);
+}
+
 static void
 img_cb (FpiUsbTransfer *transfer, FpDevice *device,
         gpointer user_data, GError *error)
@@ -81,10 +121,7 @@ img_cb (FpiUsbTransfer *transfer, FpDevice *device,
   FpiDeviceAes3k *self = FPI_DEVICE_AES3K (device);
   FpiDeviceAes3kPrivate *priv = fpi_device_aes3k_get_instance_private (self);
   FpiDeviceAes3kClass *cls = FPI_DEVICE_AES3K_GET_CLASS (self);
-  unsigned char *ptr = transfer->buffer;
-  FpImage *tmp;
-  FpImage *img;
-  int i;
+  Aes3kCapture *capture;
 
   /* Image capture operation is finished (error/completed) */
   g_clear_object (&priv->img_capture_cancel);
@@ -107,23 +144,11 @@ img_cb (FpiUsbTransfer *transfer, FpDevice *device,
 
   fpi_image_device_report_finger_status (dev, TRUE);
 
-  tmp = fp_image_new (cls->frame_width, cls->frame_width);
-  tmp->width = cls->frame_width;
-  tmp->height = cls->frame_width;
-  tmp->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED | FPI_IMAGE_H_FLIPPED;
-  for (i = 0; i < cls->frame_number; i++)
-    {
-      fp_dbg ("frame header byte %02x", *ptr);
-      ptr++;
-      aes3k_assemble_image (ptr, cls->frame_width, AES3K_FRAME_HEIGHT, tmp->data + (i * cls->frame_width * AES3K_FRAME_HEIGHT));
-      ptr += cls->frame_size;
-    }
-
-  /* FIXME: this is an ugly hack to make the image big enough for NBIS
-   * to process reliably */
-  img = fpi_image_resize (tmp, cls->enlarge_factor, cls->enlarge_factor);
-  g_object_unref (tmp);
-  fpi_image_device_image_captured (dev, img);
+  capture = g_new0 (Aes3kCapture, 1);
+  capture->cls = cls;
+  capture->data = g_memdup (transfer->buffer, transfer->length);
+  fpi_image_device_process_capture (dev, process_capture, capture,
+                                    (GDestroyNotify) aes3k_capture_free);
 
   /* FIXME: rather than assuming finger has gone, we should poll regs until
    * it really has. */
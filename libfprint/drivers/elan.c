@@ -54,6 +54,7 @@ static struct fpi_frame_asmbl_ctx assembling_ctx = {
   .frame_height = 0,
   .image_width = 0,
   .get_pixel = elan_get_pixel,
+  .linear_frames = TRUE,
 };
 
 struct _FpiDeviceElan
@@ -1329,22 +1329,37 @@ elanspi_fp_assembling_get_pixel (struct fpi_frame_asmbl_ctx *ctx, struct fpi_fra
   return frame->data[y * ctx->frame_width + x];
 }
 
+typedef struct
+{
+  guint8  frame_width, frame_height;
+  GSList *frames;
+} ElanSpiCapture;
+
 static void
-elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
+elanspi_capture_free (ElanSpiCapture *capture)
+{
+  g_slist_free_full (capture->frames, g_free);
+  g_free (capture);
+}
+
+static FpImage *
+elanspi_fp_frame_stitch (gpointer data, GCancellable *cancellable, GError **error)
 {
+  ElanSpiCapture *capture = data;
   g_autoptr(FpImage) img = NULL;
-  g_autoptr(FpImage) scaled = NULL;
+  FpImage *scaled;
   struct fpi_frame_asmbl_ctx assembling_ctx = {
-    .image_width = (self->frame_width * 3) / 2,
+    .image_width = (capture->frame_width * 3) / 2,
 
-    .frame_width = self->frame_width,
-    .frame_height = self->frame_height,
+    .frame_width = capture->frame_width,
+    .frame_height = capture->frame_height,
 
     .get_pixel = elanspi_fp_assembling_get_pixel,
+    .linear_frames = TRUE,
   };
 
   /* stitch image */
-  GSList *frame_start = g_slist_nth (self->fp_frame_list, ELANSPI_SWIPE_FRAMES_DISCARD);
+  GSList *frame_start = g_slist_nth (capture->frames, ELANSPI_SWIPE_FRAMES_DISCARD);
 
   fpi_do_movement_estimation (&assembling_ctx, frame_start);
   img = fpi_assemble_frames (&assembling_ctx, frame_start);
@@ -1352,11 +1367,24 @@ elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
 
   scaled->flags |= FPI_IMAGE_PARTIAL | FPI_IMAGE_COLORS_INVERTED;
 
-  /* submit image */
-  fpi_image_device_image_captured (FP_IMAGE_DEVICE (self), g_steal_pointer (&scaled));
+  return scaled;
+}
 
-  /* clean out frame data */
-  g_slist_free_full (g_steal_pointer (&self->fp_frame_list), g_free);
+static void
+elanspi_fp_frame_stitch_and_submit (FpiDeviceElanSpi *self)
+{
+  ElanSpiCapture *capture = g_new0 (ElanSpiCapture, 1);
+
+  /* hand the frame data over, it is stitched in a worker thread */
+  capture->frame_width = self->frame_width;
+  capture->frame_height = self->frame_height;
+  capture->frames = g_steal_pointer (&self->fp_frame_list);
+
+  /* submit image */
+  fpi_image_device_process_capture (FP_IMAGE_DEVICE (self),
+                                    elanspi_fp_frame_stitch,
+                                    capture,
+                                    (GDestroyNotify) elanspi_capture_free);
 }
 
 static gint64
@@ -30,6 +30,10 @@ G_DEFINE_TYPE (FpiDeviceSynaptics, fpi_device_synaptics, FP_TYPE_DEVICE)
 static void init_identify_msg (FpDevice *device);
 static void compose_and_send_identify_msg (FpDevice *device);
 
+/* Largest payload that fits into a single command transfer */
+#define MAX_ID_PAYLOAD_LEN \
+  MIN (G_MAXUINT8, MAX_TRANSFER_LEN - SENSOR_FW_CMD_HEADER_LEN - BMKT_MESSAGE_HEADER_LEN)
+
 static const FpIdEntry id_table[] = {
   { .vid = SYNAPTICS_VENDOR_ID,  .pid = 0x00BD,  },
   { .vid = SYNAPTICS_VENDOR_ID,  .pid = 0x00DF,  },
@@ -47,6 +51,35 @@ static const FpIdEntry id_table[] = {
   { .vid = 0,  .pid = 0,  .driver_data = 0 },   /* terminating entry */
 };
 
+/* Firmware known to accept several user IDs in one identify message, from
+ * the given build on. None has been confirmed with an identify capture
+ * yet, so for now all devices are sent one ID per message.
+ */
+static const struct
+{
+  guint8  version_major;
+  guint8  version_minor;
+  guint32 min_build_num;
+} packed_identify_fw[] = {
+  { .version_major = 0, .version_minor = 0, .min_build_num = 0 },   /* terminating entry */
+};
+
+static gboolean
+supports_packed_identify (const bmkt_sensor_version_t *version)
+{
+  gint i;
+
+  for (i = 0; packed_identify_fw[i].min_build_num; i++)
+    {
+      if (packed_identify_fw[i].version_major == version->version_major &&
+          packed_identify_fw[i].version_minor == version->version_minor &&
+          packed_identify_fw[i].min_build_num <= version->build_num)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
 
 static void
 cmd_receive_cb (FpiUsbTransfer *transfer,
@@ -696,7 +729,18 @@ identify_msg_cb (FpiDeviceSynaptics *self,
       }
 
     case BMKT_RSP_ID_FAIL:
-      if (resp->result == BMKT_SENSOR_STIMULUS_ERROR)
+      if (resp->result == BMKT_INVALID_PARAM && self->id_packed && !self->id_single)
+        {
+          /* Should not happen for known firmware, retry with one ID per
+           * message in case it does */
+          fp_info ("Device rejected packed user IDs, sending one per message");
+          self->id_single = TRUE;
+          self->action_starting = TRUE;
+          fpi_device_critical_enter (device);
+          init_identify_msg (device);
+          compose_and_send_identify_msg (device);
+        }
+      else if (resp->result == BMKT_SENSOR_STIMULUS_ERROR)
         {
           fp_info ("Match error occurred");
           fpi_device_identify_report (device, NULL, NULL,
@@ -786,22 +830,18 @@ init_identify_msg (FpDevice *device)
   FpiDeviceSynaptics *self = FPI_DEVICE_SYNAPTICS (device);
 
   self->id_idx = 0;
+  self->id_packed = FALSE;
 }
 
 static void
 compose_and_send_identify_msg (FpDevice *device)
 {
   FpiDeviceSynaptics *self = FPI_DEVICE_SYNAPTICS (device);
-  FpPrint *print = NULL;
   GPtrArray *prints = NULL;
-
-  g_autoptr(GVariant) data = NULL;
-  guint8 finger;
-  const guint8 *user_id;
-  gsize user_id_len = 0;
-  g_autofree guint8 *payload = NULL;
-  guint8 payload_len = 0;
-  guint8 payloadOffset = 0;
+  guint8 payload[MAX_ID_PAYLOAD_LEN];
+  gsize payloadOffset = 0;
+  gsize count_offset;
+  guint8 count = 0;
 
   fpi_device_get_identify_data (device, &prints);
   if (prints->len > UINT8_MAX)
@@ -818,57 +858,69 @@ compose_and_send_identify_msg (FpDevice *device)
                                                               "Unexpected index"));
       return;
     }
-  print = g_ptr_array_index (prints, self->id_idx);
-  g_object_get (print, "fpi-data", &data, NULL);
-  g_debug ("data is %p", data);
-  if (!parse_print_data (data, &finger, &user_id, &user_id_len))
-    {
-      fpi_device_identify_complete (device,
-                                    fpi_device_error_new (FP_DEVICE_ERROR_DATA_INVALID));
-      return;
-    }
+
+  /*
+   * Construct payload.
+   * The first message starts with the total number of IDs in list.
+   * Every message then has:
+   * 1 byte for the number of IDs in this message.
+   * 1 byte for each ID length, maximum id length is 100.
+   * user_id_len bytes of each ID
+   */
   if(self->id_idx == 0)
+    payload[payloadOffset++] = prints->len;
+  count_offset = payloadOffset++;
+
+  while (self->id_idx + count < prints->len)
     {
-      /*
-       * Construct payload.
-       * 1st byte is total number of IDs in list.
-       * 2nd byte is number of IDs in list.
-       * 1 byte for each ID length, maximum id length is 100.
-       * user_id_len bytes of each ID
-       */
-      payload_len = 2 + 1 + user_id_len;
-      payload = g_malloc0 (payload_len);
-      payload[payloadOffset] = prints->len;
-      payloadOffset += 1;
-      payload[payloadOffset] = 1; /* send one id per message */
-      payloadOffset += 1;
+      FpPrint *print = g_ptr_array_index (prints, self->id_idx + count);
+      g_autoptr(GVariant) data = NULL;
+      guint8 finger;
+      const guint8 *user_id;
+      gsize user_id_len = 0;
+
+      g_object_get (print, "fpi-data", &data, NULL);
+      g_debug ("data is %p", data);
+      if (!parse_print_data (data, &finger, &user_id, &user_id_len))
+        {
+          fpi_device_identify_complete (device,
+                                        fpi_device_error_new (FP_DEVICE_ERROR_DATA_INVALID));
+          return;
+        }
+
+      /* Pack as many IDs as fit, unless the firmware rejected that before */
+      if (count > 0 &&
+          (self->id_single || payloadOffset + 1 + user_id_len > sizeof (payload)))
+        break;
+
       payload[payloadOffset] = user_id_len;
       payloadOffset += 1;
       memcpy (&payload[payloadOffset], user_id, user_id_len);
       payloadOffset += user_id_len;
+      count++;
+    }
+  payload[count_offset] = count;
+  if (count > 1)
+    self->id_packed = TRUE;
 
+  fp_dbg ("sending %u of %u IDs starting at %u",
+          count, prints->len, self->id_idx);
+
+  if(self->id_idx == 0)
+    {
       G_DEBUG_HERE ();
 
-      synaptics_sensor_cmd (self, 0, BMKT_CMD_ID_USER_IN_ORDER, payload, payloadOffset, identify_msg_cb);
+      /* The command is restarted from the callback if the firmware
+       * rejected packed IDs, in that case the SSM is still running. */
+      synaptics_sensor_cmd (self, 0, BMKT_CMD_ID_USER_IN_ORDER,
+                            payload, payloadOffset,
+                            self->cmd_ssm ? NULL : identify_msg_cb);
     }
   else
     {
-      /*
-       * 1st byte is the number of IDs
-       * 1 byte for each ID length
-       * id_length bytes for each ID
-       */
-      payload_len = 1 + 1 + user_id_len;
-      payload = g_malloc0 (payload_len);
-      payload[payloadOffset] = 1; /* send one id per message */
-      payloadOffset += 1;
-      payload[payloadOffset] = user_id_len;
-      payloadOffset += 1;
-      memcpy (&payload[payloadOffset], user_id, user_id_len);
-      payloadOffset += user_id_len;
       synaptics_sensor_cmd (self, self->cmd_seq_num, BMKT_CMD_ID_NEXT_USER, payload, payloadOffset, NULL);
     }
-  self->id_idx++;
+  self->id_idx += count;
 }
 static void
 enroll_msg_cb (FpiDeviceSynaptics *self,
@@ -1309,6 +1361,8 @@ dev_probe (FpDevice *device)
   fp_dbg ("Target: %d", self->mis_version.target);
   fp_dbg ("Product: %d", self->mis_version.product);
 
+  self->id_single = !supports_packed_identify (&self->mis_version);
+
   synaptics_sensor_cmd (self, 0, BMKT_CMD_FPS_INIT, NULL, 0, prob_msg_cb);
 
   return;
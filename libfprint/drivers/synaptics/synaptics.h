@@ -114,6 +114,8 @@ struct _FpiDeviceSynaptics
   gboolean              cmd_complete_on_removal;
   gboolean              cmd_suspended;
   guint8                id_idx;
+  gboolean              id_packed;
+  gboolean              id_single;
 
   bmkt_sensor_version_t mis_version;
 
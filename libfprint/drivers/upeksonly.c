@@ -74,9 +74,7 @@ struct _FpiDeviceUpeksonly
   FpiSsm       *loopsm;
 
   /* Do we really need multiple concurrent transfers? */
-  GCancellable                    *img_cancellable;
-  GPtrArray                       *img_transfers;
-  int                              num_flying;
+  FpiUsbStream                    *img_stream;
 
   GSList                          *rows;
   unsigned                         num_rows;
@@ -154,14 +152,14 @@ upeksonly_get_pixel (struct fpi_line_asmbl_ctx *ctx,
 static void
 free_img_transfers (FpiDeviceUpeksonly *sdev)
 {
-  g_cancellable_cancel (sdev->img_cancellable);
-  g_clear_object (&sdev->img_cancellable);
-  g_clear_pointer (&sdev->img_transfers, g_ptr_array_unref);
+  g_clear_pointer (&sdev->img_stream, fpi_usb_stream_free);
 }
 
 static void
-last_transfer_killed (FpImageDevice *dev)
+last_transfer_killed (FpiUsbStream *stream, FpDevice *device,
+                      gpointer user_data)
 {
+  FpImageDevice *dev = FP_IMAGE_DEVICE (device);
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
 
   switch (self->killing_transfers)
@@ -187,10 +185,7 @@ cancel_img_transfers (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
 
-  g_cancellable_cancel (self->img_cancellable);
-
-  if (self->num_flying == 0)
-    last_transfer_killed (dev);
+  fpi_usb_stream_stop (self->img_stream);
 }
 
 static gboolean
@@ -241,9 +236,9 @@ row_complete (FpImageDevice *dev)
       unsigned char *lastrow = self->rows->data;
       int std_sq_dev, mean_sq_diff;
 
-      std_sq_dev = fpi_std_sq_dev (self->rowbuf, self->img_width);
-      mean_sq_diff = fpi_mean_sq_diff_norm (lastrow, self->rowbuf,
-                                            self->img_width);
+      fpi_line_classify (self->rowbuf, lastrow, self->img_width,
+                         BLANK_THRESHOLD, DIFF_THRESHOLD,
+                         &std_sq_dev, &mean_sq_diff);
 
       switch (self->finger_state)
         {
@@ -498,29 +493,17 @@ handle_packet (FpImageDevice *dev, unsigned char *data)
 }
 
 static void
-img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
-             gpointer user_data, GError *error)
+img_data_cb (FpiUsbStream *stream, FpiUsbTransfer *transfer,
+             FpDevice *device, gpointer user_data, GError *error)
 {
   FpImageDevice *dev = FP_IMAGE_DEVICE (device);
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   int i;
 
-  self->num_flying--;
-
-  if (self->killing_transfers)
-    {
-      if (self->num_flying == 0)
-        last_transfer_killed (dev);
-
-      /* don't care about error or success if we're terminating */
-      g_clear_error (&error);
-      return;
-    }
-
   /* NOTE: The old code assume 4096 bytes are received each time
    * but there is no reason we need to enforce that. However, we
    * always need full lines. */
-  if (transfer->actual_length % 64 != 0)
+  if (!error && transfer->actual_length % 64 != 0)
     error = fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
                                       "Data packets need to be multiple of 64 bytes, got %zi bytes",
                                       transfer->actual_length);
@@ -551,16 +534,6 @@ img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
         return;
       handle_packet (dev, transfer->buffer + i);
     }
-
-  if (is_capturing (self))
-    {
-      fpi_usb_transfer_submit (fpi_usb_transfer_ref (transfer),
-                               0,
-                               self->img_cancellable,
-                               img_data_cb,
-                               user_data);
-      self->num_flying++;
-    }
 }
 
 /***** STATE MACHINE HELPERS *****/
@@ -892,21 +865,11 @@ capsm_fire_bulk (FpiSsm   *ssm,
                  FpDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
-  int i;
 
   g_assert (self->capturing == FALSE);
 
-  g_clear_object (&self->img_cancellable);
-  self->img_cancellable = g_cancellable_new ();
-  for (i = 0; i < self->img_transfers->len; i++)
-    {
-      fpi_usb_transfer_submit (fpi_usb_transfer_ref (g_ptr_array_index (self->img_transfers, i)),
-                               0,
-                               self->img_cancellable,
-                               img_data_cb,
-                               NULL);
-      self->num_flying++;
-    }
+  fpi_usb_stream_start (self->img_stream, 0,
+                        img_data_cb, last_transfer_killed, NULL);
   self->capturing = TRUE;
   fpi_ssm_next_state (ssm);
 }
@@ -1392,26 +1355,15 @@ dev_activate (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   FpiSsm *ssm = NULL;
-  int i;
 
   self->deactivating = FALSE;
   self->capturing = FALSE;
 
-  self->num_flying = 0;
-  self->img_transfers = g_ptr_array_new_with_free_func ((GFreeFunc) fpi_usb_transfer_unref);
-
   /* This might seem odd, but we do need multiple in-flight URBs so that
    * we never stop polling the device for more data.
    */
-  for (i = 0; i < NUM_BULK_TRANSFERS; i++)
-    {
-      FpiUsbTransfer *transfer;
-
-      transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
-      fpi_usb_transfer_fill_bulk (transfer, 0x81, 4096);
-
-      g_ptr_array_add (self->img_transfers, transfer);
-    }
+  self->img_stream = fpi_usb_stream_new (FP_DEVICE (dev), 0x81, 4096,
+                                         NUM_BULK_TRANSFERS);
 
   switch (self->dev_model)
     {
@@ -24,6 +24,7 @@
 #include <pk11pub.h>
 
 #include "drivers_api.h"
+#include "uru4000_decode.h"
 
 #define EP_INTR (1 | FPI_USB_ENDPOINT_IN)
 #define EP_DATA (2 | FPI_USB_ENDPOINT_IN)
@@ -564,49 +565,6 @@ enum {
   BLOCKF_NOT_PRESENT      = 0x01,
 };
 
-static uint32_t
-update_key (uint32_t key)
-{
-  /* linear feedback shift register
-   * taps at bit positions 1 3 4 7 11 13 20 23 26 29 32 */
-  uint32_t bit = key & 0x9248144d;
-
-  bit ^= bit << 16;
-  bit ^= bit << 8;
-  bit ^= bit << 4;
-  bit ^= bit << 2;
-  bit ^= bit << 1;
-  return (bit & 0x80000000) | (key >> 1);
-}
-
-static uint32_t
-do_decode (uint8_t *data, int num_bytes, uint32_t key)
-{
-  uint8_t xorbyte;
-  int i;
-
-  for (i = 0; i < num_bytes - 1; i++)
-    {
-      /* calculate xor byte and update key */
-      xorbyte  = ((key >>  4) & 1) << 0;
-      xorbyte |= ((key >>  8) & 1) << 1;
-      xorbyte |= ((key >> 11) & 1) << 2;
-      xorbyte |= ((key >> 14) & 1) << 3;
-      xorbyte |= ((key >> 18) & 1) << 4;
-      xorbyte |= ((key >> 21) & 1) << 5;
-      xorbyte |= ((key >> 24) & 1) << 6;
-      xorbyte |= ((key >> 29) & 1) << 7;
-      key = update_key (key);
-
-      /* decrypt data */
-      data[i] = data[i + 1] ^ xorbyte;
-    }
-
-  /* the final byte is implicitly zero */
-  data[i] = 0;
-  return update_key (key);
-}
-
 static int
 calc_dev2 (struct uru4k_image *img)
 {
@@ -732,14 +690,14 @@ imaging_run_state (FpiSsm *ssm, FpDevice *_dev)
             {
             case BLOCKF_ENCRYPTED:
               fp_dbg ("decoding %d lines", num_lines);
-              key = do_decode (&img->data[self->img_lines_done][0],
-                               IMAGE_WIDTH * num_lines, key);
+              key = uru4000_decode (&img->data[self->img_lines_done][0],
+                                    IMAGE_WIDTH * num_lines, key);
               break;
 
             case 0:
               fp_dbg ("skipping %d lines", num_lines);
               for (r = 0; r < IMAGE_WIDTH * num_lines; r++)
-                key = update_key (key);
+                key = uru4000_update_key (key);
               break;
             }
           if ((flags & BLOCKF_NOT_PRESENT) == 0)
@@ -766,7 +724,7 @@ imaging_run_state (FpiSsm *ssm, FpDevice *_dev)
           to += num_lines * IMAGE_WIDTH;
         }
 
-      fpimg->flags = FPI_IMAGE_COLORS_INVERTED;
+      fpimg->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_PARALLEL_DETECTION;
       /* NOTE: For some reason all but U4000B (or rather U4500?) flipped the
        * image, we retain this behaviour here, but it is not clear whether it
        * is correct.
@@ -1456,6 +1414,8 @@ fpi_device_uru4000_class_init (FpiDeviceUru4000Class *klass)
   FpDeviceClass *dev_class = FP_DEVICE_CLASS (klass);
   FpImageDeviceClass *img_class = FP_IMAGE_DEVICE_CLASS (klass);
 
+  uru4000_decode_init ();
+
   dev_class->id = "uru4000";
   dev_class->full_name = "Digital Persona U.are.U 4000/4000B/4500";
   dev_class->type = FP_DEVICE_TYPE_USB;
@@ -0,0 +1,142 @@
+/*
+ * Digital Persona U.are.U 4000/4000B/4500 image decryption
+ * Copyright (C) 2007-2008 Daniel Drake <dsd@gentoo.org>
+ * Copyright (C) 2012 Timo Teräs <timo.teras@iki.fi>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "uru4000_decode.h"
+
+uint32_t
+uru4000_update_key (uint32_t key)
+{
+  /* linear feedback shift register
+   * taps at bit positions 1 3 4 7 11 13 20 23 26 29 32 */
+  uint32_t bit = key & 0x9248144d;
+
+  bit ^= bit << 16;
+  bit ^= bit << 8;
+  bit ^= bit << 4;
+  bit ^= bit << 2;
+  bit ^= bit << 1;
+  return (bit & 0x80000000) | (key >> 1);
+}
+
+static uint8_t
+key_xorbyte (uint32_t key)
+{
+  uint8_t xorbyte;
+
+  xorbyte  = ((key >>  4) & 1) << 0;
+  xorbyte |= ((key >>  8) & 1) << 1;
+  xorbyte |= ((key >> 11) & 1) << 2;
+  xorbyte |= ((key >> 14) & 1) << 3;
+  xorbyte |= ((key >> 18) & 1) << 4;
+  xorbyte |= ((key >> 21) & 1) << 5;
+  xorbyte |= ((key >> 24) & 1) << 6;
+  xorbyte |= ((key >> 29) & 1) << 7;
+
+  return xorbyte;
+}
+
+/* Both the key update and the xor bytes are linear in the key bits, so the
+ * state after 8 updates and the 8 xor bytes generated on the way can be
+ * computed by combining the contributions of each key byte. */
+#define DECODE_STEP 8
+
+static struct
+{
+  uint64_t xorbytes[4][256];
+  uint32_t key[4][256];
+} decode_tables;
+
+void
+uru4000_decode_init (void)
+{
+  int i, b, n;
+
+  for (i = 0; i < 4; i++)
+    {
+      for (b = 0; b < 256; b++)
+        {
+          uint32_t key = (uint32_t) b << (8 * i);
+          uint64_t xorbytes = 0;
+
+          for (n = 0; n < DECODE_STEP; n++)
+            {
+              xorbytes |= (uint64_t) key_xorbyte (key) << (8 * n);
+              key = uru4000_update_key (key);
+            }
+
+          decode_tables.xorbytes[i][b] = xorbytes;
+          decode_tables.key[i][b] = key;
+        }
+    }
+}
+
+uint32_t
+uru4000_decode_bitwise (uint8_t *data, int num_bytes, uint32_t key)
+{
+  int i;
+
+  for (i = 0; i < num_bytes - 1; i++)
+    {
+      /* calculate xor byte and update key */
+      uint8_t xorbyte = key_xorbyte (key);
+
+      key = uru4000_update_key (key);
+
+      /* decrypt data */
+      data[i] = data[i + 1] ^ xorbyte;
+    }
+
+  /* the final byte is implicitly zero */
+  data[i] = 0;
+  return uru4000_update_key (key);
+}
+
+/* Needs uru4000_decode_init() to have been called */
+uint32_t
+uru4000_decode (uint8_t *data, int num_bytes, uint32_t key)
+{
+  int i;
+
+  for (i = 0; i + DECODE_STEP < num_bytes; i += DECODE_STEP)
+    {
+      uint64_t xorbytes;
+      uint64_t word;
+
+      xorbytes = decode_tables.xorbytes[0][key & 0xff] ^
+                 decode_tables.xorbytes[1][(key >> 8) & 0xff] ^
+                 decode_tables.xorbytes[2][(key >> 16) & 0xff] ^
+                 decode_tables.xorbytes[3][key >> 24];
+      key = decode_tables.key[0][key & 0xff] ^
+            decode_tables.key[1][(key >> 8) & 0xff] ^
+            decode_tables.key[2][(key >> 16) & 0xff] ^
+            decode_tables.key[3][key >> 24];
+
+      /* decrypt data, the input is shifted by one byte */
+      memcpy (&word, &data[i + 1], sizeof (word));
+      word = GUINT64_TO_LE (GUINT64_FROM_LE (word) ^ xorbytes);
+      memcpy (&data[i], &word, sizeof (word));
+    }
+
+  /* the remaining bytes, including the final one */
+  return uru4000_decode_bitwise (&data[i], num_bytes - i, key);
+}
@@ -28,13 +28,50 @@ G_DEFINE_TYPE (FpDeviceVfs301, fpi_device_vfs301, FP_TYPE_IMAGE_DEVICE)
 
 /************************** GENERIC STUFF *************************************/
 
+typedef struct
+{
+  unsigned char *scanlines;
+  int            scanline_count;
+} Vfs301Capture;
+
+static void
+vfs301_capture_free (Vfs301Capture *capture)
+{
+  g_free (capture->scanlines);
+  g_free (capture);
+}
+
+static FpImage *
+process_capture (gpointer data, GCancellable *cancellable, GError **error)
+{
+  Vfs301Capture *capture = data;
+  int height;
+  FpImage *img;
+
+  img = fp_image_new (VFS301_FP_OUTPUT_WIDTH, capture->scanline_count);
+
+  vfs301_extract_image (capture->scanlines, capture->scanline_count,
+                        img->data, &height);
+
+  /* TODO: how to detect flip? should the resulting image be
+   * oriented so that it is equal e.g. to a fingerprint on a paper,
+   * or to the finger when I look at it?) */
+  img->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED;
+
+  /* The image buffer is larger at this point, but that does not
+   * matter. */
+  img->width = VFS301_FP_OUTPUT_WIDTH;
+  img->height = height;
+
+  return img;
+}
+
 static int
 submit_image (FpiSsm        *ssm,
               FpImageDevice *dev)
 {
   FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (dev);
-  int height;
-  FpImage *img;
+  Vfs301Capture *capture;
 
 #if 0
   /* XXX: This is probably handled by libfprint automagically? */
@@ -45,23 +82,16 @@ submit_image (FpiSsm        *ssm,
     }
 #endif
 
-  img = fp_image_new (VFS301_FP_OUTPUT_WIDTH, self->scanline_count);
-  if (img == NULL)
-    return 0;
-
-  vfs301_extract_image (self, img->data, &height);
+  /* Hand over the scanlines, the next scan uses a new buffer */
+  capture = g_new0 (Vfs301Capture, 1);
+  capture->scanlines = g_steal_pointer (&self->scanline_buf);
+  capture->scanline_count = self->scanline_count;
 
-  /* TODO: how to detect flip? should the resulting image be
-   * oriented so that it is equal e.g. to a fingerprint on a paper,
-   * or to the finger when I look at it?) */
-  img->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED;
-
-  /* The image buffer is larger at this point, but that does not
-   * matter. */
-  img->width = VFS301_FP_OUTPUT_WIDTH;
-  img->height = height;
+  self->scanline_buf = g_malloc (self->scanline_alloc * VFS301_FP_OUTPUT_WIDTH);
+  self->scanline_count = 0;
 
-  fpi_image_device_image_captured (dev, img);
+  fpi_image_device_process_capture (dev, process_capture, capture,
+                                    (GDestroyNotify) vfs301_capture_free);
 
   return 1;
 }
@@ -72,9 +102,8 @@ enum {
   M_REQUEST_PRINT,
   M_WAIT_PRINT,
   M_CHECK_PRINT,
-  M_READ_PRINT_START,
-  M_READ_PRINT_WAIT,
-  M_READ_PRINT_POLL,
+  M_CHECK_EVENT,
+  M_READ_PRINT,
   M_SUBMIT_PRINT,
 
   /* Number of states */
@@ -88,11 +117,16 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
   FpImageDevice *dev = FP_IMAGE_DEVICE (_dev);
   FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (_dev);
 
+  if (self->deactivating)
+    {
+      fpi_ssm_mark_completed (ssm);
+      return;
+    }
+
   switch (fpi_ssm_get_cur_state (ssm))
     {
     case M_REQUEST_PRINT:
-      vfs301_proto_request_fingerprint (self);
-      fpi_ssm_next_state (ssm);
+      vfs301_proto_request_fingerprint (self, ssm);
       break;
 
     case M_WAIT_PRINT:
@@ -101,32 +135,19 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
       break;
 
     case M_CHECK_PRINT:
-      if (!vfs301_proto_peek_event (self))
+      vfs301_proto_peek_event (self, ssm);
+      break;
+
+    case M_CHECK_EVENT:
+      if (!self->got_event)
         fpi_ssm_jump_to_state (ssm, M_WAIT_PRINT);
       else
         fpi_ssm_next_state (ssm);
       break;
 
-    case M_READ_PRINT_START:
+    case M_READ_PRINT:
       fpi_image_device_report_finger_status (dev, TRUE);
-      vfs301_proto_process_event_start (self);
-      fpi_ssm_next_state (ssm);
-      break;
-
-    case M_READ_PRINT_WAIT:
-      /* Wait fingerprint scanning */
-      fpi_ssm_next_state_delayed (ssm, 200);
-      break;
-
-    case M_READ_PRINT_POLL:
-      {
-        int rv = vfs301_proto_process_event_poll (self);
-        g_assert (rv != VFS301_FAILURE);
-        if (rv == VFS301_ONGOING)
-          fpi_ssm_jump_to_state (ssm, M_READ_PRINT_WAIT);
-        else
-          fpi_ssm_next_state (ssm);
-      }
+      vfs301_proto_capture (self, ssm);
       break;
 
     case M_SUBMIT_PRINT:
@@ -147,6 +168,27 @@ m_loop_state (FpiSsm *ssm, FpDevice *_dev)
     }
 }
 
+/* Complete loop sequential state machine */
+static void
+m_loop_complete (FpiSsm *ssm, FpDevice *_dev, GError *error)
+{
+  FpImageDevice *dev = FP_IMAGE_DEVICE (_dev);
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (_dev);
+
+  self->loop_running = FALSE;
+
+  if (self->deactivating)
+    {
+      self->deactivating = FALSE;
+      vfs301_proto_deinit (self);
+      fpi_image_device_deactivate_complete (dev, error);
+    }
+  else if (error)
+    {
+      fpi_image_device_session_error (dev, error);
+    }
+}
+
 /* Exec init sequential state machine */
 static void
 m_init_state (FpiSsm *ssm, FpDevice *_dev)
@@ -155,9 +197,7 @@ m_init_state (FpiSsm *ssm, FpDevice *_dev)
 
   g_assert (fpi_ssm_get_cur_state (ssm) == 0);
 
-  vfs301_proto_init (self);
-
-  fpi_ssm_mark_completed (ssm);
+  vfs301_proto_init (self, ssm);
 }
 
 /* Complete init sequential state machine */
@@ -171,8 +211,11 @@ m_init_complete (FpiSsm *ssm, FpDevice *dev, GError *error)
 static void
 dev_activate (FpImageDevice *dev)
 {
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (dev);
   FpiSsm *ssm;
 
+  self->deactivating = FALSE;
+
   /* Start init ssm */
   ssm = fpi_ssm_new (FP_DEVICE (dev), m_init_state, 1);
   fpi_ssm_start (ssm, m_init_complete);
@@ -185,6 +228,14 @@ dev_deactivate (FpImageDevice *dev)
   FpDeviceVfs301 *self;
 
   self = FPI_DEVICE_VFS301 (dev);
+
+  /* The loop completion will finish the deactivation */
+  if (self->loop_running)
+    {
+      self->deactivating = TRUE;
+      return;
+    }
+
   vfs301_proto_deinit (self);
   fpi_image_device_deactivate_complete (dev, NULL);
 }
@@ -192,6 +243,7 @@ dev_deactivate (FpImageDevice *dev)
 static void
 dev_change_state (FpImageDevice *dev, FpiImageDeviceState state)
 {
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (dev);
   FpiSsm *ssm_loop;
 
   if (state != FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_ON)
@@ -199,7 +251,8 @@ dev_change_state (FpImageDevice *dev, FpiImageDeviceState state)
 
   /* Start a capture operation. */
   ssm_loop = fpi_ssm_new (FP_DEVICE (dev), m_loop_state, M_LOOP_NUM_STATES);
-  fpi_ssm_start (ssm_loop, NULL);
+  self->loop_running = TRUE;
+  fpi_ssm_start (ssm_loop, m_loop_complete);
 }
 
 static void
@@ -211,8 +264,19 @@ dev_open (FpImageDevice *dev)
   /* Claim usb interface */
   g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error);
 
-  /* Initialize private structure */
+  /* Initialize private structure, the buffer is large enough for most
+   * swipes and is grown when needed. */
   self->scanline_count = 0;
+  self->scanline_alloc = 4 * VFS301_FP_RECV_LEN_2 / VFS301_FP_FRAME_SIZE;
+  self->scanline_buf = g_malloc (self->scanline_alloc * VFS301_FP_OUTPUT_WIDTH);
+
+  /* The recording in tests/vfs301 was made with one scan read at a time,
+   * extra reads in flight would not be replayed. */
+  self->scan_stream = fpi_usb_stream_new (FP_DEVICE (dev),
+                                          VFS301_RECEIVE_ENDPOINT_DATA,
+                                          VFS301_FP_RECV_LEN_2,
+                                          g_strcmp0 (g_getenv ("FP_DEVICE_EMULATION"), "1") == 0 ?
+                                          1 : VFS301_FP_RECV_TRANSFERS);
 
   /* Notify open complete */
   fpi_image_device_open_complete (dev, error);
@@ -226,6 +290,9 @@ dev_close (FpImageDevice *dev)
 
   /* Release private structure */
   g_clear_pointer (&self->scanline_buf, g_free);
+  self->scanline_alloc = 0;
+  g_clear_pointer (&self->scan_stream, fpi_usb_stream_free);
+  g_clear_error (&self->scan_error);
 
   /* Release usb interface */
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
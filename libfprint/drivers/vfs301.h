@@ -23,6 +23,7 @@
 
 #include "fpi-usb-transfer.h"
 #include "fpi-image-device.h"
+#include "fpi-ssm.h"
 
 enum {
   VFS301_DEFAULT_WAIT_TIMEOUT = 300,
@@ -35,6 +36,9 @@ enum {
 #define VFS301_FP_RECV_LEN_1 (84032)
 #define VFS301_FP_RECV_LEN_2 (84096)
 
+/* Number of scan data transfers kept in flight */
+#define VFS301_FP_RECV_TRANSFERS 3
+
 struct _FpDeviceVfs301
 {
   FpImageDevice parent;
@@ -42,13 +46,20 @@ struct _FpDeviceVfs301
   /* buffer to hold raw scanlines */
   unsigned char *scanline_buf;
   int            scanline_count;
+  int            scanline_alloc;
+
+  /* Reads the scan data after the first transfer of a scan */
+  FpiUsbStream  *scan_stream;
+  GError        *scan_error;
+
+  /* State of a receive from two endpoints, see usb_recv_parallel_cb() */
+  int           recv_parallel_stage;
+  gboolean      recv_parallel_retry;
+
+  gboolean      got_event;
 
-  enum {
-    VFS301_ONGOING = 0,
-    VFS301_ENDED = 1,
-    VFS301_FAILURE = -1
-  } recv_progress;
-  int recv_exp_amt;
+  gboolean      loop_running;
+  gboolean      deactivating;
 };
 
 G_DECLARE_FINAL_TYPE (FpDeviceVfs301, fpi_device_vfs301, FPI, DEVICE_VFS301, FpImageDevice)
@@ -127,16 +138,21 @@ typedef struct
   unsigned char sum3[3];
 } vfs301_line_t;
 
-void vfs301_proto_init (FpDeviceVfs301 *dev);
+void vfs301_proto_init (FpDeviceVfs301 *dev,
+                        FpiSsm         *ssm);
 void vfs301_proto_deinit (FpDeviceVfs301 *dev);
 
-void vfs301_proto_request_fingerprint (FpDeviceVfs301 *dev);
+void vfs301_proto_request_fingerprint (FpDeviceVfs301 *dev,
+                                       FpiSsm         *ssm);
 
-/** returns 0 if no event is ready, or 1 if there is one... */
-int vfs301_proto_peek_event (FpDeviceVfs301 *dev);
-void vfs301_proto_process_event_start (FpDeviceVfs301 *dev);
-int vfs301_proto_process_event_poll (FpDeviceVfs301 *dev);
+/** sets got_event if there is an event ready */
+void vfs301_proto_peek_event (FpDeviceVfs301 *dev,
+                              FpiSsm         *ssm);
+/** receives the scanlines, then finishes the scan */
+void vfs301_proto_capture (FpDeviceVfs301 *dev,
+                           FpiSsm         *ssm);
 
-void vfs301_extract_image (FpDeviceVfs301 *vfs,
-                           unsigned char  *output,
-                           int            *output_height);
+void vfs301_extract_image (const unsigned char *scanlines,
+                           int                  scanline_count,
+                           unsigned char       *output,
+                           int                 *output_height);
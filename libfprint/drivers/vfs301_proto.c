@@ -21,7 +21,6 @@
 
 /*
  * TODO:
- * - async communication everywhere :)
  * - protocol decyphering
  *   - what is needed and what is redundant
  *   - is some part of the initial data the firmware?
@@ -64,61 +63,69 @@ usb_print_packet (int dir, GError *error, const guint8 *data, int length)
 #endif
 
 static void
-usb_recv (FpDeviceVfs301 *dev, guint8 endpoint, int max_bytes, FpiUsbTransfer **out, GError **error)
+usb_send_cb (FpiUsbTransfer *transfer, FpDevice *device,
+             gpointer user_data, GError *error)
 {
-  GError *err = NULL;
-
-  g_autoptr(FpiUsbTransfer) transfer = NULL;
+#ifdef DEBUG
+  usb_print_packet (1, error, transfer->buffer, transfer->length);
+#endif
 
-  /* XXX: This function swallows any transfer errors, that is obviously
+  /* XXX: Send errors have always been ignored, that is obviously
    *      quite bad (it used to assert on no-error)! */
+  if (error)
+    {
+      g_warning ("Error while sending data, continuing anyway: %s", error->message);
+      g_error_free (error);
+    }
+
+  fpi_ssm_next_state (transfer->ssm);
+}
+
+static void
+usb_send (FpDeviceVfs301 *dev, FpiSsm *ssm, guint8 *data, gssize length, GDestroyNotify free_func)
+{
+  FpiUsbTransfer *transfer;
 
   transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
+  transfer->ssm = ssm;
   transfer->short_is_error = TRUE;
-  fpi_usb_transfer_fill_bulk (transfer, endpoint, max_bytes);
+  fpi_usb_transfer_fill_bulk_full (transfer, VFS301_SEND_ENDPOINT, data, length, free_func);
 
-  fpi_usb_transfer_submit_sync (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, &err);
+  fpi_usb_transfer_submit (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, NULL, usb_send_cb, NULL);
+}
 
+static void
+usb_recv_cb (FpiUsbTransfer *transfer, FpDevice *device,
+             gpointer user_data, GError *error)
+{
 #ifdef DEBUG
-  usb_print_packet (0, err, transfer->buffer, transfer->actual_length);
+  usb_print_packet (0, error, transfer->buffer, transfer->actual_length);
 #endif
-  if (err)
+
+  /* XXX: Receive errors have always been swallowed, that is obviously
+   *      quite bad (it used to assert on no-error)! */
+  if (error)
     {
-      if (!error)
-        g_warning ("Unhandled receive error: %s", err->message);
-      g_propagate_error (error, err);
+      g_warning ("Unhandled receive error: %s", error->message);
+      g_error_free (error);
     }
 
-  if (out)
-    *out = g_steal_pointer (&transfer);
+  fpi_ssm_next_state (transfer->ssm);
 }
 
-FP_GNUC_ACCESS (read_only, 2, 3)
 static void
-usb_send (FpDeviceVfs301 *dev, const guint8 *data, gssize length, GError **error)
+usb_recv (FpDeviceVfs301 *dev, FpiSsm *ssm, guint8 endpoint, int max_bytes,
+          FpiUsbTransferCallback callback, gpointer user_data)
 {
-  GError *err = NULL;
-
-  g_autoptr(FpiUsbTransfer) transfer = NULL;
-
-  /* XXX: This function swallows any transfer errors, that is obviously
-   *      quite bad (it used to assert on no-error)! */
+  FpiUsbTransfer *transfer;
 
   transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
+  transfer->ssm = ssm;
   transfer->short_is_error = TRUE;
-  fpi_usb_transfer_fill_bulk_full (transfer, VFS301_SEND_ENDPOINT, (guint8 *) data, length, g_free);
-
-  fpi_usb_transfer_submit_sync (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, &err);
-
-#ifdef DEBUG
-  usb_print_packet (1, err, data, length);
-#endif
+  fpi_usb_transfer_fill_bulk (transfer, endpoint, max_bytes);
 
-  if (err)
-    {
-      g_warning ("Error while sending data, continuing anyway: %s", err->message);
-      g_propagate_error (error, err);
-    }
+  fpi_usb_transfer_submit (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, NULL,
+                           callback, user_data);
 }
 
 /************************** OUT MESSAGES GENERATION ***************************/
@@ -337,14 +344,13 @@ scanline_diff (const guint8 *scanlines, int prev, int cur)
 
 /** Transform the input data to a normalized fingerprint scan */
 void
-vfs301_extract_image (FpDeviceVfs301 *vfs, guint8 *output, int *output_height
-                     )
+vfs301_extract_image (const guint8 *scanlines, int scanline_count,
+                      guint8 *output, int *output_height)
 {
-  const guint8 *scanlines = vfs->scanline_buf;
   int last_line;
   int i;
 
-  g_assert (vfs->scanline_count >= 1);
+  g_assert (scanline_count >= 1);
 
   *output_height = 1;
   memcpy (output, scanlines, VFS301_FP_OUTPUT_WIDTH);
@@ -356,7 +362,7 @@ vfs301_extract_image (FpDeviceVfs301 *vfs, guint8 *output, int *output_height
    * of bi/tri-linear resampling to get the output (so that we don't get so
    * many false edges etc.).
    */
-  for (i = 1; i < vfs->scanline_count; i++)
+  for (i = 1; i < scanline_count; i++)
     {
       if (scanline_diff (scanlines, last_line, i))
         {
@@ -396,7 +402,12 @@ img_process_data (int first_block, FpDeviceVfs301 *dev, const guint8 *buf, int l
       dev->scanline_count += no_lines;
     }
 
-  dev->scanline_buf = g_realloc (dev->scanline_buf, dev->scanline_count * VFS301_FP_OUTPUT_WIDTH);
+  /* Grow geometrically, usually the preallocated buffer is sufficient */
+  if (dev->scanline_count > dev->scanline_alloc)
+    {
+      dev->scanline_alloc = MAX (dev->scanline_alloc * 2, dev->scanline_count);
+      dev->scanline_buf = g_realloc (dev->scanline_buf, dev->scanline_alloc * VFS301_FP_OUTPUT_WIDTH);
+    }
 
   for (cur_line = dev->scanline_buf + last_img_height * VFS301_FP_OUTPUT_WIDTH, i = 0;
        i < no_lines;
@@ -421,18 +432,93 @@ img_process_data (int first_block, FpDeviceVfs301 *dev, const guint8 *buf, int l
 
 /************************** PROTOCOL STUFF ************************************/
 
+typedef enum {
+  VFS301_SEND,
+  VFS301_SEND_RAW,
+  VFS301_RECV,
+  /* Receive from two endpoints at the same time */
+  VFS301_RECV_PARALLEL,
+  /* Receive the event state, see vfs301_proto_peek_event() */
+  VFS301_RECV_EVENT,
+  /* Receive the scanlines until the sensor stops sending */
+  VFS301_RECV_SCAN,
+} vfs301_action_t;
+
+typedef struct
+{
+  vfs301_action_t      action;
+
+  /* VFS301_SEND */
+  int                  type;
+  int                  subtype;
+
+  /* VFS301_SEND_RAW */
+  const unsigned char *data;
+  gsize                len;
+
+  /* VFS301_RECV and VFS301_RECV_PARALLEL */
+  guint8               endpoint;
+  int                  max_bytes;
+  guint8               endpoint2;
+  int                  max_bytes2;
+} vfs301_step_t;
+
 #define USB_RECV(from, len) \
-  usb_recv (dev, from, len, NULL, NULL)
+  { .action = VFS301_RECV, .endpoint = from, .max_bytes = len }
+
+#define USB_SEND(t, s) \
+  { .action = VFS301_SEND, .type = t, .subtype = s }
+
+#define USB_SEND_RAW(x) \
+  { .action = VFS301_SEND_RAW, .data = x, .len = sizeof (x) }
 
-#define USB_SEND(type, subtype) \
-  { \
-    const guint8 *data; \
-    gssize len; \
-    data = vfs301_proto_generate (type, subtype, &len); \
-    usb_send (dev, data, len, NULL); \
-  }
+/* The data may come in random order, or not at all for some messages, see
+ * usb_recv_parallel_cb(). */
+#define PARALLEL_RECEIVE(e1, l1, e2, l2) \
+  { .action = VFS301_RECV_PARALLEL, .endpoint = e1, .max_bytes = l1, .endpoint2 = e2, .max_bytes2 = l2 }
+
+/* Receives from the first endpoint, then from the second one, and once more
+ * from the first one if it timed out. Submitting both at the same time
+ * would be quicker, but the recording in tests/vfs301 has them in this
+ * order and would no longer replay. */
+static void
+usb_recv_parallel_cb (FpiUsbTransfer *transfer, FpDevice *device,
+                      gpointer user_data, GError *error)
+{
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
+  const vfs301_step_t *step = user_data;
 
-#define RAW_DATA(x) g_memdup (x, sizeof (x)), sizeof (x)
+#ifdef DEBUG
+  usb_print_packet (0, error, transfer->buffer, transfer->actual_length);
+#endif
+
+  if (self->recv_parallel_stage == 0)
+    {
+      /* The first try may time out if the data comes on the other endpoint */
+      self->recv_parallel_stage = 1;
+      self->recv_parallel_retry = g_error_matches (error, G_USB_DEVICE_ERROR,
+                                                   G_USB_DEVICE_ERROR_TIMED_OUT);
+      g_clear_error (&error);
+      usb_recv (self, transfer->ssm, step->endpoint2, step->max_bytes2,
+                usb_recv_parallel_cb, user_data);
+      return;
+    }
+
+  if (!self->recv_parallel_retry)
+    {
+      usb_recv_cb (transfer, device, NULL, error);
+      return;
+    }
+
+  if (error)
+    {
+      g_warning ("Unhandled receive error: %s", error->message);
+      g_error_free (error);
+    }
+
+  usb_recv (self, transfer->ssm, step->endpoint, step->max_bytes,
+            usb_recv_cb, NULL);
+}
 
 #define IS_VFS301_FP_SEQ_START(b) ((b[0] == 0x01) && (b[1] == 0xfe))
 
@@ -454,237 +540,358 @@ vfs301_proto_process_data (FpDeviceVfs301 *dev, int first_block, const guint8 *b
   return img_process_data (first_block, dev, buf, len);
 }
 
-void
-vfs301_proto_request_fingerprint (FpDeviceVfs301 *dev)
+static void
+vfs301_proto_event_cb (FpiUsbTransfer *transfer, FpDevice *device,
+                       gpointer user_data, GError *error)
 {
-  USB_SEND (0x0220, 0xFA00);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 000000000000 */
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
+  const guint8 no_event[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  const guint8 got_event[] = {0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00};
+
+  if (error)
+    {
+      fpi_ssm_mark_failed (transfer->ssm, error);
+      return;
+    }
+
+  if (memcmp (transfer->buffer, no_event, sizeof (no_event)) == 0)
+    {
+      self->got_event = FALSE;
+    }
+  else if (memcmp (transfer->buffer, got_event, sizeof (got_event)) == 0)
+    {
+      self->got_event = TRUE;
+    }
+  else
+    {
+      fpi_ssm_mark_failed (transfer->ssm,
+                           fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO,
+                                                     "Unexpected event state"));
+      return;
+    }
+
+  fpi_ssm_next_state (transfer->ssm);
 }
 
-int
-vfs301_proto_peek_event (FpDeviceVfs301 *dev)
+static void
+vfs301_proto_scan_cb (FpiUsbStream   *stream,
+                      FpiUsbTransfer *transfer,
+                      FpDevice       *device,
+                      gpointer        user_data,
+                      GError         *error)
 {
-  g_autoptr(GError) error = NULL;
-  g_autoptr(FpiUsbTransfer) transfer = NULL;
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
 
-  const char no_event[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-  const char got_event[] = {0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00};
+  if (error)
+    {
+      g_warning ("Error receiving data: %s", error->message);
+      self->scan_error = error;
+      fpi_usb_stream_stop (stream);
+      return;
+    }
 
-  USB_SEND (0x17, -1);
-  usb_recv (dev, VFS301_RECEIVE_ENDPOINT_CTRL, 7, &transfer, &error);
+  /* TODO: process the data anyway? */
+  if (transfer->actual_length < transfer->length ||
+      !vfs301_proto_process_data (self,
+                                  FALSE,
+                                  transfer->buffer,
+                                  transfer->actual_length))
+    fpi_usb_stream_stop (stream);
+}
 
-  /* XXX: This is obviously not a sane error handling! */
-  g_assert (!error);
+static void
+vfs301_proto_scan_stopped_cb (FpiUsbStream *stream,
+                              FpDevice     *device,
+                              gpointer      user_data)
+{
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
+  FpiSsm *ssm = user_data;
 
-  if (memcmp (transfer->buffer, no_event, sizeof (no_event)) == 0)
-    return 0;
-  else if (memcmp (transfer->buffer, got_event, sizeof (no_event)) == 0)
-    return 1;
+  /* Data of the transfers that were still in flight is dropped */
+  if (self->scan_error)
+    fpi_ssm_mark_failed (ssm, g_steal_pointer (&self->scan_error));
   else
-    g_assert_not_reached ();
+    fpi_ssm_next_state (ssm);
 }
 
-/* XXX: We sometimes need to receive data on from two endpoints at the same
- *      time. However, as this driver is currently all synchronous (yikes),
- *      we will run into timeouts randomly and need to then try again.
- */
-#define PARALLEL_RECEIVE(e1, l1, e2, l2) \
-  { \
-    g_autoptr(GError) error = NULL; \
-    usb_recv (dev, e1, l1, NULL, &error); \
-    usb_recv (dev, e2, l2, NULL, NULL); \
-    if (g_error_matches (error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_TIMED_OUT)) \
-    usb_recv (dev, e1, l1, NULL, NULL); \
-  }
-
+/* The first transfer of a scan is shorter, so it is read on its own. The
+ * scan stream then keeps several reads in flight until the data ends. */
 static void
-vfs301_proto_process_event_cb (FpiUsbTransfer *transfer,
-                               FpDevice *device,
-                               gpointer user_data, GError *error)
+vfs301_proto_scan_first_cb (FpiUsbTransfer *transfer, FpDevice *device,
+                            gpointer user_data, GError *error)
 {
   FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
 
   if (error)
     {
       g_warning ("Error receiving data: %s", error->message);
-      g_error_free (error);
-      self->recv_progress = VFS301_FAILURE;
+      fpi_ssm_mark_failed (transfer->ssm, error);
       return;
     }
-  else if (transfer->actual_length < transfer->length)
+
+  /* TODO: process the data anyway? */
+  if (transfer->actual_length < transfer->length ||
+      !vfs301_proto_process_data (self,
+                                  TRUE,
+                                  transfer->buffer,
+                                  transfer->actual_length))
     {
-      /* TODO: process the data anyway? */
-      self->recv_progress = VFS301_ENDED;
+      fpi_ssm_next_state (transfer->ssm);
       return;
     }
-  else
+
+  fpi_usb_stream_start (self->scan_stream, VFS301_FP_RECV_TIMEOUT,
+                        vfs301_proto_scan_cb, vfs301_proto_scan_stopped_cb,
+                        transfer->ssm);
+}
+
+static void
+vfs301_proto_scan_submit (FpDeviceVfs301 *dev, FpiSsm *ssm)
+{
+  FpiUsbTransfer *transfer;
+
+  transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
+  transfer->ssm = ssm;
+  fpi_usb_transfer_fill_bulk (transfer, VFS301_RECEIVE_ENDPOINT_DATA,
+                              VFS301_FP_RECV_LEN_1);
+
+  fpi_usb_transfer_submit (transfer, VFS301_FP_RECV_TIMEOUT, NULL,
+                           vfs301_proto_scan_first_cb, NULL);
+}
+
+static void
+vfs301_proto_run_state (FpiSsm *ssm, FpDevice *device)
+{
+  FpDeviceVfs301 *self = FPI_DEVICE_VFS301 (device);
+  const vfs301_step_t *step = fpi_ssm_get_data (ssm);
+  FpiUsbTransfer *transfer;
+
+  step += fpi_ssm_get_cur_state (ssm);
+
+  switch (step->action)
     {
-      FpiUsbTransfer *new;
-      if (!vfs301_proto_process_data (self,
-                                      transfer->length == VFS301_FP_RECV_LEN_1,
-                                      transfer->buffer,
-                                      transfer->actual_length))
-        {
-          self->recv_progress = VFS301_ENDED;
-          return;
-        }
+    case VFS301_SEND:
+      {
+        guint8 *data;
+        gssize len;
 
-      new = fpi_usb_transfer_new (device);
+        data = vfs301_proto_generate (step->type, step->subtype, &len);
+        usb_send (self, ssm, data, len, g_free);
+      }
+      break;
 
-      fpi_usb_transfer_fill_bulk (new, VFS301_RECEIVE_ENDPOINT_DATA, VFS301_FP_RECV_LEN_2);
-      fpi_usb_transfer_submit (new, VFS301_FP_RECV_TIMEOUT, NULL,
-                               vfs301_proto_process_event_cb, NULL);
-      return;
+    case VFS301_SEND_RAW:
+      usb_send (self, ssm, (guint8 *) step->data, step->len, NULL);
+      break;
+
+    case VFS301_RECV:
+      usb_recv (self, ssm, step->endpoint, step->max_bytes, usb_recv_cb, NULL);
+      break;
+
+    case VFS301_RECV_PARALLEL:
+      self->recv_parallel_stage = 0;
+      usb_recv (self, ssm, step->endpoint, step->max_bytes,
+                usb_recv_parallel_cb, (gpointer) step);
+      break;
+
+    case VFS301_RECV_EVENT:
+      transfer = fpi_usb_transfer_new (device);
+      transfer->ssm = ssm;
+      transfer->short_is_error = TRUE;
+      fpi_usb_transfer_fill_bulk (transfer, VFS301_RECEIVE_ENDPOINT_CTRL, 7);
+      fpi_usb_transfer_submit (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, NULL,
+                               vfs301_proto_event_cb, NULL);
+      break;
+
+    case VFS301_RECV_SCAN:
+      vfs301_proto_scan_submit (self, ssm);
+      break;
+
+    default:
+      g_assert_not_reached ();
     }
 }
 
-void
-vfs301_proto_process_event_start (FpDeviceVfs301 *dev)
+/* Runs @steps as a child state machine of @ssm */
+static void
+vfs301_proto_run (FpDeviceVfs301 *dev, FpiSsm *ssm,
+                  const vfs301_step_t *steps, int n_steps, const char *name)
 {
-  FpiUsbTransfer *transfer;
+  FpiSsm *subsm;
 
-  /*
-   * Notes:
-   *
-   * seen next_scan order:
-   *    o FA00
-   *    o FA00
-   *    o 2C01
-   *    o FA00
-   *    o FA00
-   *    o 2C01
-   *    o FA00
-   *    o FA00
-   *    o 2C01
-   *    o 5E01 !?
-   *    o FA00
-   *    o FA00
-   *    o 2C01
-   *    o FA00
-   *    o FA00
-   *    o 2C01
-   */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 64);
+  subsm = fpi_ssm_new_full (FP_DEVICE (dev), vfs301_proto_run_state, n_steps, n_steps, name);
+  fpi_ssm_set_data (subsm, (gpointer) steps, NULL);
+  fpi_ssm_start_subsm (ssm, subsm);
+}
 
-  /* now read the fingerprint data, while there are some */
-  transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
-  dev->recv_progress = VFS301_ONGOING;
+static const vfs301_step_t vfs301_request_fingerprint_steps[] = {
+  USB_SEND (0x0220, 0xFA00),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 000000000000 */
+};
 
-  fpi_usb_transfer_fill_bulk (transfer, VFS301_RECEIVE_ENDPOINT_DATA, VFS301_FP_RECV_LEN_1);
-  fpi_usb_transfer_submit (transfer, VFS301_FP_RECV_TIMEOUT, NULL,
-                           vfs301_proto_process_event_cb, NULL);
+void
+vfs301_proto_request_fingerprint (FpDeviceVfs301 *dev, FpiSsm *ssm)
+{
+  vfs301_proto_run (dev, ssm, vfs301_request_fingerprint_steps,
+                    G_N_ELEMENTS (vfs301_request_fingerprint_steps),
+                    "request fingerprint");
 }
 
-int
-vfs301_proto_process_event_poll (FpDeviceVfs301 *dev)
+static const vfs301_step_t vfs301_peek_event_steps[] = {
+  USB_SEND (0x17, -1),
+  { .action = VFS301_RECV_EVENT },
+};
+
+void
+vfs301_proto_peek_event (FpDeviceVfs301 *dev, FpiSsm *ssm)
 {
-  if (dev->recv_progress != VFS301_ENDED)
-    return dev->recv_progress;
+  vfs301_proto_run (dev, ssm, vfs301_peek_event_steps,
+                    G_N_ELEMENTS (vfs301_peek_event_steps),
+                    "peek event");
+}
 
-  /* Finish the scan process... */
+/*
+ * Notes:
+ *
+ * seen next_scan order:
+ *    o FA00
+ *    o FA00
+ *    o 2C01
+ *    o FA00
+ *    o FA00
+ *    o 2C01
+ *    o FA00
+ *    o FA00
+ *    o 2C01
+ *    o 5E01 !?
+ *    o FA00
+ *    o FA00
+ *    o 2C01
+ *    o FA00
+ *    o FA00
+ *    o 2C01
+ */
+static const vfs301_step_t vfs301_capture_steps[] = {
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 64),
 
-  USB_SEND (0x04, -1);
+  /* now read the fingerprint data, while there are some */
+  { .action = VFS301_RECV_SCAN },
+
+  /* Finish the scan process... */
+  USB_SEND (0x04, -1),
   /* the following may come in random order, data may not come at all, don't
    * try for too long... */
   PARALLEL_RECEIVE (
     VFS301_RECEIVE_ENDPOINT_CTRL, 2,             /* 1204 */
     VFS301_RECEIVE_ENDPOINT_DATA, 16384
-                   );
+                   ),
 
-  USB_SEND (0x0220, 2);
+  USB_SEND (0x0220, 2),
   PARALLEL_RECEIVE (
     VFS301_RECEIVE_ENDPOINT_DATA, 5760,             /* seems to always come */
     VFS301_RECEIVE_ENDPOINT_CTRL, 2             /* 0000 */
-                   );
-
-  return dev->recv_progress;
-}
+                   ),
+};
 
 void
-vfs301_proto_init (FpDeviceVfs301 *dev)
+vfs301_proto_capture (FpDeviceVfs301 *dev, FpiSsm *ssm)
 {
-  USB_SEND (0x01, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38);
-  USB_SEND (0x0B, 0x04);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 6);      /* 000000000000 */
-  USB_SEND (0x0B, 0x05);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 7);      /* 00000000000000 */
-  USB_SEND (0x19, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 64);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 4);      /* 6BB4D0BC */
-  usb_send (dev, RAW_DATA (vfs301_06_1), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-
-  USB_SEND (0x01, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38);
-  USB_SEND (0x1A, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_06_2), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_SEND (0x0220, 1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 256);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 32);
-
-  USB_SEND (0x1A, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_06_3), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-
-  USB_SEND (0x01, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38);
-  USB_SEND (0x02D0, 1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 11648);      /* 56 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 2);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 53248);      /* 2 * 128 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 3);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 19968);      /* 96 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 4);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 5824);      /* 28 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 5);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 6656);      /* 32 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 6);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 6656);      /* 32 * vfs301_init_line_t[] */
-  USB_SEND (0x02D0, 7);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 832);
-  usb_send (dev, RAW_DATA (vfs301_12), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-
-  USB_SEND (0x1A, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_06_2), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  USB_SEND (0x0220, 2);
+  vfs301_proto_run (dev, ssm, vfs301_capture_steps,
+                    G_N_ELEMENTS (vfs301_capture_steps),
+                    "capture");
+}
+
+static const vfs301_step_t vfs301_init_steps[] = {
+  USB_SEND (0x01, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38),
+  USB_SEND (0x0B, 0x04),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 6),      /* 000000000000 */
+  USB_SEND (0x0B, 0x05),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 7),      /* 00000000000000 */
+  USB_SEND (0x19, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 64),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 4),      /* 6BB4D0BC */
+  USB_SEND_RAW (vfs301_06_1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+
+  USB_SEND (0x01, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38),
+  USB_SEND (0x1A, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_06_2),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND (0x0220, 1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 256),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 32),
+
+  USB_SEND (0x1A, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_06_3),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+
+  USB_SEND (0x01, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38),
+  USB_SEND (0x02D0, 1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 11648),      /* 56 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 2),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 53248),      /* 2 * 128 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 3),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 19968),      /* 96 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 4),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 5824),      /* 28 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 5),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 6656),      /* 32 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 6),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 6656),      /* 32 * vfs301_init_line_t[] */
+  USB_SEND (0x02D0, 7),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 832),
+  USB_SEND_RAW (vfs301_12),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+
+  USB_SEND (0x1A, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_06_2),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND (0x0220, 2),
   PARALLEL_RECEIVE (
     VFS301_RECEIVE_ENDPOINT_CTRL, 2,             /* 0000 */
     VFS301_RECEIVE_ENDPOINT_DATA, 5760
-                   );
-
-  USB_SEND (0x1A, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_06_1), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-
-  USB_SEND (0x1A, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_06_4), NULL);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-  usb_send (dev, RAW_DATA (vfs301_24), NULL);     /* turns on white */
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2);      /* 0000 */
-
-  USB_SEND (0x01, -1);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38);
-  USB_SEND (0x0220, 3);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2368);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 36);
-  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 5760);
+                   ),
+
+  USB_SEND (0x1A, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_06_1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+
+  USB_SEND (0x1A, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_06_4),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+  USB_SEND_RAW (vfs301_24),     /* turns on white */
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2),      /* 0000 */
+
+  USB_SEND (0x01, -1),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 38),
+  USB_SEND (0x0220, 3),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 2368),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_CTRL, 36),
+  USB_RECV (VFS301_RECEIVE_ENDPOINT_DATA, 5760),
+};
+
+void
+vfs301_proto_init (FpDeviceVfs301 *dev, FpiSsm *ssm)
+{
+  vfs301_proto_run (dev, ssm, vfs301_init_steps,
+                    G_N_ELEMENTS (vfs301_init_steps),
+                    "init");
 }
 
 void
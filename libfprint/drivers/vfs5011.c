@@ -326,9 +326,15 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
     {
       unsigned char *linebuf = self->capture_buffer
                                + i * VFS5011_LINE_SIZE;
+      FpiLineFlags line;
 
-      if (fpi_std_sq_dev (linebuf + 8, VFS5011_IMAGE_WIDTH)
-          < DEVIATION_THRESHOLD)
+      line = fpi_line_classify (linebuf + 8,
+                                self->lastline ? self->lastline + 8 : NULL,
+                                VFS5011_IMAGE_WIDTH,
+                                DEVIATION_THRESHOLD, DIFFERENCE_THRESHOLD,
+                                NULL, NULL);
+
+      if (line & FPI_LINE_BLANK)
         {
           if (self->lines_captured == 0)
             continue;
@@ -354,10 +360,7 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
           return 1;
         }
 
-      if ((self->lastline == NULL) ||
-          (fpi_mean_sq_diff_norm (self->lastline + 8,
-                                  linebuf + 8,
-                                  VFS5011_IMAGE_WIDTH) >= DIFFERENCE_THRESHOLD))
+      if (line & FPI_LINE_DIFFERS)
         {
           self->lastline = g_malloc (VFS5011_LINE_SIZE);
           self->rows = g_slist_prepend (self->rows,
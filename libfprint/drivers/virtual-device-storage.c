@@ -225,12 +225,29 @@ dev_delete (FpDevice *dev)
                                 fpi_device_error_new (FP_DEVICE_ERROR_DATA_NOT_FOUND));
 }
 
+static void
+probe_delay_cb (FpDevice *dev, gpointer user_data)
+{
+  fpi_device_probe_complete (dev, NULL, NULL, NULL);
+}
+
 static void
 dev_probe (FpDevice *dev)
 {
+  const char *delay;
+
   /* Disable features listed in driver_data */
   fpi_device_update_features (dev, fpi_device_get_driver_data (dev), 0);
 
+  /* Allows testing probes that take a long time */
+  delay = g_getenv ("FP_VIRTUAL_DEVICE_STORAGE_PROBE_DELAY");
+  if (delay && delay[0] != '\0')
+    {
+      fpi_device_add_timeout (dev, g_ascii_strtoull (delay, NULL, 10),
+                              probe_delay_cb, NULL, NULL);
+      return;
+    }
+
   fpi_device_probe_complete (dev, NULL, NULL, NULL);
 }
 
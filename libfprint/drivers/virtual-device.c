@@ -774,6 +774,7 @@ fpi_device_virtual_device_class_init (FpDeviceVirtualDeviceClass *klass)
   dev_class->type = FP_DEVICE_TYPE_VIRTUAL;
   dev_class->id_table = driver_ids;
   dev_class->nr_enroll_stages = 5;
+  dev_class->no_driver_thread = TRUE;
 
   dev_class->open = dev_init;
   dev_class->close = dev_deinit;
@@ -53,12 +53,35 @@ typedef struct
   gint          pending_devices;
   gboolean      enumerated;
 
-  GArray       *drivers;
+  guint         probe_threads;
+  guint         probe_timeout;
+  GThreadPool  *probe_pool;
+
+  GPtrArray    *driver_classes;
+  GHashTable   *usb_drivers;  /* VID:PID to #GArray of #DriverEntry */
+  GHashTable   *hid_drivers;  /* HID VID:PID to #GArray of #DriverEntry */
+  GArray       *udev_drivers; /* #DriverEntry of all udev drivers */
   GPtrArray    *devices;
 } FpContextPrivate;
 
+/* An entry of a driver's id_table, see build_driver_index() */
+typedef struct
+{
+  FpDeviceClass   *cls;
+  const FpIdEntry *entry;
+} DriverEntry;
+
 G_DEFINE_TYPE_WITH_PRIVATE (FpContext, fp_context, G_TYPE_OBJECT)
 
+enum {
+  PROP_0,
+  PROP_PROBE_THREADS,
+  PROP_PROBE_TIMEOUT,
+  N_PROPS
+};
+
+static GParamSpec *properties[N_PROPS];
+
 enum {
   DEVICE_ADDED_SIGNAL,
   DEVICE_REMOVED_SIGNAL,
@@ -95,6 +118,89 @@ is_driver_allowed (const gchar *driver)
   return FALSE;
 }
 
+static inline gpointer
+id_key (guint vid, guint pid)
+{
+  /* USB and HID IDs are 16 bit, matches still need to compare the IDs */
+  return GUINT_TO_POINTER (((vid & 0xffff) << 16) | (pid & 0xffff));
+}
+
+static void
+driver_index_add (GHashTable *index, gpointer key, FpDeviceClass *cls,
+                  const FpIdEntry *entry)
+{
+  DriverEntry match = { cls, entry };
+  GArray *matches;
+
+  matches = g_hash_table_lookup (index, key);
+  if (!matches)
+    {
+      matches = g_array_new (FALSE, FALSE, sizeof (DriverEntry));
+      g_hash_table_insert (index, key, matches);
+    }
+
+  g_array_append_val (matches, match);
+}
+
+/* Index the id_table of all drivers, so that devices can be matched without
+ * walking all of them for every hotplug event. Entries for the same ID keep
+ * the order of the drivers. */
+static void
+build_driver_index (FpContext *self)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+  guint i;
+
+  priv->usb_drivers = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) g_array_unref);
+  priv->hid_drivers = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) g_array_unref);
+  priv->udev_drivers = g_array_new (FALSE, FALSE, sizeof (DriverEntry));
+
+  for (i = 0; i < priv->driver_classes->len; i++)
+    {
+      FpDeviceClass *cls = g_ptr_array_index (priv->driver_classes, i);
+      const FpIdEntry *entry;
+
+      if (cls->type == FP_DEVICE_TYPE_USB)
+        {
+          for (entry = cls->id_table; entry->pid; entry++)
+            driver_index_add (priv->usb_drivers, id_key (entry->vid, entry->pid),
+                              cls, entry);
+        }
+      else if (cls->type == FP_DEVICE_TYPE_UDEV)
+        {
+          for (entry = cls->id_table; entry->udev_types; entry++)
+            {
+              DriverEntry match = { cls, entry };
+
+              g_array_append_val (priv->udev_drivers, match);
+
+              if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
+                driver_index_add (priv->hid_drivers,
+                                  id_key (entry->hid_id.vid, entry->hid_id.pid),
+                                  cls, entry);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_UDEV
+/* A hidraw node found during enumeration, see fp_context_enumerate() */
+typedef struct
+{
+  GList  *link;
+  guint32 vid;
+  guint32 pid;
+} HidrawNode;
+
+static void
+hidraw_nodes_free (GQueue *nodes)
+{
+  g_queue_free_full (nodes, g_free);
+}
+#endif
+
 typedef struct
 {
   FpContext *context;
@@ -173,20 +279,10 @@ device_removed_cb (FpContext *context, FpDevice *device)
 }
 
 static void
-async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+device_probed (FpContext *context, FpDevice *device, GError *error)
 {
-  g_autoptr(GError) error = NULL;
-  FpDevice *device;
-  FpContext *context;
-  FpContextPrivate *priv;
-
-  device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
-                                                   res, &error));
-  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-    return;
+  FpContextPrivate *priv = fp_context_get_instance_private (context);
 
-  context = FP_CONTEXT (user_data);
-  priv = fp_context_get_instance_private (context);
   priv->pending_devices--;
 
   if (error)
@@ -205,6 +301,211 @@ async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer u
   g_signal_emit (context, signals[DEVICE_ADDED_SIGNAL], 0, device);
 }
 
+static void
+async_device_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  FpDevice *device;
+
+  device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
+                                                   res, &error));
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  device_probed (FP_CONTEXT (user_data), device, error);
+}
+
+typedef struct
+{
+  FpContext    *context;
+  GMainContext *main_context;
+
+  GType         driver;
+  gchar        *virtual_env;
+  GUsbDevice   *usb_device;
+  gchar        *spidev_path;
+  gchar        *hidraw_path;
+  guint64       driver_data;
+
+  guint         timeout;
+  gint64        deadline;
+  gboolean      timed_out;
+  GCancellable *cancellable;
+
+  gboolean      done;
+  FpDevice     *device;
+  GError       *error;
+} ProbeData;
+
+static void
+probe_data_free (ProbeData *data)
+{
+  g_clear_object (&data->cancellable);
+  g_clear_object (&data->device);
+  g_clear_error (&data->error);
+  g_free (data->virtual_env);
+  g_clear_object (&data->usb_device);
+  g_free (data->spidev_path);
+  g_free (data->hidraw_path);
+  g_main_context_unref (data->main_context);
+  g_object_unref (data->context);
+  g_free (data);
+}
+
+static gboolean
+probe_done_cb (gpointer user_data)
+{
+  ProbeData *data = user_data;
+
+  /* The probe may have succeeded anyway if the driver ignored the
+   * cancellation, but the device is dropped all the same. */
+  if (data->timed_out)
+    {
+      g_clear_object (&data->device);
+      g_clear_error (&data->error);
+      g_set_error (&data->error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                   "Probing %s did not finish within %u ms",
+                   g_type_name (data->driver), data->timeout);
+    }
+
+  device_probed (data->context, g_steal_pointer (&data->device), data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+probe_init_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  ProbeData *data = user_data;
+
+  data->device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
+                                                         res, &data->error));
+  data->done = TRUE;
+}
+
+static gboolean
+probe_deadline_cb (gpointer user_data)
+{
+  ProbeData *data = user_data;
+
+  data->timed_out = TRUE;
+  g_cancellable_cancel (data->cancellable);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs a probe in a worker of the probe pool. The worker iterates its own
+ * main context until the probe finishes, so drivers can still use
+ * asynchronous transfers and timeouts while probing. The result is then
+ * reported from the context the probe was started in. */
+static void
+probe_thread_func (ProbeData *data, gpointer user_data)
+{
+  g_autoptr(GMainContext) main_context = g_main_context_new ();
+  g_autoptr(GSource) timeout = NULL;
+  g_autoptr(GSource) done = NULL;
+
+  g_main_context_push_thread_default (main_context);
+
+  if (data->deadline)
+    {
+      gint64 remaining = data->deadline - g_get_monotonic_time ();
+
+      timeout = g_timeout_source_new (MAX (remaining, 0) / 1000);
+      g_source_set_callback (timeout, probe_deadline_cb, data, NULL);
+      g_source_attach (timeout, main_context);
+    }
+
+  g_async_initable_new_async (data->driver,
+                              G_PRIORITY_LOW,
+                              data->cancellable,
+                              probe_init_done_cb,
+                              data,
+                              "fpi-environ", data->virtual_env,
+                              "fpi-usb-device", data->usb_device,
+                              "fpi-udev-data-spidev", data->spidev_path,
+                              "fpi-udev-data-hidraw", data->hidraw_path,
+                              "fpi-driver-data", data->driver_data,
+                              NULL);
+
+  while (!data->done)
+    g_main_context_iteration (main_context, TRUE);
+
+  if (timeout)
+    g_source_destroy (timeout);
+
+  /* Dispatch anything the probe left behind for this context */
+  while (g_main_context_iteration (main_context, FALSE))
+    {
+    }
+
+  g_main_context_pop_thread_default (main_context);
+
+  /* Not g_main_context_invoke(), which runs the callback in this thread
+   * if the context is not currently owned by another one. */
+  done = g_idle_source_new ();
+  g_source_set_priority (done, G_PRIORITY_DEFAULT);
+  g_source_set_callback (done, probe_done_cb, data, (GDestroyNotify) probe_data_free);
+  g_source_attach (done, data->main_context);
+}
+
+/* Creates and probes a device for a driver. With probe threads, this happens
+ * in the probe pool, otherwise in the current main context. */
+static void
+probe_device (FpContext       *self,
+              GType            driver,
+              const FpIdEntry *entry,
+              const gchar     *virtual_env,
+              GUsbDevice      *usb_device,
+              const gchar     *spidev_path,
+              const gchar     *hidraw_path)
+{
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+  ProbeData *data;
+
+  priv->pending_devices++;
+
+  if (priv->probe_threads == 0)
+    {
+      g_async_initable_new_async (driver,
+                                  G_PRIORITY_LOW,
+                                  priv->cancellable,
+                                  async_device_init_done_cb,
+                                  self,
+                                  "fpi-environ", virtual_env,
+                                  "fpi-usb-device", usb_device,
+                                  "fpi-udev-data-spidev", spidev_path,
+                                  "fpi-udev-data-hidraw", hidraw_path,
+                                  "fpi-driver-data", entry->driver_data,
+                                  NULL);
+      return;
+    }
+
+  if (!priv->probe_pool)
+    priv->probe_pool = g_thread_pool_new ((GFunc) probe_thread_func, NULL,
+                                          priv->probe_threads, FALSE, NULL);
+
+  data = g_new0 (ProbeData, 1);
+  data->context = g_object_ref (self);
+  data->main_context = g_main_context_ref_thread_default ();
+  data->driver = driver;
+  data->virtual_env = g_strdup (virtual_env);
+  data->usb_device = usb_device ? g_object_ref (usb_device) : NULL;
+  data->spidev_path = g_strdup (spidev_path);
+  data->hidraw_path = g_strdup (hidraw_path);
+  data->driver_data = entry->driver_data;
+
+  /* The deadline includes the time spent waiting for a free worker */
+  data->timeout = priv->probe_timeout;
+  if (data->timeout)
+    data->deadline = g_get_monotonic_time () + data->timeout * G_TIME_SPAN_MILLISECOND;
+
+  /* Only cancelled on timeout, the context stays alive while probing */
+  data->cancellable = g_cancellable_new ();
+
+  g_thread_pool_push (priv->probe_pool, data, NULL);
+}
+
 static void
 usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
 {
@@ -212,6 +513,7 @@ usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
   GType found_driver = G_TYPE_NONE;
   const FpIdEntry *found_entry = NULL;
   gint found_score = 0;
+  GArray *matches;
   gint i;
   guint16 pid, vid;
 
@@ -219,33 +521,25 @@ usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
   vid = g_usb_device_get_vid (device);
 
   /* Find the best driver to handle this USB device. */
-  for (i = 0; i < priv->drivers->len; i++)
+  matches = g_hash_table_lookup (priv->usb_drivers, id_key (vid, pid));
+  for (i = 0; matches && i < matches->len; i++)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
+      DriverEntry *match = &g_array_index (matches, DriverEntry, i);
+      gint driver_score = 50;
 
-      if (cls->type != FP_DEVICE_TYPE_USB)
+      if (match->entry->pid != pid || match->entry->vid != vid)
         continue;
 
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          gint driver_score = 50;
-
-          if (entry->pid != pid || entry->vid != vid)
-            continue;
+      if (match->cls->usb_discover)
+        driver_score = match->cls->usb_discover (device);
 
-          if (cls->usb_discover)
-            driver_score = cls->usb_discover (device);
-
-          /* Is this driver better than the one we had? */
-          if (driver_score <= found_score)
-            continue;
+      /* Is this driver better than the one we had? */
+      if (driver_score <= found_score)
+        continue;
 
-          found_score = driver_score;
-          found_driver = driver;
-          found_entry = entry;
-        }
+      found_score = driver_score;
+      found_driver = G_TYPE_FROM_CLASS (match->cls);
+      found_entry = match->entry;
     }
 
   if (found_driver == G_TYPE_NONE)
@@ -254,15 +548,7 @@ usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
       return;
     }
 
-  priv->pending_devices++;
-  g_async_initable_new_async (found_driver,
-                              G_PRIORITY_LOW,
-                              priv->cancellable,
-                              async_device_init_done_cb,
-                              self,
-                              "fpi-usb-device", device,
-                              "fpi-driver-data", found_entry->driver_data,
-                              NULL);
+  probe_device (self, found_driver, found_entry, NULL, device, NULL, NULL);
 }
 
 static void
@@ -293,9 +579,16 @@ fp_context_finalize (GObject *object)
 
   g_clear_pointer (&priv->devices, g_ptr_array_unref);
 
+  /* Probes hold a reference, so the pool is idle by now */
+  if (priv->probe_pool)
+    g_thread_pool_free (g_steal_pointer (&priv->probe_pool), FALSE, TRUE);
+
   g_cancellable_cancel (priv->cancellable);
   g_clear_object (&priv->cancellable);
-  g_clear_pointer (&priv->drivers, g_array_unref);
+  g_clear_pointer (&priv->usb_drivers, g_hash_table_unref);
+  g_clear_pointer (&priv->hid_drivers, g_hash_table_unref);
+  g_clear_pointer (&priv->udev_drivers, g_array_unref);
+  g_clear_pointer (&priv->driver_classes, g_ptr_array_unref);
 
   g_slist_free_full (g_steal_pointer (&priv->sources), (GDestroyNotify) g_source_destroy);
 
@@ -306,12 +599,99 @@ fp_context_finalize (GObject *object)
   G_OBJECT_CLASS (fp_context_parent_class)->finalize (object);
 }
 
+static void
+fp_context_get_property (GObject    *object,
+                         guint       prop_id,
+                         GValue     *value,
+                         GParamSpec *pspec)
+{
+  FpContext *self = FP_CONTEXT (object);
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  switch (prop_id)
+    {
+    case PROP_PROBE_THREADS:
+      g_value_set_uint (value, priv->probe_threads);
+      break;
+
+    case PROP_PROBE_TIMEOUT:
+      g_value_set_uint (value, priv->probe_timeout);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+fp_context_set_property (GObject      *object,
+                         guint         prop_id,
+                         const GValue *value,
+                         GParamSpec   *pspec)
+{
+  FpContext *self = FP_CONTEXT (object);
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  switch (prop_id)
+    {
+    case PROP_PROBE_THREADS:
+      priv->probe_threads = g_value_get_uint (value);
+      if (priv->probe_pool && priv->probe_threads > 0)
+        g_thread_pool_set_max_threads (priv->probe_pool, priv->probe_threads, NULL);
+      break;
+
+    case PROP_PROBE_TIMEOUT:
+      priv->probe_timeout = g_value_get_uint (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 fp_context_class_init (FpContextClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->finalize = fp_context_finalize;
+  object_class->get_property = fp_context_get_property;
+  object_class->set_property = fp_context_set_property;
+
+  /**
+   * FpContext:probe-threads:
+   *
+   * The maximum number of devices that are probed at the same time in
+   * worker threads. Each probe runs with its own thread default
+   * #GMainContext, and the device is reported in the main context the
+   * probe was started from.
+   *
+   * The default of 0 probes devices one after the other in the main
+   * context. Changes only apply to devices that are discovered later.
+   */
+  properties[PROP_PROBE_THREADS] =
+    g_param_spec_uint ("probe-threads",
+                       "Probe threads",
+                       "Maximum number of devices probed at the same time",
+                       0, G_MAXINT, 0,
+                       G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE);
+
+  /**
+   * FpContext:probe-timeout:
+   *
+   * Time in milliseconds after which a probe running in a worker thread is
+   * cancelled and the device is ignored. This includes the time waiting
+   * for a free worker. The default of 0 means that probes may take as long
+   * as they need. Only used if #FpContext:probe-threads is set.
+   */
+  properties[PROP_PROBE_TIMEOUT] =
+    g_param_spec_uint ("probe-timeout",
+                       "Probe timeout",
+                       "Time in milliseconds after which a probe is cancelled",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
 
   /**
    * FpContext::device-added:
@@ -358,27 +738,31 @@ static void
 fp_context_init (FpContext *self)
 {
   g_autoptr(GError) error = NULL;
+  g_autoptr(GArray) drivers = NULL;
   FpContextPrivate *priv = fp_context_get_instance_private (self);
   guint i;
 
   g_debug ("Initializing FpContext (libfprint version " LIBFPRINT_VERSION ")");
 
-  priv->drivers = fpi_get_driver_types ();
+  drivers = fpi_get_driver_types ();
+  priv->driver_classes = g_ptr_array_new_with_free_func (g_type_class_unref);
 
-  if (get_drivers_whitelist_env ())
+  for (i = 0; i < drivers->len; i++)
     {
-      for (i = 0; i < priv->drivers->len;)
-        {
-          GType driver = g_array_index (priv->drivers, GType, i);
-          g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
+      GType driver = g_array_index (drivers, GType, i);
+      FpDeviceClass *cls = g_type_class_ref (driver);
 
-          if (!is_driver_allowed (cls->id))
-            g_array_remove_index (priv->drivers, i);
-          else
-            ++i;
+      if (get_drivers_whitelist_env () && !is_driver_allowed (cls->id))
+        {
+          g_type_class_unref (cls);
+          continue;
         }
+
+      g_ptr_array_add (priv->driver_classes, cls);
     }
 
+  build_driver_index (self);
+
   priv->devices = g_ptr_array_new_with_free_func (g_object_unref);
 
   priv->cancellable = g_cancellable_new ();
@@ -443,10 +827,10 @@ fp_context_enumerate (FpContext *context)
     g_usb_context_enumerate (priv->usb_ctx);
 
   /* Handle Virtual devices based on environment variables */
-  for (i = 0; i < priv->drivers->len; i++)
+  for (i = 0; i < priv->driver_classes->len; i++)
     {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
+      FpDeviceClass *cls = g_ptr_array_index (priv->driver_classes, i);
+      GType driver = G_TYPE_FROM_CLASS (cls);
       const FpIdEntry *entry;
 
       if (cls->type != FP_DEVICE_TYPE_VIRTUAL)
@@ -461,15 +845,7 @@ fp_context_enumerate (FpContext *context)
             continue;
 
           g_debug ("Found virtual environment device: %s, %s", entry->virtual_envvar, val);
-          priv->pending_devices++;
-          g_async_initable_new_async (driver,
-                                      G_PRIORITY_LOW,
-                                      priv->cancellable,
-                                      async_device_init_done_cb,
-                                      context,
-                                      "fpi-environ", val,
-                                      "fpi-driver-data", entry->driver_data,
-                                      NULL);
+          probe_device (context, driver, entry, val, NULL, NULL, NULL);
           g_debug ("created");
         }
     }
@@ -486,78 +862,106 @@ fp_context_enumerate (FpContext *context)
 
     g_autoptr(GList) spidev_devices = g_udev_client_query_by_subsystem (udev_client, "spidev");
     g_autoptr(GList) hidraw_devices = g_udev_client_query_by_subsystem (udev_client, "hidraw");
-
-    /* for each potential driver, try to match all requested resources. */
-    for (i = 0; i < priv->drivers->len; i++)
+    g_autoptr(GHashTable) hidraw_by_id = g_hash_table_new_full (NULL, NULL, NULL,
+                                                                (GDestroyNotify) hidraw_nodes_free);
+    GList *l;
+
+    /* Look up the HID ID of each hidraw node only once, by finding the parent
+     * HID node and checking the vid/pid from its HID_ID property. Nodes that
+     * no driver is interested in are skipped. */
+    for (l = hidraw_devices; l; l = l->next)
       {
-        GType driver = g_array_index (priv->drivers, GType, i);
-        g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-        const FpIdEntry *entry;
+        g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (l->data, "hid", NULL);
+        const gchar * hid_id;
+        guint32 vendor, product;
+        HidrawNode *node;
+        GQueue *nodes;
+
+        if (!parent)
+          continue;
+
+        hid_id = g_udev_device_get_property (parent, "HID_ID");
+        if (!hid_id)
+          continue;
+
+        if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
+          continue;
 
-        if (cls->type != FP_DEVICE_TYPE_UDEV)
+        if (!g_hash_table_contains (priv->hid_drivers, id_key (vendor, product)))
           continue;
 
-        for (entry = cls->id_table; entry->udev_types; entry++)
+        nodes = g_hash_table_lookup (hidraw_by_id, id_key (vendor, product));
+        if (!nodes)
           {
-            GList *matched_spidev = NULL, *matched_hidraw = NULL;
+            nodes = g_queue_new ();
+            g_hash_table_insert (hidraw_by_id, id_key (vendor, product), nodes);
+          }
+
+        node = g_new (HidrawNode, 1);
+        node->link = l;
+        node->vid = vendor;
+        node->pid = product;
+        g_queue_push_tail (nodes, node);
+      }
+
+    /* for each potential driver, try to match all requested resources. */
+    for (i = 0; i < priv->udev_drivers->len; i++)
+      {
+        DriverEntry *match = &g_array_index (priv->udev_drivers, DriverEntry, i);
+        GType driver = G_TYPE_FROM_CLASS (match->cls);
+        const FpIdEntry *entry = match->entry;
+        GList *matched_spidev = NULL, *matched_hidraw = NULL;
 
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_SPIDEV)
+          {
+            for (matched_spidev = spidev_devices; matched_spidev; matched_spidev = matched_spidev->next)
               {
-                for (matched_spidev = spidev_devices; matched_spidev; matched_spidev = matched_spidev->next)
-                  {
-                    const gchar * sysfs = g_udev_device_get_sysfs_path (matched_spidev->data);
-                    if (!sysfs)
-                      continue;
-                    if (strstr (sysfs, entry->spi_acpi_id))
-                      break;
-                  }
-                /* If match was not found exit */
-                if (matched_spidev == NULL)
+                const gchar * sysfs = g_udev_device_get_sysfs_path (matched_spidev->data);
+                if (!sysfs)
                   continue;
+                if (strstr (sysfs, entry->spi_acpi_id))
+                  break;
               }
-            if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
-              {
-                for (matched_hidraw = hidraw_devices; matched_hidraw; matched_hidraw = matched_hidraw->next)
-                  {
-                    /* Find the parent HID node, and check the vid/pid from its HID_ID property */
-                    g_autoptr(GUdevDevice) parent = g_udev_device_get_parent_with_subsystem (matched_hidraw->data, "hid", NULL);
-                    const gchar * hid_id = g_udev_device_get_property (parent, "HID_ID");
-                    guint32 vendor, product;
-
-                    if (!parent || !hid_id)
-                      continue;
+            /* If match was not found exit */
+            if (matched_spidev == NULL)
+              continue;
+          }
+        if (entry->udev_types & FPI_DEVICE_UDEV_SUBTYPE_HIDRAW)
+          {
+            GQueue *nodes;
+            GList *link;
 
-                    if (sscanf (hid_id, "%*X:%X:%X", &vendor, &product) != 2)
-                      continue;
+            nodes = g_hash_table_lookup (hidraw_by_id,
+                                         id_key (entry->hid_id.vid, entry->hid_id.pid));
+            for (link = nodes ? nodes->head : NULL; link; link = link->next)
+              {
+                HidrawNode *node = link->data;
 
-                    if (vendor == entry->hid_id.vid && product == entry->hid_id.pid)
-                      break;
+                if (node->vid == entry->hid_id.vid && node->pid == entry->hid_id.pid)
+                  {
+                    matched_hidraw = node->link;
+                    g_queue_delete_link (nodes, link);
+                    g_free (node);
+                    break;
                   }
-                /* If match was not found exit */
-                if (matched_hidraw == NULL)
-                  continue;
-              }
-            priv->pending_devices++;
-            g_async_initable_new_async (driver,
-                                        G_PRIORITY_LOW,
-                                        priv->cancellable,
-                                        async_device_init_done_cb,
-                                        context,
-                                        "fpi-driver-data", entry->driver_data,
-                                        "fpi-udev-data-spidev", (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
-                                        "fpi-udev-data-hidraw", (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL),
-                                        NULL);
-            /* remove entries from list to avoid conflicts */
-            if (matched_spidev)
-              {
-                g_object_unref (matched_spidev->data);
-                spidev_devices = g_list_delete_link (spidev_devices, matched_spidev);
-              }
-            if (matched_hidraw)
-              {
-                g_object_unref (matched_hidraw->data);
-                hidraw_devices = g_list_delete_link (hidraw_devices, matched_hidraw);
               }
+            /* If match was not found exit */
+            if (matched_hidraw == NULL)
+              continue;
+          }
+        probe_device (context, driver, entry, NULL, NULL,
+                      (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
+                      (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL));
+        /* remove entries from list to avoid conflicts */
+        if (matched_spidev)
+          {
+            g_object_unref (matched_spidev->data);
+            spidev_devices = g_list_delete_link (spidev_devices, matched_spidev);
+          }
+        if (matched_hidraw)
+          {
+            g_object_unref (matched_hidraw->data);
+            hidraw_devices = g_list_delete_link (hidraw_devices, matched_hidraw);
           }
       }
 
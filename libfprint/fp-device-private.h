@@ -64,8 +64,20 @@ typedef struct
 
   gint            nr_enroll_stages;
   GSList         *sources;
-
-  /* We always make sure that only one task is run at a time. */
+  GMutex          sources_lock;
+
+  /* Optional dedicated thread that all driver code runs in */
+  GThread      *driver_thread;
+  GMainContext *driver_context;
+  GMainLoop    *driver_loop;
+  GMainContext *caller_context;
+
+  /* We always make sure that only one task is run at a time.
+   * With a driver thread, the API user starts, cancels and completes
+   * operations while the driver thread may look at them. The action, the
+   * task, the cancellable, the cancellation reason, the cancel and return
+   * sources and the critical section state are protected by action_lock. */
+  GMutex              action_lock;
   FpiDeviceAction     current_action;
   GTask              *current_task;
   GError             *current_cancellation_reason;
@@ -80,7 +92,10 @@ typedef struct
   gboolean            wait_for_finger;
   FpFingerStatusFlags finger_status;
 
-  /* Driver critical sections */
+  /* Dedicated thread for blocking I/O, e.g. SPI transfers */
+  GThreadPool *io_thread_pool;
+
+  /* Driver critical sections, see action_lock */
   guint    critical_section;
   GSource *critical_section_flush_source;
   gboolean cancel_queued;
@@ -91,7 +106,8 @@ typedef struct
   GTask  *suspend_resume_task;
   GError *suspend_error;
 
-  /* Device temperature model information and state */
+  /* Device temperature model information and state, this is only used in
+   * the context of the API user (never in the driver thread). */
   GSource      *temp_timeout;
   FpTemperature temp_current;
   gint32        temp_hot_seconds;
@@ -130,6 +146,12 @@ typedef struct
 
 void match_data_free (FpMatchData *match_data);
 
+GMainContext *fpi_device_get_driver_context (FpDevice *device);
+gboolean fpi_device_in_driver_thread (FpDevice *device);
+void fpi_device_set_current_task (FpDevice       *device,
+                                  FpiDeviceAction action,
+                                  GTask          *task);
+
 void fpi_device_suspend (FpDevice *device);
 void fpi_device_resume (FpDevice *device);
 
@@ -137,3 +159,7 @@ void fpi_device_configure_wakeup (FpDevice *device,
                                   gboolean  enabled);
 void fpi_device_update_temp (FpDevice *device,
                              gboolean  is_active);
+
+void fpi_device_run_in_io_thread (FpDevice       *device,
+                                  GTask          *task,
+                                  GTaskThreadFunc task_func);
@@ -49,6 +49,7 @@ enum {
   PROP_SCAN_TYPE,
   PROP_FINGER_STATUS,
   PROP_TEMPERATURE,
+  PROP_DRIVER_THREAD,
   PROP_FPI_ENVIRON,
   PROP_FPI_USB_DEVICE,
   PROP_FPI_UDEV_DATA_SPIDEV,
@@ -86,17 +87,21 @@ fp_device_cancel_in_idle_cb (gpointer user_data)
   FpDevice *self = user_data;
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (self);
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  gboolean queued;
 
   g_assert (cls->cancel);
-  g_assert (priv->current_action != FPI_DEVICE_ACTION_NONE);
 
   g_debug ("Idle cancelling on ongoing operation!");
 
+  g_mutex_lock (&priv->action_lock);
+  g_assert (priv->current_action != FPI_DEVICE_ACTION_NONE);
   priv->current_idle_cancel_source = NULL;
-
-  if (priv->critical_section)
+  queued = priv->critical_section > 0;
+  if (queued)
     priv->cancel_queued = TRUE;
-  else
+  g_mutex_unlock (&priv->action_lock);
+
+  if (!queued)
     cls->cancel (self);
 
   fpi_device_report_finger_status (self, FP_FINGER_STATUS_NONE);
@@ -106,20 +111,22 @@ fp_device_cancel_in_idle_cb (gpointer user_data)
 
 /* Notify the class that the task was cancelled; this should be connected
  * with the GTask as the user_data object for automatic cleanup together
- * with the task. */
+ * with the task. This runs in the thread that cancels, the source may be
+ * dispatched (and cleared) by the driver thread as soon as it is attached. */
 static void
 fp_device_cancelled_cb (GCancellable *cancellable, FpDevice *self)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  GMainContext *driver_context = fpi_device_get_driver_context (self);
+  g_autoptr(GSource) source = NULL;
+
+  source = g_idle_source_new ();
+  g_source_set_callback (source, fp_device_cancel_in_idle_cb, self, NULL);
 
-  priv->current_idle_cancel_source = g_idle_source_new ();
-  g_source_set_callback (priv->current_idle_cancel_source,
-                         fp_device_cancel_in_idle_cb,
-                         self,
-                         NULL);
-  g_source_attach (priv->current_idle_cancel_source,
-                   g_task_get_context (priv->current_task));
-  g_source_unref (priv->current_idle_cancel_source);
+  g_mutex_lock (&priv->action_lock);
+  priv->current_idle_cancel_source = source;
+  g_source_attach (source, driver_context);
+  g_mutex_unlock (&priv->action_lock);
 }
 
 /* Forward the external task cancellable to the internal one. */
@@ -127,8 +134,14 @@ static void
 fp_device_task_cancelled_cb (GCancellable *cancellable, FpDevice *self)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  g_autoptr(GCancellable) current_cancellable = NULL;
 
-  g_cancellable_cancel (priv->current_cancellable);
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_cancellable)
+    current_cancellable = g_object_ref (priv->current_cancellable);
+  g_mutex_unlock (&priv->action_lock);
+
+  g_cancellable_cancel (current_cancellable);
 }
 
 static void
@@ -138,7 +151,9 @@ setup_task_cancellable (FpDevice *device)
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
   /* Create an internal cancellable and hook it up. */
+  g_mutex_lock (&priv->action_lock);
   priv->current_cancellable = g_cancellable_new ();
+  g_mutex_unlock (&priv->action_lock);
   if (cls->cancel)
     {
       priv->current_cancellable_id = g_cancellable_connect (priv->current_cancellable,
@@ -208,6 +223,149 @@ fp_device_constructed (GObject *object)
   G_OBJECT_CLASS (fp_device_parent_class)->constructed (object);
 }
 
+typedef void (*FpDeviceDriverFunc) (FpDevice *device);
+
+typedef struct
+{
+  FpDevice          *device;
+  FpDeviceDriverFunc func;
+} FpDeviceDriverCall;
+
+static gboolean
+driver_call_cb (gpointer user_data)
+{
+  FpDeviceDriverCall *call = user_data;
+
+  call->func (call->device);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+driver_call_free (FpDeviceDriverCall *call)
+{
+  g_object_unref (call->device);
+  g_free (call);
+}
+
+/* Call into the driver, which means switching to the driver thread if the
+ * device has one. The caller has set up the current task at this point. */
+static void
+fp_device_call_driver (FpDevice *device, FpDeviceDriverFunc func)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GSource) source = NULL;
+  FpDeviceDriverCall *call;
+
+  if (!priv->driver_context)
+    {
+      func (device);
+      return;
+    }
+
+  call = g_new0 (FpDeviceDriverCall, 1);
+  call->device = g_object_ref (device);
+  call->func = func;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback (source, driver_call_cb, call, (GDestroyNotify) driver_call_free);
+  g_source_set_name (source, "libfprint call into driver");
+  g_source_attach (source, priv->driver_context);
+}
+
+static gpointer
+driver_thread_func (gpointer user_data)
+{
+  g_autoptr(GMainLoop) loop = user_data;
+  GMainContext *context = g_main_loop_get_context (loop);
+
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+static gboolean
+driver_loop_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+fp_device_start_driver_thread (FpDevice *self)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  priv->caller_context = g_main_context_ref_thread_default ();
+  priv->driver_context = g_main_context_new ();
+  priv->driver_loop = g_main_loop_new (priv->driver_context, FALSE);
+  priv->driver_thread = g_thread_new ("fprint-device",
+                                      driver_thread_func,
+                                      g_main_loop_ref (priv->driver_loop));
+}
+
+static void
+fp_device_stop_driver_thread (FpDevice *self)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+  g_autoptr(GSource) source = NULL;
+
+  if (!priv->driver_thread)
+    return;
+
+  /* Quit from within the loop, g_main_loop_quit() has no effect if the
+   * thread did not get to run the loop yet. */
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, driver_loop_quit_cb,
+                         g_main_loop_ref (priv->driver_loop),
+                         (GDestroyNotify) g_main_loop_unref);
+  g_source_attach (source, priv->driver_context);
+
+  /* The last reference may be dropped by the driver thread itself. */
+  if (priv->driver_thread == g_thread_self ())
+    g_thread_unref (g_steal_pointer (&priv->driver_thread));
+  else
+    g_thread_join (g_steal_pointer (&priv->driver_thread));
+
+  g_clear_pointer (&priv->driver_loop, g_main_loop_unref);
+  g_clear_pointer (&priv->driver_context, g_main_context_unref);
+  g_clear_pointer (&priv->caller_context, g_main_context_unref);
+}
+
+static void
+fp_device_set_driver_thread (FpDevice *self, gboolean enabled)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  if (enabled == (priv->driver_thread != NULL))
+    return;
+
+  if (priv->is_open || priv->current_action != FPI_DEVICE_ACTION_NONE)
+    {
+      g_warning ("The driver thread can only be changed while the device is closed and idle");
+      return;
+    }
+
+  if (enabled && FP_DEVICE_GET_CLASS (self)->no_driver_thread)
+    {
+      g_warning ("Driver %s does not support running in a driver thread",
+                 FP_DEVICE_GET_CLASS (self)->id);
+      return;
+    }
+
+  if (enabled)
+    fp_device_start_driver_thread (self);
+  else
+    fp_device_stop_driver_thread (self);
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_DRIVER_THREAD]);
+}
+
 static void
 fp_device_finalize (GObject *object)
 {
@@ -219,6 +377,9 @@ fp_device_finalize (GObject *object)
   if (priv->is_open)
     g_warning ("User destroyed open device! Not cleaning up properly!");
 
+  /* The driver thread must be gone before its sources are destroyed. */
+  fp_device_stop_driver_thread (self);
+
   g_clear_pointer (&priv->temp_timeout, g_source_destroy);
 
   g_slist_free_full (priv->sources, (GDestroyNotify) g_source_destroy);
@@ -226,10 +387,17 @@ fp_device_finalize (GObject *object)
   g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
   g_clear_pointer (&priv->current_task_idle_return_source, g_source_destroy);
   g_clear_pointer (&priv->critical_section_flush_source, g_source_destroy);
+  g_mutex_clear (&priv->sources_lock);
+  g_mutex_clear (&priv->action_lock);
 
   g_clear_pointer (&priv->device_id, g_free);
   g_clear_pointer (&priv->device_name, g_free);
 
+  /* Every queued job holds a reference, so there is nothing left to run.
+   * Do not wait, as the last reference may be dropped by the thread itself. */
+  if (priv->io_thread_pool)
+    g_thread_pool_free (g_steal_pointer (&priv->io_thread_pool), FALSE, FALSE);
+
   g_clear_object (&priv->usb_device);
   g_clear_pointer (&priv->virtual_env, g_free);
   g_clear_pointer (&priv->udev_data.spidev_path, g_free);
@@ -266,6 +434,10 @@ fp_device_get_property (GObject    *object,
       g_value_set_enum (value, priv->temp_current);
       break;
 
+    case PROP_DRIVER_THREAD:
+      g_value_set_boolean (value, priv->driver_thread != NULL);
+      break;
+
     case PROP_DRIVER:
       g_value_set_static_string (value, FP_DEVICE_GET_CLASS (self)->id);
       break;
@@ -322,6 +494,10 @@ fp_device_set_property (GObject      *object,
   /* _construct has not run yet, so we cannot use priv->type. */
   switch (prop_id)
     {
+    case PROP_DRIVER_THREAD:
+      fp_device_set_driver_thread (self, g_value_get_boolean (value));
+      break;
+
     case PROP_FPI_ENVIRON:
       if (cls->type == FP_DEVICE_TYPE_VIRTUAL)
         priv->virtual_env = g_value_dup_string (value);
@@ -396,8 +572,7 @@ fp_device_async_initable_init_async (GAsyncInitable     *initable,
   if (g_task_return_error_if_cancelled (task))
     return;
 
-  priv->current_action = FPI_DEVICE_ACTION_PROBE;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (self, FPI_DEVICE_ACTION_PROBE, g_steal_pointer (&task));
   setup_task_cancellable (self);
 
   /* We push this into an idle handler for compatibility with libgusb
@@ -462,6 +637,25 @@ fp_device_class_init (FpDeviceClass *klass)
                        FP_TYPE_TEMPERATURE, FP_TEMPERATURE_COLD,
                        G_PARAM_STATIC_STRINGS | G_PARAM_READABLE);
 
+  /**
+   * FpDevice:driver-thread:
+   *
+   * Run all driver code for this device in a dedicated thread with its own
+   * #GMainContext. This keeps a slow driver from stalling the main loop of
+   * the API user and lets several devices work in parallel.
+   *
+   * Results, callbacks and property notifications are still delivered in
+   * the thread-default #GMainContext of the API user. Only change this while
+   * the device is closed. Drivers that use the global default #GMainContext
+   * directly do not support a driver thread, enabling it is refused.
+   */
+  properties[PROP_DRIVER_THREAD] =
+    g_param_spec_boolean ("driver-thread",
+                          "Driver Thread",
+                          "Whether driver code runs in a dedicated thread",
+                          FALSE,
+                          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY);
+
   properties[PROP_DRIVER] =
     g_param_spec_string ("driver",
                          "Driver",
@@ -600,6 +794,10 @@ fp_device_class_init (FpDeviceClass *klass)
 static void
 fp_device_init (FpDevice *self)
 {
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  g_mutex_init (&priv->sources_lock);
+  g_mutex_init (&priv->action_lock);
 }
 
 /**
@@ -858,12 +1056,11 @@ fp_device_open (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_OPEN;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_OPEN, g_steal_pointer (&task));
   setup_task_cancellable (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
 
-  FP_DEVICE_GET_CLASS (device)->open (device);
+  fp_device_call_driver (device, FP_DEVICE_GET_CLASS (device)->open);
 }
 
 /**
@@ -923,11 +1120,10 @@ fp_device_close (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLOSE;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_CLOSE, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
-  FP_DEVICE_GET_CLASS (device)->close (device);
+  fp_device_call_driver (device, FP_DEVICE_GET_CLASS (device)->close);
 }
 
 /**
@@ -999,7 +1195,7 @@ fp_device_suspend (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_suspend (device);
+  fp_device_call_driver (device, fpi_device_suspend);
 }
 
 /**
@@ -1064,7 +1260,7 @@ fp_device_resume (FpDevice           *device,
 
   priv->suspend_resume_task = g_steal_pointer (&task);
 
-  fpi_device_resume (device);
+  fp_device_call_driver (device, fpi_device_resume);
 }
 
 /**
@@ -1172,8 +1368,7 @@ fp_device_enroll (FpDevice           *device,
         }
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_ENROLL;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_ENROLL, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
   fpi_device_update_temp (device, TRUE);
@@ -1193,7 +1388,7 @@ fp_device_enroll (FpDevice           *device,
   // Attach the progress data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) enroll_data_free);
 
-  FP_DEVICE_GET_CLASS (device)->enroll (device);
+  fp_device_call_driver (device, FP_DEVICE_GET_CLASS (device)->enroll);
 }
 
 /**
@@ -1273,8 +1468,7 @@ fp_device_verify (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_VERIFY;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_VERIFY, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
   fpi_device_update_temp (device, TRUE);
@@ -1294,7 +1488,7 @@ fp_device_verify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->verify (device);
+  fp_device_call_driver (device, cls->verify);
 }
 
 /**
@@ -1400,8 +1594,7 @@ fp_device_identify (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_IDENTIFY;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_IDENTIFY, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
   fpi_device_update_temp (device, TRUE);
@@ -1427,7 +1620,7 @@ fp_device_identify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->identify (device);
+  fp_device_call_driver (device, cls->identify);
 }
 
 /**
@@ -1525,8 +1718,7 @@ fp_device_capture (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CAPTURE;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_CAPTURE, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
   fpi_device_update_temp (device, TRUE);
@@ -1539,7 +1731,7 @@ fp_device_capture (FpDevice           *device,
 
   priv->wait_for_finger = wait_for_finger;
 
-  cls->capture (device);
+  fp_device_call_driver (device, cls->capture);
 }
 
 /**
@@ -1615,15 +1807,14 @@ fp_device_delete_print (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_DELETE;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_DELETE, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
   g_task_set_task_data (priv->current_task,
                         g_object_ref (enrolled_print),
                         g_object_unref);
 
-  cls->delete (device);
+  fp_device_call_driver (device, cls->delete);
 }
 
 /**
@@ -1694,11 +1885,10 @@ fp_device_list_prints (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_LIST;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_LIST, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
-  cls->list (device);
+  fp_device_call_driver (device, cls->list);
 }
 
 /**
@@ -1779,11 +1969,10 @@ fp_device_clear_storage (FpDevice           *device,
       return;
     }
 
-  priv->current_action = FPI_DEVICE_ACTION_CLEAR_STORAGE;
-  priv->current_task = g_steal_pointer (&task);
+  fpi_device_set_current_task (device, FPI_DEVICE_ACTION_CLEAR_STORAGE, g_steal_pointer (&task));
   setup_task_cancellable (device);
 
-  cls->clear_storage (device);
+  fp_device_call_driver (device, cls->clear_storage);
 
   return;
 }
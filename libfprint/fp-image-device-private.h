@@ -33,10 +33,14 @@ typedef struct
   gint                enroll_stage;
 
   gboolean            minutiae_scan_active;
+  gboolean            identify_active;
   GError             *action_error;
   FpImage            *capture_image;
 
   gint                bz3_threshold;
+  gint                bz3_max_minutiae;
+  gboolean            identify_best_match;
+  gdouble             identify_min_similarity;
 } FpImageDevicePrivate;
 
 
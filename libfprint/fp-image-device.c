@@ -131,9 +131,10 @@ fp_image_device_start_capture_action (FpDevice *device)
     }
 
   priv->enroll_stage = 0;
-  /* The internal state machine guarantees both of these. */
+  /* The internal state machine guarantees all of these. */
   g_assert (!priv->finger_present);
   g_assert (!priv->minutiae_scan_active);
+  g_assert (!priv->identify_active);
 
   /* And activate the device; we rely on fpi_image_device_activate_complete()
    * to be called when done (or immediately). */
@@ -198,6 +199,12 @@ fp_image_device_constructed (GObject *obj)
   if (cls->bz3_threshold > 0)
     priv->bz3_threshold = cls->bz3_threshold;
 
+  /* Zero keeps the first minutiae in detection order, as before. */
+  priv->bz3_max_minutiae = cls->bz3_max_minutiae;
+
+  /* Search the gallery in order unless a driver enables the prefilter. */
+  priv->identify_min_similarity = -1;
+
   G_OBJECT_CLASS (fp_image_device_parent_class)->constructed (obj);
 }
 
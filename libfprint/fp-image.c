@@ -59,9 +59,11 @@ fp_image_finalize (GObject *object)
 {
   FpImage *self = (FpImage *) object;
 
-  g_clear_pointer (&self->data, g_free);
+  g_clear_pointer (&self->data, fpi_image_buffer_unref);
   g_clear_pointer (&self->binarized, g_free);
   g_clear_pointer (&self->minutiae, g_ptr_array_unref);
+  if (self->process_data_destroy)
+    g_clear_pointer (&self->process_data, self->process_data_destroy);
 
   G_OBJECT_CLASS (fp_image_parent_class)->finalize (object);
 }
@@ -71,7 +73,9 @@ fp_image_constructed (GObject *object)
 {
   FpImage *self = (FpImage *) object;
 
-  self->data = g_malloc0 (self->width * self->height);
+  self->data = fpi_image_buffer_new (self->width * self->height);
+  if (self->data)
+    memset (self->data, 0, self->width * self->height);
 }
 
 static void
@@ -165,50 +169,63 @@ typedef struct
   FpiImageFlags       flags;
   guchar             *image;
   guchar             *binarized;
+
+  FpiImageProcessFunc process;
+  gpointer            process_data;
+  GDestroyNotify      process_data_destroy;
 } DetectMinutiaeData;
 
 static void
 fp_image_detect_minutiae_free (DetectMinutiaeData *data)
 {
-  g_clear_pointer (&data->image, g_free);
+  if (data->process_data_destroy)
+    g_clear_pointer (&data->process_data, data->process_data_destroy);
+  g_clear_pointer (&data->image, fpi_image_buffer_unref);
   g_clear_pointer (&data->minutiae, free_minutiae);
   g_clear_pointer (&data->binarized, g_free);
   g_free (data);
 }
 
+/* Moves the detection results into the image */
 static void
-fp_image_detect_minutiae_cb (GObject      *source_object,
-                             GAsyncResult *res,
-                             gpointer      user_data)
+fp_image_apply_detect_result (FpImage *image, DetectMinutiaeData *data)
 {
-  GTask *task = G_TASK (res);
-  FpImage *image;
-  DetectMinutiaeData *data = g_task_get_task_data (task);
+  gint i;
 
-  if (!g_task_had_error (task))
-    {
-      gint i;
-      image = FP_IMAGE (source_object);
+  /* Only known at this point if the image was processed in the task */
+  image->width = data->width;
+  image->height = data->height;
+  image->ppmm = data->ppmm;
+  image->flags = data->flags;
 
-      image->flags = data->flags;
+  g_clear_pointer (&image->data, fpi_image_buffer_unref);
+  image->data = g_steal_pointer (&data->image);
 
-      g_clear_pointer (&image->data, g_free);
-      image->data = g_steal_pointer (&data->image);
+  g_clear_pointer (&image->binarized, g_free);
+  image->binarized = g_steal_pointer (&data->binarized);
 
-      g_clear_pointer (&image->binarized, g_free);
-      image->binarized = g_steal_pointer (&data->binarized);
+  g_clear_pointer (&image->minutiae, g_ptr_array_unref);
+  image->minutiae = g_ptr_array_new_full (data->minutiae->num,
+                                          (GDestroyNotify) free_minutia);
 
-      g_clear_pointer (&image->minutiae, g_ptr_array_unref);
-      image->minutiae = g_ptr_array_new_full (data->minutiae->num,
-                                              (GDestroyNotify) free_minutia);
+  for (i = 0; i < data->minutiae->num; i++)
+    g_ptr_array_add (image->minutiae,
+                     g_steal_pointer (&data->minutiae->list[i]));
 
-      for (i = 0; i < data->minutiae->num; i++)
-        g_ptr_array_add (image->minutiae,
-                         g_steal_pointer (&data->minutiae->list[i]));
+  /* Don't let it delete anything. */
+  data->minutiae->num = 0;
+}
 
-      /* Don't let it delete anything. */
-      data->minutiae->num = 0;
-    }
+static void
+fp_image_detect_minutiae_cb (GObject      *source_object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  GTask *task = G_TASK (res);
+  DetectMinutiaeData *data = g_task_get_task_data (task);
+
+  if (!g_task_had_error (task))
+    fp_image_apply_detect_result (FP_IMAGE (source_object), data);
 
   if (data->user_cb)
     data->user_cb (source_object, res, user_data);
@@ -263,14 +280,43 @@ invert_colors (guint8 *data, gint width, gint height)
     data[i] = 0xff - data[i];
 }
 
+/* Copies the image while normalizing it, used if the data is shared */
 static void
-fp_image_detect_minutiae_thread_func (GTask        *task,
-                                      gpointer      source_object,
-                                      gpointer      task_data,
-                                      GCancellable *cancellable)
+normalize_copy (guint8 *dst, const guint8 *src, gint width, gint height,
+                FpiImageFlags flags)
+{
+  int i, j;
+
+  for (i = 0; i < height; i++)
+    {
+      const guint8 *src_row;
+      guint8 *dst_row = dst + i * width;
+
+      if (flags & FPI_IMAGE_V_FLIPPED)
+        src_row = src + (height - i - 1) * width;
+      else
+        src_row = src + i * width;
+
+      if (flags & FPI_IMAGE_H_FLIPPED)
+        for (j = 0; j < width; j++)
+          dst_row[j] = src_row[width - j - 1];
+      else
+        memcpy (dst_row, src_row, width);
+
+      if (flags & FPI_IMAGE_COLORS_INVERTED)
+        for (j = 0; j < width; j++)
+          dst_row[j] = 0xff - dst_row[j];
+    }
+}
+
+/* Detects the minutiae, @lfsparms is scratch space for the parameters */
+static gboolean
+fp_image_detect_minutiae_run (DetectMinutiaeData *data,
+                              LFSPARMS           *lfsparms,
+                              gint                map_threads,
+                              GError            **error)
 {
   g_autoptr(GTimer) timer = NULL;
-  DetectMinutiaeData *data = task_data;
   struct fp_minutiae *minutiae = NULL;
   g_autofree gint *direction_map = NULL;
   g_autofree gint *low_contrast_map = NULL;
@@ -281,22 +327,35 @@ fp_image_detect_minutiae_thread_func (GTask        *task,
   gint map_w, map_h;
   gint bw, bh, bd;
   gint r;
-  g_autofree LFSPARMS *lfsparms = NULL;
 
-  /* Normalize the image first */
-  if (data->flags & FPI_IMAGE_H_FLIPPED)
-    hflip (data->image, data->width, data->height);
+  /* Normalize the image first, copy on write if the data is shared */
+  if (data->image && fpi_image_buffer_is_shared (data->image) &&
+      (data->flags & (FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED | FPI_IMAGE_COLORS_INVERTED)))
+    {
+      guint8 *normalized = fpi_image_buffer_new (data->width * data->height);
+
+      normalize_copy (normalized, data->image, data->width, data->height, data->flags);
+
+      fpi_image_buffer_unref (data->image);
+      data->image = normalized;
+    }
+  else
+    {
+      if (data->flags & FPI_IMAGE_H_FLIPPED)
+        hflip (data->image, data->width, data->height);
 
-  if (data->flags & FPI_IMAGE_V_FLIPPED)
-    vflip (data->image, data->width, data->height);
+      if (data->flags & FPI_IMAGE_V_FLIPPED)
+        vflip (data->image, data->width, data->height);
 
-  if (data->flags & FPI_IMAGE_COLORS_INVERTED)
-    invert_colors (data->image, data->width, data->height);
+      if (data->flags & FPI_IMAGE_COLORS_INVERTED)
+        invert_colors (data->image, data->width, data->height);
+    }
 
   data->flags &= ~(FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED | FPI_IMAGE_COLORS_INVERTED);
 
-  lfsparms = g_memdup (&g_lfsparms_V2, sizeof (LFSPARMS));
+  *lfsparms = g_lfsparms_V2;
   lfsparms->remove_perimeter_pts = data->flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE;
+  lfsparms->map_threads = map_threads;
 
   timer = g_timer_new ();
   r = get_minutiae (&minutiae, &quality_map, &direction_map,
@@ -313,21 +372,77 @@ fp_image_detect_minutiae_thread_func (GTask        *task,
   if (r)
     {
       fp_err ("get minutiae failed, code %d", r);
-      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Minutiae scan failed with code %d", r);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Minutiae scan failed with code %d", r);
+      return FALSE;
+    }
+
+  if (!data->minutiae || data->minutiae->num == 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "No minutiae found");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+fp_image_detect_minutiae_thread_func (GTask        *task,
+                                      gpointer      source_object,
+                                      gpointer      task_data,
+                                      GCancellable *cancellable)
+{
+  DetectMinutiaeData *data = task_data;
+  g_autofree LFSPARMS *lfsparms = g_new (LFSPARMS, 1);
+  GError *error = NULL;
+
+  if (!fp_image_detect_minutiae_run (data, lfsparms,
+                                     data->flags & FPI_IMAGE_PARALLEL_DETECTION ? g_get_num_processors () : 1,
+                                     &error))
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+static void
+fp_image_process_thread_func (GTask        *task,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  g_autoptr(FpImage) image = NULL;
+  DetectMinutiaeData *data = task_data;
+  GError *error = NULL;
+
+  image = data->process (data->process_data, cancellable, &error);
+
+  /* The raw data is not needed anymore */
+  if (data->process_data_destroy)
+    g_clear_pointer (&data->process_data, data->process_data_destroy);
+
+  if (!image)
+    {
+      g_task_return_error (task, error);
       g_object_unref (task);
       return;
     }
 
-  if (!data->minutiae || data->minutiae->num == 0)
+  if (g_task_return_error_if_cancelled (task))
     {
-      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
-                               "No minutiae found");
       g_object_unref (task);
       return;
     }
 
-  g_task_return_boolean (task, TRUE);
-  g_object_unref (task);
+  /* The image is private to this thread, so the data can be moved */
+  data->image = g_steal_pointer (&image->data);
+  data->flags = image->flags;
+  data->width = image->width;
+  data->height = image->height;
+  data->ppmm = image->ppmm;
+
+  fp_image_detect_minutiae_thread_func (task, source_object, task_data, cancellable);
 }
 
 /**
@@ -447,14 +562,26 @@ fp_image_detect_minutiae (FpImage            *self,
   DetectMinutiaeData *data = g_new0 (DetectMinutiaeData, 1);
 
   task = g_task_new (self, cancellable, fp_image_detect_minutiae_cb, user_data);
+  data->user_cb = callback;
+
+  if (self->process)
+    {
+      /* The image is created from raw data in the worker first */
+      data->process = g_steal_pointer (&self->process);
+      data->process_data = g_steal_pointer (&self->process_data);
+      data->process_data_destroy = g_steal_pointer (&self->process_data_destroy);
+
+      g_task_set_task_data (task, data, (GDestroyNotify) fp_image_detect_minutiae_free);
+      g_task_run_in_thread (task, fp_image_process_thread_func);
+      return;
+    }
 
-  data->image = g_malloc (self->width * self->height);
-  memcpy (data->image, self->data, self->width * self->height);
+  /* The data is only copied if it needs to be normalized */
+  data->image = fpi_image_buffer_ref (self->data);
   data->flags = self->flags;
   data->width = self->width;
   data->height = self->height;
   data->ppmm = self->ppmm;
-  data->user_cb = callback;
 
   g_task_set_task_data (task, data, (GDestroyNotify) fp_image_detect_minutiae_free);
   g_task_run_in_thread (task, fp_image_detect_minutiae_thread_func);
@@ -478,6 +605,295 @@ fp_image_detect_minutiae_finish (FpImage      *self,
   return g_task_propagate_boolean (G_TASK (result), error);
 }
 
+typedef struct
+{
+  GPtrArray            *images;
+  GPtrArray            *items;
+  GPtrArray            *errors;
+  gboolean             *applied;
+  guint                 n_threads;
+  gint                  next;
+  guint                 completed;
+
+  GAsyncReadyCallback   user_cb;
+  FpImageDetectProgress progress_cb;
+  gpointer              progress_data;
+  GDestroyNotify        progress_destroy;
+} DetectBatchData;
+
+typedef struct
+{
+  GTask *task;
+  guint  index;
+} DetectBatchProgress;
+
+static void
+detect_batch_error_free (gpointer error)
+{
+  if (error)
+    g_error_free (error);
+}
+
+static void
+detect_batch_data_free (DetectBatchData *batch)
+{
+  g_ptr_array_unref (batch->images);
+  g_ptr_array_unref (batch->items);
+  g_ptr_array_unref (batch->errors);
+  g_free (batch->applied);
+
+  if (batch->progress_destroy)
+    batch->progress_destroy (batch->progress_data);
+
+  g_free (batch);
+}
+
+static void
+detect_batch_progress_free (DetectBatchProgress *progress)
+{
+  g_object_unref (progress->task);
+  g_free (progress);
+}
+
+/* Called on the main context to move the result into the image */
+static void
+detect_batch_apply (DetectBatchData *batch, guint index)
+{
+  FpImage *image = g_ptr_array_index (batch->images, index);
+  GError *error = g_ptr_array_index (batch->errors, index);
+
+  if (batch->applied[index])
+    return;
+
+  batch->applied[index] = TRUE;
+  batch->completed += 1;
+
+  if (!error)
+    fp_image_apply_detect_result (image, g_ptr_array_index (batch->items, index));
+
+  if (batch->progress_cb)
+    batch->progress_cb (image, batch->completed, batch->images->len,
+                        batch->progress_data, error);
+}
+
+static gboolean
+detect_batch_progress_idle (gpointer user_data)
+{
+  DetectBatchProgress *progress = user_data;
+
+  detect_batch_apply (g_task_get_task_data (progress->task), progress->index);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+detect_batch_worker (gpointer user_data)
+{
+  GTask *task = user_data;
+  DetectBatchData *batch = g_task_get_task_data (task);
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  g_autofree LFSPARMS *lfsparms = g_new (LFSPARMS, 1);
+  LFSTABLES *tables = NULL;
+  gint maxpad;
+  gint i;
+
+  maxpad = get_max_padding_V2 (g_lfsparms_V2.windowsize, g_lfsparms_V2.windowoffset,
+                               g_lfsparms_V2.dirbin_grid_w, g_lfsparms_V2.dirbin_grid_h);
+
+  while ((i = g_atomic_int_add (&batch->next, 1)) < (gint) batch->images->len)
+    {
+      DetectMinutiaeData *data = g_ptr_array_index (batch->items, i);
+      DetectBatchProgress *progress;
+      GSource *source;
+      GError *error = NULL;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+
+      /* Hold on to the lookup tables for the current image width, so that
+       * they are not recomputed even if evicted from the shared cache. */
+      if (!tables || tables->iw != data->width)
+        {
+          g_clear_pointer (&tables, release_lfs_tables);
+          if (get_lfs_tables (&tables, data->width, maxpad, &g_lfsparms_V2))
+            tables = NULL;
+        }
+
+      /* Images are processed concurrently, so use a single thread each */
+      if (!fp_image_detect_minutiae_run (data, lfsparms, 1, &error))
+        g_ptr_array_index (batch->errors, i) = error;
+
+      /* Always go through an idle source, g_main_context_invoke() would
+       * run the callback right here if the worker owns the context. */
+      progress = g_new0 (DetectBatchProgress, 1);
+      progress->task = g_object_ref (task);
+      progress->index = i;
+      source = g_idle_source_new ();
+      g_source_set_priority (source, G_PRIORITY_DEFAULT);
+      g_source_set_callback (source, detect_batch_progress_idle, progress,
+                             (GDestroyNotify) detect_batch_progress_free);
+      g_source_attach (source, g_task_get_context (task));
+      g_source_unref (source);
+    }
+
+  g_clear_pointer (&tables, release_lfs_tables);
+
+  return NULL;
+}
+
+static void
+detect_batch_thread_func (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  DetectBatchData *batch = task_data;
+  g_autoptr(GPtrArray) threads = g_ptr_array_new ();
+  guint i;
+
+  /* The current thread is a worker too */
+  for (i = 1; i < batch->n_threads; i++)
+    {
+      GThread *thread = g_thread_try_new ("fp-detect-batch", detect_batch_worker, task, NULL);
+
+      /* Continue with fewer workers if we cannot create more */
+      if (!thread)
+        break;
+
+      g_ptr_array_add (threads, thread);
+    }
+
+  detect_batch_worker (task);
+
+  for (i = 0; i < threads->len; i++)
+    g_thread_join (g_ptr_array_index (threads, i));
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+static void
+detect_batch_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  GTask *task = G_TASK (res);
+  DetectBatchData *batch = g_task_get_task_data (task);
+  guint i;
+
+  /* Apply the results that have not been reported yet */
+  if (!g_task_had_error (task))
+    for (i = 0; i < batch->images->len; i++)
+      detect_batch_apply (batch, i);
+
+  if (batch->user_cb)
+    batch->user_cb (source_object, res, user_data);
+}
+
+/**
+ * fp_image_detect_minutiae_batch:
+ * @images: (element-type FpImage) (transfer none): The images
+ * @max_threads: The maximum number of worker threads, or 0 to use one
+ *   per processor
+ * @cancellable: a #GCancellable, or %NULL
+ * @progress_cb: (nullable) (scope notified): progress reporting callback
+ * @progress_data: (closure progress_cb): user data for @progress_cb
+ * @progress_destroy: (destroy progress_data): Destroy notify for @progress_data
+ * @callback: the function to call on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Detects the minutiae of many images, like calling
+ * fp_image_detect_minutiae() for each of them. The images are processed
+ * by a bounded number of worker threads, which reuse their scratch data
+ * between images.
+ *
+ * The results are stored in each image as soon as it has been processed,
+ * at which point @progress_cb is called with the image and the error
+ * for it, if any.
+ */
+void
+fp_image_detect_minutiae_batch (GPtrArray            *images,
+                                guint                 max_threads,
+                                GCancellable         *cancellable,
+                                FpImageDetectProgress progress_cb,
+                                gpointer              progress_data,
+                                GDestroyNotify        progress_destroy,
+                                GAsyncReadyCallback   callback,
+                                gpointer              user_data)
+{
+  GTask *task;
+  DetectBatchData *batch;
+  guint i;
+
+  g_return_if_fail (images != NULL);
+
+  batch = g_new0 (DetectBatchData, 1);
+  batch->images = g_ptr_array_new_full (images->len, g_object_unref);
+  batch->items = g_ptr_array_new_full (images->len, (GDestroyNotify) fp_image_detect_minutiae_free);
+  batch->errors = g_ptr_array_new_full (images->len, detect_batch_error_free);
+  batch->applied = g_new0 (gboolean, images->len);
+  batch->user_cb = callback;
+  batch->progress_cb = progress_cb;
+  batch->progress_data = progress_data;
+  batch->progress_destroy = progress_destroy;
+
+  for (i = 0; i < images->len; i++)
+    {
+      FpImage *image = g_ptr_array_index (images, i);
+      DetectMinutiaeData *data = g_new0 (DetectMinutiaeData, 1);
+
+      /* The data is only copied if it needs to be normalized */
+      data->image = fpi_image_buffer_ref (image->data);
+      data->flags = image->flags;
+      data->width = image->width;
+      data->height = image->height;
+      data->ppmm = image->ppmm;
+
+      g_ptr_array_add (batch->images, g_object_ref (image));
+      g_ptr_array_add (batch->items, data);
+      g_ptr_array_add (batch->errors, NULL);
+    }
+
+  if (max_threads == 0)
+    max_threads = g_get_num_processors ();
+  batch->n_threads = CLAMP (images->len, 1, max_threads);
+
+  task = g_task_new (NULL, cancellable, detect_batch_cb, user_data);
+  g_task_set_source_tag (task, fp_image_detect_minutiae_batch);
+  g_task_set_task_data (task, batch, (GDestroyNotify) detect_batch_data_free);
+  g_task_run_in_thread (task, detect_batch_thread_func);
+}
+
+/**
+ * fp_image_detect_minutiae_batch_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Finish minutiae detection of many images. Failing to detect the
+ * minutiae of some of the images is not an error, the result contains
+ * an error for each image that failed and %NULL for every other image.
+ *
+ * Returns: (transfer container) (element-type GError) (nullable): The
+ *   error for each image in the order they were passed, or %NULL on error
+ */
+GPtrArray *
+fp_image_detect_minutiae_batch_finish (GAsyncResult *result,
+                                       GError      **error)
+{
+  DetectBatchData *batch;
+
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  if (!g_task_propagate_boolean (G_TASK (result), error))
+    return NULL;
+
+  batch = g_task_get_task_data (G_TASK (result));
+
+  return g_ptr_array_ref (batch->errors);
+}
+
 /**
  * fp_minutia_get_coords:
  * @min: A #FpMinutia
@@ -47,6 +47,34 @@ gboolean      fp_image_detect_minutiae_finish (FpImage      *self,
                                                GAsyncResult *result,
                                                GError      **error);
 
+/**
+ * FpImageDetectProgress:
+ * @image: (transfer none): The image that has been processed
+ * @completed: Number of images that have been processed
+ * @total: Total number of images
+ * @user_data: (nullable) (transfer none): User provided data
+ * @error: (nullable) (transfer none): #GError or %NULL
+ *
+ * Reports the minutiae detection of one image from a batch. If @error is
+ * %NULL, then the minutiae of @image are available.
+ */
+typedef void (*FpImageDetectProgress) (FpImage  *image,
+                                       guint     completed,
+                                       guint     total,
+                                       gpointer  user_data,
+                                       GError   *error);
+
+void          fp_image_detect_minutiae_batch (GPtrArray            *images,
+                                              guint                 max_threads,
+                                              GCancellable         *cancellable,
+                                              FpImageDetectProgress progress_cb,
+                                              gpointer              progress_data,
+                                              GDestroyNotify        progress_destroy,
+                                              GAsyncReadyCallback   callback,
+                                              gpointer              user_data);
+GPtrArray *   fp_image_detect_minutiae_batch_finish (GAsyncResult *result,
+                                                     GError      **error);
+
 const guchar * fp_image_get_data (FpImage *self,
                                   gsize   *len);
 const guchar * fp_image_get_binarized (FpImage *self,
@@ -43,4 +43,14 @@ struct _FpPrint
 
   GVariant  *data;
   GPtrArray *prints;
+
+  /* Shared backing store of prints loaded from a gallery, see fp-print.c */
+  GBytes    *prints_storage;
+
+  /* Lazily built bozorth3 tables and prefilter descriptors of prints,
+   * see fpi-print.c */
+  GPtrArray *bz3_galleries;
+  GPtrArray *bz3_descriptors;
 };
+
+void fpi_print_clear_bz3_caches (FpPrint *print);
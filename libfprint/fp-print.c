@@ -21,6 +21,8 @@
 #define FP_COMPONENT "print"
 
 #include "fp-print-private.h"
+#include "fpi-byte-reader.h"
+#include "fpi-byte-writer.h"
 #include "fpi-compat.h"
 #include "fpi-log.h"
 
@@ -30,6 +32,11 @@
  * @short_description: Fingerprint handling
  *
  * Interaction with prints and their storage.
+ *
+ * Single prints can be stored using fp_print_serialize(). For large
+ * numbers of prints, e.g. the gallery used for identification, the
+ * compact gallery format written by fp_print_serialize_gallery() is much
+ * faster to load and uses less memory.
  */
 
 /**
@@ -80,6 +87,9 @@ fp_print_finalize (GObject *object)
   g_clear_pointer (&self->enroll_date, g_date_free);
   g_clear_pointer (&self->data, g_variant_unref);
   g_clear_pointer (&self->prints, g_ptr_array_unref);
+  g_clear_pointer (&self->prints_storage, g_bytes_unref);
+  g_clear_pointer (&self->bz3_galleries, g_ptr_array_unref);
+  g_clear_pointer (&self->bz3_descriptors, g_ptr_array_unref);
 
   G_OBJECT_CLASS (fp_print_parent_class)->finalize (object);
 }
@@ -195,7 +205,9 @@ fp_print_set_property (GObject      *object,
 
     case PROP_FPI_PRINTS:
       g_clear_pointer (&self->prints, g_ptr_array_unref);
+      g_clear_pointer (&self->prints_storage, g_bytes_unref);
       self->prints = g_value_get_pointer (value);
+      fpi_print_clear_bz3_caches (self);
       break;
 
     default:
@@ -904,3 +916,562 @@ invalid_format:
                "Data could not be parsed");
   return NULL;
 }
+
+/*
+ * Gallery format, all values are little endian:
+ *
+ *  header:     "FPG", version (u8), n_prints, n_xyt, strings_size,
+ *              minutiae_size, data_size (u32)
+ *  records:    n_prints times
+ *                type, finger, device_stored, reserved (u8),
+ *                driver, device_id, username, description (u32 string
+ *                offset or FPI_GALLERY_NO_STRING),
+ *                enroll date (i32 julian day or G_MININT32),
+ *                NBIS: first xyt, number of xyts (u32)
+ *                RAW:  data offset, data size (u32)
+ *  xyts:       n_xyt times
+ *                minutiae offset (u32), number of minutiae (u16),
+ *                value width in bytes (u8), reserved (u8)
+ *  strings:    NUL terminated strings
+ *  minutiae:   x, y and theta columns of each xyt as int8 or int16
+ *  padding:    to align the data to 8 bytes
+ *  data:       serialized GVariant of type "v" of each RAW print
+ */
+#define FPI_GALLERY_MAGIC "FPG"
+#define FPI_GALLERY_VERSION 1
+#define FPI_GALLERY_HEADER_SIZE 24
+#define FPI_GALLERY_RECORD_SIZE 32
+#define FPI_GALLERY_XYT_SIZE 8
+#define FPI_GALLERY_NO_STRING G_MAXUINT32
+
+typedef struct
+{
+  FpiByteWriter records;
+  FpiByteWriter xyts;
+  FpiByteWriter strings;
+  FpiByteWriter minutiae;
+  FpiByteWriter data;
+  GHashTable   *string_offsets;
+  guint32       n_xyt;
+} GalleryWriter;
+
+static guint32
+gallery_add_string (GalleryWriter *writer, const gchar *str, gboolean *written)
+{
+  gpointer offset;
+
+  if (!str)
+    return FPI_GALLERY_NO_STRING;
+
+  /* Driver and device ID are usually the same for all prints */
+  if (g_hash_table_lookup_extended (writer->string_offsets, str, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (fpi_byte_writer_get_pos (&writer->strings));
+  *written &= fpi_byte_writer_put_string (&writer->strings, str);
+  g_hash_table_insert (writer->string_offsets, (gpointer) str, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static gboolean
+gallery_add_xyt (GalleryWriter *writer, struct xyt_struct *xyt)
+{
+  const gint *cols[] = { xyt->xcol, xyt->ycol, xyt->thetacol };
+  gboolean written = TRUE;
+  guint8 width = 1;
+  guint c;
+  gint i;
+
+  for (c = 0; c < G_N_ELEMENTS (cols); c++)
+    {
+      for (i = 0; i < xyt->nrows; i++)
+        {
+          if (cols[c][i] < G_MININT16 || cols[c][i] > G_MAXINT16)
+            return FALSE;
+          if (cols[c][i] < G_MININT8 || cols[c][i] > G_MAXINT8)
+            width = 2;
+        }
+    }
+
+  written &= fpi_byte_writer_put_uint32_le (&writer->xyts,
+                                            fpi_byte_writer_get_pos (&writer->minutiae));
+  written &= fpi_byte_writer_put_uint16_le (&writer->xyts, xyt->nrows);
+  written &= fpi_byte_writer_put_uint8 (&writer->xyts, width);
+  written &= fpi_byte_writer_put_uint8 (&writer->xyts, 0);
+
+  for (c = 0; c < G_N_ELEMENTS (cols); c++)
+    {
+      for (i = 0; i < xyt->nrows; i++)
+        {
+          if (width == 1)
+            written &= fpi_byte_writer_put_int8 (&writer->minutiae, cols[c][i]);
+          else
+            written &= fpi_byte_writer_put_int16_le (&writer->minutiae, cols[c][i]);
+        }
+    }
+
+  writer->n_xyt += 1;
+
+  return written;
+}
+
+static gboolean
+gallery_add_print (GalleryWriter *writer, FpPrint *print)
+{
+  gboolean written = TRUE;
+  guint32 driver, device_id, username, description;
+  guint32 first, size;
+
+  if (print->type == FPI_PRINT_NBIS)
+    {
+      guint i;
+
+      first = writer->n_xyt;
+      size = print->prints->len;
+
+      for (i = 0; i < print->prints->len; i++)
+        if (!gallery_add_xyt (writer, g_ptr_array_index (print->prints, i)))
+          return FALSE;
+    }
+  else if (print->type == FPI_PRINT_RAW && print->data)
+    {
+      g_autoptr(GVariant) value = NULL;
+
+      value = g_variant_ref_sink (g_variant_new_variant (print->data));
+      if (G_BYTE_ORDER == G_BIG_ENDIAN)
+        {
+          GVariant *tmp;
+          tmp = g_variant_byteswap (value);
+          g_variant_unref (value);
+          value = tmp;
+        }
+
+      /* Align so that the data can be used in place */
+      written &= fpi_byte_writer_fill (&writer->data, 0,
+                                       (8 - fpi_byte_writer_get_pos (&writer->data) % 8) % 8);
+
+      first = fpi_byte_writer_get_pos (&writer->data);
+      size = g_variant_get_size (value);
+      written &= fpi_byte_writer_put_data (&writer->data, g_variant_get_data (value), size);
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  driver = gallery_add_string (writer, print->driver, &written);
+  device_id = gallery_add_string (writer, print->device_id, &written);
+  username = gallery_add_string (writer, print->username, &written);
+  description = gallery_add_string (writer, print->description, &written);
+
+  written &= fpi_byte_writer_put_uint8 (&writer->records, print->type);
+  written &= fpi_byte_writer_put_uint8 (&writer->records, print->finger);
+  written &= fpi_byte_writer_put_uint8 (&writer->records, print->device_stored);
+  written &= fpi_byte_writer_put_uint8 (&writer->records, 0);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, driver);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, device_id);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, username);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, description);
+  if (print->enroll_date && g_date_valid (print->enroll_date))
+    written &= fpi_byte_writer_put_int32_le (&writer->records, g_date_get_julian (print->enroll_date));
+  else
+    written &= fpi_byte_writer_put_int32_le (&writer->records, G_MININT32);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, first);
+  written &= fpi_byte_writer_put_uint32_le (&writer->records, size);
+
+  return written;
+}
+
+static gboolean
+gallery_append (FpiByteWriter *writer, FpiByteWriter *section)
+{
+  if (fpi_byte_writer_get_size (section) == 0)
+    return TRUE;
+
+  return fpi_byte_writer_put_data (writer, section->parent.data,
+                                   fpi_byte_writer_get_size (section));
+}
+
+/**
+ * fp_print_serialize_gallery:
+ * @prints: (element-type FpPrint): The prints to store
+ * @data: (array length=length) (transfer full) (out): Return location for data pointer
+ * @length: (transfer full) (out): Length of @data
+ * @error: Return location for error
+ *
+ * Serialize a number of prints into a single gallery for permanent storage.
+ * Compared to storing each print using fp_print_serialize(), the gallery
+ * format is more compact and can be loaded without copying most of the
+ * data, see fp_print_load_gallery(). As with fp_print_serialize() the
+ * image data is discarded.
+ *
+ * Returns: (type void): %TRUE on success
+ */
+gboolean
+fp_print_serialize_gallery (GPtrArray *prints,
+                            guchar   **data,
+                            gsize     *length,
+                            GError   **error)
+{
+  GalleryWriter writer = { 0, };
+  FpiByteWriter result;
+  gboolean written = TRUE;
+  guint i;
+
+  g_return_val_if_fail (prints, FALSE);
+  g_assert (data);
+  g_assert (length);
+
+  for (i = 0; i < prints->len; i++)
+    g_return_val_if_fail (FP_IS_PRINT (g_ptr_array_index (prints, i)), FALSE);
+
+  *data = NULL;
+  *length = 0;
+
+  fpi_byte_writer_init (&writer.records);
+  fpi_byte_writer_init (&writer.xyts);
+  fpi_byte_writer_init (&writer.strings);
+  fpi_byte_writer_init (&writer.minutiae);
+  fpi_byte_writer_init (&writer.data);
+  writer.string_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < prints->len && written; i++)
+    written = gallery_add_print (&writer, g_ptr_array_index (prints, i));
+
+  if (written)
+    {
+      guint pos;
+
+      fpi_byte_writer_init (&result);
+      written &= fpi_byte_writer_put_data (&result, (const guint8 *) FPI_GALLERY_MAGIC, 3);
+      written &= fpi_byte_writer_put_uint8 (&result, FPI_GALLERY_VERSION);
+      written &= fpi_byte_writer_put_uint32_le (&result, prints->len);
+      written &= fpi_byte_writer_put_uint32_le (&result, writer.n_xyt);
+      written &= fpi_byte_writer_put_uint32_le (&result, fpi_byte_writer_get_size (&writer.strings));
+      written &= fpi_byte_writer_put_uint32_le (&result, fpi_byte_writer_get_size (&writer.minutiae));
+      written &= fpi_byte_writer_put_uint32_le (&result, fpi_byte_writer_get_size (&writer.data));
+      g_assert (!written || fpi_byte_writer_get_size (&result) == FPI_GALLERY_HEADER_SIZE);
+
+      written &= gallery_append (&result, &writer.records);
+      written &= gallery_append (&result, &writer.xyts);
+      written &= gallery_append (&result, &writer.strings);
+      written &= gallery_append (&result, &writer.minutiae);
+      pos = fpi_byte_writer_get_pos (&result);
+      written &= fpi_byte_writer_fill (&result, 0, (8 - pos % 8) % 8);
+      written &= gallery_append (&result, &writer.data);
+
+      *length = fpi_byte_writer_get_size (&result);
+      *data = fpi_byte_writer_reset_and_get_data (&result);
+    }
+
+  fpi_byte_writer_reset (&writer.records);
+  fpi_byte_writer_reset (&writer.xyts);
+  fpi_byte_writer_reset (&writer.strings);
+  fpi_byte_writer_reset (&writer.minutiae);
+  fpi_byte_writer_reset (&writer.data);
+  g_hash_table_unref (writer.string_offsets);
+
+  if (!written)
+    {
+      g_clear_pointer (data, g_free);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Prints could not be stored in a gallery");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gallery_get_string (FpiByteReader *strings, guint32 offset, gchar **str)
+{
+  const gchar *value;
+
+  if (offset == FPI_GALLERY_NO_STRING)
+    return TRUE;
+
+  if (!fpi_byte_reader_set_pos (strings, offset) ||
+      !fpi_byte_reader_get_string (strings, &value))
+    return FALSE;
+
+  *str = g_strdup (value);
+
+  return TRUE;
+}
+
+static gboolean
+gallery_get_xyt (FpiByteReader *xyts, FpiByteReader *minutiae, struct xyt_struct *xyt)
+{
+  gint *cols[] = { xyt->xcol, xyt->ycol, xyt->thetacol };
+  gboolean read_ok = TRUE;
+  guint32 offset;
+  guint16 nrows;
+  guint8 width;
+  guint c, i;
+
+  read_ok &= fpi_byte_reader_get_uint32_le (xyts, &offset);
+  read_ok &= fpi_byte_reader_get_uint16_le (xyts, &nrows);
+  read_ok &= fpi_byte_reader_get_uint8 (xyts, &width);
+  read_ok &= fpi_byte_reader_skip (xyts, 1);
+
+  if (!read_ok || nrows > G_N_ELEMENTS (xyt->xcol) || (width != 1 && width != 2))
+    return FALSE;
+
+  if (!fpi_byte_reader_set_pos (minutiae, offset))
+    return FALSE;
+
+  xyt->nrows = nrows;
+  for (c = 0; c < G_N_ELEMENTS (cols); c++)
+    {
+      for (i = 0; i < nrows; i++)
+        {
+          if (width == 1)
+            {
+              gint8 val;
+              read_ok &= fpi_byte_reader_get_int8 (minutiae, &val);
+              cols[c][i] = val;
+            }
+          else
+            {
+              gint16 val;
+              read_ok &= fpi_byte_reader_get_int16_le (minutiae, &val);
+              cols[c][i] = val;
+            }
+        }
+    }
+
+  return read_ok;
+}
+
+/**
+ * fp_print_deserialize_gallery:
+ * @data: The binary data
+ * @error: Return location for error
+ *
+ * Deserialize a gallery written by fp_print_serialize_gallery(). For
+ * convenience, data written by fp_print_serialize() is accepted too and
+ * results in a gallery containing a single print.
+ *
+ * The minutiae of all prints are stored in a single shared allocation.
+ * Other than that, @data may be referenced by the returned prints, so
+ * it must not be modified afterwards.
+ *
+ * Returns: (transfer full) (element-type FpPrint): The prints of the
+ *   gallery, or %NULL on error
+ */
+GPtrArray *
+fp_print_deserialize_gallery (GBytes  *data,
+                              GError **error)
+{
+  g_autoptr(GPtrArray) result = NULL;
+  g_autoptr(GBytes) prints_storage = NULL;
+  struct xyt_struct *xyt_slab = NULL;
+  FpiByteReader reader, records, xyts, strings, minutiae;
+  const guint8 *buf;
+  gsize length;
+  guint8 version;
+  guint32 n_prints, n_xyt, strings_size, minutiae_size, data_size;
+  guint data_offset;
+  gboolean read_ok = TRUE;
+  guint i;
+
+  g_return_val_if_fail (data, NULL);
+
+  buf = g_bytes_get_data (data, &length);
+
+  if (length > 3 && memcmp (buf, "FP3", 3) == 0)
+    {
+      FpPrint *print = fp_print_deserialize (buf, length, error);
+
+      if (!print)
+        return NULL;
+
+      result = g_ptr_array_new_with_free_func (g_object_unref);
+      g_ptr_array_add (result, print);
+
+      return g_steal_pointer (&result);
+    }
+
+  if (length < FPI_GALLERY_HEADER_SIZE || length > G_MAXUINT ||
+      memcmp (buf, FPI_GALLERY_MAGIC, 3) != 0)
+    goto invalid_format;
+
+  fpi_byte_reader_init (&reader, buf, length);
+  read_ok &= fpi_byte_reader_skip (&reader, 3);
+  read_ok &= fpi_byte_reader_get_uint8 (&reader, &version);
+  read_ok &= fpi_byte_reader_get_uint32_le (&reader, &n_prints);
+  read_ok &= fpi_byte_reader_get_uint32_le (&reader, &n_xyt);
+  read_ok &= fpi_byte_reader_get_uint32_le (&reader, &strings_size);
+  read_ok &= fpi_byte_reader_get_uint32_le (&reader, &minutiae_size);
+  read_ok &= fpi_byte_reader_get_uint32_le (&reader, &data_size);
+
+  if (!read_ok)
+    goto invalid_format;
+
+  if (version != FPI_GALLERY_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Unsupported gallery version %d", version);
+      return NULL;
+    }
+
+  /* Ensure the sizes are sane before allocating anything */
+  if (n_prints > length / FPI_GALLERY_RECORD_SIZE || n_xyt > length / FPI_GALLERY_XYT_SIZE)
+    goto invalid_format;
+
+  read_ok &= fpi_byte_reader_get_sub_reader (&reader, &records, n_prints * FPI_GALLERY_RECORD_SIZE);
+  read_ok &= fpi_byte_reader_get_sub_reader (&reader, &xyts, n_xyt * FPI_GALLERY_XYT_SIZE);
+  read_ok &= fpi_byte_reader_get_sub_reader (&reader, &strings, strings_size);
+  read_ok &= fpi_byte_reader_get_sub_reader (&reader, &minutiae, minutiae_size);
+  read_ok &= fpi_byte_reader_skip (&reader, (8 - fpi_byte_reader_get_pos (&reader) % 8) % 8);
+  data_offset = fpi_byte_reader_get_pos (&reader);
+  read_ok &= fpi_byte_reader_skip (&reader, data_size);
+
+  if (!read_ok)
+    goto invalid_format;
+
+  /* A single allocation for all minutiae, referenced by each print */
+  if (n_xyt > 0)
+    {
+      xyt_slab = g_new0 (struct xyt_struct, n_xyt);
+      prints_storage = g_bytes_new_take (xyt_slab, n_xyt * sizeof (struct xyt_struct));
+    }
+
+  for (i = 0; i < n_xyt; i++)
+    if (!gallery_get_xyt (&xyts, &minutiae, &xyt_slab[i]))
+      goto invalid_format;
+
+  result = g_ptr_array_new_full (n_prints, g_object_unref);
+  for (i = 0; i < n_prints; i++)
+    {
+      FpPrint *print;
+      guint8 type, finger, device_stored;
+      guint32 driver, device_id, username, description;
+      gint32 julian_date;
+      guint32 first, size;
+
+      read_ok &= fpi_byte_reader_get_uint8 (&records, &type);
+      read_ok &= fpi_byte_reader_get_uint8 (&records, &finger);
+      read_ok &= fpi_byte_reader_get_uint8 (&records, &device_stored);
+      read_ok &= fpi_byte_reader_skip (&records, 1);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &driver);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &device_id);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &username);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &description);
+      read_ok &= fpi_byte_reader_get_int32_le (&records, &julian_date);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &first);
+      read_ok &= fpi_byte_reader_get_uint32_le (&records, &size);
+
+      if (!read_ok)
+        goto invalid_format;
+
+      print = g_object_ref_sink (g_object_new (FP_TYPE_PRINT, NULL));
+      g_ptr_array_add (result, print);
+
+      /* Set the fields directly, this is much cheaper than property
+       * notifications when loading large galleries. */
+      print->finger = finger;
+      print->device_stored = !!device_stored;
+      read_ok &= gallery_get_string (&strings, driver, &print->driver);
+      read_ok &= gallery_get_string (&strings, device_id, &print->device_id);
+      read_ok &= gallery_get_string (&strings, username, &print->username);
+      read_ok &= gallery_get_string (&strings, description, &print->description);
+
+      if (julian_date > 0 && g_date_valid_julian (julian_date))
+        print->enroll_date = g_date_new_julian (julian_date);
+
+      if (!read_ok)
+        goto invalid_format;
+
+      if (type == FPI_PRINT_NBIS)
+        {
+          guint j;
+
+          if ((guint64) first + size > n_xyt)
+            goto invalid_format;
+
+          print->type = FPI_PRINT_NBIS;
+          print->prints = g_ptr_array_sized_new (size);
+          for (j = 0; j < size; j++)
+            g_ptr_array_add (print->prints, &xyt_slab[first + j]);
+
+          if (size > 0)
+            print->prints_storage = g_bytes_ref (prints_storage);
+        }
+      else if (type == FPI_PRINT_RAW)
+        {
+          g_autoptr(GBytes) variant_data = NULL;
+          g_autoptr(GVariant) value = NULL;
+
+          if (first % 8 != 0 || (guint64) first + size > data_size)
+            goto invalid_format;
+
+          variant_data = g_bytes_new_from_bytes (data, data_offset + first, size);
+
+          /* The variant data can only be used in place if it is aligned */
+          if (GPOINTER_TO_SIZE (g_bytes_get_data (variant_data, NULL)) % 8 != 0)
+            {
+              g_autoptr(GBytes) unaligned = g_steal_pointer (&variant_data);
+
+              variant_data = g_bytes_new (g_bytes_get_data (unaligned, NULL), size);
+            }
+
+          value = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARIANT,
+                                                                variant_data,
+                                                                FALSE));
+          if (G_BYTE_ORDER == G_BIG_ENDIAN)
+            {
+              GVariant *tmp;
+              tmp = g_variant_byteswap (value);
+              g_variant_unref (value);
+              value = tmp;
+            }
+
+          print->type = FPI_PRINT_RAW;
+          print->data = g_variant_get_variant (value);
+        }
+      else
+        {
+          g_warning ("Invalid print type: 0x%X", type);
+          goto invalid_format;
+        }
+    }
+
+  return g_steal_pointer (&result);
+
+invalid_format:
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               "Data could not be parsed");
+  return NULL;
+}
+
+/**
+ * fp_print_load_gallery:
+ * @filename: The file to load
+ * @error: Return location for error
+ *
+ * Loads a gallery written by fp_print_serialize_gallery() from a file. The
+ * file is mapped into memory, so that the data of raw prints does not need
+ * to be copied. See fp_print_deserialize_gallery().
+ *
+ * Returns: (transfer full) (element-type FpPrint): The prints of the
+ *   gallery, or %NULL on error
+ */
+GPtrArray *
+fp_print_load_gallery (const gchar *filename,
+                       GError     **error)
+{
+  g_autoptr(GMappedFile) file = NULL;
+  g_autoptr(GBytes) data = NULL;
+
+  g_return_val_if_fail (filename, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (!file)
+    return NULL;
+
+  data = g_mapped_file_get_bytes (file);
+
+  return fp_print_deserialize_gallery (data, error);
+}
@@ -113,4 +113,15 @@ FpPrint *fp_print_deserialize (const guchar *data,
                                gsize         length,
                                GError      **error);
 
+gboolean fp_print_serialize_gallery (GPtrArray *prints,
+                                     guchar   **data,
+                                     gsize     *length,
+                                     GError   **error);
+
+GPtrArray *fp_print_deserialize_gallery (GBytes  *data,
+                                         GError **error);
+
+GPtrArray *fp_print_load_gallery (const gchar *filename,
+                                  GError     **error);
+
 G_END_DECLS
@@ -26,6 +26,10 @@
 
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "fpi-assembling.h"
 
 /**
@@ -39,6 +43,23 @@
  * data in small stripes.
  */
 
+/* Scales the error of the overlapping part of two frames up to the full
+ * frame size. The multiplication overflows for frames of more than about
+ * 4100 pixels, e.g. those of elan sensors. The movement estimated for the
+ * recorded captures depends on this, so it is kept as is.
+ */
+static inline unsigned int
+normalize_error (struct fpi_frame_asmbl_ctx *ctx,
+                 unsigned int                err,
+                 unsigned int                width,
+                 unsigned int                height)
+{
+  err *= (ctx->frame_height * ctx->frame_width);
+  err /= (height * width);
+
+  return err;
+}
+
 static unsigned int
 calc_error (struct fpi_frame_asmbl_ctx *ctx,
             struct fpi_frame           *first_frame,
@@ -86,12 +107,187 @@ calc_error (struct fpi_frame_asmbl_ctx *ctx,
   while (i < height);
 
   /* Normalize error */
-  err *= (ctx->frame_height * ctx->frame_width);
-  err /= (height * width);
+  return normalize_error (ctx, err, width, height);
+}
+
+static inline unsigned int
+sad_row (const unsigned char *row1,
+         const unsigned char *row2,
+         unsigned int         width)
+{
+  unsigned int err = 0;
+  unsigned int x = 0;
+
+#ifdef __SSE2__
+  __m128i sum = _mm_setzero_si128 ();
+
+  for (; x + 16 <= width; x += 16)
+    {
+      __m128i v1 = _mm_loadu_si128 ((const __m128i *) (row1 + x));
+      __m128i v2 = _mm_loadu_si128 ((const __m128i *) (row2 + x));
+
+      sum = _mm_add_epi64 (sum, _mm_sad_epu8 (v1, v2));
+    }
+  err = _mm_cvtsi128_si32 (sum) +
+        _mm_cvtsi128_si32 (_mm_unpackhi_epi64 (sum, sum));
+#endif
+
+  for (; x < width; x++)
+    err += row1[x] > row2[x] ? row1[x] - row2[x] : row2[x] - row1[x];
 
   return err;
 }
 
+/* Same as calc_error(), but for linear frames and only looking at every
+ * @step-th line. Returns G_MAXUINT as soon as the error is known to be
+ * larger than @max_error, unless @max_error is G_MAXUINT.
+ */
+static unsigned int
+calc_error_linear (struct fpi_frame_asmbl_ctx *ctx,
+                   struct fpi_frame           *first_frame,
+                   struct fpi_frame           *second_frame,
+                   int                         dx,
+                   int                         dy,
+                   unsigned int                step,
+                   unsigned int                max_error)
+{
+  const unsigned char *row1, *row2;
+  unsigned int width, height, lines, i;
+  guint64 frame_size, limit;
+  guint64 err = 0;
+
+  width = ctx->frame_width - (dx > 0 ? dx : -dx);
+  height = ctx->frame_height - dy;
+
+  if (height == 0 || width == 0)
+    return G_MAXUINT;
+
+  row1 = first_frame->data + (dx < 0 ? 0 : dx);
+  row2 = second_frame->data + dy * ctx->frame_width + (dx < 0 ? -dx : 0);
+  lines = (height + step - 1) / step;
+
+  /* The normalized error is larger than max_error once err * frame_size
+   * reaches limit. */
+  frame_size = (guint64) ctx->frame_height * ctx->frame_width;
+  limit = ((guint64) max_error + 1) * lines * width;
+
+  for (i = 0; i < height; i += step)
+    {
+      err += sad_row (row1, row2, width);
+      if (max_error != G_MAXUINT && err * frame_size >= limit)
+        return G_MAXUINT;
+
+      row1 += step * ctx->frame_width;
+      row2 += step * ctx->frame_width;
+    }
+
+  return normalize_error (ctx, err, width, lines);
+}
+
+/* Same search as find_overlap(), but a lot faster for linear frames.
+ *
+ * A coarse search only looking at every other line first finds a
+ * candidate that is usually the best match or close to it. The full
+ * search then gives up on each candidate as soon as it is known to be
+ * worse than the best match so far, so most of them only need to look
+ * at a few lines. Ties are resolved in favour of the candidate that
+ * find_overlap() checks first, so the result is exactly the same.
+ */
+static void
+find_overlap_linear (struct fpi_frame_asmbl_ctx *ctx,
+                     struct fpi_frame           *first_frame,
+                     struct fpi_frame           *second_frame,
+                     int                        *dx_out,
+                     int                        *dy_out,
+                     unsigned int               *min_error)
+{
+  unsigned int coarse_min_error = G_MAXUINT;
+  int n_candidates, coarse_best = 0;
+  guint64 frame_size;
+  int best = -1;
+  int i;
+
+  *min_error = 255 * ctx->frame_height * ctx->frame_width;
+
+  if (ctx->frame_height <= 2)
+    return;
+
+  /* Candidates are numbered in the order find_overlap() checks them */
+  n_candidates = (ctx->frame_height - 2) * 16;
+
+  /* Skipping candidates early relies on the normalized error growing with
+   * the error of the overlap, which is not the case once normalize_error()
+   * overflows. Check all candidates fully for such frames.
+   */
+  frame_size = (guint64) ctx->frame_height * ctx->frame_width;
+  if (255 * frame_size * frame_size > G_MAXUINT)
+    {
+      for (i = 0; i < n_candidates; i++)
+        {
+          unsigned int err;
+          int dx, dy;
+
+          dx = i % 16 - 8;
+          dy = 2 + i / 16;
+          err = calc_error_linear (ctx, first_frame, second_frame,
+                                   dx, dy, 1, G_MAXUINT);
+          if (err < *min_error)
+            {
+              *min_error = err;
+              *dx_out = -dx;
+              *dy_out = dy;
+            }
+        }
+
+      return;
+    }
+
+  for (i = 0; i < n_candidates; i++)
+    {
+      unsigned int err;
+
+      err = calc_error_linear (ctx, first_frame, second_frame,
+                               i % 16 - 8, 2 + i / 16, 2,
+                               coarse_min_error == G_MAXUINT ? G_MAXUINT : coarse_min_error - 1);
+      if (err < coarse_min_error)
+        {
+          coarse_min_error = err;
+          coarse_best = i;
+        }
+    }
+
+  /* Start the full search with the best coarse candidate */
+  for (i = -1; i < n_candidates; i++)
+    {
+      int candidate = i < 0 ? coarse_best : i;
+      unsigned int max_error, err;
+      int dx, dy;
+
+      if (i == coarse_best)
+        continue;
+
+      /* Candidates checked later by find_overlap() need to be better */
+      if (candidate < best)
+        max_error = *min_error;
+      else if (*min_error > 0)
+        max_error = *min_error - 1;
+      else
+        break;
+
+      dx = candidate % 16 - 8;
+      dy = 2 + candidate / 16;
+      err = calc_error_linear (ctx, first_frame, second_frame,
+                               dx, dy, 1, max_error);
+      if (err < *min_error || (err == *min_error && candidate < best))
+        {
+          *min_error = err;
+          *dx_out = -dx;
+          *dy_out = dy;
+          best = candidate;
+        }
+    }
+}
+
 /* This function is rather CPU-intensive. It's better to use hardware
  * to detect movement direction when possible.
  */
@@ -106,6 +302,13 @@ find_overlap (struct fpi_frame_asmbl_ctx *ctx,
   int dx, dy;
   unsigned int err;
 
+  if (ctx->linear_frames)
+    {
+      find_overlap_linear (ctx, first_frame, second_frame,
+                           dx_out, dy_out, min_error);
+      return;
+    }
+
   *min_error = 255 * ctx->frame_height * ctx->frame_width;
 
   /* Seeking in horizontal and vertical dimensions,
@@ -312,6 +515,278 @@ fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
   return img;
 }
 
+/* The swipe direction is only known once all frames were captured, so the
+ * assembler keeps a candidate image for either direction. The image for
+ * a swipe in reverse direction is stored upside down, so that both only
+ * ever grow at the bottom.
+ */
+typedef struct
+{
+  guchar            *data;
+  guint              n_rows;
+  guint              height;
+  int                x;
+  int                y;
+  unsigned long long total_error;
+} FrameCanvas;
+
+struct _FpiFrameAssembler
+{
+  struct fpi_frame_asmbl_ctx *ctx;
+  struct fpi_frame           *prev_frame;
+  guint                       n_frames;
+  FrameCanvas                 forward;
+  FrameCanvas                 reverse;
+};
+
+/**
+ * fpi_frame_assembler_new:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ *
+ * Creates an assembler which estimates the movement and assembles the
+ * frames while they are being captured, see fpi_frame_assembler_add_frame().
+ * The result is the same as calling fpi_do_movement_estimation() and
+ * fpi_assemble_frames() on the list of all frames, but the frames do not
+ * need to be kept in memory, and only little work is left once the finger
+ * was removed.
+ *
+ * @ctx must stay valid for the lifetime of the assembler.
+ *
+ * Returns: (transfer full): a new #FpiFrameAssembler
+ */
+FpiFrameAssembler *
+fpi_frame_assembler_new (struct fpi_frame_asmbl_ctx *ctx)
+{
+  FpiFrameAssembler *assembler;
+
+  g_return_val_if_fail (ctx != NULL, NULL);
+  g_return_val_if_fail (ctx->get_pixel != NULL, NULL);
+
+  assembler = g_new0 (FpiFrameAssembler, 1);
+  assembler->ctx = ctx;
+
+  return assembler;
+}
+
+/**
+ * fpi_frame_assembler_free:
+ * @assembler: a #FpiFrameAssembler
+ *
+ * Frees @assembler, including any frames that were added and not yet
+ * assembled into an image.
+ */
+void
+fpi_frame_assembler_free (FpiFrameAssembler *assembler)
+{
+  if (assembler == NULL)
+    return;
+
+  g_free (assembler->prev_frame);
+  g_free (assembler->forward.data);
+  g_free (assembler->reverse.data);
+  g_free (assembler);
+}
+
+/**
+ * fpi_frame_assembler_reset:
+ * @assembler: a #FpiFrameAssembler
+ *
+ * Drops all frames that were added, so that the assembler can be used for
+ * the next capture. The buffers are kept for reuse.
+ */
+void
+fpi_frame_assembler_reset (FpiFrameAssembler *assembler)
+{
+  g_return_if_fail (assembler != NULL);
+
+  g_clear_pointer (&assembler->prev_frame, g_free);
+  assembler->n_frames = 0;
+
+  /* The unused parts of the image need to be blank */
+  if (assembler->forward.height > 0)
+    memset (assembler->forward.data, 0,
+            (gsize) assembler->forward.height * assembler->ctx->image_width);
+  if (assembler->reverse.height > 0)
+    memset (assembler->reverse.data, 0,
+            (gsize) assembler->reverse.height * assembler->ctx->image_width);
+
+  assembler->forward.height = 0;
+  assembler->forward.total_error = 0;
+  assembler->reverse.height = 0;
+  assembler->reverse.total_error = 0;
+}
+
+static void
+frame_canvas_blit (struct fpi_frame_asmbl_ctx *ctx,
+                   FrameCanvas                *canvas,
+                   struct fpi_frame           *frame,
+                   gboolean                    upside_down)
+{
+  unsigned int ix1, fx1;
+  unsigned int fx, fy, ix;
+  guint height = canvas->y + ctx->frame_height;
+
+  if (height > canvas->n_rows)
+    {
+      guint n_rows = MAX (height, canvas->n_rows * 2);
+
+      canvas->data = g_realloc (canvas->data, (gsize) n_rows * ctx->image_width);
+      memset (canvas->data + (gsize) canvas->n_rows * ctx->image_width, 0,
+              (gsize) (n_rows - canvas->n_rows) * ctx->image_width);
+      canvas->n_rows = n_rows;
+    }
+  canvas->height = MAX (canvas->height, height);
+
+  /* Select starting point inside image and frame, as in aes_blit_stripe */
+  if (canvas->x < 0)
+    {
+      ix1 = 0;
+      fx1 = -canvas->x;
+    }
+  else
+    {
+      ix1 = canvas->x;
+      fx1 = 0;
+    }
+
+  for (fy = 0; fy < ctx->frame_height; fy++)
+    {
+      guint iy = canvas->y + (upside_down ? ctx->frame_height - 1 - fy : fy);
+      guchar *row = canvas->data + (gsize) iy * ctx->image_width;
+
+      for (fx = fx1, ix = ix1; fx < ctx->frame_width && ix < ctx->image_width; fx++, ix++)
+        row[ix] = ctx->get_pixel (ctx, frame, fx, fy);
+    }
+}
+
+/**
+ * fpi_frame_assembler_add_frame:
+ * @assembler: a #FpiFrameAssembler
+ * @frame: (transfer full): the next #fpi_frame, allocated using g_malloc()
+ *
+ * Estimates the movement of @frame relative to the previously added frame
+ * and adds it to the image. The @delta_x and @delta_y values of @frame are
+ * ignored.
+ *
+ * The assembler takes ownership of @frame, which is freed once the next
+ * frame was added.
+ */
+void
+fpi_frame_assembler_add_frame (FpiFrameAssembler *assembler,
+                               struct fpi_frame  *frame)
+{
+  struct fpi_frame_asmbl_ctx *ctx;
+  unsigned int min_error;
+  int dx, dy;
+
+  g_return_if_fail (assembler != NULL);
+  g_return_if_fail (frame != NULL);
+
+  ctx = assembler->ctx;
+
+  if (assembler->n_frames == 0)
+    {
+      assembler->forward.x = ((int) ctx->image_width - (int) ctx->frame_width) / 2;
+      assembler->forward.y = 0;
+      assembler->reverse.x = assembler->forward.x;
+      assembler->reverse.y = 0;
+    }
+  else
+    {
+      /* Same estimation as do_movement_estimation() for both directions */
+      dx = dy = 0;
+      find_overlap (ctx, frame, assembler->prev_frame, &dx, &dy, &min_error);
+      assembler->forward.x += dx;
+      assembler->forward.y += dy;
+      assembler->forward.total_error += min_error;
+
+      dx = dy = 0;
+      find_overlap (ctx, assembler->prev_frame, frame, &dx, &dy, &min_error);
+      assembler->reverse.x -= dx;
+      assembler->reverse.y += dy;
+      assembler->reverse.total_error += min_error;
+    }
+
+  frame_canvas_blit (ctx, &assembler->forward, frame, FALSE);
+  frame_canvas_blit (ctx, &assembler->reverse, frame, TRUE);
+
+  g_free (assembler->prev_frame);
+  assembler->prev_frame = frame;
+  assembler->n_frames++;
+}
+
+/**
+ * fpi_frame_assembler_get_n_frames:
+ * @assembler: a #FpiFrameAssembler
+ *
+ * Returns: the number of frames added since the last reset.
+ */
+guint
+fpi_frame_assembler_get_n_frames (FpiFrameAssembler *assembler)
+{
+  g_return_val_if_fail (assembler != NULL, 0);
+
+  return assembler->n_frames;
+}
+
+/**
+ * fpi_frame_assembler_finish:
+ * @assembler: a #FpiFrameAssembler
+ *
+ * Picks the more likely swipe direction and returns the assembled image.
+ * The assembler is reset afterwards and can be used for the next capture.
+ * At least one frame needs to have been added.
+ *
+ * Returns: (transfer full): a newly allocated #FpImage.
+ */
+FpImage *
+fpi_frame_assembler_finish (FpiFrameAssembler *assembler)
+{
+  struct fpi_frame_asmbl_ctx *ctx;
+  FrameCanvas *canvas;
+  FpImage *img;
+  guint err, rev_err;
+  gboolean reverse;
+  guint y;
+
+  g_return_val_if_fail (assembler != NULL, NULL);
+  g_return_val_if_fail (assembler->n_frames > 0, NULL);
+
+  ctx = assembler->ctx;
+
+  err = assembler->forward.total_error / assembler->n_frames;
+  rev_err = assembler->reverse.total_error / assembler->n_frames;
+  fp_dbg ("errors: %d rev: %d", err, rev_err);
+
+  /* fpi_do_movement_estimation() prefers the reverse direction on ties */
+  reverse = assembler->n_frames > 1 && err >= rev_err;
+  canvas = reverse ? &assembler->reverse : &assembler->forward;
+
+  fp_dbg ("height is %d", canvas->height);
+
+  img = fp_image_new (ctx->image_width, canvas->height);
+  img->flags = FPI_IMAGE_COLORS_INVERTED;
+  img->flags |= reverse ? 0 :  FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED;
+  img->width = ctx->image_width;
+  img->height = canvas->height;
+
+  if (reverse)
+    {
+      for (y = 0; y < canvas->height; y++)
+        memcpy (img->data + (gsize) y * ctx->image_width,
+                canvas->data + (gsize) (canvas->height - 1 - y) * ctx->image_width,
+                ctx->image_width);
+    }
+  else
+    {
+      memcpy (img->data, canvas->data, (gsize) canvas->height * ctx->image_width);
+    }
+
+  fpi_frame_assembler_reset (assembler);
+
+  return img;
+}
+
 static int
 cmpint (const void *p1, const void *p2, gpointer data)
 {
@@ -44,6 +44,7 @@ struct fpi_frame
  * @frame_height: height of the frame
  * @image_width: resulting image width
  * @get_pixel: pixel accessor, returns pixel brightness at x,y of frame
+ * @linear_frames: whether the frame data is a plain 8-bit bitmap
  *
  * #fpi_frame_asmbl_ctx is a structure holding the context for frame
  * assembling routines.
@@ -51,6 +52,11 @@ struct fpi_frame
  * Drivers should define their own #fpi_frame_asmbl_ctx depending on
  * hardware parameters of scanner. @image_width is usually 25% wider than
  * @frame_width to take horizontal movement into account.
+ *
+ * Drivers should set @linear_frames if @data of each #fpi_frame holds
+ * @frame_width * @frame_height bytes in row-major order, so that @get_pixel
+ * returns `data[x + y * frame_width]`. This allows the movement estimation
+ * to access the data directly, which is a lot faster.
  */
 struct fpi_frame_asmbl_ctx
 {
@@ -61,6 +67,7 @@ struct fpi_frame_asmbl_ctx
                              struct fpi_frame           *frame,
                              unsigned int                x,
                              unsigned int                y);
+  gboolean      linear_frames;
 };
 
 void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
@@ -69,6 +76,24 @@ void fpi_do_movement_estimation (struct fpi_frame_asmbl_ctx *ctx,
 FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
                               GSList                     *stripes);
 
+/**
+ * FpiFrameAssembler:
+ *
+ * An opaque structure used to assemble frames of swipe sensors while
+ * they are being captured. See fpi_frame_assembler_new().
+ */
+typedef struct _FpiFrameAssembler FpiFrameAssembler;
+
+FpiFrameAssembler *fpi_frame_assembler_new (struct fpi_frame_asmbl_ctx *ctx);
+void fpi_frame_assembler_free (FpiFrameAssembler *assembler);
+void fpi_frame_assembler_add_frame (FpiFrameAssembler *assembler,
+                                    struct fpi_frame  *frame);
+guint fpi_frame_assembler_get_n_frames (FpiFrameAssembler *assembler);
+FpImage *fpi_frame_assembler_finish (FpiFrameAssembler *assembler);
+void fpi_frame_assembler_reset (FpiFrameAssembler *assembler);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiFrameAssembler, fpi_frame_assembler_free)
+
 /**
  * fpi_line_asmbl_ctx:
  * @line_width: width of line
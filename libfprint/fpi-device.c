@@ -38,6 +38,28 @@
  * case.
  *
  * Also see the public #FpDevice routines.
+ *
+ * # Threading
+ *
+ * By default all driver code runs in the #GMainContext that the API user
+ * started the current operation from. If #FpDevice:driver-thread is set,
+ * the device instead gets a dedicated thread with its own #GMainContext
+ * and every vfunc, timeout and cancellation is dispatched there. Drivers
+ * must work in both cases, which means:
+ *
+ *  - All sources need to be attached to the thread-default main context,
+ *    preferably through fpi_device_add_timeout(). Never use g_idle_add(),
+ *    g_timeout_add() or the global default context.
+ *  - Asynchronous operations (USB transfers, SPI transfers, #FpiSsm) pick
+ *    up the thread-default main context when they are started and need no
+ *    special handling.
+ *  - Completion, progress and match reports as well as property
+ *    notifications are delivered to the API user in its own context. The
+ *    driver must not assume that the API user has seen them when the
+ *    report function returns.
+ *  - After reporting completion of an action, the driver must not touch
+ *    the action state again, as the API user may already be starting the
+ *    next action.
  */
 
 /* Manually redefine what G_DEFINE_* macro does */
@@ -50,6 +72,158 @@ fp_device_get_instance_private (FpDevice *self)
                             g_type_class_get_instance_private_offset (dev_class));
 }
 
+/* The context that driver code runs in. This is the context of the driver
+ * thread if #FpDevice:driver-thread is set and otherwise the one of the
+ * current operation. %NULL means the global default context. */
+GMainContext *
+fpi_device_get_driver_context (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (priv->driver_context)
+    return priv->driver_context;
+
+  if (priv->current_task)
+    return g_task_get_context (priv->current_task);
+
+  return g_main_context_get_thread_default ();
+}
+
+/* Whether the device has a driver thread and we are running in it. */
+gboolean
+fpi_device_in_driver_thread (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  return priv->driver_thread && priv->driver_thread == g_thread_self ();
+}
+
+/* The context of the API user, which is where results are delivered. */
+static GMainContext *
+fpi_device_get_caller_context (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  GMainContext *context = NULL;
+
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_task)
+    context = g_task_get_context (priv->current_task);
+  g_mutex_unlock (&priv->action_lock);
+
+  if (context)
+    return context;
+
+  if (priv->driver_context)
+    return priv->caller_context;
+
+  return g_main_context_get_thread_default ();
+}
+
+/* Install the task of an operation that is about to be started. */
+void
+fpi_device_set_current_task (FpDevice       *device,
+                             FpiDeviceAction action,
+                             GTask          *task)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_mutex_lock (&priv->action_lock);
+  g_assert (priv->current_task == NULL);
+  priv->current_action = action;
+  priv->current_task = task;
+  g_mutex_unlock (&priv->action_lock);
+}
+
+/* The API user drops the cancellable when the operation completes, which
+ * may happen while the driver thread still looks at it. */
+static GCancellable *
+fpi_device_ref_current_cancellable (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  GCancellable *cancellable = NULL;
+
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_cancellable)
+    cancellable = g_object_ref (priv->current_cancellable);
+  g_mutex_unlock (&priv->action_lock);
+
+  return cancellable;
+}
+
+typedef struct
+{
+  FpDevice    *device;
+  GTask       *task;
+  const gchar *property_name;
+  gint         completed_stages;
+  FpPrint     *print;
+  GError      *error;
+} FpDeviceCallerData;
+
+static void
+caller_data_free (FpDeviceCallerData *data)
+{
+  g_clear_object (&data->task);
+  g_clear_object (&data->print);
+  g_clear_error (&data->error);
+  g_object_unref (data->device);
+  g_free (data);
+}
+
+/* Queue a report from the driver thread to the context of the API user.
+ * The priority is above the one of the idle source used to return the
+ * task, so reports are always seen before the operation completes. */
+static void
+fpi_device_invoke_in_caller (FpDevice           *device,
+                             GSourceFunc         func,
+                             FpDeviceCallerData *data)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GSource) source = NULL;
+
+  data->device = g_object_ref (device);
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_task)
+    data->task = g_object_ref (priv->current_task);
+  g_mutex_unlock (&priv->action_lock);
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, func, data, (GDestroyNotify) caller_data_free);
+  g_source_set_name (source, "libfprint report to caller");
+  g_source_attach (source,
+                   data->task ? g_task_get_context (data->task) :
+                   fpi_device_get_caller_context (device));
+}
+
+static gboolean
+notify_in_caller_cb (gpointer user_data)
+{
+  FpDeviceCallerData *data = user_data;
+
+  g_object_notify (G_OBJECT (data->device), data->property_name);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Property notifications must reach the API user in its own context. */
+static void
+fpi_device_notify (FpDevice    *device,
+                   const gchar *property_name)
+{
+  FpDeviceCallerData *data;
+
+  if (!fpi_device_in_driver_thread (device))
+    {
+      g_object_notify (G_OBJECT (device), property_name);
+      return;
+    }
+
+  data = g_new0 (FpDeviceCallerData, 1);
+  data->property_name = property_name;
+  fpi_device_invoke_in_caller (device, notify_in_caller_cb, data);
+}
+
 /**
  * fpi_device_class_auto_initialize_features:
  *
@@ -264,7 +438,7 @@ fpi_device_set_nr_enroll_stages (FpDevice *device,
   g_return_if_fail (enroll_stages > 0);
 
   priv->nr_enroll_stages = enroll_stages;
-  g_object_notify (G_OBJECT (device), "nr-enroll-stages");
+  fpi_device_notify (device, "nr-enroll-stages");
 }
 
 /**
@@ -285,7 +459,7 @@ fpi_device_set_scan_type (FpDevice  *device,
   g_return_if_fail (FP_IS_DEVICE (device));
 
   priv->scan_type = scan_type;
-  g_object_notify (G_OBJECT (device), "scan-type");
+  fpi_device_notify (device, "scan-type");
 }
 
 /**
@@ -324,7 +498,9 @@ timeout_finalize (GSource *source)
   FpDevicePrivate *priv;
 
   priv = fp_device_get_instance_private (timeout_source->device);
+  g_mutex_lock (&priv->sources_lock);
   priv->sources = g_slist_remove (priv->sources, source);
+  g_mutex_unlock (&priv->sources_lock);
 }
 
 static gboolean
@@ -346,6 +522,35 @@ static GSourceFuncs timeout_funcs = {
   NULL, NULL
 };
 
+static GSource *
+add_timeout_in_context (FpDevice      *device,
+                        GMainContext  *context,
+                        gint           interval,
+                        FpTimeoutFunc  func,
+                        gpointer       user_data,
+                        GDestroyNotify destroy_notify)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceTimeoutSource *source;
+
+  source = (FpDeviceTimeoutSource *) g_source_new (&timeout_funcs,
+                                                   sizeof (FpDeviceTimeoutSource));
+  source->device = device;
+
+  g_source_set_callback (&source->source, (GSourceFunc) func, user_data, destroy_notify);
+  g_source_set_ready_time (&source->source,
+                           g_get_monotonic_time () + interval * (guint64) 1000);
+
+  g_mutex_lock (&priv->sources_lock);
+  priv->sources = g_slist_prepend (priv->sources, source);
+  g_mutex_unlock (&priv->sources_lock);
+
+  g_source_attach (&source->source, context);
+  g_source_unref (&source->source);
+
+  return &source->source;
+}
+
 /**
  * fpi_device_add_timeout:
  * @device: The #FpDevice
@@ -366,27 +571,12 @@ fpi_device_add_timeout (FpDevice      *device,
                         gpointer       user_data,
                         GDestroyNotify destroy_notify)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-  FpDeviceTimeoutSource *source;
-  GMainContext *context;
-
-  source = (FpDeviceTimeoutSource *) g_source_new (&timeout_funcs,
-                                                   sizeof (FpDeviceTimeoutSource));
-  source->device = device;
-
-  if (priv->current_task)
-    context = g_task_get_context (priv->current_task);
-  else
-    context = g_main_context_get_thread_default ();
-
-  g_source_attach (&source->source, context);
-  g_source_set_callback (&source->source, (GSourceFunc) func, user_data, destroy_notify);
-  g_source_set_ready_time (&source->source,
-                           g_source_get_time (&source->source) + interval * (guint64) 1000);
-  priv->sources = g_slist_prepend (priv->sources, source);
-  g_source_unref (&source->source);
-
-  return &source->source;
+  return add_timeout_in_context (device,
+                                 fpi_device_get_driver_context (device),
+                                 interval,
+                                 func,
+                                 user_data,
+                                 destroy_notify);
 }
 
 /**
@@ -478,10 +668,15 @@ FpiDeviceAction
 fpi_device_get_current_action (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpiDeviceAction action;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), FPI_DEVICE_ACTION_NONE);
 
-  return priv->current_action;
+  g_mutex_lock (&priv->action_lock);
+  action = priv->current_action;
+  g_mutex_unlock (&priv->action_lock);
+
+  return action;
 }
 
 /**
@@ -499,11 +694,14 @@ gboolean
 fpi_device_action_is_cancelled (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GCancellable) cancellable = NULL;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), TRUE);
   g_return_val_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE, TRUE);
 
-  return g_cancellable_is_cancelled (priv->current_cancellable);
+  cancellable = fpi_device_ref_current_cancellable (device);
+
+  return g_cancellable_is_cancelled (cancellable);
 }
 
 /**
@@ -677,11 +875,16 @@ GCancellable *
 fpi_device_get_cancellable (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  GCancellable *cancellable;
 
   g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
   g_return_val_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE, NULL);
 
-  return priv->current_cancellable;
+  g_mutex_lock (&priv->action_lock);
+  cancellable = priv->current_cancellable;
+  g_mutex_unlock (&priv->action_lock);
+
+  return cancellable;
 }
 
 static void
@@ -703,19 +906,25 @@ void
 fpi_device_remove (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GTask) task = NULL;
 
   g_return_if_fail (FP_IS_DEVICE (device));
   g_return_if_fail (!priv->is_removed);
 
   priv->is_removed = TRUE;
 
-  g_object_notify (G_OBJECT (device), "removed");
+  fpi_device_notify (device, "removed");
+
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_task)
+    task = g_object_ref (priv->current_task);
+  g_mutex_unlock (&priv->action_lock);
 
   /* If there is a pending action, we wait for it to fail, otherwise we
    * immediately emit the "removed" signal. */
-  if (priv->current_task)
+  if (task)
     {
-      g_signal_connect_object (priv->current_task,
+      g_signal_connect_object (task,
                                "notify::completed",
                                (GCallback) emit_removed_on_task_completed,
                                device,
@@ -810,6 +1019,40 @@ fpi_device_action_error (FpDevice *device,
     }
 }
 
+/* Queues a request for after the critical section if the driver is in one,
+ * returns %TRUE if it was queued. */
+static gboolean
+fpi_device_queue_in_critical_section (FpDevice *device,
+                                      gboolean *queued)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean in_critical_section;
+
+  g_mutex_lock (&priv->action_lock);
+  in_critical_section = priv->critical_section > 0;
+  if (in_critical_section)
+    *queued = TRUE;
+  g_mutex_unlock (&priv->action_lock);
+
+  return in_critical_section;
+}
+
+/* Clears a queued request, returns whether it was queued. */
+static gboolean
+fpi_device_take_queued (FpDevice *device,
+                        gboolean *queued)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean was_queued;
+
+  g_mutex_lock (&priv->action_lock);
+  was_queued = *queued;
+  *queued = FALSE;
+  g_mutex_unlock (&priv->action_lock);
+
+  return was_queued;
+}
+
 /**
  * fpi_device_critical_enter:
  * @device: The #FpDevice
@@ -840,7 +1083,9 @@ fpi_device_critical_enter (FpDevice *device)
 
   g_return_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE);
 
+  g_mutex_lock (&priv->action_lock);
   priv->critical_section += 1;
+  g_mutex_unlock (&priv->action_lock);
 
   /* Stop flushing events if that was previously queued. */
   if (priv->critical_section_flush_source)
@@ -854,28 +1099,34 @@ fpi_device_critical_section_flush_idle_cb (FpDevice *device)
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
-  if (priv->cancel_queued)
+  gboolean cancel_queued;
+  gboolean busy;
+
+  g_mutex_lock (&priv->action_lock);
+  cancel_queued = priv->cancel_queued;
+  priv->cancel_queued = FALSE;
+  /* Cancellation must only happen if the driver is busy. */
+  busy = priv->current_action != FPI_DEVICE_ACTION_NONE &&
+         priv->current_task_idle_return_source == NULL;
+  g_mutex_unlock (&priv->action_lock);
+
+  if (cancel_queued)
     {
-      /* Cancellation must only happen if the driver is busy. */
-      if (priv->current_action != FPI_DEVICE_ACTION_NONE &&
-          priv->current_task_idle_return_source == NULL)
+      if (busy)
         cls->cancel (device);
-      priv->cancel_queued = FALSE;
 
       return G_SOURCE_CONTINUE;
     }
 
-  if (priv->suspend_queued)
+  if (fpi_device_take_queued (device, &priv->suspend_queued))
     {
-      priv->suspend_queued = FALSE;
       fpi_device_suspend (device);
 
       return G_SOURCE_CONTINUE;
     }
 
-  if (priv->resume_queued)
+  if (fpi_device_take_queued (device, &priv->resume_queued))
     {
-      priv->resume_queued = FALSE;
       fpi_device_resume (device);
 
       return G_SOURCE_CONTINUE;
@@ -902,11 +1153,20 @@ fpi_device_critical_leave (FpDevice *device)
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (priv->current_action != FPI_DEVICE_ACTION_NONE);
-  g_return_if_fail (priv->critical_section);
 
+  g_mutex_lock (&priv->action_lock);
+  if (priv->critical_section == 0)
+    {
+      g_mutex_unlock (&priv->action_lock);
+      g_return_if_reached ();
+    }
   priv->critical_section -= 1;
   if (priv->critical_section)
-    return;
+    {
+      g_mutex_unlock (&priv->action_lock);
+      return;
+    }
+  g_mutex_unlock (&priv->action_lock);
 
   /* We left the critical section, make sure a flush is queued. */
   if (priv->critical_section_flush_source)
@@ -921,7 +1181,7 @@ fpi_device_critical_leave (FpDevice *device)
   g_source_set_name (priv->critical_section_flush_source,
                      "Flush libfprint driver critical section");
   g_source_attach (priv->critical_section_flush_source,
-                   g_task_get_context (priv->current_task));
+                   fpi_device_get_driver_context (device));
   g_source_unref (priv->critical_section_flush_source);
 }
 
@@ -929,22 +1189,34 @@ static void
 clear_device_cancel_action (FpDevice *device)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
-  g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
-
-  if (priv->current_cancellable_id)
-    {
-      g_cancellable_disconnect (priv->current_cancellable,
-                                priv->current_cancellable_id);
-      priv->current_cancellable_id = 0;
-    }
-
-  if (priv->current_task_cancellable_id)
-    {
-      g_cancellable_disconnect (g_task_get_cancellable (priv->current_task),
-                                priv->current_task_cancellable_id);
-      priv->current_task_cancellable_id = 0;
-    }
+  g_autoptr(GSource) cancel_source = NULL;
+  g_autoptr(GCancellable) cancellable = NULL;
+  g_autoptr(GCancellable) task_cancellable = NULL;
+  gulong cancellable_id, task_cancellable_id;
+
+  /* The cancel handlers take the lock, so only disconnect once it has
+   * been released again. */
+  g_mutex_lock (&priv->action_lock);
+  if (priv->current_idle_cancel_source)
+    cancel_source = g_source_ref (g_steal_pointer (&priv->current_idle_cancel_source));
+  if (priv->current_cancellable)
+    cancellable = g_object_ref (priv->current_cancellable);
+  if (priv->current_task && g_task_get_cancellable (priv->current_task))
+    task_cancellable = g_object_ref (g_task_get_cancellable (priv->current_task));
+  cancellable_id = priv->current_cancellable_id;
+  priv->current_cancellable_id = 0;
+  task_cancellable_id = priv->current_task_cancellable_id;
+  priv->current_task_cancellable_id = 0;
+  g_mutex_unlock (&priv->action_lock);
+
+  if (cancel_source)
+    g_source_destroy (cancel_source);
+
+  if (cancellable_id)
+    g_cancellable_disconnect (cancellable, cancellable_id);
+
+  if (task_cancellable_id)
+    g_cancellable_disconnect (task_cancellable, task_cancellable_id);
 }
 
 typedef enum _FpDeviceTaskReturnType {
@@ -971,18 +1243,21 @@ fp_device_task_return_in_idle_cb (gpointer user_data)
   FpiDeviceAction action;
 
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GCancellable) current_cancellable = NULL;
   g_autoptr(GError) cancellation_reason = NULL;
 
 
   action_str = g_enum_to_string (FPI_TYPE_DEVICE_ACTION, priv->current_action);
   g_debug ("Completing action %s in idle!", action_str);
 
+  g_mutex_lock (&priv->action_lock);
   task = g_steal_pointer (&priv->current_task);
   action = priv->current_action;
   priv->current_action = FPI_DEVICE_ACTION_NONE;
   priv->current_task_idle_return_source = NULL;
-  g_clear_object (&priv->current_cancellable);
+  current_cancellable = g_steal_pointer (&priv->current_cancellable);
   cancellation_reason = g_steal_pointer (&priv->current_cancellation_reason);
+  g_mutex_unlock (&priv->action_lock);
 
   fpi_device_update_temp (data->device, FALSE);
 
@@ -1097,23 +1372,28 @@ fpi_device_return_task_in_idle (FpDevice              *device,
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceTaskReturnData *data;
+  GSource *source;
 
   data = g_new0 (FpDeviceTaskReturnData, 1);
   data->device = g_object_ref (device);
   data->type = return_type;
   data->result = return_data;
 
-  priv->current_task_idle_return_source = g_idle_source_new ();
-  g_source_set_priority (priv->current_task_idle_return_source,
-                         g_task_get_priority (priv->current_task));
-  g_source_set_callback (priv->current_task_idle_return_source,
+  source = g_idle_source_new ();
+  g_source_set_callback (source,
                          fp_device_task_return_in_idle_cb,
                          data,
                          (GDestroyNotify) fpi_device_task_return_data_free);
 
-  g_source_attach (priv->current_task_idle_return_source,
-                   g_task_get_context (priv->current_task));
-  g_source_unref (priv->current_task_idle_return_source);
+  /* The callback may run in another thread as soon as the source is
+   * attached, do not touch the source through priv after that. */
+  g_mutex_lock (&priv->action_lock);
+  g_source_set_priority (source, g_task_get_priority (priv->current_task));
+  priv->current_task_idle_return_source = source;
+  g_source_attach (source, g_task_get_context (priv->current_task));
+  g_mutex_unlock (&priv->action_lock);
+
+  g_source_unref (source);
 }
 
 /**
@@ -1147,13 +1427,13 @@ fpi_device_probe_complete (FpDevice    *device,
         {
           g_clear_pointer (&priv->device_id, g_free);
           priv->device_id = g_strdup (device_id);
-          g_object_notify (G_OBJECT (device), "device-id");
+          fpi_device_notify (device, "device-id");
         }
       if (device_name)
         {
           g_clear_pointer (&priv->device_name, g_free);
           priv->device_name = g_strdup (device_name);
-          g_object_notify (G_OBJECT (device), "name");
+          fpi_device_notify (device, "name");
         }
       fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
                                       GUINT_TO_POINTER (TRUE));
@@ -1624,10 +1904,10 @@ fpi_device_suspend (FpDevice *device)
     case FPI_DEVICE_ACTION_CAPTURE:
       if (FP_DEVICE_GET_CLASS (device)->suspend)
         {
-          if (priv->critical_section)
-            priv->suspend_queued = TRUE;
-          else
-            FP_DEVICE_GET_CLASS (device)->suspend (device);
+          if (fpi_device_queue_in_critical_section (device, &priv->suspend_queued))
+            break;
+
+          FP_DEVICE_GET_CLASS (device)->suspend (device);
         }
       else
         {
@@ -1669,10 +1949,10 @@ fpi_device_resume (FpDevice *device)
     case FPI_DEVICE_ACTION_CAPTURE:
       if (FP_DEVICE_GET_CLASS (device)->resume)
         {
-          if (priv->critical_section)
-            priv->resume_queued = TRUE;
-          else
-            FP_DEVICE_GET_CLASS (device)->resume (device);
+          if (fpi_device_queue_in_critical_section (device, &priv->resume_queued))
+            break;
+
+          FP_DEVICE_GET_CLASS (device)->resume (device);
         }
       else
         {
@@ -1763,8 +2043,10 @@ fpi_device_suspend_completed (FpDevice *device)
   if (priv->current_action != FPI_DEVICE_ACTION_NONE)
     fpi_device_configure_wakeup (device, TRUE);
 
+  g_mutex_lock (&priv->action_lock);
   if (priv->critical_section)
     g_warning ("Driver was in a critical section at suspend time. It likely deadlocked!");
+  g_mutex_unlock (&priv->action_lock);
 
   if (priv->suspend_error)
     g_task_return_error (g_steal_pointer (&priv->suspend_resume_task),
@@ -1793,6 +2075,7 @@ fpi_device_suspend_complete (FpDevice *device,
                              GError   *error)
 {
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GCancellable) cancellable = NULL;
 
   g_return_if_fail (FP_IS_DEVICE (device));
   g_return_if_fail (priv->suspend_resume_task);
@@ -1816,11 +2099,14 @@ fpi_device_suspend_complete (FpDevice *device,
                            G_CONNECT_SWAPPED);
 
   /* And cancel any action that might be long-running. */
+  g_mutex_lock (&priv->action_lock);
   if (!priv->current_cancellation_reason)
     priv->current_cancellation_reason = fpi_device_error_new_msg (FP_DEVICE_ERROR_BUSY,
                                                                   "Cannot run while suspended.");
+  g_mutex_unlock (&priv->action_lock);
 
-  g_cancellable_cancel (priv->current_cancellable);
+  cancellable = fpi_device_ref_current_cancellable (device);
+  g_cancellable_cancel (cancellable);
 }
 
 /**
@@ -1876,6 +2162,21 @@ fpi_device_clear_storage_complete (FpDevice *device,
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_ERROR, error);
 }
 
+static gboolean
+enroll_progress_in_caller_cb (gpointer user_data)
+{
+  FpDeviceCallerData *caller_data = user_data;
+  FpEnrollData *data = g_task_get_task_data (caller_data->task);
+
+  data->enroll_progress_cb (caller_data->device,
+                            caller_data->completed_stages,
+                            caller_data->print,
+                            data->enroll_progress_data,
+                            caller_data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
 /**
 
  * fpi_device_enroll_progress:
@@ -1913,7 +2214,16 @@ fpi_device_enroll_progress (FpDevice *device,
 
   data = g_task_get_task_data (priv->current_task);
 
-  if (data->enroll_progress_cb)
+  if (data->enroll_progress_cb && fpi_device_in_driver_thread (device))
+    {
+      FpDeviceCallerData *caller_data = g_new0 (FpDeviceCallerData, 1);
+
+      caller_data->completed_stages = completed_stages;
+      caller_data->print = g_steal_pointer (&print);
+      caller_data->error = g_steal_pointer (&error);
+      fpi_device_invoke_in_caller (device, enroll_progress_in_caller_cb, caller_data);
+    }
+  else if (data->enroll_progress_cb)
     {
       data->enroll_progress_cb (device,
                                 completed_stages,
@@ -1926,6 +2236,30 @@ fpi_device_enroll_progress (FpDevice *device,
   g_clear_object (&print);
 }
 
+static gboolean
+match_in_caller_cb (gpointer user_data)
+{
+  FpDeviceCallerData *caller_data = user_data;
+  FpMatchData *data = g_task_get_task_data (caller_data->task);
+
+  data->match_cb (caller_data->device, data->match, data->print, data->match_data, data->error);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* The match data is owned by the task, which the queued report keeps alive. */
+static void
+fpi_device_call_match_cb (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpMatchData *data = g_task_get_task_data (priv->current_task);
+
+  if (fpi_device_in_driver_thread (device))
+    fpi_device_invoke_in_caller (device, match_in_caller_cb, g_new0 (FpDeviceCallerData, 1));
+  else
+    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+}
+
 /**
  * fpi_device_verify_report:
  * @device: The #FpDevice
@@ -1995,7 +2329,7 @@ fpi_device_verify_report (FpDevice      *device,
     }
 
   if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+    fpi_device_call_match_cb (device);
 }
 
 /**
@@ -2071,7 +2405,7 @@ fpi_device_identify_report (FpDevice *device,
     }
 
   if (call_cb && data->match_cb)
-    data->match_cb (device, data->match, data->print, data->match_data, data->error);
+    fpi_device_call_match_cb (device);
 }
 
 /**
@@ -2098,7 +2432,7 @@ fpi_device_report_finger_status (FpDevice           *device,
   fp_dbg ("Device reported finger status change: %s", status_string);
 
   priv->finger_status = finger_status;
-  g_object_notify (G_OBJECT (device), "finger-status");
+  fpi_device_notify (device, "finger-status");
 
   return TRUE;
 }
@@ -2159,6 +2493,9 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
   g_autofree char *old_temp_str = NULL;
   g_autofree char *new_temp_str = NULL;
 
+  /* The model state is confined to the context of the API user */
+  g_assert (!fpi_device_in_driver_thread (device));
+
   if (priv->temp_hot_seconds < 0)
     {
       g_debug ("Not updating temperature model, device can run continuously!");
@@ -2219,7 +2556,7 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
            new_temp_str);
 
   if (priv->temp_current != old_temp)
-    g_object_notify (G_OBJECT (device), "temperature");
+    fpi_device_notify (device, "temperature");
 
   /* If the device is HOT, then do an internal cancellation of long running tasks. */
   if (priv->temp_current == FP_TEMPERATURE_HOT)
@@ -2229,8 +2566,10 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
           priv->current_action == FPI_DEVICE_ACTION_IDENTIFY ||
           priv->current_action == FPI_DEVICE_ACTION_CAPTURE)
         {
+          g_mutex_lock (&priv->action_lock);
           if (!priv->current_cancellation_reason)
             priv->current_cancellation_reason = fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT);
+          g_mutex_unlock (&priv->action_lock);
 
           g_cancellable_cancel (priv->current_cancellable);
         }
@@ -2249,8 +2588,75 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
 
   passed_seconds += TEMP_DELAY_SECONDS;
 
-  priv->temp_timeout = fpi_device_add_timeout (device,
+  /* The model is not driver state, keep it in the context of the API user. */
+  priv->temp_timeout = add_timeout_in_context (device,
+                                               fpi_device_get_caller_context (device),
                                                passed_seconds * 1000,
                                                update_temp_timeout,
                                                NULL, NULL);
 }
+
+typedef struct
+{
+  GTask          *task;
+  GTaskThreadFunc task_func;
+} IoThreadJob;
+
+static void
+io_thread_func (gpointer data, gpointer user_data)
+{
+  IoThreadJob *job = data;
+
+  job->task_func (job->task,
+                  g_task_get_source_object (job->task),
+                  g_task_get_task_data (job->task),
+                  g_task_get_cancellable (job->task));
+
+  g_object_unref (job->task);
+  g_free (job);
+}
+
+/**
+ * fpi_device_run_in_io_thread:
+ * @device: The #FpDevice
+ * @task: The #GTask to run
+ * @task_func: The function to run in the thread
+ *
+ * Works like g_task_run_in_thread(), but runs @task_func in a thread that
+ * is dedicated to @device. All tasks of a device run in the order they
+ * were queued and never in parallel. This avoids the overhead of the
+ * shared GLib thread pool for frequent, small blocking operations.
+ *
+ * The thread is created on first use and stays around until @device is
+ * destroyed.
+ */
+void
+fpi_device_run_in_io_thread (FpDevice       *device,
+                             GTask          *task,
+                             GTaskThreadFunc task_func)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  IoThreadJob *job;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (G_IS_TASK (task));
+
+  if (G_UNLIKELY (priv->io_thread_pool == NULL))
+    {
+      g_autoptr(GError) error = NULL;
+
+      priv->io_thread_pool = g_thread_pool_new (io_thread_func, NULL, 1, TRUE, &error);
+      if (!priv->io_thread_pool)
+        {
+          g_warning ("Could not create I/O thread: %s", error->message);
+          g_task_run_in_thread (task, task_func);
+          return;
+        }
+    }
+
+  job = g_new0 (IoThreadJob, 1);
+  job->task = g_object_ref (task);
+  job->task_func = task_func;
+
+  g_thread_pool_push (priv->io_thread_pool, job, NULL);
+}
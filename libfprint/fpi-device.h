@@ -86,6 +86,9 @@ struct _FpIdEntry
  *   after being mostly cold. Set to -1 if the device can be always-on.
  * @temp_cold_seconds: Assumed time in seconds for the device to be mostly cold
  *   after having been too hot to operate.
+ * @no_driver_thread: Set if the driver attaches sources to the global default
+ *   #GMainContext (e.g. using g_timeout_add()), enabling
+ *   #FpDevice:driver-thread is refused for such drivers.
  * @usb_discover: Class method to check whether a USB device is supported by
  *  the driver. Should return 0 if the device is unsupported and a positive
  *  score otherwise. The default score is 50 and the driver with the highest
@@ -133,6 +136,10 @@ struct _FpIdEntry
  * Note that @cancel, @suspend and @resume will not be called while the device
  * is within a fpi_device_critical_enter()/fpi_device_critical_leave() block.
  *
+ * All entry points are called from the same thread, but this is not
+ * necessarily the thread of the API user, see #FpDevice:driver-thread and
+ * the threading rules in the fpi-device section.
+ *
  * This API is solely intended for drivers. It is purely internal and neither
  * API nor ABI stable.
  */
@@ -157,6 +164,8 @@ struct _FpDeviceClass
   gint32 temp_hot_seconds;
   gint32 temp_cold_seconds;
 
+  gboolean no_driver_thread;
+
   /* Callbacks */
   gint (*usb_discover) (GUsbDevice *usb_device);
   void (*probe)    (FpDevice *device);
@@ -190,8 +190,9 @@ fp_image_device_maybe_complete_action (FpImageDevice *self, GError *error)
         }
     }
 
-  /* Do not complete if the device is still active or a minutiae scan is pending. */
-  if (priv->active || priv->minutiae_scan_active)
+  /* Do not complete if the device is still active, a minutiae scan or the
+   * gallery search is pending. */
+  if (priv->active || priv->minutiae_scan_active || priv->identify_active)
     return;
 
   if (!priv->action_error)
@@ -232,6 +233,33 @@ fp_image_device_maybe_complete_action (FpImageDevice *self, GError *error)
     }
 }
 
+static void
+fpi_image_device_identify_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(FpPrint) print = g_object_ref (FP_PRINT (source_object));
+  g_autoptr(FpPrint) result = NULL;
+  GError *error = NULL;
+  FpImageDevice *self = FP_IMAGE_DEVICE (user_data);
+  FpDevice *device = FP_DEVICE (self);
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  priv->identify_active = FALSE;
+
+  result = fpi_print_bz3_identify_finish (print, res, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      fp_image_device_maybe_complete_action (self, g_steal_pointer (&error));
+      fpi_image_device_deactivate (self, TRUE);
+      return;
+    }
+
+  if (!error || error->domain == FP_DEVICE_RETRY)
+    fpi_device_identify_report (device, result, g_steal_pointer (&print), g_steal_pointer (&error));
+
+  fp_image_device_maybe_complete_action (self, g_steal_pointer (&error));
+}
+
 static void
 fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
@@ -257,11 +285,15 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
           return;
         }
 
-      /* Replace error with a retry condition. */
-      g_warning ("Failed to detect minutiae: %s", error->message);
-      g_clear_pointer (&error, g_error_free);
+      /* Replace error with a retry condition, unless processing the raw
+       * capture already reported one. */
+      if (error->domain != FP_DEVICE_RETRY)
+        {
+          g_warning ("Failed to detect minutiae: %s", error->message);
+          g_clear_pointer (&error, g_error_free);
 
-      error = fpi_device_retry_new_msg (FP_DEVICE_RETRY_GENERAL, "Minutiae detection failed, please retry");
+          error = fpi_device_retry_new_msg (FP_DEVICE_RETRY_GENERAL, "Minutiae detection failed, please retry");
+        }
     }
 
   action = fpi_device_get_current_action (device);
@@ -277,7 +309,7 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     {
       print = fp_print_new (device);
       fpi_print_set_type (print, FPI_PRINT_NBIS);
-      if (!fpi_print_add_from_image (print, image, &error))
+      if (!fpi_print_add_from_image (print, image, priv->bz3_max_minutiae, &error))
         {
           g_clear_object (&print);
 
@@ -334,26 +366,27 @@ fpi_image_device_minutiae_detected (GObject *source_object, GAsyncResult *res, g
     }
   else if (action == FPI_DEVICE_ACTION_IDENTIFY)
     {
-      gint i;
       GPtrArray *templates;
-      FpPrint *result = NULL;
 
-      fpi_device_get_identify_data (device, &templates);
-      for (i = 0; !error && i < templates->len; i++)
+      if (!print)
         {
-          FpPrint *template = g_ptr_array_index (templates, i);
-
-          if (fpi_print_bz3_match (template, print, priv->bz3_threshold, &error) == FPI_MATCH_SUCCESS)
-            {
-              result = template;
-              break;
-            }
+          fpi_device_identify_report (device, NULL, NULL, g_steal_pointer (&error));
+          fp_image_device_maybe_complete_action (self, NULL);
+          return;
         }
 
-      if (!error || error->domain == FP_DEVICE_RETRY)
-        fpi_device_identify_report (device, result, g_steal_pointer (&print), g_steal_pointer (&error));
-
-      fp_image_device_maybe_complete_action (self, g_steal_pointer (&error));
+      /* Search the gallery on the matcher threads, completion is
+       * delayed until the result is in. */
+      fpi_device_get_identify_data (device, &templates);
+      priv->identify_active = TRUE;
+      fpi_print_bz3_identify (templates,
+                              print,
+                              priv->bz3_threshold,
+                              priv->identify_best_match,
+                              priv->identify_min_similarity,
+                              fpi_device_get_cancellable (device),
+                              fpi_image_device_identify_done,
+                              self);
     }
   else
     {
@@ -392,6 +425,80 @@ fpi_image_device_set_bz3_threshold (FpImageDevice *self,
   priv->bz3_threshold = bz3_threshold;
 }
 
+/**
+ * fpi_image_device_set_bz3_max_minutiae:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @max_minutiae: Maximum number of minutiae per print, or 0 for the default
+ *
+ * Limit the number of minutiae that are stored for each scanned print. Only
+ * the most reliable minutiae are kept. Sensors that produce many spurious
+ * minutiae can use this to speed up matching considerably, as the bozorth3
+ * matching time grows quadratically with the number of minutiae. Like
+ * fpi_image_device_set_bz3_threshold(), this should generally be called
+ * from the probe or open callback.
+ *
+ * By default, the first 200 minutiae in detection order are kept. Setting a
+ * limit changes which minutiae end up in new prints, so prints enrolled
+ * before may match with slightly different scores.
+ */
+void
+fpi_image_device_set_bz3_max_minutiae (FpImageDevice *self,
+                                       gint           max_minutiae)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_return_if_fail (FP_IS_IMAGE_DEVICE (self));
+  g_return_if_fail (max_minutiae >= 0);
+
+  priv->bz3_max_minutiae = max_minutiae;
+}
+
+/**
+ * fpi_image_device_set_identify_best_match:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @best_match: Whether to report the best scoring template
+ *
+ * By default identification reports the first template of the gallery
+ * that reaches the bz3 threshold. Setting @best_match makes the whole
+ * gallery be searched and the template with the highest score be reported
+ * instead. This is slower, but avoids reporting a worse match just because
+ * it happened to be earlier in the gallery.
+ */
+void
+fpi_image_device_set_identify_best_match (FpImageDevice *self,
+                                          gboolean       best_match)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_return_if_fail (FP_IS_IMAGE_DEVICE (self));
+
+  priv->identify_best_match = best_match;
+}
+
+/**
+ * fpi_image_device_set_identify_prefilter:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @min_similarity: Minimum similarity between 0 and 1, or a negative value
+ *   to disable the prefilter
+ *
+ * Rank the identify gallery by a cheap similarity measure before matching,
+ * see fpi_print_bz3_identify(). With large galleries, this means that a
+ * genuine match is usually found after matching only a small part of the
+ * gallery. Templates below @min_similarity are not matched at all, so any
+ * value above 0 trades accuracy for speed and needs to be tuned per sensor.
+ */
+void
+fpi_image_device_set_identify_prefilter (FpImageDevice *self,
+                                         gdouble        min_similarity)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+
+  g_return_if_fail (FP_IS_IMAGE_DEVICE (self));
+  g_return_if_fail (min_similarity <= 1);
+
+  priv->identify_min_similarity = min_similarity;
+}
+
 /**
  * fpi_image_device_report_finger_status:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -505,6 +612,56 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
   fp_image_device_change_state (self, FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_OFF);
 }
 
+/**
+ * fpi_image_device_process_capture:
+ * @self: a #FpImageDevice imaging fingerprint device
+ * @process: (scope async): the #FpiImageProcessFunc creating the image
+ * @data: the raw capture data to pass to @process
+ * @data_destroy: (destroy data): #GDestroyNotify for @data
+ *
+ * Reports a raw capture, which still needs to be turned into an image.
+ * This is the equivalent of fpi_image_device_image_captured() for drivers
+ * that need to e.g. assemble frames, scale the image or apply a
+ * background correction. @process is run in a worker thread and the
+ * minutiae detection directly follows in the same thread, so none of
+ * this work happens on the main context.
+ *
+ * @data must contain everything needed to create the image, as the
+ * driver will continue to receive data while it is being processed. If
+ * @process returns an error in the %FP_DEVICE_RETRY domain then it is
+ * reported like fpi_image_device_retry_scan() would.
+ */
+void
+fpi_image_device_process_capture (FpImageDevice      *self,
+                                  FpiImageProcessFunc process,
+                                  gpointer            data,
+                                  GDestroyNotify      data_destroy)
+{
+  FpImageDevicePrivate *priv = fp_image_device_get_instance_private (self);
+  FpiDeviceAction action;
+
+  action = fpi_device_get_current_action (FP_DEVICE (self));
+
+  g_return_if_fail (process != NULL);
+  g_return_if_fail (priv->state == FPI_IMAGE_DEVICE_STATE_CAPTURE);
+  g_return_if_fail (action == FPI_DEVICE_ACTION_ENROLL ||
+                    action == FPI_DEVICE_ACTION_VERIFY ||
+                    action == FPI_DEVICE_ACTION_IDENTIFY ||
+                    action == FPI_DEVICE_ACTION_CAPTURE);
+
+  g_debug ("Image device captured raw data");
+
+  priv->minutiae_scan_active = TRUE;
+
+  fpi_image_process_and_detect_minutiae (process, data, data_destroy,
+                                         fpi_device_get_cancellable (FP_DEVICE (self)),
+                                         fpi_image_device_minutiae_detected,
+                                         self);
+
+  /* XXX: This is wrong if we add support for raw capture mode. */
+  fp_image_device_change_state (self, FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_OFF);
+}
+
 /**
  * fpi_image_device_retry_scan:
  * @self: a #FpImageDevice imaging fingerprint device
@@ -21,6 +21,7 @@
 
 #include "fpi-device.h"
 #include "fp-image-device.h"
+#include "fpi-image.h"
 
 /**
  * FpiImageDeviceState:
@@ -44,7 +45,8 @@
  *  - activating -> idle: fpi_image_device_activate_complete()
  *  - idle -> await-finger-on
  *  - await-finger-on -> capture: fpi_image_device_report_finger_status()
- *  - capture -> await-finger-off: fpi_image_device_image_captured()
+ *  - capture -> await-finger-off: fpi_image_device_image_captured() or
+ *    fpi_image_device_process_capture()
  *  - await-finger-off -> idle: fpi_image_device_report_finger_status()
  *  - idle -> deactivating: deactivate vfunc is called
  *  - deactivating -> inactive: fpi_image_device_deactivate_complete()
@@ -73,6 +75,9 @@ typedef enum {
 /**
  * FpImageDeviceClass:
  * @bz3_threshold: Threshold to consider bozorth3 score a match, default: 40
+ * @bz3_max_minutiae: Maximum number of minutiae to store per print, the most
+ *   reliable ones are kept. Default: 0, which keeps the first 200 (the
+ *   bozorth3 maximum) in detection order
  * @img_width: Width of the image, only provide if constant
  * @img_height: Height of the image, only provide if constant
  * @img_open: Open the device and do basic initialization
@@ -105,6 +110,7 @@ struct _FpImageDeviceClass
   FpDeviceClass parent_class;
 
   gint          bz3_threshold;
+  gint          bz3_max_minutiae;
   gint          img_width;
   gint          img_height;
 
@@ -118,6 +124,12 @@ struct _FpImageDeviceClass
 
 void fpi_image_device_set_bz3_threshold (FpImageDevice *self,
                                          gint           bz3_threshold);
+void fpi_image_device_set_bz3_max_minutiae (FpImageDevice *self,
+                                            gint           max_minutiae);
+void fpi_image_device_set_identify_best_match (FpImageDevice *self,
+                                               gboolean       best_match);
+void fpi_image_device_set_identify_prefilter (FpImageDevice *self,
+                                              gdouble        min_similarity);
 
 void fpi_image_device_session_error (FpImageDevice *self,
                                      GError        *error);
@@ -135,5 +147,9 @@ void fpi_image_device_report_finger_status (FpImageDevice *self,
                                             gboolean       present);
 void fpi_image_device_image_captured (FpImageDevice *self,
                                       FpImage       *image);
+void fpi_image_device_process_capture (FpImageDevice      *self,
+                                       FpiImageProcessFunc process,
+                                       gpointer            data,
+                                       GDestroyNotify      data_destroy);
 void fpi_image_device_retry_scan (FpImageDevice *self,
                                   FpDeviceRetry  retry);
@@ -25,6 +25,12 @@
 
 #include <nbis.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #if HAVE_PIXMAN
 #include <pixman.h>
 #endif
@@ -37,6 +43,344 @@
  * Internal image handling routines. See #FpImage for public routines.
  */
 
+/* Image data buffers are reference counted, so that minutiae detection
+ * can share the data with the image rather than copying it. Released
+ * buffers are kept in a small pool, as images of a device usually all
+ * have the same size. */
+typedef struct
+{
+  gint  ref_count;
+  gsize size;
+} ImageBufferHeader;
+
+/* Keeps the data 16 byte aligned */
+#define IMAGE_BUFFER_HEADER_SIZE 16
+G_STATIC_ASSERT (sizeof (ImageBufferHeader) <= IMAGE_BUFFER_HEADER_SIZE);
+
+#define IMAGE_BUFFER_HEADER(buffer) ((ImageBufferHeader *) ((guint8 *) (buffer) - IMAGE_BUFFER_HEADER_SIZE))
+
+G_LOCK_DEFINE_STATIC (image_buffer_pool);
+static GQueue image_buffer_pool = G_QUEUE_INIT;
+
+/**
+ * fpi_image_buffer_new:
+ * @size: The size of the buffer
+ *
+ * Allocates a reference counted buffer for image data. The buffer is
+ * taken from a pool if possible, its content is undefined.
+ *
+ * Returns: (transfer full): The new buffer, or %NULL if @size is 0
+ */
+guint8 *
+fpi_image_buffer_new (gsize size)
+{
+  ImageBufferHeader *header = NULL;
+  GList *l;
+
+  if (size == 0)
+    return NULL;
+
+  G_LOCK (image_buffer_pool);
+  for (l = image_buffer_pool.head; l; l = l->next)
+    {
+      if (((ImageBufferHeader *) l->data)->size == size)
+        {
+          header = l->data;
+          g_queue_delete_link (&image_buffer_pool, l);
+          break;
+        }
+    }
+  G_UNLOCK (image_buffer_pool);
+
+  if (!header)
+    {
+      header = g_malloc (IMAGE_BUFFER_HEADER_SIZE + size);
+      header->size = size;
+    }
+  header->ref_count = 1;
+
+  return (guint8 *) header + IMAGE_BUFFER_HEADER_SIZE;
+}
+
+/**
+ * fpi_image_buffer_ref:
+ * @buffer: A buffer from fpi_image_buffer_new()
+ *
+ * Increases the reference count of @buffer.
+ *
+ * Returns: (transfer full): @buffer
+ */
+guint8 *
+fpi_image_buffer_ref (guint8 *buffer)
+{
+  if (buffer)
+    g_atomic_int_inc (&IMAGE_BUFFER_HEADER (buffer)->ref_count);
+
+  return buffer;
+}
+
+/**
+ * fpi_image_buffer_unref:
+ * @buffer: A buffer from fpi_image_buffer_new()
+ *
+ * Decreases the reference count of @buffer. The buffer is returned to
+ * the pool once the last reference is dropped.
+ */
+void
+fpi_image_buffer_unref (guint8 *buffer)
+{
+  ImageBufferHeader *header;
+
+  if (!buffer)
+    return;
+
+  header = IMAGE_BUFFER_HEADER (buffer);
+  if (!g_atomic_int_dec_and_test (&header->ref_count))
+    return;
+
+  G_LOCK (image_buffer_pool);
+  g_queue_push_head (&image_buffer_pool, header);
+  /* Drop the least recently used buffer */
+  if (image_buffer_pool.length > FPI_IMAGE_BUFFER_POOL_SIZE)
+    header = g_queue_pop_tail (&image_buffer_pool);
+  else
+    header = NULL;
+  G_UNLOCK (image_buffer_pool);
+
+  g_free (header);
+}
+
+/**
+ * fpi_image_buffer_is_shared:
+ * @buffer: A buffer from fpi_image_buffer_new()
+ *
+ * Checks whether there is more than one reference to @buffer, in which
+ * case it must not be modified.
+ *
+ * Returns: %TRUE if the buffer is shared
+ */
+gboolean
+fpi_image_buffer_is_shared (const guint8 *buffer)
+{
+  return g_atomic_int_get (&IMAGE_BUFFER_HEADER (buffer)->ref_count) > 1;
+}
+
+/**
+ * fpi_image_buffer_pool_get_length:
+ *
+ * Gets the number of released buffers that are kept for reuse, which is
+ * at most %FPI_IMAGE_BUFFER_POOL_SIZE.
+ *
+ * Returns: The number of pooled buffers
+ */
+guint
+fpi_image_buffer_pool_get_length (void)
+{
+  guint length;
+
+  G_LOCK (image_buffer_pool);
+  length = image_buffer_pool.length;
+  G_UNLOCK (image_buffer_pool);
+
+  return length;
+}
+
+/**
+ * fpi_image_process_and_detect_minutiae:
+ * @process: (scope async): the #FpiImageProcessFunc creating the image
+ * @process_data: the data to pass to @process
+ * @process_data_destroy: (destroy process_data): #GDestroyNotify for @process_data
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: the function to call on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Creates an image from raw data in a worker thread and directly continues
+ * with the minutiae detection in the same thread. This is equivalent to
+ * calling @process and then fp_image_detect_minutiae() on the result, but
+ * neither step runs on the main context.
+ *
+ * The source object passed to @callback is the resulting #FpImage, use
+ * fp_image_detect_minutiae_finish() to retrieve the result. If @process
+ * fails, its error is returned and the image will be empty.
+ */
+void
+fpi_image_process_and_detect_minutiae (FpiImageProcessFunc process,
+                                       gpointer            process_data,
+                                       GDestroyNotify      process_data_destroy,
+                                       GCancellable       *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer            user_data)
+{
+  g_autoptr(FpImage) image = NULL;
+
+  g_return_if_fail (process != NULL);
+
+  /* The image is filled in once the minutiae have been detected */
+  image = fp_image_new (0, 0);
+  image->process = process;
+  image->process_data = process_data;
+  image->process_data_destroy = process_data_destroy;
+
+  fp_image_detect_minutiae (image, cancellable, callback, user_data);
+}
+
+/* Lines are accumulated in blocks of this many bytes, so that the 32bit
+ * lanes of the squared sums cannot overflow (4 * 255^2 per lane and step).
+ */
+#define LINE_STATS_BLOCK (4096 * 16)
+
+#ifdef __SSE2__
+static inline guint64
+hsum_epu32 (__m128i v)
+{
+  guint32 lanes[4];
+
+  _mm_storeu_si128 ((__m128i *) lanes, v);
+  return (guint64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static inline guint64
+hsum_epu64 (__m128i v)
+{
+  guint64 lanes[2];
+
+  _mm_storeu_si128 ((__m128i *) lanes, v);
+  return lanes[0] + lanes[1];
+}
+
+static inline __m128i
+sq_sum_epu8 (__m128i v)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i lo = _mm_unpacklo_epi8 (v, zero);
+  __m128i hi = _mm_unpackhi_epi8 (v, zero);
+
+  return _mm_add_epi32 (_mm_madd_epi16 (lo, lo), _mm_madd_epi16 (hi, hi));
+}
+#elif defined(__ARM_NEON)
+static inline guint64
+hsum_u32 (uint32x4_t v)
+{
+  guint32 lanes[4];
+
+  vst1q_u32 (lanes, v);
+  return (guint64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static inline uint32x4_t
+sq_sum_acc_u8 (uint32x4_t acc, uint8x16_t v)
+{
+  acc = vpadalq_u16 (acc, vmull_u8 (vget_low_u8 (v), vget_low_u8 (v)));
+  return vpadalq_u16 (acc, vmull_u8 (vget_high_u8 (v), vget_high_u8 (v)));
+}
+#endif
+
+/* Single pass over @buf that accumulates the sum and the sum of squares of
+ * all pixels, and (if @ref is given) the sum of squared differences to @ref.
+ */
+static void
+line_stats (const guint8 *buf,
+            const guint8 *ref,
+            gsize         size,
+            guint64      *sum,
+            guint64      *sum_sq,
+            guint64      *diff_sq)
+{
+  guint64 s = 0, sq = 0, dsq = 0;
+  gsize i = 0;
+
+#ifdef __SSE2__
+  while (i + 16 <= size)
+    {
+      gsize end = MIN (size & ~((gsize) 15), i + LINE_STATS_BLOCK);
+      __m128i vs = _mm_setzero_si128 ();
+      __m128i vsq = _mm_setzero_si128 ();
+      __m128i vdsq = _mm_setzero_si128 ();
+
+      for (; i < end; i += 16)
+        {
+          __m128i v = _mm_loadu_si128 ((const __m128i *) (buf + i));
+
+          vs = _mm_add_epi64 (vs, _mm_sad_epu8 (v, _mm_setzero_si128 ()));
+          vsq = _mm_add_epi32 (vsq, sq_sum_epu8 (v));
+
+          if (ref)
+            {
+              __m128i r = _mm_loadu_si128 ((const __m128i *) (ref + i));
+              __m128i d = _mm_or_si128 (_mm_subs_epu8 (v, r),
+                                        _mm_subs_epu8 (r, v));
+
+              vdsq = _mm_add_epi32 (vdsq, sq_sum_epu8 (d));
+            }
+        }
+
+      s += hsum_epu64 (vs);
+      sq += hsum_epu32 (vsq);
+      dsq += hsum_epu32 (vdsq);
+    }
+#elif defined(__ARM_NEON)
+  while (i + 16 <= size)
+    {
+      gsize end = MIN (size & ~((gsize) 15), i + LINE_STATS_BLOCK);
+      uint32x4_t vs = vdupq_n_u32 (0);
+      uint32x4_t vsq = vdupq_n_u32 (0);
+      uint32x4_t vdsq = vdupq_n_u32 (0);
+
+      for (; i < end; i += 16)
+        {
+          uint8x16_t v = vld1q_u8 (buf + i);
+
+          vs = vpadalq_u16 (vs, vpaddlq_u8 (v));
+          vsq = sq_sum_acc_u8 (vsq, v);
+
+          if (ref)
+            vdsq = sq_sum_acc_u8 (vdsq, vabdq_u8 (v, vld1q_u8 (ref + i)));
+        }
+
+      s += hsum_u32 (vs);
+      sq += hsum_u32 (vsq);
+      dsq += hsum_u32 (vdsq);
+    }
+#endif
+
+  for (; i < size; i++)
+    {
+      s += buf[i];
+      sq += buf[i] * buf[i];
+
+      if (ref)
+        {
+          int dev = (int) buf[i] - (int) ref[i];
+          dsq += dev * dev;
+        }
+    }
+
+  if (sum)
+    *sum = s;
+  if (sum_sq)
+    *sum_sq = sq;
+  if (diff_sq)
+    *diff_sq = dsq;
+}
+
+/* Squared standard deviation from the sums, using the same integer mean
+ * as a two pass calculation would. Expanding the squares is exact:
+ *   sum ((x - m) ^ 2) = sum (x ^ 2) - 2 * m * sum (x) + size * m ^ 2
+ */
+static gint
+std_sq_dev_from_sums (guint64 sum,
+                      guint64 sum_sq,
+                      gint    size,
+                      gint   *mean)
+{
+  guint64 m = sum / size;
+
+  if (mean)
+    *mean = m;
+
+  return (sum_sq + m * m * size - 2 * m * sum) / size;
+}
+
 /**
  * fpi_std_sq_dev:
  * @buf: buffer (usually bitmap, one byte per pixel)
@@ -57,21 +401,30 @@ gint
 fpi_std_sq_dev (const guint8 *buf,
                 gint          size)
 {
-  guint64 res = 0, mean = 0;
-  gint i;
-
-  for (i = 0; i < size; i++)
-    mean += buf[i];
+  return fpi_mean_std_sq_dev (buf, size, NULL);
+}
 
-  mean /= size;
+/**
+ * fpi_mean_std_sq_dev:
+ * @buf: buffer (usually bitmap, one byte per pixel)
+ * @size: size of @buffer
+ * @mean: (out) (optional): return location for the mean pixel value
+ *
+ * Same as fpi_std_sq_dev(), but also returns the (integer) mean of
+ * the pixels. Both are calculated in a single pass over @buf.
+ *
+ * Returns: the squared standard deviation for @buffer
+ */
+gint
+fpi_mean_std_sq_dev (const guint8 *buf,
+                     gint          size,
+                     gint         *mean)
+{
+  guint64 sum, sum_sq;
 
-  for (i = 0; i < size; i++)
-    {
-      int dev = (int) buf[i] - mean;
-      res += dev * dev;
-    }
+  line_stats (buf, NULL, size, &sum, &sum_sq, NULL);
 
-  return res / size;
+  return std_sq_dev_from_sums (sum, sum_sq, size, mean);
 }
 
 /**
@@ -96,15 +449,63 @@ fpi_mean_sq_diff_norm (const guint8 *buf1,
                        const guint8 *buf2,
                        gint          size)
 {
-  int res = 0, i;
+  guint64 diff_sq;
 
-  for (i = 0; i < size; i++)
-    {
-      int dev = (int) buf1[i] - (int) buf2[i];
-      res += dev * dev;
-    }
+  line_stats (buf1, buf2, size, NULL, NULL, &diff_sq);
+
+  return diff_sq / size;
+}
+
+/**
+ * fpi_line_classify:
+ * @line: the new line (one byte per pixel)
+ * @prev: (nullable): the previously recorded line, or %NULL
+ * @size: number of pixels in a line
+ * @blank_threshold: the line is blank if its squared standard deviation is
+ *   below this value
+ * @diff_threshold: the line differs if its normalized mean squared
+ *   difference to @prev is at least this value
+ * @std_sq_dev: (out) (optional): return location for fpi_std_sq_dev()
+ *   of @line
+ * @mean_sq_diff: (out) (optional): return location for
+ *   fpi_mean_sq_diff_norm() of @prev and @line, 0 if @prev is %NULL
+ *
+ * Classifies a scan line of a swipe sensor in a single pass over the
+ * data, instead of calling fpi_std_sq_dev() and fpi_mean_sq_diff_norm()
+ * separately. If @prev is %NULL, the line is always considered to differ.
+ *
+ * Returns: #FpiLineFlags describing @line
+ */
+FpiLineFlags
+fpi_line_classify (const guint8 *line,
+                   const guint8 *prev,
+                   gint          size,
+                   gint          blank_threshold,
+                   gint          diff_threshold,
+                   gint         *std_sq_dev,
+                   gint         *mean_sq_diff)
+{
+  FpiLineFlags flags = 0;
+  guint64 sum, sum_sq, diff_sq;
+  gint dev, diff = 0;
+
+  line_stats (line, prev, size, &sum, &sum_sq, &diff_sq);
+
+  dev = std_sq_dev_from_sums (sum, sum_sq, size, NULL);
+  if (dev < blank_threshold)
+    flags |= FPI_LINE_BLANK;
+
+  if (prev)
+    diff = diff_sq / size;
+  if (!prev || diff >= diff_threshold)
+    flags |= FPI_LINE_DIFFERS;
+
+  if (std_sq_dev)
+    *std_sq_dev = dev;
+  if (mean_sq_diff)
+    *mean_sq_diff = diff;
 
-  return res / size;
+  return flags;
 }
 
 #if HAVE_PIXMAN
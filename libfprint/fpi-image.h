@@ -28,18 +28,41 @@
  * @FPI_IMAGE_V_FLIPPED: the image is vertically flipped
  * @FPI_IMAGE_H_FLIPPED: the image is horizontally flipped
  * @FPI_IMAGE_COLORS_INVERTED: the colours are inverted
+ * @FPI_IMAGE_PARTIAL: the image is partial, removes minutiae on the perimeter
+ * @FPI_IMAGE_PARALLEL_DETECTION: the image is large, use several threads
+ *   for minutiae detection
  *
  * Flags used in an #FpImage structure to describe the contained image.
  * This is useful for image drivers as they can simply set these flags and
  * rely on the image to be normalized by libfprint before further processing.
  */
 typedef enum {
-  FPI_IMAGE_V_FLIPPED       = 1 << 0,
-  FPI_IMAGE_H_FLIPPED       = 1 << 1,
-  FPI_IMAGE_COLORS_INVERTED = 1 << 2,
-  FPI_IMAGE_PARTIAL         = 1 << 3,
+  FPI_IMAGE_V_FLIPPED          = 1 << 0,
+  FPI_IMAGE_H_FLIPPED          = 1 << 1,
+  FPI_IMAGE_COLORS_INVERTED    = 1 << 2,
+  FPI_IMAGE_PARTIAL            = 1 << 3,
+  FPI_IMAGE_PARALLEL_DETECTION = 1 << 4,
 } FpiImageFlags;
 
+/**
+ * FpiImageProcessFunc:
+ * @data: the raw capture data
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: Return location for errors
+ *
+ * Creates an #FpImage from raw capture data, e.g. by assembling the frames
+ * of a swipe sensor and scaling the result. The function is run in a worker
+ * thread, so it must not access the device.
+ *
+ * The error may be a retry error in the %FP_DEVICE_RETRY domain if the
+ * capture is unusable.
+ *
+ * Returns: (transfer full): The new #FpImage, or %NULL on error
+ */
+typedef FpImage * (*FpiImageProcessFunc) (gpointer      data,
+                                          GCancellable *cancellable,
+                                          GError      **error);
+
 /**
  * FpImage:
  * @width: Width of the image
@@ -64,19 +87,70 @@ struct _FpImage
   FpiImageFlags flags;
 
   /*< private >*/
+  /* Allocated using fpi_image_buffer_new() */
   guint8    *data;
   guint8    *binarized;
 
   GPtrArray *minutiae;
   guint      ref_count;
+
+  /* Set up by fpi_image_process_and_detect_minutiae(), the detection
+   * creates the image using these first. */
+  FpiImageProcessFunc process;
+  gpointer            process_data;
+  GDestroyNotify      process_data_destroy;
 };
 
+/**
+ * FPI_IMAGE_BUFFER_POOL_SIZE:
+ *
+ * The maximum number of released image buffers kept for reuse.
+ */
+#define FPI_IMAGE_BUFFER_POOL_SIZE 8
+
+guint8 *fpi_image_buffer_new (gsize size);
+guint8 *fpi_image_buffer_ref (guint8 *buffer);
+void fpi_image_buffer_unref (guint8 *buffer);
+gboolean fpi_image_buffer_is_shared (const guint8 *buffer);
+guint fpi_image_buffer_pool_get_length (void);
+
+void fpi_image_process_and_detect_minutiae (FpiImageProcessFunc process,
+                                            gpointer            process_data,
+                                            GDestroyNotify      process_data_destroy,
+                                            GCancellable       *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer            user_data);
+
 gint fpi_std_sq_dev (const guint8 *buf,
                      gint          size);
+gint fpi_mean_std_sq_dev (const guint8 *buf,
+                          gint          size,
+                          gint         *mean);
 gint fpi_mean_sq_diff_norm (const guint8 *buf1,
                             const guint8 *buf2,
                             gint          size);
 
+/**
+ * FpiLineFlags:
+ * @FPI_LINE_BLANK: the squared standard deviation of the line is below
+ *   the blank threshold
+ * @FPI_LINE_DIFFERS: the line differs enough from the previous line
+ *
+ * Flags returned by fpi_line_classify().
+ */
+typedef enum {
+  FPI_LINE_BLANK   = 1 << 0,
+  FPI_LINE_DIFFERS = 1 << 1,
+} FpiLineFlags;
+
+FpiLineFlags fpi_line_classify (const guint8 *line,
+                                const guint8 *prev,
+                                gint          size,
+                                gint          blank_threshold,
+                                gint          diff_threshold,
+                                gint         *std_sq_dev,
+                                gint         *mean_sq_diff);
+
 #if HAVE_PIXMAN
 FpImage *fpi_image_resize (FpImage *orig,
                            guint    w_factor,
@@ -19,6 +19,8 @@
  */
 
 #define FP_COMPONENT "print"
+#include <math.h>
+
 #include "fpi-log.h"
 
 #include "fp-print-private.h"
@@ -34,6 +36,22 @@
  * #FpPrint routines.
  */
 
+/* Prints loaded from a gallery share their storage, copy before modifying */
+static void
+ensure_prints_owned (FpPrint *print)
+{
+  guint i;
+
+  if (!print->prints_storage)
+    return;
+
+  for (i = 0; i < print->prints->len; i++)
+    print->prints->pdata[i] = g_memdup (print->prints->pdata[i], sizeof (struct xyt_struct));
+  g_ptr_array_set_free_func (print->prints, g_free);
+
+  g_clear_pointer (&print->prints_storage, g_bytes_unref);
+}
+
 /**
  * fpi_print_add_print:
  * @print: A #FpPrint
@@ -50,6 +68,7 @@ fpi_print_add_print (FpPrint *print, FpPrint *add)
   g_return_if_fail (add->type == FPI_PRINT_NBIS);
 
   g_assert (add->prints->len == 1);
+  ensure_prints_owned (print);
   g_ptr_array_add (print->prints, g_memdup (add->prints->pdata[0], sizeof (struct xyt_struct)));
 }
 
@@ -97,25 +116,63 @@ fpi_print_set_device_stored (FpPrint *print,
   g_object_notify (G_OBJECT (print), "device-stored");
 }
 
-/* XXX: This is the old version, but wouldn't it be smarter to instead
- * use the highest quality mintutiae? Possibly just using bz_prune from
- * upstream? */
+typedef struct
+{
+  double reliability;
+  int    index;
+} RankedMinutia;
+
+/* Most reliable first, ties are kept in detection order */
+static int
+sort_reliability (const void *a, const void *b)
+{
+  const RankedMinutia *ra = a;
+  const RankedMinutia *rb = b;
+
+  if (ra->reliability != rb->reliability)
+    return ra->reliability < rb->reliability ? 1 : -1;
+
+  return ra->index - rb->index;
+}
+
+/* With a @max_minutiae limit, keeps the most reliable minutiae, similar to
+ * what bz_prune does upstream. Both the size of the bozorth3 edge tables
+ * and the time to match grow quadratically with the number of minutiae,
+ * and noisy images tend to produce many spurious, low reliability minutiae.
+ * Without a limit, the first minutiae in detection order are kept so that
+ * templates of existing drivers stay the same. */
 static void
 minutiae_to_xyt (struct fp_minutiae *minutiae,
                  int                 bwidth,
                  int                 bheight,
+                 int                 max_minutiae,
                  struct xyt_struct  *xyt)
 {
   int i;
   struct fp_minutia *minutia;
-  struct minutiae_struct c[MAX_FILE_MINUTIAE];
+  struct minutiae_struct c[MAX_BOZORTH_MINUTIAE];
+  g_autofree RankedMinutia *ranked = NULL;
+  int nmin;
 
   /* struct xyt_struct uses arrays of MAX_BOZORTH_MINUTIAE (200) */
-  int nmin = min (minutiae->num, MAX_BOZORTH_MINUTIAE);
+  if (max_minutiae > 0)
+    nmin = min (minutiae->num, min (max_minutiae, MAX_BOZORTH_MINUTIAE));
+  else
+    nmin = min (minutiae->num, MAX_BOZORTH_MINUTIAE);
+
+  ranked = g_new (RankedMinutia, minutiae->num);
+  for (i = 0; i < minutiae->num; i++)
+    {
+      ranked[i].reliability = minutiae->list[i]->reliability;
+      ranked[i].index = i;
+    }
+
+  if (max_minutiae > 0 && nmin < minutiae->num)
+    qsort (ranked, minutiae->num, sizeof (RankedMinutia), sort_reliability);
 
   for (i = 0; i < nmin; i++)
     {
-      minutia = minutiae->list[i];
+      minutia = minutiae->list[ranked[i].index];
 
       lfs2nist_minutia_XYT (&c[i].col[0], &c[i].col[1], &c[i].col[2],
                             minutia, bwidth, bheight);
@@ -141,11 +198,17 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
  * fpi_print_add_from_image:
  * @print: A #FpPrint
  * @image: A #FpImage
+ * @max_minutiae: Maximum number of minutiae to keep, or 0 for the default
  * @error: Return location for error
  *
  * Extracts the minutiae from the given image and adds it to @print of
  * type #FPI_PRINT_NBIS.
  *
+ * If the image has more than @max_minutiae minutiae, only the most reliable
+ * ones are kept. The limit is never higher than %MAX_BOZORTH_MINUTIAE. With
+ * the default of 0, the first %MAX_BOZORTH_MINUTIAE minutiae in detection
+ * order are kept, which is what libfprint always did.
+ *
  * The @image will be kept so that API users can get retrieve it e.g.
  * for debugging purposes.
  *
@@ -154,6 +217,7 @@ minutiae_to_xyt (struct fp_minutiae *minutiae,
 gboolean
 fpi_print_add_from_image (FpPrint *print,
                           FpImage *image,
+                          gint     max_minutiae,
                           GError **error)
 {
   GPtrArray *minutiae;
@@ -184,7 +248,8 @@ fpi_print_add_from_image (FpPrint *print,
   _minutiae.alloc = minutiae->len;
 
   xyt = g_new0 (struct xyt_struct, 1);
-  minutiae_to_xyt (&_minutiae, image->width, image->height, xyt);
+  minutiae_to_xyt (&_minutiae, image->width, image->height, max_minutiae, xyt);
+  ensure_prints_owned (print);
   g_ptr_array_add (print->prints, xyt);
 
   g_clear_object (&print->image);
@@ -194,6 +259,205 @@ fpi_print_add_from_image (FpPrint *print,
   return TRUE;
 }
 
+/* The bozorth3 working tables are large, so keep one context per thread
+ * around rather than allocating it for every match. Using a thread local
+ * context means that matches may run in parallel from several threads. */
+static GPrivate bz3_context = G_PRIVATE_INIT ((GDestroyNotify) bozorth_context_free);
+
+static BozorthContext *
+get_bz3_context (void)
+{
+  BozorthContext *ctx = g_private_get (&bz3_context);
+
+  if (!ctx)
+    {
+      ctx = bozorth_context_new ();
+      g_private_set (&bz3_context, ctx);
+    }
+
+  return ctx;
+}
+
+/* The sorted edge table of an enrolled print only depends on the print
+ * itself. It is built on the first match and then cached on the #FpPrint, so
+ * that repeated matches against the same template only pay for the actual
+ * comparison. The lock only protects the cache array, the (expensive) table
+ * is built without holding it. */
+static GMutex bz3_galleries_lock;
+
+/* The caches are indexed like the prints, drop them when the prints are
+ * replaced. */
+void
+fpi_print_clear_bz3_caches (FpPrint *print)
+{
+  g_autoptr(GPtrArray) galleries = NULL;
+  g_autoptr(GPtrArray) descriptors = NULL;
+
+  g_mutex_lock (&bz3_galleries_lock);
+  galleries = g_steal_pointer (&print->bz3_galleries);
+  descriptors = g_steal_pointer (&print->bz3_descriptors);
+  g_mutex_unlock (&bz3_galleries_lock);
+}
+
+static BozorthGallery *
+get_bz3_gallery (BozorthContext *ctx, FpPrint *template, guint idx)
+{
+  BozorthGallery *gallery = NULL;
+  BozorthGallery *new_gallery;
+
+  g_mutex_lock (&bz3_galleries_lock);
+  if (template->bz3_galleries && idx < template->bz3_galleries->len)
+    gallery = g_ptr_array_index (template->bz3_galleries, idx);
+  g_mutex_unlock (&bz3_galleries_lock);
+
+  if (gallery)
+    return gallery;
+
+  new_gallery = bozorth_gallery_new (ctx, g_ptr_array_index (template->prints, idx));
+
+  g_mutex_lock (&bz3_galleries_lock);
+  if (!template->bz3_galleries)
+    template->bz3_galleries = g_ptr_array_new_with_free_func ((GDestroyNotify) bozorth_gallery_free);
+  if (template->bz3_galleries->len <= idx)
+    g_ptr_array_set_size (template->bz3_galleries, template->prints->len);
+
+  /* Someone else may have been faster */
+  gallery = g_ptr_array_index (template->bz3_galleries, idx);
+  if (!gallery)
+    {
+      gallery = new_gallery;
+      g_ptr_array_index (template->bz3_galleries, idx) = gallery;
+      new_gallery = NULL;
+    }
+  g_mutex_unlock (&bz3_galleries_lock);
+
+  g_clear_pointer (&new_gallery, bozorth_gallery_free);
+
+  return gallery;
+}
+
+static gint
+bz3_print_score (BozorthContext    *ctx,
+                 FpPrint           *template,
+                 guint              idx,
+                 struct xyt_struct *pstruct,
+                 gint               probe_len)
+{
+  BozorthGallery *gallery = get_bz3_gallery (ctx, template, idx);
+
+  return bozorth_to_gallery_cached_ctx (ctx, probe_len, pstruct,
+                                        g_ptr_array_index (template->prints, idx),
+                                        gallery);
+}
+
+/* Cheap descriptors of a print for ranking gallery candidates before running
+ * bozorth3. The distance histogram is invariant to rotation and translation,
+ * the orientation histogram only to translation, but fingers are usually
+ * placed in a similar orientation. */
+#define BZ3_DESC_THETA_BINS 12
+#define BZ3_DESC_DIST_BINS 16
+#define BZ3_DESC_DIST_BIN_WIDTH 16
+
+typedef struct
+{
+  gint   n;
+  gfloat theta[BZ3_DESC_THETA_BINS];
+  gfloat dist[BZ3_DESC_DIST_BINS];
+} Bz3Descriptor;
+
+static void
+bz3_descriptor_init (Bz3Descriptor *desc, const struct xyt_struct *xyt)
+{
+  gint n_pairs = 0;
+  gint i, j, bin;
+
+  *desc = (Bz3Descriptor) { .n = xyt->nrows };
+  if (desc->n == 0)
+    return;
+
+  for (i = 0; i < xyt->nrows; i++)
+    {
+      bin = ((xyt->thetacol[i] + 360) % 360) * BZ3_DESC_THETA_BINS / 360;
+      desc->theta[bin] += 1.0f / xyt->nrows;
+    }
+
+  for (i = 0; i < xyt->nrows; i++)
+    {
+      for (j = i + 1; j < xyt->nrows; j++)
+        {
+          gint dx = xyt->xcol[j] - xyt->xcol[i];
+          gint dy = xyt->ycol[j] - xyt->ycol[i];
+
+          bin = (gint) sqrtf (dx * dx + dy * dy) / BZ3_DESC_DIST_BIN_WIDTH;
+          desc->dist[MIN (bin, BZ3_DESC_DIST_BINS - 1)] += 1;
+          n_pairs += 1;
+        }
+    }
+
+  for (i = 0; n_pairs && i < BZ3_DESC_DIST_BINS; i++)
+    desc->dist[i] /= n_pairs;
+}
+
+/* Returns a similarity between 0 and 1 from histogram intersections and the
+ * ratio of the minutiae counts. */
+static gfloat
+bz3_descriptor_similarity (const Bz3Descriptor *a, const Bz3Descriptor *b)
+{
+  gfloat theta = 0, dist = 0, count;
+  gint i;
+
+  if (a->n == 0 || b->n == 0)
+    return 0;
+
+  for (i = 0; i < BZ3_DESC_THETA_BINS; i++)
+    theta += MIN (a->theta[i], b->theta[i]);
+
+  for (i = 0; i < BZ3_DESC_DIST_BINS; i++)
+    dist += MIN (a->dist[i], b->dist[i]);
+
+  count = (gfloat) MIN (a->n, b->n) / MAX (a->n, b->n);
+
+  return (2 * dist + theta + count) / 4;
+}
+
+/* Like the bozorth3 tables, descriptors are cached on the template. */
+static const Bz3Descriptor *
+get_bz3_descriptor (FpPrint *template, guint idx)
+{
+  Bz3Descriptor *desc = NULL;
+  Bz3Descriptor *new_desc;
+
+  g_mutex_lock (&bz3_galleries_lock);
+  if (template->bz3_descriptors && idx < template->bz3_descriptors->len)
+    desc = g_ptr_array_index (template->bz3_descriptors, idx);
+  g_mutex_unlock (&bz3_galleries_lock);
+
+  if (desc)
+    return desc;
+
+  new_desc = g_new (Bz3Descriptor, 1);
+  bz3_descriptor_init (new_desc, g_ptr_array_index (template->prints, idx));
+
+  g_mutex_lock (&bz3_galleries_lock);
+  if (!template->bz3_descriptors)
+    template->bz3_descriptors = g_ptr_array_new_with_free_func (g_free);
+  if (template->bz3_descriptors->len <= idx)
+    g_ptr_array_set_size (template->bz3_descriptors, template->prints->len);
+
+  desc = g_ptr_array_index (template->bz3_descriptors, idx);
+  if (!desc)
+    {
+      desc = new_desc;
+      g_ptr_array_index (template->bz3_descriptors, idx) = desc;
+      new_desc = NULL;
+    }
+  g_mutex_unlock (&bz3_galleries_lock);
+
+  g_free (new_desc);
+
+  return desc;
+}
+
 /**
  * fpi_print_bz3_match:
  * @template: A #FpPrint containing one or more prints
@@ -207,11 +471,14 @@ fpi_print_add_from_image (FpPrint *print,
  * Both @template and @print need to be of type #FPI_PRINT_NBIS for this to
  * work.
  *
+ * This function is thread safe, the matcher state is kept per thread.
+ *
  * Returns: Whether the prints match, @error will be set if #FPI_MATCH_ERROR is returned
  */
 FpiMatchResult
 fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GError **error)
 {
+  BozorthContext *ctx;
   struct xyt_struct *pstruct;
   gint probe_len;
   gint i;
@@ -231,15 +498,15 @@ fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GErr
       return FPI_MATCH_ERROR;
     }
 
+  ctx = get_bz3_context ();
   pstruct = g_ptr_array_index (print->prints, 0);
-  probe_len = bozorth_probe_init (pstruct);
+  probe_len = bozorth_probe_init_ctx (ctx, pstruct);
 
   for (i = 0; i < template->prints->len; i++)
     {
-      struct xyt_struct *gstruct;
       gint score;
-      gstruct = g_ptr_array_index (template->prints, i);
-      score = bozorth_to_gallery (probe_len, pstruct, gstruct);
+
+      score = bz3_print_score (ctx, template, i, pstruct, probe_len);
       fp_dbg ("score %d/%d", score, bz3_threshold);
 
       if (score >= bz3_threshold)
@@ -249,6 +516,425 @@ fpi_print_bz3_match (FpPrint *template, FpPrint *print, gint bz3_threshold, GErr
   return FPI_MATCH_FAIL;
 }
 
+/* Identification is sharded over a dedicated pool of matcher threads. The
+ * threads are exclusive to the pool, which means that they stay alive and
+ * keep their (large) bozorth3 context around between identifications. */
+#define BZ3_IDENTIFY_MIN_TEMPLATES_PER_WORKER 8
+
+typedef struct
+{
+  GPtrArray *templates;
+  gint       bz3_threshold;
+  gboolean   best_match;
+
+  /* Prefilter, only used if min_similarity is not negative */
+  gdouble       min_similarity;
+  Bz3Descriptor probe_desc;
+  /* Gallery indices in search order and their number, or NULL */
+  gint         *order;
+  gint          n_candidates;
+  gint          n_workers;
+
+  /* Next position to be matched, handed out atomically to the workers */
+  gint       next_template;
+  /* Number of workers that have not yet finished */
+  gint       pending_workers;
+
+  GMutex     lock;
+  gint       result_idx;
+  gint       result_pos;
+  gint       result_score;
+} Bz3IdentifyData;
+
+static void
+bz3_identify_data_free (Bz3IdentifyData *data)
+{
+  g_ptr_array_unref (data->templates);
+  g_free (data->order);
+  g_mutex_clear (&data->lock);
+  g_free (data);
+}
+
+typedef struct
+{
+  gint   idx;
+  gfloat similarity;
+} Bz3Candidate;
+
+static int
+sort_candidates (const void *a, const void *b)
+{
+  const Bz3Candidate *ca = a;
+  const Bz3Candidate *cb = b;
+
+  if (ca->similarity != cb->similarity)
+    return ca->similarity < cb->similarity ? 1 : -1;
+
+  return ca->idx - cb->idx;
+}
+
+/* Returns the highest score of any of the prints of @template, or the first
+ * score reaching the threshold unless doing a best match search. With the
+ * prefilter, the prints are tried in order of their similarity to the probe
+ * and those below the minimum similarity are skipped. */
+static gint
+bz3_template_score (BozorthContext    *ctx,
+                    Bz3IdentifyData   *data,
+                    FpPrint           *template,
+                    struct xyt_struct *pstruct,
+                    gint               probe_len)
+{
+  g_autofree Bz3Candidate *prints = NULL;
+  gint n_prints = 0;
+  gint best_score = 0;
+  gint i;
+
+  if (data->min_similarity < 0)
+    {
+      for (i = 0; i < template->prints->len; i++)
+        {
+          gint score;
+
+          score = bz3_print_score (ctx, template, i, pstruct, probe_len);
+          best_score = MAX (best_score, score);
+
+          if (!data->best_match && score >= data->bz3_threshold)
+            break;
+        }
+
+      return best_score;
+    }
+
+  prints = g_new (Bz3Candidate, template->prints->len);
+  for (i = 0; i < template->prints->len; i++)
+    {
+      gfloat similarity;
+
+      similarity = bz3_descriptor_similarity (&data->probe_desc,
+                                              get_bz3_descriptor (template, i));
+      if (similarity < data->min_similarity)
+        continue;
+
+      prints[n_prints].idx = i;
+      prints[n_prints].similarity = similarity;
+      n_prints += 1;
+    }
+
+  qsort (prints, n_prints, sizeof (Bz3Candidate), sort_candidates);
+
+  for (i = 0; i < n_prints; i++)
+    {
+      gint score;
+
+      score = bz3_print_score (ctx, template, prints[i].idx, pstruct, probe_len);
+      best_score = MAX (best_score, score);
+
+      if (!data->best_match && score >= data->bz3_threshold)
+        break;
+    }
+
+  return best_score;
+}
+
+/* Orders the gallery by descending similarity of the best matching print
+ * of each template, dropping templates below the minimum similarity. */
+static void
+bz3_identify_rank (Bz3IdentifyData *data)
+{
+  g_autofree Bz3Candidate *candidates = g_new (Bz3Candidate, data->templates->len);
+  gint n = 0;
+  gint i, j;
+
+  for (i = 0; i < data->templates->len; i++)
+    {
+      FpPrint *template = g_ptr_array_index (data->templates, i);
+      gfloat similarity = 0;
+
+      for (j = 0; j < template->prints->len; j++)
+        similarity = MAX (similarity,
+                          bz3_descriptor_similarity (&data->probe_desc,
+                                                     get_bz3_descriptor (template, j)));
+
+      if (similarity < data->min_similarity)
+        continue;
+
+      candidates[n].idx = i;
+      candidates[n].similarity = similarity;
+      n += 1;
+    }
+
+  qsort (candidates, n, sizeof (Bz3Candidate), sort_candidates);
+
+  data->order = g_new (gint, MAX (n, 1));
+  for (i = 0; i < n; i++)
+    data->order[i] = candidates[i].idx;
+  data->n_candidates = n;
+
+  fp_dbg ("Prefilter kept %d of %u templates", n, data->templates->len);
+}
+
+static void
+bz3_identify_complete (GTask *task)
+{
+  Bz3IdentifyData *data = g_task_get_task_data (task);
+  FpPrint *result = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  if (data->result_idx >= 0)
+    {
+      result = g_ptr_array_index (data->templates, data->result_idx);
+      fp_dbg ("Identified template %d with score %d/%d",
+              data->result_idx, data->result_score, data->bz3_threshold);
+    }
+
+  g_task_return_pointer (task,
+                         result ? g_object_ref (result) : NULL,
+                         g_object_unref);
+  g_object_unref (task);
+}
+
+static GThreadPool *get_bz3_thread_pool (void);
+
+static void
+bz3_identify_worker (gpointer task_ptr, gpointer user_data)
+{
+  GTask *task = task_ptr;
+  Bz3IdentifyData *data = g_task_get_task_data (task);
+  FpPrint *print = g_task_get_source_object (task);
+  GCancellable *cancellable = g_task_get_cancellable (task);
+  BozorthContext *ctx = get_bz3_context ();
+  struct xyt_struct *pstruct;
+  gint probe_len;
+
+  pstruct = g_ptr_array_index (print->prints, 0);
+
+  /* With the prefilter, the first job ranks the gallery and only then
+   * starts the remaining workers. */
+  if (data->min_similarity >= 0 && !data->order)
+    {
+      gint i;
+
+      bz3_identify_rank (data);
+      for (i = 1; i < data->n_workers; i++)
+        g_thread_pool_push (get_bz3_thread_pool (), task, NULL);
+    }
+
+  probe_len = bozorth_probe_init_ctx (ctx, pstruct);
+
+  while (!g_cancellable_is_cancelled (cancellable))
+    {
+      FpPrint *template;
+      gboolean better;
+      gint score;
+      gint pos, i;
+
+      pos = g_atomic_int_add (&data->next_template, 1);
+      if (pos >= data->n_candidates)
+        break;
+
+      /* Templates are handed out in order, so in first match mode there
+       * is nothing left to do for us once a match at an earlier position
+       * has been found. This way we report the same match as a serial
+       * search in the same order. */
+      if (!data->best_match)
+        {
+          g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&data->lock);
+
+          if (data->result_pos >= 0 && data->result_pos < pos)
+            break;
+        }
+
+      i = data->order ? data->order[pos] : pos;
+      template = g_ptr_array_index (data->templates, i);
+      score = bz3_template_score (ctx, data, template, pstruct, probe_len);
+      fp_dbg ("template %d score %d/%d", i, score, data->bz3_threshold);
+
+      if (score < data->bz3_threshold)
+        continue;
+
+      g_mutex_lock (&data->lock);
+      if (data->result_idx < 0)
+        better = TRUE;
+      else if (data->best_match)
+        better = score > data->result_score ||
+                 (score == data->result_score && i < data->result_idx);
+      else
+        better = pos < data->result_pos;
+
+      if (better)
+        {
+          data->result_idx = i;
+          data->result_pos = pos;
+          data->result_score = score;
+        }
+      g_mutex_unlock (&data->lock);
+    }
+
+  if (g_atomic_int_dec_and_test (&data->pending_workers))
+    bz3_identify_complete (task);
+}
+
+static GThreadPool *
+get_bz3_thread_pool (void)
+{
+  static gsize initialized = 0;
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&initialized))
+    {
+      pool = g_thread_pool_new (bz3_identify_worker, NULL,
+                                g_get_num_processors (), TRUE, NULL);
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return pool;
+}
+
+/**
+ * fpi_print_bz3_identify:
+ * @templates: (element-type FpPrint): The gallery of #FpPrint templates
+ * @print: A newly scanned #FpPrint to identify
+ * @bz3_threshold: The BZ3 match threshold
+ * @best_match: Whether to search for the best scoring match
+ * @min_similarity: Minimum prefilter similarity, or a negative value to
+ *   search the gallery in order without prefiltering
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: The callback to call once the search has finished
+ * @user_data: User data for @callback
+ *
+ * Asynchronously searches @templates for a match of the newly scanned
+ * @print (containing exactly one print). The matching happens on a pool of
+ * worker threads and the gallery is distributed across all of them.
+ *
+ * If @best_match is %FALSE, the first template (in gallery order) with a
+ * score of at least @bz3_threshold is returned, which is the same result
+ * as calling fpi_print_bz3_match() on each template in turn. Otherwise the
+ * whole gallery is searched and the template with the highest score is
+ * returned.
+ *
+ * If @min_similarity is not negative, the gallery is first ranked using
+ * cheap descriptors of the minutiae (their number, an orientation histogram
+ * and a histogram of the pairwise distances), which are cached on the
+ * templates. Templates and their prints are then matched from the most to
+ * the least similar, so in first match mode a genuine match is usually
+ * found after trying only a small part of the gallery. The first match is
+ * then the first one in this order rather than in gallery order. Prints
+ * with a similarity (between 0 and 1) below @min_similarity are not matched
+ * at all, 0 only ranks without rejecting anything.
+ *
+ * All prints need to be of type #FPI_PRINT_NBIS for this to work.
+ */
+void
+fpi_print_bz3_identify (GPtrArray          *templates,
+                        FpPrint            *print,
+                        gint                bz3_threshold,
+                        gboolean            best_match,
+                        gdouble             min_similarity,
+                        GCancellable       *cancellable,
+                        GAsyncReadyCallback callback,
+                        gpointer            user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  Bz3IdentifyData *data;
+  GThreadPool *pool;
+  gint n_workers;
+  gint i;
+
+  g_return_if_fail (templates != NULL);
+  g_return_if_fail (FP_IS_PRINT (print));
+
+  task = g_task_new (print, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fpi_print_bz3_identify);
+
+  if (print->type != FPI_PRINT_NBIS)
+    {
+      g_task_return_error (task,
+                           fpi_device_error_new_msg (FP_DEVICE_ERROR_NOT_SUPPORTED,
+                                                     "It is only possible to match NBIS type print data"));
+      return;
+    }
+
+  if (print->prints->len != 1)
+    {
+      g_task_return_error (task,
+                           fpi_device_error_new_msg (FP_DEVICE_ERROR_GENERAL,
+                                                     "New print contains more than one print!"));
+      return;
+    }
+
+  for (i = 0; i < templates->len; i++)
+    {
+      FpPrint *template = g_ptr_array_index (templates, i);
+
+      if (template->type != FPI_PRINT_NBIS)
+        {
+          g_task_return_error (task,
+                               fpi_device_error_new_msg (FP_DEVICE_ERROR_NOT_SUPPORTED,
+                                                         "It is only possible to match NBIS type print data"));
+          return;
+        }
+    }
+
+  if (templates->len == 0)
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      return;
+    }
+
+  pool = get_bz3_thread_pool ();
+  n_workers = g_thread_pool_get_max_threads (pool);
+  n_workers = CLAMP (templates->len / BZ3_IDENTIFY_MIN_TEMPLATES_PER_WORKER,
+                     1, n_workers);
+
+  data = g_new0 (Bz3IdentifyData, 1);
+  data->templates = g_ptr_array_ref (templates);
+  data->bz3_threshold = bz3_threshold;
+  data->best_match = best_match;
+  data->min_similarity = min_similarity;
+  data->n_candidates = templates->len;
+  data->n_workers = n_workers;
+  data->pending_workers = n_workers;
+  data->result_idx = -1;
+  data->result_pos = -1;
+  g_mutex_init (&data->lock);
+  g_task_set_task_data (task, data, (GDestroyNotify) bz3_identify_data_free);
+
+  if (min_similarity >= 0)
+    bz3_descriptor_init (&data->probe_desc, g_ptr_array_index (print->prints, 0));
+
+  /* The workers share one reference, the last one to finish drops it. The
+   * prefilter ranks the gallery in the first job, which starts the rest. */
+  g_object_ref (task);
+  for (i = 0; i < (min_similarity >= 0 ? 1 : n_workers); i++)
+    g_thread_pool_push (pool, task, NULL);
+}
+
+/**
+ * fpi_print_bz3_identify_finish:
+ * @print: The #FpPrint passed to fpi_print_bz3_identify()
+ * @res: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with fpi_print_bz3_identify().
+ *
+ * Returns: (transfer full) (nullable): The matching template or %NULL if
+ *   there was no match or an error occurred.
+ */
+FpPrint *
+fpi_print_bz3_identify_finish (FpPrint      *print,
+                               GAsyncResult *res,
+                               GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, print), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 /**
  * fpi_print_generate_user_id:
  * @print: #FpPrint to generate the ID for
@@ -40,6 +40,7 @@ void     fpi_print_set_device_stored (FpPrint *print,
 
 gboolean fpi_print_add_from_image (FpPrint *print,
                                    FpImage *image,
+                                   gint     max_minutiae,
                                    GError **error);
 
 FpiMatchResult fpi_print_bz3_match (FpPrint *temp,
@@ -47,6 +48,18 @@ FpiMatchResult fpi_print_bz3_match (FpPrint *temp,
                                     gint     bz3_threshold,
                                     GError **error);
 
+void     fpi_print_bz3_identify (GPtrArray          *templates,
+                                 FpPrint            *print,
+                                 gint                bz3_threshold,
+                                 gboolean            best_match,
+                                 gdouble             min_similarity,
+                                 GCancellable       *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer            user_data);
+FpPrint *fpi_print_bz3_identify_finish (FpPrint      *print,
+                                        GAsyncResult *res,
+                                        GError      **error);
+
 /* Helpers to encode metadata into user ID strings. */
 gchar *  fpi_print_generate_user_id (FpPrint *print);
 gboolean fpi_print_fill_from_user_id (FpPrint    *print,
@@ -18,6 +18,7 @@
  */
 
 #include "fpi-spi-transfer.h"
+#include "fp-device-private.h"
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 #include <errno.h>
@@ -27,6 +28,11 @@
 #define SPIDEV_BLOCK_SIZE_FALLBACK 4096
 static gsize block_size = 0;
 
+/* Maximum number of spi_ioc_transfer entries in one batched ioctl. */
+#define SPIDEV_BATCH_MAX_XFERS 64
+
+static FpiSpiTransferIoctlFunc ioctl_func = NULL;
+
 /**
  * SECTION:fpi-spi-transfer
  * @title: SPI transfer helpers
@@ -41,6 +47,13 @@ static gsize block_size = 0;
  * Drivers should always use this API rather than calling read/write/ioctl on
  * the spidev device.
  *
+ * Multiple small transfers can be combined using fpi_spi_transfer_batch_add().
+ * These are then sent to the kernel in as few ioctl calls as possible while
+ * keeping the chip select behaviour of separate transfers.
+ *
+ * Asynchronous transfers of a device are run in order by a thread dedicated
+ * to that device.
+ *
  * Setting G_MESSAGES_DEBUG and FP_DEBUG_TRANSFER will result in the message
  * content to be dumped.
  */
@@ -167,6 +180,8 @@ fpi_spi_transfer_free (FpiSpiTransfer *self)
   self->buffer_wr = NULL;
   self->buffer_rd = NULL;
 
+  g_clear_pointer (&self->batch, g_ptr_array_unref);
+
   g_slice_free (FpiSpiTransfer, self);
 }
 
@@ -293,6 +308,62 @@ fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
   transfer->free_buffer_rd = free_func;
 }
 
+/**
+ * fpi_spi_transfer_batch_add:
+ * @transfer: The #FpiSpiTransfer to submit
+ * @next: (transfer full): A filled #FpiSpiTransfer to run after @transfer
+ *
+ * Adds @next to the batch of @transfer. When @transfer is submitted, all
+ * transfers of the batch are run in the order they were added. Small
+ * transfers are combined into a single ioctl call, which avoids the
+ * overhead of a round trip for each of them. The chip select is still
+ * toggled between the transfers, so the resulting bus traffic is the same
+ * as if the transfers were submitted one by one.
+ *
+ * Only @transfer will have its callback called, which happens once the
+ * whole batch has completed or the first error was encountered. The
+ * transfers of the batch are free'ed together with @transfer.
+ */
+void
+fpi_spi_transfer_batch_add (FpiSpiTransfer *transfer,
+                            FpiSpiTransfer *next)
+{
+  g_return_if_fail (transfer);
+  g_return_if_fail (next);
+  g_return_if_fail (next->batch == NULL);
+  g_return_if_fail (transfer->callback == NULL);
+  g_return_if_fail (transfer->spidev_fd == next->spidev_fd);
+
+  if (!transfer->batch)
+    transfer->batch = g_ptr_array_new_with_free_func ((GDestroyNotify) fpi_spi_transfer_unref);
+
+  g_ptr_array_add (transfer->batch, next);
+}
+
+static inline FpiSpiTransfer *
+batch_get (FpiSpiTransfer *transfer, guint idx)
+{
+  if (idx == 0)
+    return transfer;
+
+  return g_ptr_array_index (transfer->batch, idx - 1);
+}
+
+static inline guint
+batch_len (FpiSpiTransfer *transfer)
+{
+  return 1 + (transfer->batch ? transfer->batch->len : 0);
+}
+
+static void
+log_batch (FpiSpiTransfer *transfer, gboolean submit, GError *error)
+{
+  guint i;
+
+  for (i = 0; i < batch_len (transfer); i++)
+    log_transfer (batch_get (transfer, i), submit, error);
+}
+
 static void
 transfer_finish_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
@@ -303,13 +374,23 @@ transfer_finish_cb (GObject *source_object, GAsyncResult *res, gpointer user_dat
 
   g_task_propagate_boolean (task, &error);
 
-  log_transfer (transfer, FALSE, error);
+  log_batch (transfer, FALSE, error);
 
   callback = transfer->callback;
   transfer->callback = NULL;
   callback (transfer, transfer->device, transfer->user_data, error);
 }
 
+static int
+transfer_ioctl (int fd, guint n_xfers, struct spi_ioc_transfer *xfers)
+{
+  if (ioctl_func)
+    return ioctl_func (fd, n_xfers, xfers);
+
+  /* This ioctl cannot be interrupted. */
+  return ioctl (fd, SPI_IOC_MESSAGE (n_xfers), xfers);
+}
+
 static int
 transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
 {
@@ -373,8 +454,7 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
       xfer[transfers - 1].cs_change = TRUE;
     }
 
-  /* This ioctl cannot be interrupted. */
-  status = ioctl (transfer->spidev_fd, SPI_IOC_MESSAGE (transfers), xfer);
+  status = transfer_ioctl (transfer->spidev_fd, transfers, xfer);
 
   if (status >= 0)
     *transferred += len;
@@ -382,6 +462,88 @@ transfer_chunk (FpiSpiTransfer *transfer, gsize full_length, gsize *transferred)
   return status;
 }
 
+static gsize
+transfer_length (FpiSpiTransfer *transfer)
+{
+  gsize full_length = 0;
+
+  if (transfer->buffer_wr)
+    full_length += transfer->length_wr;
+  if (transfer->buffer_rd)
+    full_length += transfer->length_rd;
+
+  return full_length;
+}
+
+static int
+transfer_single (FpiSpiTransfer *transfer)
+{
+  gsize full_length = transfer_length (transfer);
+  gsize transferred = 0;
+  int status = 0;
+
+  while (transferred < full_length && status >= 0)
+    status = transfer_chunk (transfer, full_length, &transferred);
+
+  return status;
+}
+
+/* Runs the transfers starting at @first in one ioctl, for as long as they
+ * fit into a single block. Returns the number of transfers that were run,
+ * or zero if the transfer at @first needs to be run on its own. */
+static int
+transfer_batched (FpiSpiTransfer *transfer, guint first, guint *done)
+{
+  struct spi_ioc_transfer xfer[SPIDEV_BATCH_MAX_XFERS] = { 0 };
+  guint n_transfers = batch_len (transfer);
+  gsize len = 0;
+  int transfers = 0;
+  guint i;
+
+  for (i = first; i < n_transfers; i++)
+    {
+      FpiSpiTransfer *t = batch_get (transfer, i);
+      gsize t_len = transfer_length (t);
+      int t_xfers = (t->buffer_wr ? 1 : 0) + (t->buffer_rd ? 1 : 0);
+
+      if (len + t_len > block_size ||
+          transfers + t_xfers > SPIDEV_BATCH_MAX_XFERS)
+        break;
+
+      /* Deselect the chip after the previous transfer, just as if the
+       * transfers were submitted separately. */
+      if (transfers > 0)
+        xfer[transfers - 1].cs_change = TRUE;
+
+      if (t->buffer_wr)
+        {
+          xfer[transfers].tx_buf = (gsize) t->buffer_wr;
+          xfer[transfers].len = t->length_wr;
+          transfers += 1;
+        }
+
+      if (t->buffer_rd)
+        {
+          xfer[transfers].rx_buf = (gsize) t->buffer_rd;
+          xfer[transfers].len = t->length_rd;
+          transfers += 1;
+        }
+
+      len += t_len;
+    }
+
+  /* Nothing to gain for a single transfer */
+  if (i - first < 2)
+    {
+      *done = 0;
+      return 0;
+    }
+
+  *done = i - first;
+
+  return transfer_ioctl (transfer->spidev_fd, transfers, xfer);
+}
+
 static void
 transfer_thread_func (GTask        *task,
                       gpointer      source_object,
@@ -389,27 +551,38 @@ transfer_thread_func (GTask        *task,
                       GCancellable *cancellable)
 {
   FpiSpiTransfer *transfer = (FpiSpiTransfer *) task_data;
-  gsize full_length;
-  gsize transferred = 0;
+  guint n_transfers = batch_len (transfer);
+  guint i;
   int status = 0;
 
-  if (transfer->buffer_wr == NULL && transfer->buffer_rd == NULL)
+  for (i = 0; i < n_transfers; i++)
     {
-      g_task_return_new_error (task,
-                               G_IO_ERROR,
-                               G_IO_ERROR_INVALID_ARGUMENT,
-                               "Transfer with neither write or read!");
-      return;
+      FpiSpiTransfer *t = batch_get (transfer, i);
+
+      if (t->buffer_wr == NULL && t->buffer_rd == NULL)
+        {
+          g_task_return_new_error (task,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_INVALID_ARGUMENT,
+                                   "Transfer with neither write or read!");
+          return;
+        }
     }
 
-  full_length = 0;
-  if (transfer->buffer_wr)
-    full_length += transfer->length_wr;
-  if (transfer->buffer_rd)
-    full_length += transfer->length_rd;
+  i = 0;
+  while (i < n_transfers && status >= 0)
+    {
+      guint done = 0;
 
-  while (transferred < full_length && status >= 0)
-    status = transfer_chunk (transfer, full_length, &transferred);
+      status = transfer_batched (transfer, i, &done);
+      if (done == 0)
+        {
+          status = transfer_single (batch_get (transfer, i));
+          done = 1;
+        }
+
+      i += done;
+    }
 
   if (status < 0)
     {
@@ -458,7 +631,7 @@ fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
   transfer->callback = callback;
   transfer->user_data = user_data;
 
-  log_transfer (transfer, TRUE, NULL);
+  log_batch (transfer, TRUE, NULL);
 
   task = g_task_new (transfer->device,
                      cancellable,
@@ -468,7 +641,7 @@ fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                         g_steal_pointer (&transfer),
                         (GDestroyNotify) fpi_spi_transfer_unref);
 
-  g_task_run_in_thread (task, transfer_thread_func);
+  fpi_device_run_in_io_thread (transfer->device, task, transfer_thread_func);
 }
 
 /**
@@ -497,7 +670,7 @@ fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
   /* Recycling is allowed, but not two at the same time. */
   g_return_val_if_fail (transfer->callback == NULL, FALSE);
 
-  log_transfer (transfer, TRUE, NULL);
+  log_batch (transfer, TRUE, NULL);
 
   task = g_task_new (transfer->device,
                      NULL,
@@ -511,9 +684,24 @@ fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
 
   res = g_task_propagate_boolean (task, &err);
 
-  log_transfer (transfer, FALSE, err);
+  log_batch (transfer, FALSE, err);
 
   g_propagate_error (error, err);
 
   return res;
 }
+
+/**
+ * fpi_spi_transfer_set_ioctl_func:
+ * @func: (nullable): The #FpiSpiTransferIoctlFunc, or %NULL
+ *
+ * Replaces the SPI_IOC_MESSAGE ioctl for all transfers. This allows unit
+ * tests to check the messages that would be sent to the kernel. Passing
+ * %NULL restores the default. It must be set while no transfer is in
+ * flight.
+ */
+void
+fpi_spi_transfer_set_ioctl_func (FpiSpiTransferIoctlFunc func)
+{
+  ioctl_func = func;
+}
@@ -73,8 +73,27 @@ struct _FpiSpiTransfer
   /* Data free function */
   GDestroyNotify free_buffer_wr;
   GDestroyNotify free_buffer_rd;
+
+  /* Further transfers submitted together with this one */
+  GPtrArray *batch;
 };
 
+struct spi_ioc_transfer;
+
+/**
+ * FpiSpiTransferIoctlFunc:
+ * @spidev_fd: The file descriptor of the spidev device
+ * @n_xfers: The number of entries in @xfers
+ * @xfers: The messages, as passed to the SPI_IOC_MESSAGE ioctl
+ *
+ * Runs the SPI_IOC_MESSAGE ioctl, see fpi_spi_transfer_set_ioctl_func().
+ *
+ * Returns: A negative value with errno set on failure
+ */
+typedef int (*FpiSpiTransferIoctlFunc)(int                      spidev_fd,
+                                       guint                    n_xfers,
+                                       struct spi_ioc_transfer *xfers);
+
 GType              fpi_spi_transfer_get_type (void) G_GNUC_CONST;
 FpiSpiTransfer     *fpi_spi_transfer_new (FpDevice *device,
                                           int       spidev_fd);
@@ -99,6 +118,9 @@ void               fpi_spi_transfer_read_full (FpiSpiTransfer *transfer,
                                                gsize           length,
                                                GDestroyNotify  free_func);
 
+void               fpi_spi_transfer_batch_add (FpiSpiTransfer *transfer,
+                                               FpiSpiTransfer *next);
+
 void               fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
                                             GCancellable          *cancellable,
                                             FpiSpiTransferCallback callback,
@@ -107,6 +129,8 @@ void               fpi_spi_transfer_submit (FpiSpiTransfer        *transfer,
 gboolean           fpi_spi_transfer_submit_sync (FpiSpiTransfer *transfer,
                                                  GError        **error);
 
+void               fpi_spi_transfer_set_ioctl_func (FpiSpiTransferIoctlFunc func);
+
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiSpiTransfer, fpi_spi_transfer_unref)
 
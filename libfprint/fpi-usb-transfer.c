@@ -548,3 +548,311 @@ fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
 
   return res;
 }
+
+typedef struct
+{
+  FpiUsbStream   *stream;
+  FpiUsbTransfer *transfer;
+  gboolean        done;
+  GError         *error;
+} FpiUsbStreamSlot;
+
+/**
+ * FpiUsbStream:
+ *
+ * Opaque structure to keep a number of bulk transfers in flight on one
+ * endpoint, see fpi_usb_stream_new().
+ */
+struct _FpiUsbStream
+{
+  FpDevice                   *device;
+  guint                       ref_count;
+
+  FpiUsbStreamSlot           *slots;
+  guint                       n_slots;
+  /* Oldest submitted slot, completions are delivered from here on */
+  guint                       head;
+  guint                       num_flying;
+
+  guint                       timeout_ms;
+  GCancellable               *cancellable;
+  gboolean                    stopping;
+  gboolean                    stop_requested;
+
+  FpiUsbStreamCallback        callback;
+  FpiUsbStreamStoppedCallback stopped_callback;
+  gpointer                    user_data;
+
+  FpiUsbStreamSubmitFunc      submit;
+};
+
+static void
+stream_unref (FpiUsbStream *stream)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&stream->ref_count))
+    return;
+
+  for (i = 0; i < stream->n_slots; i++)
+    {
+      g_clear_error (&stream->slots[i].error);
+      fpi_usb_transfer_unref (stream->slots[i].transfer);
+    }
+
+  g_clear_object (&stream->cancellable);
+  g_free (stream->slots);
+  g_slice_free (FpiUsbStream, stream);
+}
+
+static void stream_transfer_cb (FpiUsbTransfer *transfer,
+                                FpDevice       *device,
+                                gpointer        user_data,
+                                GError         *error);
+
+static void
+stream_submit (FpiUsbStream *stream, FpiUsbStreamSlot *slot)
+{
+  g_atomic_int_inc (&stream->ref_count);
+  stream->num_flying++;
+
+  stream->submit (fpi_usb_transfer_ref (slot->transfer),
+                  stream->timeout_ms,
+                  stream->cancellable,
+                  stream_transfer_cb,
+                  slot);
+}
+
+static void
+stream_notify_stopped (FpiUsbStream *stream)
+{
+  stream->stop_requested = FALSE;
+
+  if (stream->stopped_callback)
+    stream->stopped_callback (stream, stream->device, stream->user_data);
+}
+
+static void
+stream_deliver (FpiUsbStream *stream)
+{
+  while (!stream->stopping)
+    {
+      FpiUsbStreamSlot *slot = &stream->slots[stream->head];
+      GError *error;
+
+      if (!slot->done)
+        return;
+
+      slot->done = FALSE;
+      error = g_steal_pointer (&slot->error);
+
+      if (error)
+        {
+          /* Stop the stream, the remaining transfers are cancelled and
+           * their data is dropped. */
+          stream->stopping = TRUE;
+          g_cancellable_cancel (stream->cancellable);
+        }
+
+      stream->callback (stream, slot->transfer, stream->device,
+                        stream->user_data, error);
+
+      if (stream->stopping)
+        return;
+
+      stream_submit (stream, slot);
+      stream->head = (stream->head + 1) % stream->n_slots;
+    }
+}
+
+static void
+stream_transfer_cb (FpiUsbTransfer *transfer,
+                    FpDevice       *device,
+                    gpointer        user_data,
+                    GError         *error)
+{
+  FpiUsbStreamSlot *slot = user_data;
+  FpiUsbStream *stream = slot->stream;
+
+  stream->num_flying--;
+
+  if (stream->stopping)
+    {
+      g_clear_error (&error);
+
+      if (stream->num_flying == 0 && stream->stop_requested)
+        stream_notify_stopped (stream);
+    }
+  else
+    {
+      slot->done = TRUE;
+      slot->error = error;
+      stream_deliver (stream);
+    }
+
+  stream_unref (stream);
+}
+
+/**
+ * fpi_usb_stream_new:
+ * @device: The #FpDevice the stream belongs to
+ * @endpoint: The bulk endpoint to read from
+ * @length: The buffer size of each transfer
+ * @n_transfers: The number of transfers to keep in flight
+ *
+ * Creates a stream of bulk reads from @endpoint. Once started, the stream
+ * keeps @n_transfers transfers submitted at all times, so that the device
+ * can always send data even if the main loop is busy for a moment.
+ *
+ * The transfers and their buffers are allocated once and then reused for
+ * the lifetime of the stream.
+ *
+ * Returns: (transfer full): A new #FpiUsbStream
+ */
+FpiUsbStream *
+fpi_usb_stream_new (FpDevice *device,
+                    guint8    endpoint,
+                    gsize     length,
+                    guint     n_transfers)
+{
+  FpiUsbStream *stream;
+  guint i;
+
+  g_return_val_if_fail (device != NULL, NULL);
+  g_return_val_if_fail (n_transfers > 0, NULL);
+
+  stream = g_slice_new0 (FpiUsbStream);
+  stream->device = device;
+  stream->ref_count = 1;
+  stream->n_slots = n_transfers;
+  stream->slots = g_new0 (FpiUsbStreamSlot, n_transfers);
+  stream->submit = fpi_usb_transfer_submit;
+
+  for (i = 0; i < n_transfers; i++)
+    {
+      stream->slots[i].stream = stream;
+      stream->slots[i].transfer = fpi_usb_transfer_new (device);
+      fpi_usb_transfer_fill_bulk (stream->slots[i].transfer, endpoint, length);
+    }
+
+  return stream;
+}
+
+/**
+ * fpi_usb_stream_free:
+ * @stream: The #FpiUsbStream
+ *
+ * Cancels all transfers of @stream and frees it. No callbacks will be
+ * called anymore, the memory is released once the last cancelled transfer
+ * has returned.
+ */
+void
+fpi_usb_stream_free (FpiUsbStream *stream)
+{
+  g_return_if_fail (stream);
+
+  stream->callback = NULL;
+  stream->stopped_callback = NULL;
+  stream->stopping = TRUE;
+  if (stream->cancellable)
+    g_cancellable_cancel (stream->cancellable);
+
+  stream_unref (stream);
+}
+
+/**
+ * fpi_usb_stream_start:
+ * @stream: The #FpiUsbStream
+ * @timeout_ms: Timeout for each transfer in ms
+ * @callback: Callback for each completed transfer
+ * @stopped_callback: (nullable): Callback once the stream stopped after
+ *   fpi_usb_stream_stop()
+ * @user_data: Data to pass to the callbacks
+ *
+ * Submits all transfers of @stream. @callback is called for each completed
+ * transfer in the order the transfers were submitted, even if the
+ * completions arrive in a different order. The transfer is resubmitted
+ * after @callback returns, so the data in its buffer needs to be copied if
+ * it is required later on.
+ *
+ * If a transfer fails, the stream stops and @callback is called a last
+ * time with the error. The callback takes ownership of the error.
+ *
+ * A stream can be started again after it has stopped.
+ */
+void
+fpi_usb_stream_start (FpiUsbStream               *stream,
+                      guint                       timeout_ms,
+                      FpiUsbStreamCallback        callback,
+                      FpiUsbStreamStoppedCallback stopped_callback,
+                      gpointer                    user_data)
+{
+  guint i;
+
+  g_return_if_fail (stream);
+  g_return_if_fail (callback);
+  g_return_if_fail (stream->num_flying == 0);
+
+  stream->timeout_ms = timeout_ms;
+  stream->callback = callback;
+  stream->stopped_callback = stopped_callback;
+  stream->user_data = user_data;
+  stream->stopping = FALSE;
+  stream->stop_requested = FALSE;
+  stream->head = 0;
+
+  g_clear_object (&stream->cancellable);
+  stream->cancellable = g_cancellable_new ();
+
+  for (i = 0; i < stream->n_slots; i++)
+    {
+      stream->slots[i].done = FALSE;
+      g_clear_error (&stream->slots[i].error);
+    }
+
+  for (i = 0; i < stream->n_slots; i++)
+    stream_submit (stream, &stream->slots[i]);
+}
+
+/**
+ * fpi_usb_stream_stop:
+ * @stream: The #FpiUsbStream
+ *
+ * Cancels all transfers of @stream, data that is still in flight is
+ * dropped. The stopped callback passed to fpi_usb_stream_start() is
+ * called once no transfer is in flight anymore, which may happen right
+ * away.
+ */
+void
+fpi_usb_stream_stop (FpiUsbStream *stream)
+{
+  g_return_if_fail (stream);
+
+  stream->stopping = TRUE;
+  stream->stop_requested = TRUE;
+  if (stream->cancellable)
+    g_cancellable_cancel (stream->cancellable);
+
+  if (stream->num_flying == 0)
+    stream_notify_stopped (stream);
+}
+
+/**
+ * fpi_usb_stream_set_submit_func:
+ * @stream: The #FpiUsbStream
+ * @submit: The #FpiUsbStreamSubmitFunc
+ *
+ * Replaces fpi_usb_transfer_submit() for the transfers of @stream. This
+ * allows unit tests to complete the transfers themselves. It must be set
+ * while no transfer is in flight.
+ */
+void
+fpi_usb_stream_set_submit_func (FpiUsbStream          *stream,
+                                FpiUsbStreamSubmitFunc submit)
+{
+  g_return_if_fail (stream);
+  g_return_if_fail (submit);
+  g_return_if_fail (stream->num_flying == 0);
+
+  stream->submit = submit;
+}
@@ -31,6 +31,7 @@ G_BEGIN_DECLS
 #define FPI_USB_ENDPOINT_OUT 0x00
 
 typedef struct _FpiUsbTransfer FpiUsbTransfer;
+typedef struct _FpiUsbStream   FpiUsbStream;
 typedef struct _FpiSsm         FpiSsm;
 
 typedef void (*FpiUsbTransferCallback)(FpiUsbTransfer *transfer,
@@ -153,7 +154,68 @@ gboolean           fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
                                                  guint           timeout_ms,
                                                  GError        **error);
 
+/**
+ * FpiUsbStreamCallback:
+ * @stream: The #FpiUsbStream
+ * @transfer: The completed transfer
+ * @dev: The #FpDevice the stream belongs to
+ * @user_data: User data passed to fpi_usb_stream_start()
+ * @error: (transfer full): The #GError or %NULL
+ *
+ * Called for each completed transfer of a #FpiUsbStream. The data is in
+ * the buffer of @transfer and is only valid until the callback returns.
+ */
+typedef void (*FpiUsbStreamCallback)(FpiUsbStream   *stream,
+                                     FpiUsbTransfer *transfer,
+                                     FpDevice       *dev,
+                                     gpointer        user_data,
+                                     GError         *error);
+
+/**
+ * FpiUsbStreamStoppedCallback:
+ * @stream: The #FpiUsbStream
+ * @dev: The #FpDevice the stream belongs to
+ * @user_data: User data passed to fpi_usb_stream_start()
+ *
+ * Called once all transfers of a stopped #FpiUsbStream have returned.
+ */
+typedef void (*FpiUsbStreamStoppedCallback)(FpiUsbStream *stream,
+                                            FpDevice     *dev,
+                                            gpointer      user_data);
+
+/**
+ * FpiUsbStreamSubmitFunc:
+ * @transfer: (transfer full): The transfer to submit
+ * @timeout_ms: Timeout for the transfer in ms
+ * @cancellable: Cancellable of the stream
+ * @callback: Callback on completion or error
+ * @user_data: Data to pass to callback
+ *
+ * Submits a transfer of a #FpiUsbStream, see fpi_usb_transfer_submit()
+ * which is used by default.
+ */
+typedef void (*FpiUsbStreamSubmitFunc)(FpiUsbTransfer        *transfer,
+                                       guint                  timeout_ms,
+                                       GCancellable          *cancellable,
+                                       FpiUsbTransferCallback callback,
+                                       gpointer               user_data);
+
+FpiUsbStream      *fpi_usb_stream_new (FpDevice *device,
+                                       guint8    endpoint,
+                                       gsize     length,
+                                       guint     n_transfers);
+void               fpi_usb_stream_free (FpiUsbStream *stream);
+
+void               fpi_usb_stream_start (FpiUsbStream               *stream,
+                                         guint                       timeout_ms,
+                                         FpiUsbStreamCallback        callback,
+                                         FpiUsbStreamStoppedCallback stopped_callback,
+                                         gpointer                    user_data);
+void               fpi_usb_stream_stop (FpiUsbStream *stream);
+void               fpi_usb_stream_set_submit_func (FpiUsbStream          *stream,
+                                                   FpiUsbStreamSubmitFunc submit);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbTransfer, fpi_usb_transfer_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbStream, fpi_usb_stream_free)
 
 G_END_DECLS
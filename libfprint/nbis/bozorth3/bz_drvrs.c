@@ -68,17 +68,29 @@ of the software.
 #cat:                        single probe fingerprint is to be matched
 #cat:                        to a single gallery fingerprint as in
 #cat:                        verificaiton mode
+#cat: bozorth_probe_init_ctx, bozorth_gallery_init_ctx,
+#cat: bozorth_to_gallery_ctx - variants of the above using the tables
+#cat:                        of a caller supplied BozorthContext, so
+#cat:                        that several matches may run concurrently
+#cat: bozorth_gallery_new -  builds and keeps a copy of the pruned and
+#cat:                        sorted comparison table of a gallery
+#cat:                        fingerprint, so it can be matched repeatedly
+#cat: bozorth_gallery_free - releases a table built by
+#cat:                        bozorth_gallery_new()
+#cat: bozorth_to_gallery_cached_ctx - like bozorth_to_gallery_ctx, but
+#cat:                        using a table built by bozorth_gallery_new()
 
 ***********************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <glib.h>
 #include <bozorth.h>
 
 /**************************************************************************/
 
-int bozorth_probe_init( struct xyt_struct * pstruct )
+int bozorth_probe_init_ctx( BozorthContext * ctx, struct xyt_struct * pstruct )
 {
 int sim;	/* number of pointwise comparisons for Subject's record*/
 int msim;	/* Pruned length of Subject's comparison pointer list */
@@ -93,14 +105,14 @@ bz_comp(
 	pstruct->ycol,
 	pstruct->thetacol,
 	&sim,
-	scols,
-	scolpt );
+	ctx->scols,
+	ctx->scolpt );
 
 msim = sim;	/* Init search to end of Subject's pointwise comparison table (last edge in Web) */
 
 
 
-bz_find( &msim, scolpt );
+bz_find( &msim, ctx->scolpt );
 
 
 
@@ -116,7 +128,7 @@ return msim;
 
 /**************************************************************************/
 
-int bozorth_gallery_init( struct xyt_struct * gstruct )
+int bozorth_gallery_init_ctx( BozorthContext * ctx, struct xyt_struct * gstruct )
 {
 int fim;	/* number of pointwise comparisons for On-File record*/
 int mfim;	/* Pruned length of On-File Record's pointer list */
@@ -130,14 +142,14 @@ bz_comp(
 	gstruct->ycol,
 	gstruct->thetacol,
 	&fim,
-	fcols,
-	fcolpt );
+	ctx->fcols,
+	ctx->fcolpt );
 
 mfim = fim;	/* Init search to end of On-File Record's pointwise comparison table (last edge in Web) */
 
 
 
-bz_find( &mfim, fcolpt );
+bz_find( &mfim, ctx->fcolpt );
 
 
 
@@ -153,7 +165,8 @@ return mfim;
 
 /**************************************************************************/
 
-int bozorth_to_gallery(
+int bozorth_to_gallery_ctx(
+		BozorthContext * ctx,
 		int probe_len,
 		struct xyt_struct * pstruct,
 		struct xyt_struct * gstruct
@@ -162,9 +175,84 @@ int bozorth_to_gallery(
 int np;
 int gallery_len;
 
-gallery_len = bozorth_gallery_init( gstruct );
-np = bz_match( probe_len, gallery_len );
-return bz_match_score( np, pstruct, gstruct );
+gallery_len = bozorth_gallery_init_ctx( ctx, gstruct );
+np = bz_match_ctx( ctx, probe_len, gallery_len );
+return bz_match_score_ctx( ctx, np, pstruct, gstruct );
+}
+
+/**************************************************************************/
+
+BozorthGallery * bozorth_gallery_new( BozorthContext * ctx, struct xyt_struct * gstruct )
+{
+BozorthGallery * gallery;
+int mfim;	/* Pruned length of On-File Record's pointer list */
+int i;
+
+
+/* Build the table in the context and keep the sorted and pruned rows only */
+mfim = bozorth_gallery_init_ctx( ctx, gstruct );
+
+gallery = (BozorthGallery *) g_malloc( sizeof( BozorthGallery ) + mfim * sizeof( gallery->cols[0] ) );
+gallery->len = mfim;
+for ( i = 0; i < mfim; i++ )
+	memcpy( gallery->cols[i], ctx->fcolpt[i], sizeof( gallery->cols[i] ) );
+
+return gallery;
+}
+
+/**************************************************************************/
+
+void bozorth_gallery_free( BozorthGallery * gallery )
+{
+g_free( gallery );
+}
+
+/**************************************************************************/
+
+int bozorth_to_gallery_cached_ctx(
+		BozorthContext * ctx,
+		int probe_len,
+		struct xyt_struct * pstruct,
+		struct xyt_struct * gstruct,
+		BozorthGallery * gallery
+		)
+{
+int np;
+int i;
+
+/* bz_match() only reads the rows, so point it at the cached table */
+for ( i = 0; i < gallery->len; i++ )
+	ctx->fcolpt[i] = gallery->cols[i];
+
+np = bz_match_ctx( ctx, probe_len, gallery->len );
+return bz_match_score_ctx( ctx, np, pstruct, gstruct );
+}
+
+/**************************************************************************/
+/* Context-less entry points, operating on bz_global_context */
+/**************************************************************************/
+
+int bozorth_probe_init( struct xyt_struct * pstruct )
+{
+return bozorth_probe_init_ctx( &bz_global_context, pstruct );
+}
+
+/**************************************************************************/
+
+int bozorth_gallery_init( struct xyt_struct * gstruct )
+{
+return bozorth_gallery_init_ctx( &bz_global_context, gstruct );
+}
+
+/**************************************************************************/
+
+int bozorth_to_gallery(
+		int probe_len,
+		struct xyt_struct * pstruct,
+		struct xyt_struct * gstruct
+		)
+{
+return bozorth_to_gallery_ctx( &bz_global_context, probe_len, pstruct, gstruct );
 }
 
 /**************************************************************************/
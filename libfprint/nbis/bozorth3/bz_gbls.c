@@ -53,75 +53,60 @@ of the software.
       Contains global variables responsible for supporting the
       Bozorth3 fingerprint matching "core" algorithm.
 
+***********************************************************************
+
+      ROUTINES:
+#cat: bozorth_context_new -  allocates a zero initialized matcher
+#cat:                        context holding all working tables
+#cat: bozorth_context_free - releases a context allocated with
+#cat:                        bozorth_context_new()
+
 ***********************************************************************
 ***********************************************************************/
 
+#include <glib.h>
 #include <bozorth.h>
 
 /**************************************************************************/
 /* General supporting global variables */
 /**************************************************************************/
 
-int colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];		/* Output from match(), this is a sorted table of compatible edge pairs containing: */
-						/*	DeltaThetaKJs, Subject's K, J, then On-File's {K,J} or {J,K} depending */
-						/* Sorted first on Subject's point index K, */
-						/*	then On-File's K or J point index (depending), */
-						/*	lastly on Subject's J point index */
-int scols[ SCOLS_SIZE_1 ][ COLS_SIZE_2 ];	/* Subject's pointwise comparison table containing: */
-						/*	Distance,min(BetaK,BetaJ),max(BetaK,BbetaJ), K,J,ThetaKJ */
-int fcols[ FCOLS_SIZE_1 ][ COLS_SIZE_2 ];	/* On-File Record's pointwise comparison table with: */
-						/*	Distance,min(BetaK,BetaJ),max(BetaK,BbetaJ),K,J, ThetaKJ */
-int * scolpt[ SCOLPT_SIZE ];			/* Subject's list of pointers to pointwise comparison rows, sorted on: */
-						/*	Distance, min(BetaK,BetaJ), then max(BetaK,BetaJ) */
-int * fcolpt[ FCOLPT_SIZE ];			/* On-File Record's list of pointers to pointwise comparison rows sorted on: */
-						/*	Distance, min(BetaK,BetaJ), then max(BetaK,BetaJ) */
-int sc[ SC_SIZE ];				/* Flags all compatible edges in the Subject's Web */
-
-int yl[ YL_SIZE_1 ][ YL_SIZE_2 ];
+/* The working tables of the matcher.  Amongst others, the context holds:  */
+/*	colp:   Output from match(), this is a sorted table of compatible  */
+/*		edge pairs containing:                                      */
+/*		DeltaThetaKJs, Subject's K, J, then On-File's {K,J} or     */
+/*		{J,K} depending.  Sorted first on Subject's point index K, */
+/*		then On-File's K or J point index (depending), lastly on   */
+/*		Subject's J point index                                     */
+/*	scols:  Subject's pointwise comparison table containing:           */
+/*		Distance,min(BetaK,BetaJ),max(BetaK,BbetaJ), K,J,ThetaKJ    */
+/*	fcols:  On-File Record's pointwise comparison table with:          */
+/*		Distance,min(BetaK,BetaJ),max(BetaK,BbetaJ),K,J, ThetaKJ    */
+/*	scolpt: Subject's list of pointers to pointwise comparison rows,   */
+/*		sorted on: Distance, min(BetaK,BetaJ), then max(BetaK,BetaJ)*/
+/*	fcolpt: On-File Record's list of pointers to pointwise comparison  */
+/*		rows sorted on: Distance, min(BetaK,BetaJ), then            */
+/*		max(BetaK,BetaJ)                                            */
+/*	sc:     Flags all compatible edges in the Subject's Web            */
+/* The remaining arrays are used significantly by sift().               */
+BozorthContext bz_global_context;
 
-
-/**************************************************************************/
-/* Globals used significantly by sift() */
 /**************************************************************************/
-#ifdef TARGET_OS
-   int rq[ RQ_SIZE ];
-   int tq[ TQ_SIZE ];
-   int zz[ ZZ_SIZE ];
-
-   int rx[ RX_SIZE ];
-   int mm[ MM_SIZE ];
-   int nn[ NN_SIZE ];
-
-   int qq[ QQ_SIZE ];
 
-   int rk[ RK_SIZE ];
+BozorthContext *bozorth_context_new(void)
+{
+BozorthContext * ctx;
 
-   int cp[ CP_SIZE ];
-   int rp[ RP_SIZE ];
+/* The context is large (mostly YY and CTP), but the pages are only */
+/* touched as far as the matcher actually needs them.               */
+ctx = (BozorthContext *) g_malloc0( sizeof( BozorthContext ) );
 
-   int rf[RF_SIZE_1][RF_SIZE_2];
-   int cf[CF_SIZE_1][CF_SIZE_2];
+return ctx;
+}
 
-   int bz_y[20000];
-#else
-   int rq[ RQ_SIZE ] = {};
-   int tq[ TQ_SIZE ] = {};
-   int zz[ ZZ_SIZE ] = {};
-
-   int rx[ RX_SIZE ] = {};
-   int mm[ MM_SIZE ] = {};
-   int nn[ NN_SIZE ] = {};
-
-   int qq[ QQ_SIZE ] = {};
-
-   int rk[ RK_SIZE ] = {};
-
-   int cp[ CP_SIZE ] = {};
-   int rp[ RP_SIZE ] = {};
-
-   int rf[RF_SIZE_1][RF_SIZE_2] = {};
-   int cf[CF_SIZE_1][CF_SIZE_2] = {};
-
-   int bz_y[20000] = {};
-#endif
+/**************************************************************************/
 
+void bozorth_context_free( BozorthContext * ctx )
+{
+g_free( ctx );
+}
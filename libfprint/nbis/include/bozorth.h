@@ -223,39 +223,78 @@ extern FILE *stderr;
 /**************************************************************************/
 /* In: BZ_GBLS.C */
 /**************************************************************************/
-/* Global arrays supporting "core" bozorth algorithm */
-extern int colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];
-extern int scols[ SCOLS_SIZE_1 ][ COLS_SIZE_2 ];
-extern int fcols[ FCOLS_SIZE_1 ][ COLS_SIZE_2 ];
-extern int * scolpt[ SCOLPT_SIZE ];
-extern int * fcolpt[ FCOLPT_SIZE ];
-extern int sc[ SC_SIZE ];
-extern int yl[ YL_SIZE_1 ][ YL_SIZE_2 ];
-/* Global arrays supporting "core" bozorth algorithm continued: */
-/*    Globals used significantly by sift() */
-extern int rq[ RQ_SIZE ];
-extern int tq[ TQ_SIZE ];
-extern int zz[ ZZ_SIZE ];
-extern int rx[ RX_SIZE ];
-extern int mm[ MM_SIZE ];
-extern int nn[ NN_SIZE ];
-extern int qq[ QQ_SIZE ];
-extern int rk[ RK_SIZE ];
-extern int cp[ CP_SIZE ];
-extern int rp[ RP_SIZE ];
-extern int rf[RF_SIZE_1][RF_SIZE_2];
-extern int cf[CF_SIZE_1][CF_SIZE_2];
-extern int bz_y[20000];
+/* Working state of the "core" bozorth algorithm.  These arrays used to be */
+/* process wide globals (and statics in bozorth3.c), which meant only one  */
+/* match could ever run at a time.  Each concurrent matcher now needs its  */
+/* own context; see bozorth_context_new().                                 */
+typedef struct bozorth_context {
+	/* Arrays supporting "core" bozorth algorithm */
+	int colp[ COLP_SIZE_1 ][ COLP_SIZE_2 ];
+	int scols[ SCOLS_SIZE_1 ][ COLS_SIZE_2 ];
+	int fcols[ FCOLS_SIZE_1 ][ COLS_SIZE_2 ];
+	int * scolpt[ SCOLPT_SIZE ];
+	int * fcolpt[ FCOLPT_SIZE ];
+	int sc[ SC_SIZE ];
+	int yl[ YL_SIZE_1 ][ YL_SIZE_2 ];
+	/* Arrays supporting "core" bozorth algorithm continued: */
+	/*    used significantly by sift() */
+	int rq[ RQ_SIZE ];
+	int tq[ TQ_SIZE ];
+	int zz[ ZZ_SIZE ];
+	int rx[ RX_SIZE ];
+	int mm[ MM_SIZE ];
+	int nn[ NN_SIZE ];
+	int qq[ QQ_SIZE ];
+	int rk[ RK_SIZE ];
+	int cp[ CP_SIZE ];
+	int rp[ RP_SIZE ];
+	int rf[RF_SIZE_1][RF_SIZE_2];
+	int cf[CF_SIZE_1][CF_SIZE_2];
+	int bz_y[20000];
+	/* Formerly static scratch of bz_match() */
+	int rot[ ROT_SIZE_1 ][ ROT_SIZE_2 ];
+	int * rtp[ ROT_SIZE_1 ];
+	/* Formerly static, shared by bz_match_score() & bz_final_loop() */
+	int ct[ CT_SIZE ];
+	int gct[ GCT_SIZE ];
+	int ctt[ CTT_SIZE ];
+	int ctp[ CTP_SIZE_1 ][ CTP_SIZE_2 ];
+	int yy[ YY_SIZE_1 ][ YY_SIZE_2 ][ YY_SIZE_3 ];
+	/* Formerly static scratch of bz_final_loop() */
+	int sct[ SCT_SIZE_1 ][ SCT_SIZE_2 ];
+} BozorthContext;
+
+/* Context used by the legacy entry points that do not take one */
+extern BozorthContext bz_global_context;
+
+/* The pruned and sorted pairwise comparison table of a gallery           */
+/* fingerprint.  It only depends on the gallery fingerprint, so it can be */
+/* built once and then be used for any number of matches.                */
+typedef struct bozorth_gallery {
+	int len;
+	int cols[][ COLS_SIZE_2 ];
+} BozorthGallery;
 
 /**************************************************************************/
 /**************************************************************************/
 /* ROUTINE PROTOTYPES */
 /**************************************************************************/
+/* In: BZ_GBLS.C */
+extern BozorthContext *bozorth_context_new(void);
+extern void bozorth_context_free(BozorthContext *);
 /* In: BZ_DRVRS.C */
 extern int bozorth_probe_init( struct xyt_struct *);
 extern int bozorth_gallery_init( struct xyt_struct *);
 extern int bozorth_to_gallery(int, struct xyt_struct *, struct xyt_struct *);
 extern int bozorth_main(struct xyt_struct *, struct xyt_struct *);
+extern int bozorth_probe_init_ctx(BozorthContext *, struct xyt_struct *);
+extern int bozorth_gallery_init_ctx(BozorthContext *, struct xyt_struct *);
+extern int bozorth_to_gallery_ctx(BozorthContext *, int, struct xyt_struct *,
+                    struct xyt_struct *);
+extern BozorthGallery *bozorth_gallery_new(BozorthContext *, struct xyt_struct *);
+extern void bozorth_gallery_free(BozorthGallery *);
+extern int bozorth_to_gallery_cached_ctx(BozorthContext *, int, struct xyt_struct *,
+                    struct xyt_struct *, BozorthGallery *);
 /* In: BOZORTH3.C */
 extern void bz_comp(int, int [], int [], int [], int *, int [][COLS_SIZE_2],
                     int *[]);
@@ -263,6 +302,11 @@ extern void bz_find(int *, int *[]);
 extern int bz_match(int, int);
 extern int bz_match_score(int, struct xyt_struct *, struct xyt_struct *);
 extern void bz_sift(int *, int, int *, int, int, int, int *, int *);
+extern int bz_match_ctx(BozorthContext *, int, int);
+extern int bz_match_score_ctx(BozorthContext *, int, struct xyt_struct *,
+                    struct xyt_struct *);
+extern void bz_sift_ctx(BozorthContext *, int *, int, int *, int, int, int,
+                    int *, int *);
 /* In: BZ_ALLOC.C */
 extern char *malloc_or_exit(int, const char *);
 extern char *malloc_or_return_error(int, const char *);
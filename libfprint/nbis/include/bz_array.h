@@ -59,6 +59,9 @@ of the software.
 
 #define SC_SIZE 20000
 
+#define ROT_SIZE_1 20000
+#define ROT_SIZE_2 5
+
 
 #define RQ_SIZE 20000
 #define TQ_SIZE 20000
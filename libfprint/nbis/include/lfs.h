@@ -128,6 +128,10 @@ typedef struct dftwaves{
    int nwaves;
    int wavelen;
    DFTWAVE **waves;
+   /* Vectorized kernels used by dft_dir_powers() and the wave forms  */
+   /* interleaved for them, see init_dft_simd().                      */
+   int simd;
+   double *simd_table;
 }DFTWAVES;
 
 /* Rotated pixel offsets for a grid of specified dimensions */
@@ -266,8 +270,35 @@ typedef struct g_lfsparms{
    /* Ridge Counting Controls */
    int    max_nbrs;
    int    max_ridge_steps;
+
+   /* Threading Controls */
+   int    map_threads;     /* Max. threads used to generate initial maps. */
 } LFSPARMS;
 
+/* Lookup tables required by lfs_detect_minutiae_V2().  These only depend */
+/* on the image width, the padding and some of the LFSPARMS, so they are  */
+/* shared by all detections with the same geometry (see get_lfs_tables). */
+/* The tables must not be modified.                                      */
+typedef struct lfstables{
+   /* Values the tables were computed for */
+   int iw;
+   int pad;
+   int num_directions;
+   double start_dir_angle;
+   int num_dft_waves;
+   int windowsize;
+   int dirbin_grid_w;
+   int dirbin_grid_h;
+
+   DIR2RAD *dir2rad;
+   ROTGRIDS *dftgrids;
+   DFTWAVES *dftwaves;
+   ROTGRIDS *dirbingrids;
+
+   int ref_count;
+   struct lfstables *next;
+} LFSTABLES;
+
 /*************************************************************************/
 /*        LFS CONSTANT DEFINITIONS                                       */
 /*************************************************************************/
@@ -788,6 +819,7 @@ extern int lfs_detect_minutiae_V2(MINUTIAE **,
                      const LFSPARMS *);
 
 /* dft.c */
+extern void init_dft_simd(DFTWAVES *);
 extern int dft_dir_powers(double **, unsigned char *, const int,
                      const int, const int, const DFTWAVES *,
                      const ROTGRIDS *);
@@ -836,6 +868,8 @@ extern int init_rotgrids(ROTGRIDS **, const int, const int, const int,
                      const double, const int, const int, const int, const int);
 extern int alloc_dir_powers(double ***, const int, const int);
 extern int alloc_power_stats(int **, double **, int **, double **, const int);
+extern int get_lfs_tables(LFSTABLES **, const int, const int, const LFSPARMS *);
+extern void release_lfs_tables(LFSTABLES *);
 
 /* isempty.c */
 extern int is_image_empty(int *, const int, const int);
@@ -991,6 +1025,8 @@ extern int create_minutia(MINUTIA **, const int, const int,
 extern void free_minutiae(MINUTIAE *);
 extern void free_minutia(MINUTIA *);
 extern int remove_minutia(const int, MINUTIAE *);
+extern int remove_minutia_deferred(const int, MINUTIAE *);
+extern void compact_minutiae(MINUTIAE *);
 extern int join_minutia(const MINUTIA *, const MINUTIA *, unsigned char *,
                      const int, const int, const int, const int);
 extern int minutia_type(const int);
@@ -1208,6 +1244,11 @@ extern double angle2line(const int, const int, const int, const int);
 extern int line2direction(const int, const int, const int, const int,
                      const int);
 extern int closest_dir_dist(const int, const int, const int);
+extern void begin_lfs_scratch(void);
+extern void reset_lfs_scratch(void);
+extern void end_lfs_scratch(void);
+extern void *alloc_lfs_scratch(const size_t);
+extern void free_lfs_scratch(void *);
 
 /* xytreps.c */
 extern void lfs2nist_minutia_XYT(int *, int *, int *,
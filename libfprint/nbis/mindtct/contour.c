@@ -107,19 +107,20 @@ int allocate_contour(int **ocontour_x, int **ocontour_y,
 {
    int *contour_x, *contour_y, *contour_ex, *contour_ey;
 
-   ASSERT_SIZE_MUL(ncontour, sizeof(int));
+   ASSERT_SIZE_MUL(ncontour, 4 * sizeof(int));
 
-   /* Allocate contour's x-coord list. */
-   contour_x = (int *)g_malloc(ncontour * sizeof(int));
+   /* Allocate all four lists at once from the detection's scratch */
+   /* memory, contours are traced for every candidate minutia.     */
+   contour_x = (int *)alloc_lfs_scratch(ncontour * 4 * sizeof(int));
 
-   /* Allocate contour's y-coord list. */
-   contour_y = (int *)g_malloc(ncontour * sizeof(int));
+   /* Contour's y-coord list. */
+   contour_y = contour_x + ncontour;
 
-   /* Allocate contour's edge x-coord list. */
-   contour_ex = (int *)g_malloc(ncontour * sizeof(int));
+   /* Contour's edge x-coord list. */
+   contour_ex = contour_y + ncontour;
 
-   /* Allocate contour's edge y-coord list. */
-   contour_ey = (int *)g_malloc(ncontour * sizeof(int));
+   /* Contour's edge y-coord list. */
+   contour_ey = contour_ex + ncontour;
 
    /* Otherwise, allocations successful, so assign output pointers. */
    *ocontour_x = contour_x;
@@ -152,10 +153,8 @@ int allocate_contour(int **ocontour_x, int **ocontour_y,
 void free_contour(int *contour_x, int *contour_y,
                   int *contour_ex, int *contour_ey)
 {
-   g_free(contour_x);
-   g_free(contour_y);
-   g_free(contour_ex);
-   g_free(contour_ey);
+   /* All four lists are part of the same allocation. */
+   free_lfs_scratch(contour_x);
 }
 
 /*************************************************************************
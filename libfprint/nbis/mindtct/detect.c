@@ -141,10 +141,7 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
 {
    unsigned char *pdata, *bdata;
    int pw, ph, bw, bh;
-   DIR2RAD *dir2rad;
-   DFTWAVES *dftwaves;
-   ROTGRIDS *dftgrids;
-   ROTGRIDS *dirbingrids;
+   LFSTABLES *tables;
    int *direction_map, *low_contrast_map, *low_flow_map, *high_curve_map;
    int mw, mh;
    int ret, maxpad;
@@ -166,42 +163,21 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    maxpad = get_max_padding_V2(lfsparms->windowsize, lfsparms->windowoffset,
                           lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h);
 
-   /* Initialize lookup table for converting integer directions */
-   /* to angles in radians.                                     */
-   if((ret = init_dir2rad(&dir2rad, lfsparms->num_directions))){
+   /* Get the lookup tables for converting integer directions to   */
+   /* angles in radians, the DFT wave forms and the pixel offsets to */
+   /* rotated grids used for DFT analyses and direction binarization. */
+   /* These are shared with other detections on the same geometry.   */
+   if((ret = get_lfs_tables(&tables, iw, maxpad, lfsparms))){
       /* Free memory allocated to this point. */
       return(ret);
    }
 
-   /* Initialize wave form lookup tables for DFT analyses. */
-   /* used for direction binarization.                             */
-   if((ret = init_dftwaves(&dftwaves, g_dft_coefs, lfsparms->num_dft_waves,
-                        lfsparms->windowsize))){
-      /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
-      return(ret);
-   }
-
-   /* Initialize lookup table for pixel offsets to rotated grids */
-   /* used for DFT analyses.                                     */
-   if((ret = init_rotgrids(&dftgrids, iw, ih, maxpad,
-                        lfsparms->start_dir_angle, lfsparms->num_directions,
-                        lfsparms->windowsize, lfsparms->windowsize,
-                        RELATIVE2ORIGIN))){
-      /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
-      free_dftwaves(dftwaves);
-      return(ret);
-   }
-
    /* Pad input image based on max padding. */
    if(maxpad > 0){   /* May not need to pad at all */
       if((ret = pad_uchar_image(&pdata, &pw, &ph, idata, iw, ih,
                              maxpad, lfsparms->pad_value))){
          /* Free memory allocated to this point. */
-         free_dir2rad(dir2rad);
-         free_dftwaves(dftwaves);
-         free_rotgrids(dftgrids);
+         release_lfs_tables(tables);
          return(ret);
       }
    }
@@ -231,18 +207,13 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    /* Generate block maps from the input image. */
    if((ret = gen_image_maps(&direction_map, &low_contrast_map,
                     &low_flow_map, &high_curve_map, &mw, &mh,
-                    pdata, pw, ph, dir2rad, dftwaves, dftgrids, lfsparms))){
+                    pdata, pw, ph, tables->dir2rad, tables->dftwaves,
+                    tables->dftgrids, lfsparms))){
       /* Free memory allocated to this point. */
-      free_dir2rad(dir2rad);
-      free_dftwaves(dftwaves);
-      free_rotgrids(dftgrids);
+      release_lfs_tables(tables);
       g_free(pdata);
       return(ret);
    }
-   /* Deallocate working memories. */
-   free_dir2rad(dir2rad);
-   free_dftwaves(dftwaves);
-   free_rotgrids(dftgrids);
 
    print2log("\nMAPS DONE\n");
 
@@ -253,37 +224,22 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
    /******************/
    set_timer(bin_timer);
 
-   /* Initialize lookup table for pixel offsets to rotated grids */
-   /* used for directional binarization.                         */
-   if((ret = init_rotgrids(&dirbingrids, iw, ih, maxpad,
-                        lfsparms->start_dir_angle, lfsparms->num_directions,
-                        lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h,
-                        RELATIVE2CENTER))){
-      /* Free memory allocated to this point. */
-      g_free(pdata);
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      g_free(high_curve_map);
-      return(ret);
-   }
-
    /* Binarize input image based on NMAP information. */
    if((ret = binarize_V2(&bdata, &bw, &bh,
                       pdata, pw, ph, direction_map, mw, mh,
-                      dirbingrids, lfsparms))){
+                      tables->dirbingrids, lfsparms))){
       /* Free memory allocated to this point. */
       g_free(pdata);
       g_free(direction_map);
       g_free(low_contrast_map);
       g_free(low_flow_map);
       g_free(high_curve_map);
-      free_rotgrids(dirbingrids);
+      release_lfs_tables(tables);
       return(ret);
    }
 
-   /* Deallocate working memory. */
-   free_rotgrids(dirbingrids);
+   /* Release the lookup tables, they are not needed anymore. */
+   release_lfs_tables(tables);
 
    /* Check dimension of binary image.  If they are different from */
    /* the input image, then ERROR.                                 */
@@ -335,6 +291,9 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
 
    time_accum(minutia_timer, minutia_time);
 
+   /* Release the contours traced during detection all at once. */
+   reset_lfs_scratch();
+
    set_timer(rm_minutia_timer);
 
    if((ret = remove_false_minutia_V2(minutiae, bdata, iw, ih,
@@ -355,6 +314,9 @@ int lfs_detect_minutiae_V2(MINUTIAE **ominutiae,
 
    time_accum(rm_minutia_timer, rm_minutia_time);
 
+   /* Release the contours traced during removal all at once. */
+   reset_lfs_scratch();
+
    /******************/
    /*  RIDGE COUNTS  */
    /******************/
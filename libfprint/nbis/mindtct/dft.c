@@ -62,11 +62,259 @@ of the software.
                         dft_power_stats()
                         get_max_norm()
                         sort_dft_waves()
+                        init_dft_simd()
+                        dft_simd_level() (static)
+                        sum_rot_block_rows_avx2() (static)
+                        dft_wave_table() (static)
+                        dft_powers_sse2() (static)
+                        dft_powers_avx2() (static)
 ***********************************************************************/
 
 #include <stdio.h>
 #include <lfs.h>
 
+/* On x86-64 the DFT analysis uses vectorized kernels.  SSE2 is always */
+/* available there, AVX2 is used if the CPU supports it.               */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DFT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define DFT_SIMD_SSE2   1
+#define DFT_SIMD_AVX2   2
+
+#ifdef DFT_X86_SIMD
+
+/*************************************************************************
+**************************************************************************
+#cat: dft_simd_level - Determines the vectorized DFT kernels supported by
+#cat:             the CPU at runtime.
+
+   Return Code:
+      DFT_SIMD_AVX2 - AVX2 kernels may be used
+      DFT_SIMD_SSE2 - SSE2 kernels may be used
+**************************************************************************/
+static int dft_simd_level(void)
+{
+   if(__builtin_cpu_supports("avx2"))
+      return(DFT_SIMD_AVX2);
+
+   return(DFT_SIMD_SSE2);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: sum_rot_block_rows_avx2 - AVX2 version of sum_rot_block_rows(),
+#cat:             gathering 8 pixels of a rotated row at a time.  Each
+#cat:             pixel is gathered as a 32 bit word, so up to 3 bytes
+#cat:             beyond the last rotated grid position are read.  The
+#cat:             caller needs to ensure that these are within the image.
+
+   Input:
+      blkptr    - the pixel address of the origin of the current image block
+      grid_offsets - the rotated pixel offsets for a block-sized grid
+                  rotated according to a specific orientation
+      blocksize - the width and height of the image block and thus the size
+                  of the rotated grid
+   Output:
+      rowsums   - the resulting vector of pixel row sums
+**************************************************************************/
+__attribute__((target("avx2")))
+static void sum_rot_block_rows_avx2(int *rowsums, const unsigned char *blkptr,
+                        const int *grid_offsets, const int blocksize)
+{
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   __m256i acc, offsets, pixels;
+   __m128i sum;
+   int ix, iy, gi;
+
+   gi = 0;
+
+   for(iy = 0; iy < blocksize; iy++){
+      acc = _mm256_setzero_si256();
+      for(ix = 0; ix + 8 <= blocksize; ix += 8){
+         offsets = _mm256_loadu_si256((const __m256i *)(grid_offsets + gi));
+         pixels = _mm256_i32gather_epi32((const int *)blkptr, offsets, 1);
+         /* Only the lowest byte of each gathered word is the pixel */
+         acc = _mm256_add_epi32(acc, _mm256_and_si256(pixels, mask));
+         gi += 8;
+      }
+
+      /* Horizontal sum of the 8 lanes */
+      sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                          _mm256_extracti128_si256(acc, 1));
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1,0,3,2)));
+      sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2,3,0,1)));
+      rowsums[iy] = _mm_cvtsi128_si32(sum);
+
+      /* Remaining pixels of the row */
+      for(; ix < blocksize; ix++){
+         rowsums[iy] += *(blkptr + grid_offsets[gi]);
+         gi++;
+      }
+   }
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: dft_wave_table - Interleaves the DFT wave forms, so that a group of
+#cat:             "lanes" wave forms can be applied in parallel.  For each
+#cat:             group and each point in the wave forms, the cos components
+#cat:             of all wave forms in the group are followed by their sin
+#cat:             components.  Missing wave forms of the last group are zero.
+
+   Input:
+      dftwaves  - structure containing the DFT wave forms
+      lanes     - number of wave forms in each group
+   Return Code:
+      The allocated table of interleaved wave forms
+**************************************************************************/
+static double *dft_wave_table(const DFTWAVES *dftwaves, const int lanes)
+{
+   int ngroups, g, i, l, w;
+   double *table, *tptr;
+
+   ngroups = (dftwaves->nwaves + lanes - 1) / lanes;
+   table = (double *)g_malloc0(ngroups * dftwaves->wavelen * 2 * lanes *
+                               sizeof(double));
+
+   tptr = table;
+   for(g = 0; g < ngroups; g++){
+      for(i = 0; i < dftwaves->wavelen; i++){
+         for(l = 0; l < lanes; l++){
+            w = (g * lanes) + l;
+            if(w < dftwaves->nwaves){
+               tptr[l] = dftwaves->waves[w]->cos[i];
+               tptr[lanes + l] = dftwaves->waves[w]->sin[i];
+            }
+         }
+         tptr += 2 * lanes;
+      }
+   }
+
+   return(table);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: dft_powers_sse2 - SSE2 version of applying dft_power() for all wave
+#cat:             forms at a given orientation.  Two wave forms are applied
+#cat:             in parallel, and as each lane accumulates in the same order
+#cat:             as dft_power(), the results are identical.
+
+   Input:
+      dir       - the orientation (direction) of the row sums
+      rowsums   - accumulated rows of pixels from within a rotated grid
+                  overlaying an input image block
+      table     - the wave forms as interleaved by dft_wave_table() for
+                  groups of 2 wave forms
+      nwaves    - the number of wave forms
+      wavelen   - the length of the wave forms
+   Output:
+      powers    - the computed DFT power for each wave form at the given
+                  direction
+**************************************************************************/
+static void dft_powers_sse2(double **powers, const int dir,
+                            const int *rowsums, const double *table,
+                            const int nwaves, const int wavelen)
+{
+   __m128d cospart, sinpart, rowsum;
+   double power[2];
+   int w, i, l;
+
+   for(w = 0; w < nwaves; w += 2){
+      cospart = _mm_setzero_pd();
+      sinpart = _mm_setzero_pd();
+
+      for(i = 0; i < wavelen; i++){
+         rowsum = _mm_set1_pd((double)rowsums[i]);
+         cospart = _mm_add_pd(cospart, _mm_mul_pd(rowsum, _mm_loadu_pd(table)));
+         sinpart = _mm_add_pd(sinpart, _mm_mul_pd(rowsum, _mm_loadu_pd(table + 2)));
+         table += 4;
+      }
+
+      _mm_storeu_pd(power, _mm_add_pd(_mm_mul_pd(cospart, cospart),
+                                      _mm_mul_pd(sinpart, sinpart)));
+      for(l = 0; l < 2 && w + l < nwaves; l++)
+         powers[w + l][dir] = power[l];
+   }
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: dft_powers_avx2 - AVX2 version of applying dft_power() for all wave
+#cat:             forms at a given orientation.  Four wave forms are applied
+#cat:             in parallel, and as each lane accumulates in the same order
+#cat:             as dft_power(), the results are identical.
+
+   Input:
+      dir       - the orientation (direction) of the row sums
+      rowsums   - accumulated rows of pixels from within a rotated grid
+                  overlaying an input image block
+      table     - the wave forms as interleaved by dft_wave_table() for
+                  groups of 4 wave forms
+      nwaves    - the number of wave forms
+      wavelen   - the length of the wave forms
+   Output:
+      powers    - the computed DFT power for each wave form at the given
+                  direction
+**************************************************************************/
+__attribute__((target("avx2")))
+static void dft_powers_avx2(double **powers, const int dir,
+                            const int *rowsums, const double *table,
+                            const int nwaves, const int wavelen)
+{
+   __m256d cospart, sinpart, rowsum;
+   double power[4];
+   int w, i, l;
+
+   for(w = 0; w < nwaves; w += 4){
+      cospart = _mm256_setzero_pd();
+      sinpart = _mm256_setzero_pd();
+
+      for(i = 0; i < wavelen; i++){
+         rowsum = _mm256_set1_pd((double)rowsums[i]);
+         cospart = _mm256_add_pd(cospart,
+                                 _mm256_mul_pd(rowsum, _mm256_loadu_pd(table)));
+         sinpart = _mm256_add_pd(sinpart,
+                                 _mm256_mul_pd(rowsum, _mm256_loadu_pd(table + 4)));
+         table += 8;
+      }
+
+      _mm256_storeu_pd(power, _mm256_add_pd(_mm256_mul_pd(cospart, cospart),
+                                            _mm256_mul_pd(sinpart, sinpart)));
+      for(l = 0; l < 4 && w + l < nwaves; l++)
+         powers[w + l][dir] = power[l];
+   }
+}
+
+#endif /* DFT_X86_SIMD */
+
+/*************************************************************************
+**************************************************************************
+#cat: init_dft_simd - Selects the vectorized DFT kernels supported by the
+#cat:             CPU and interleaves the DFT wave forms for them.  This
+#cat:             is done once when the wave forms are initialized, so
+#cat:             that dft_dir_powers() does not repeat it for every block.
+
+   Input:
+      dftwaves  - structure containing the DFT wave forms
+   Output:
+      dftwaves  - simd and simd_table are set, simd is zero and
+                  simd_table is NULL if no vectorized kernels are used
+**************************************************************************/
+void init_dft_simd(DFTWAVES *dftwaves)
+{
+   dftwaves->simd = 0;
+   dftwaves->simd_table = (double *)NULL;
+
+#ifdef DFT_X86_SIMD
+   dftwaves->simd = dft_simd_level();
+   dftwaves->simd_table = dft_wave_table(dftwaves,
+                             (dftwaves->simd == DFT_SIMD_AVX2) ? 4 : 2);
+#endif
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: dft_dir_powers - Conducts the DFT analysis on a block of image data.
@@ -90,7 +338,8 @@ of the software.
                   the origin of the current block in the image
       pw        - the width (in pixels) of the padded input image
       ph        - the height (in pixels) of the padded input image
-      dftwaves  - structure containing the DFT wave forms
+      dftwaves  - structure containing the DFT wave forms, the vectorized
+                  kernels selected by init_dft_simd() are used
       dftgrids  - structure containing the rotated pixel grid offsets
    Output:
       powers    - DFT power computed from each wave form frequencies at each
@@ -106,6 +355,9 @@ int dft_dir_powers(double **powers, unsigned char *pdata,
    int w, dir;
    int *rowsums;
    unsigned char *blkptr;
+#ifdef DFT_X86_SIMD
+   int gather;
+#endif
 
    /* Allocate line sum vector, and initialize to zeros */
    /* This routine requires square block (grid), so ERROR otherwise. */
@@ -116,13 +368,41 @@ int dft_dir_powers(double **powers, unsigned char *pdata,
    rowsums = (int *)g_malloc(dftgrids->grid_w * sizeof(int));
    memset(rowsums, 0, dftgrids->grid_w * sizeof(int));
 
+#ifdef DFT_X86_SIMD
+   /* The rotated grid stays within pad pixels around the block, the  */
+   /* gathered row sums may only be used if reading 32 bits at the    */
+   /* last grid position stays within the padded image.               */
+   gather = (dftwaves->simd == DFT_SIMD_AVX2) &&
+            (blkoffset + ((dftgrids->grid_h + dftgrids->pad) * pw) +
+             dftgrids->grid_w + dftgrids->pad + (int)sizeof(int) <= pw * ph);
+#endif
+
    /* Foreach direction ... */
    for(dir = 0; dir < dftgrids->ngrids; dir++){
       /* Compute vector of line sums from rotated grid */
       blkptr = pdata + blkoffset;
+#ifdef DFT_X86_SIMD
+      if(gather)
+         sum_rot_block_rows_avx2(rowsums, blkptr,
+                                 dftgrids->grids[dir], dftgrids->grid_w);
+      else
+#endif
       sum_rot_block_rows(rowsums, blkptr,
                          dftgrids->grids[dir], dftgrids->grid_w);
 
+#ifdef DFT_X86_SIMD
+      if(dftwaves->simd == DFT_SIMD_AVX2){
+         dft_powers_avx2(powers, dir, rowsums, dftwaves->simd_table,
+                         dftwaves->nwaves, dftwaves->wavelen);
+         continue;
+      }
+      if(dftwaves->simd == DFT_SIMD_SSE2){
+         dft_powers_sse2(powers, dir, rowsums, dftwaves->simd_table,
+                         dftwaves->nwaves, dftwaves->wavelen);
+         continue;
+      }
+#endif
+
       /* Foreach DFT wave ... */
       for(w = 0; w < dftwaves->nwaves; w++){
          dft_power(&(powers[w][dir]), rowsums,
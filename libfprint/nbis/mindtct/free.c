@@ -95,6 +95,7 @@ void free_dftwaves(DFTWAVES *dftwaves)
        g_free(dftwaves->waves[i]);
    }
    g_free(dftwaves->waves);
+   g_free(dftwaves->simd_table);
    g_free(dftwaves);
 }
 
@@ -119,13 +119,21 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
       return(-2);
    }
 
+   /* Contours and other short lived buffers of this detection are */
+   /* allocated from scratch memory.                               */
+   begin_lfs_scratch();
+
    /* Detect minutiae in grayscale fingerpeint image. */
-   if((ret = lfs_detect_minutiae_V2(&minutiae,
-                                   &direction_map, &low_contrast_map,
-                                   &low_flow_map, &high_curve_map,
-                                   &map_w, &map_h,
-                                   &bdata, &bw, &bh,
-                                   idata, iw, ih, lfsparms))){
+   ret = lfs_detect_minutiae_V2(&minutiae,
+                                &direction_map, &low_contrast_map,
+                                &low_flow_map, &high_curve_map,
+                                &map_w, &map_h,
+                                &bdata, &bw, &bh,
+                                idata, iw, ih, lfsparms);
+
+   end_lfs_scratch();
+
+   if(ret){
       return(ret);
    }
 
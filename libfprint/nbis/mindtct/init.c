@@ -63,11 +63,26 @@ of the software.
                         init_rotgrids()
                         alloc_dir_powers()
                         alloc_power_stats()
+                        free_lfs_tables() (static)
+                        lfs_tables_match() (static)
+                        lfs_tables_cache_lookup() (static)
+                        get_lfs_tables()
+                        release_lfs_tables()
 ***********************************************************************/
 
 #include <stdio.h>
 #include <lfs.h>
 
+/* Number of unused sets of lookup tables kept around.  Swipe sensors   */
+/* produce images of varying height, but the tables only depend on the  */
+/* width, so even these need few entries.                               */
+#define LFS_TABLES_CACHE_SIZE 4
+
+/* Cache of lookup tables, most recently used first.  The cache holds a */
+/* reference to each of these.                                          */
+static GMutex lfs_tables_lock;
+static LFSTABLES *lfs_tables_cache = NULL;
+
 /*************************************************************************
 **************************************************************************
 #cat: init_dir2rad - Allocates and initializes a lookup table containing
@@ -196,6 +211,9 @@ int init_dftwaves(DFTWAVES **optr, const double *dft_coefs,
       }
    }
 
+   /* Pick the vectorized kernels once for all blocks */
+   init_dft_simd(dftwaves);
+
    *optr = dftwaves;
    return(0);
 }
@@ -619,5 +637,226 @@ int alloc_power_stats(int **owis, double **opowmaxs, int **opowmax_dirs,
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: free_lfs_tables - Deallocates a set of lookup tables.
+
+   Input:
+      tables   - the tables to be deallocated
+**************************************************************************/
+static void free_lfs_tables(LFSTABLES *tables)
+{
+   if(tables->dir2rad != NULL)
+      free_dir2rad(tables->dir2rad);
+   if(tables->dftwaves != NULL)
+      free_dftwaves(tables->dftwaves);
+   if(tables->dftgrids != NULL)
+      free_rotgrids(tables->dftgrids);
+   if(tables->dirbingrids != NULL)
+      free_rotgrids(tables->dirbingrids);
+   g_free(tables);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_tables_match - Determines whether a set of lookup tables was
+#cat:                computed for the given geometry and parameters.
+
+   Input:
+      tables   - the lookup tables
+      iw       - width (in pixels) of the image
+      pad      - padding (in pixels) of the image
+      lfsparms - parameters and thresholds for controlling LFS
+   Return Code:
+      TRUE     - the tables may be used
+      FALSE    - the tables were computed for something else
+**************************************************************************/
+static int lfs_tables_match(const LFSTABLES *tables, const int iw,
+                            const int pad, const LFSPARMS *lfsparms)
+{
+   return((tables->iw == iw) &&
+          (tables->pad == pad) &&
+          (tables->num_directions == lfsparms->num_directions) &&
+          (tables->start_dir_angle == lfsparms->start_dir_angle) &&
+          (tables->num_dft_waves == lfsparms->num_dft_waves) &&
+          (tables->windowsize == lfsparms->windowsize) &&
+          (tables->dirbin_grid_w == lfsparms->dirbin_grid_w) &&
+          (tables->dirbin_grid_h == lfsparms->dirbin_grid_h));
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: lfs_tables_cache_lookup - Looks up a set of lookup tables in the
+#cat:                cache, moving it to the front of the cache.  The
+#cat:                cache lock must be held.
+
+   Input:
+      iw       - width (in pixels) of the image
+      pad      - padding (in pixels) of the image
+      lfsparms - parameters and thresholds for controlling LFS
+   Return Code:
+      The matching tables with a new reference, or NULL
+**************************************************************************/
+static LFSTABLES *lfs_tables_cache_lookup(const int iw, const int pad,
+                                          const LFSPARMS *lfsparms)
+{
+   LFSTABLES *tables, *prev;
+
+   prev = NULL;
+   for(tables = lfs_tables_cache; tables != NULL; tables = tables->next){
+      if(lfs_tables_match(tables, iw, pad, lfsparms)){
+         if(prev != NULL){
+            prev->next = tables->next;
+            tables->next = lfs_tables_cache;
+            lfs_tables_cache = tables;
+         }
+         tables->ref_count++;
+         return(tables);
+      }
+      prev = tables;
+   }
+
+   return(NULL);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: get_lfs_tables - Returns the lookup tables needed to detect minutiae
+#cat:                in an image of the given width and padding.  Tables
+#cat:                are shared, so they are only computed if they are not
+#cat:                in use or cached already.  This routine is thread safe.
+
+   Input:
+      iw       - width (in pixels) of the image
+      pad      - padding (in pixels) of the image
+      lfsparms - parameters and thresholds for controlling LFS
+   Output:
+      otables  - points to the lookup tables, which must be released
+                 using release_lfs_tables()
+   Return Code:
+      Zero     - successful completion
+      Negative - system error
+**************************************************************************/
+int get_lfs_tables(LFSTABLES **otables, const int iw, const int pad,
+                   const LFSPARMS *lfsparms)
+{
+   LFSTABLES *tables, *cached, *evicted, *last;
+   int ret, n;
+
+   g_mutex_lock(&lfs_tables_lock);
+   tables = lfs_tables_cache_lookup(iw, pad, lfsparms);
+   g_mutex_unlock(&lfs_tables_lock);
+
+   if(tables != NULL){
+      *otables = tables;
+      return(0);
+   }
+
+   /* Compute the tables without holding the lock */
+   tables = (LFSTABLES *)g_malloc0(sizeof(LFSTABLES));
+   tables->iw = iw;
+   tables->pad = pad;
+   tables->num_directions = lfsparms->num_directions;
+   tables->start_dir_angle = lfsparms->start_dir_angle;
+   tables->num_dft_waves = lfsparms->num_dft_waves;
+   tables->windowsize = lfsparms->windowsize;
+   tables->dirbin_grid_w = lfsparms->dirbin_grid_w;
+   tables->dirbin_grid_h = lfsparms->dirbin_grid_h;
+
+   /* Initialize lookup table for converting integer directions */
+   /* to angles in radians.                                     */
+   if((ret = init_dir2rad(&(tables->dir2rad), lfsparms->num_directions))){
+      free_lfs_tables(tables);
+      return(ret);
+   }
+
+   /* Initialize wave form lookup tables for DFT analyses. */
+   if((ret = init_dftwaves(&(tables->dftwaves), g_dft_coefs,
+                        lfsparms->num_dft_waves, lfsparms->windowsize))){
+      free_lfs_tables(tables);
+      return(ret);
+   }
+
+   /* Initialize lookup table for pixel offsets to rotated grids */
+   /* used for DFT analyses.  The image height does not matter.  */
+   if((ret = init_rotgrids(&(tables->dftgrids), iw, 0, pad,
+                        lfsparms->start_dir_angle, lfsparms->num_directions,
+                        lfsparms->windowsize, lfsparms->windowsize,
+                        RELATIVE2ORIGIN))){
+      free_lfs_tables(tables);
+      return(ret);
+   }
+
+   /* Initialize lookup table for pixel offsets to rotated grids */
+   /* used for directional binarization.                         */
+   if((ret = init_rotgrids(&(tables->dirbingrids), iw, 0, pad,
+                        lfsparms->start_dir_angle, lfsparms->num_directions,
+                        lfsparms->dirbin_grid_w, lfsparms->dirbin_grid_h,
+                        RELATIVE2CENTER))){
+      free_lfs_tables(tables);
+      return(ret);
+   }
+
+   /* One reference for the caller */
+   tables->ref_count = 1;
+
+   g_mutex_lock(&lfs_tables_lock);
+
+   /* Another thread may have computed the same tables meanwhile */
+   cached = lfs_tables_cache_lookup(iw, pad, lfsparms);
+   if(cached != NULL){
+      g_mutex_unlock(&lfs_tables_lock);
+      free_lfs_tables(tables);
+      *otables = cached;
+      return(0);
+   }
+
+   /* Add the tables to the front of the cache with a reference */
+   tables->ref_count++;
+   tables->next = lfs_tables_cache;
+   lfs_tables_cache = tables;
+
+   /* Evict the least recently used tables, if there are too many */
+   evicted = NULL;
+   last = lfs_tables_cache;
+   for(n = 1; last->next != NULL && n < LFS_TABLES_CACHE_SIZE; n++)
+      last = last->next;
+   if(last->next != NULL){
+      evicted = last->next;
+      last->next = NULL;
+   }
+
+   while(evicted != NULL){
+      cached = evicted;
+      evicted = evicted->next;
+      cached->next = NULL;
+      /* Tables still in use are deallocated once released */
+      if(--cached->ref_count == 0)
+         free_lfs_tables(cached);
+   }
+
+   g_mutex_unlock(&lfs_tables_lock);
+
+   *otables = tables;
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: release_lfs_tables - Releases a reference to lookup tables returned
+#cat:                by get_lfs_tables().  This routine is thread safe.
 
+   Input:
+      tables   - the lookup tables
+**************************************************************************/
+void release_lfs_tables(LFSTABLES *tables)
+{
+   int unused;
 
+   g_mutex_lock(&lfs_tables_lock);
+   unused = (--tables->ref_count == 0);
+   g_mutex_unlock(&lfs_tables_lock);
+
+   if(unused)
+      free_lfs_tables(tables);
+}
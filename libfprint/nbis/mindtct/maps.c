@@ -61,6 +61,10 @@ of the software.
 ***********************************************************************
                ROUTINES:
                         gen_image_maps()
+                        gen_initial_maps_rows() (static)
+                        unref_initial_maps_job() (static)
+                        gen_initial_maps_worker() (static)
+                        get_initial_maps_pool() (static)
                         gen_initial_maps()
                         interpolate_direction_map()
                         morph_TF_map()
@@ -216,6 +220,253 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
    return(0);
 }
 
+/* State shared by the threads generating the initial maps */
+typedef struct initial_maps_job{
+   int *direction_map;
+   int *low_contrast_map;
+   int *low_flow_map;
+   int *blkoffs;
+   int mw, mh;
+   unsigned char *pdata;
+   int pw, ph;
+   const DFTWAVES *dftwaves;
+   const ROTGRIDS *dftgrids;
+   const LFSPARMS *lfsparms;
+   int next_row;   /* Next row of blocks to be analyzed */
+   int ret;        /* First error encountered by any thread */
+
+   /* Pool workers that joined the job, see gen_initial_maps_worker() */
+   GMutex lock;
+   GCond cond;
+   int active;     /* Workers currently analyzing rows */
+   int finished;   /* Set once all rows are taken, late workers return */
+   int ref_count;
+} INITIAL_MAPS_JOB;
+
+/*************************************************************************
+**************************************************************************
+#cat: gen_initial_maps_rows - Conducts the DFT analysis of gen_initial_maps()
+#cat:             for rows of blocks until all rows have been analyzed.
+#cat:             Rows are taken from the job one at a time, so several
+#cat:             threads may run this routine on the same job, each with
+#cat:             its own working memory.  The analysis of a block does not
+#cat:             depend on any other block.
+
+   Input:
+      job       - the maps being generated and the parameters to do so
+   Output:
+      job       - the analyzed rows in the maps are set, and ret is set if
+                  an error occured
+**************************************************************************/
+static void gen_initial_maps_rows(INITIAL_MAPS_JOB *job)
+{
+   const LFSPARMS *lfsparms = job->lfsparms;
+   const DFTWAVES *dftwaves = job->dftwaves;
+   const ROTGRIDS *dftgrids = job->dftgrids;
+   const int pw = job->pw;
+   const int ph = job->ph;
+   int bi, by, blkdir;
+   int *wis, *powmax_dirs;
+   double **powers, *powmaxs, *pownorms;
+   int nstats;
+   int ret; /* return code */
+   int dft_offset;
+   int xminlimit, xmaxlimit, yminlimit, ymaxlimit;
+   int win_x, win_y, low_contrast_offset;
+
+   /* Allocate DFT directional power vectors */
+   if((ret = alloc_dir_powers(&powers, dftwaves->nwaves, dftgrids->ngrids))){
+      g_atomic_int_compare_and_exchange(&job->ret, 0, ret);
+      return;
+   }
+
+   /* Allocate DFT power statistic arrays */
+   /* Compute length of statistics arrays.  Statistics not needed   */
+   /* for the first DFT wave, so the length is number of waves - 1. */
+   nstats = dftwaves->nwaves - 1;
+   if((ret = alloc_power_stats(&wis, &powmaxs, &powmax_dirs,
+                            &pownorms, nstats))){
+      /* Free memory allocated to this point. */
+      free_dir_powers(powers, dftwaves->nwaves);
+      g_atomic_int_compare_and_exchange(&job->ret, 0, ret);
+      return;
+   }
+
+   /* Compute special window origin limits for determining low contrast.  */
+   /* These pixel limits avoid analyzing the padded borders of the image. */
+   xminlimit = dftgrids->pad;
+   yminlimit = dftgrids->pad;
+   xmaxlimit = pw - dftgrids->pad - lfsparms->windowsize - 1;
+   ymaxlimit = ph - dftgrids->pad - lfsparms->windowsize - 1;
+
+   ret = 0;
+
+   /* Foreach row of blocks not taken by another thread ... */
+   while(!ret && !g_atomic_int_get(&job->ret) &&
+         (by = g_atomic_int_add(&job->next_row, 1)) < job->mh){
+      /* Foreach block in the row ... */
+      for(bi = by * job->mw; bi < (by + 1) * job->mw; bi++){
+         /* Adjust block offset from pointing to block origin to pointing */
+         /* to surrounding window origin.                                 */
+         dft_offset = job->blkoffs[bi] - (lfsparms->windowoffset * pw) -
+                         lfsparms->windowoffset;
+
+         /* Compute pixel coords of window origin. */
+         win_x = dft_offset % pw;
+         win_y = (int)(dft_offset / pw);
+
+         /* Make sure the current window does not access padded image pixels */
+         /* for analyzing low contrast.                                      */
+         win_x = max(xminlimit, win_x);
+         win_x = min(xmaxlimit, win_x);
+         win_y = max(yminlimit, win_y);
+         win_y = min(ymaxlimit, win_y);
+         low_contrast_offset = (win_y * pw) + win_x;
+
+         print2log("   BLOCK %2d (%2d, %2d) ", bi, bi%job->mw, bi/job->mw);
+
+         /* If block is low contrast ... */
+         if((ret = low_contrast_block(low_contrast_offset, lfsparms->windowsize,
+                                     job->pdata, pw, ph, lfsparms))){
+            /* If system error ... */
+            if(ret < 0)
+               break;
+
+            ret = 0;
+
+            /* Otherwise, block is low contrast ... */
+            print2log("LOW CONTRAST\n");
+            job->low_contrast_map[bi] = TRUE;
+            /* Direction Map's block is already set to INVALID. */
+         }
+         /* Otherwise, sufficient contrast for DFT processing ... */
+         else {
+            print2log("\n");
+
+            /* Compute DFT powers */
+            if((ret = dft_dir_powers(powers, job->pdata, low_contrast_offset,
+                                  pw, ph, dftwaves, dftgrids)))
+               break;
+
+            /* Compute DFT power statistics, skipping first applied DFT  */
+            /* wave.  This is dependent on how the primary and secondary */
+            /* direction tests work below.                               */
+            if((ret = dft_power_stats(wis, powmaxs, powmax_dirs, pownorms, powers,
+                                   1, dftwaves->nwaves, dftgrids->ngrids)))
+               break;
+
+#ifdef LOG_REPORT /*vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv*/
+            {  int _w;
+               fprintf(logfp, "      Power\n");
+               for(_w = 0; _w < nstats; _w++){
+                  /* Add 1 to wis[w] to create index to original g_dft_coefs[] */
+                  fprintf(logfp, "         wis[%d] %d %12.3f %2d %9.3f %12.3f\n",
+                       _w, wis[_w]+1,
+                       powmaxs[wis[_w]], powmax_dirs[wis[_w]], pownorms[wis[_w]],
+                       powers[0][powmax_dirs[wis[_w]]]);
+               }
+            }
+#endif /*^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^*/
+
+            /* Conduct primary direction test */
+            blkdir = primary_dir_test(powers, wis, powmaxs, powmax_dirs,
+                                     pownorms, nstats, lfsparms);
+
+            if(blkdir != INVALID_DIR)
+               job->direction_map[bi] = blkdir;
+            else{
+               /* Conduct secondary (fork) direction test */
+               blkdir = secondary_fork_test(powers, wis, powmaxs, powmax_dirs,
+                                     pownorms, nstats, lfsparms);
+               if(blkdir != INVALID_DIR)
+                  job->direction_map[bi] = blkdir;
+               /* Otherwise current direction in Direction Map remains INVALID */
+               else
+                  /* Flag the block as having LOW RIDGE FLOW. */
+                  job->low_flow_map[bi] = TRUE;
+            }
+
+         } /* End DFT */
+      } /* bi */
+   } /* by */
+
+   /* Report the error to the other threads */
+   if(ret)
+      g_atomic_int_compare_and_exchange(&job->ret, 0, ret);
+
+   /* Deallocate working memory */
+   free_dir_powers(powers, dftwaves->nwaves);
+   g_free(wis);
+   g_free(powmaxs);
+   g_free(powmax_dirs);
+   g_free(pownorms);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: unref_initial_maps_job - Drops a reference to a job, freeing it
+#cat:             once the last reference is gone.
+**************************************************************************/
+static void unref_initial_maps_job(INITIAL_MAPS_JOB *job)
+{
+   if(!g_atomic_int_dec_and_test(&job->ref_count))
+      return;
+
+   g_mutex_clear(&job->lock);
+   g_cond_clear(&job->cond);
+   g_free(job);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: gen_initial_maps_worker - Pool function running
+#cat:             gen_initial_maps_rows() on a job.  The pool is shared
+#cat:             by all detections, so a worker may only start after the
+#cat:             calling thread analyzed all rows by itself.  The caller
+#cat:             does not wait for such workers, they return right away.
+**************************************************************************/
+static void gen_initial_maps_worker(gpointer data, gpointer user_data)
+{
+   INITIAL_MAPS_JOB *job = (INITIAL_MAPS_JOB *)data;
+
+   g_mutex_lock(&job->lock);
+   if(job->finished){
+      g_mutex_unlock(&job->lock);
+      unref_initial_maps_job(job);
+      return;
+   }
+   job->active++;
+   g_mutex_unlock(&job->lock);
+
+   gen_initial_maps_rows(job);
+
+   g_mutex_lock(&job->lock);
+   job->active--;
+   g_cond_signal(&job->cond);
+   g_mutex_unlock(&job->lock);
+
+   unref_initial_maps_job(job);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: get_initial_maps_pool - Returns the worker pool shared by all
+#cat:             gen_initial_maps() calls, creating it on first use.
+**************************************************************************/
+static GThreadPool *get_initial_maps_pool(void)
+{
+   static gsize initialized = 0;
+   static GThreadPool *pool = (GThreadPool *)NULL;
+
+   if(g_once_init_enter(&initialized)){
+      pool = g_thread_pool_new(gen_initial_maps_worker, NULL,
+                               g_get_num_processors(), FALSE, NULL);
+      g_once_init_leave(&initialized, 1);
+   }
+
+   return(pool);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: gen_initial_maps - Creates an initial Direction Map from the given
@@ -234,7 +485,9 @@ int gen_image_maps(int **odmap, int **olcmap, int **olfmap, int **ohcmap,
 #cat:             The Low Flow Map flags blocks in which the DFT analyses
 #cat:             could not determine a significant ridge flow.  Blocks with
 #cat:             low ridge flow also have a corresponding direction of
-#cat:             INVALID in the Direction Map.
+#cat:             INVALID in the Direction Map.  If lfsparms->map_threads
+#cat:             is larger than 1, rows of blocks are analyzed in parallel
+#cat:             by up to that many threads of a shared worker pool.
 
    Input:
       blkoffs   - offsets to the pixel origin of each block in the padded image
@@ -260,14 +513,9 @@ int gen_initial_maps(int **odmap, int **olcmap, int **olfmap,
                 const LFSPARMS *lfsparms)
 {
    int *direction_map, *low_contrast_map, *low_flow_map;
-   int bi, bsize, blkdir;
-   int *wis, *powmax_dirs;
-   double **powers, *powmaxs, *pownorms;
-   int nstats;
-   int ret; /* return code */
-   int dft_offset;
-   int xminlimit, xmaxlimit, yminlimit, ymaxlimit;
-   int win_x, win_y, low_contrast_offset;
+   int bsize;
+   int nthreads, i, ret;
+   INITIAL_MAPS_JOB *job;
 
    print2log("INITIAL MAP\n");
 
@@ -290,155 +538,55 @@ int gen_initial_maps(int **odmap, int **olcmap, int **olfmap,
    /* Initialize the Low Flow Map to FALSE (0). */
    memset(low_flow_map, 0, bsize * sizeof(int));
 
-   /* Allocate DFT directional power vectors */
-   if((ret = alloc_dir_powers(&powers, dftwaves->nwaves, dftgrids->ngrids))){
-      /* Free memory allocated to this point. */
-      g_free(direction_map);
-      g_free(low_contrast_map);
-      g_free(low_flow_map);
-      return(ret);
+   /* The job is reference counted, as queued pool workers may only */
+   /* run after this routine returned.                               */
+   job = (INITIAL_MAPS_JOB *)g_malloc0(sizeof(INITIAL_MAPS_JOB));
+   job->direction_map = direction_map;
+   job->low_contrast_map = low_contrast_map;
+   job->low_flow_map = low_flow_map;
+   job->blkoffs = blkoffs;
+   job->mw = mw;
+   job->mh = mh;
+   job->pdata = pdata;
+   job->pw = pw;
+   job->ph = ph;
+   job->dftwaves = dftwaves;
+   job->dftgrids = dftgrids;
+   job->lfsparms = lfsparms;
+   job->next_row = 0;
+   job->ret = 0;
+   g_mutex_init(&job->lock);
+   g_cond_init(&job->cond);
+   job->ref_count = 1;
+
+   /* Rows of blocks are analyzed in parallel if requested.  The calling */
+   /* thread takes part in the analysis.                                 */
+   nthreads = min(lfsparms->map_threads, mh);
+   for(i = 0; i < nthreads - 1; i++){
+      g_atomic_int_inc(&job->ref_count);
+      g_thread_pool_push(get_initial_maps_pool(), job, NULL);
    }
 
-   /* Allocate DFT power statistic arrays */
-   /* Compute length of statistics arrays.  Statistics not needed   */
-   /* for the first DFT wave, so the length is number of waves - 1. */
-   nstats = dftwaves->nwaves - 1;
-   if((ret = alloc_power_stats(&wis, &powmaxs, &powmax_dirs,
-                            &pownorms, nstats))){
+   gen_initial_maps_rows(job);
+
+   /* All rows are taken, wait for the workers still analyzing them */
+   g_mutex_lock(&job->lock);
+   job->finished = TRUE;
+   while(job->active > 0)
+      g_cond_wait(&job->cond, &job->lock);
+   g_mutex_unlock(&job->lock);
+
+   ret = g_atomic_int_get(&job->ret);
+   unref_initial_maps_job(job);
+
+   if(ret){
       /* Free memory allocated to this point. */
       g_free(direction_map);
       g_free(low_contrast_map);
       g_free(low_flow_map);
-      free_dir_powers(powers, dftwaves->nwaves);
       return(ret);
    }
 
-   /* Compute special window origin limits for determining low contrast.  */
-   /* These pixel limits avoid analyzing the padded borders of the image. */
-   xminlimit = dftgrids->pad;
-   yminlimit = dftgrids->pad;
-   xmaxlimit = pw - dftgrids->pad - lfsparms->windowsize - 1;
-   ymaxlimit = ph - dftgrids->pad - lfsparms->windowsize - 1;
-
-   /* Foreach block in image ... */
-   for(bi = 0; bi < bsize; bi++){
-      /* Adjust block offset from pointing to block origin to pointing */
-      /* to surrounding window origin.                                 */
-      dft_offset = blkoffs[bi] - (lfsparms->windowoffset * pw) -
-                      lfsparms->windowoffset;
-
-      /* Compute pixel coords of window origin. */
-      win_x = dft_offset % pw;
-      win_y = (int)(dft_offset / pw);
-
-      /* Make sure the current window does not access padded image pixels */
-      /* for analyzing low contrast.                                      */
-      win_x = max(xminlimit, win_x);
-      win_x = min(xmaxlimit, win_x);
-      win_y = max(yminlimit, win_y);
-      win_y = min(ymaxlimit, win_y);
-      low_contrast_offset = (win_y * pw) + win_x;
-
-      print2log("   BLOCK %2d (%2d, %2d) ", bi, bi%mw, bi/mw);
-
-      /* If block is low contrast ... */
-      if((ret = low_contrast_block(low_contrast_offset, lfsparms->windowsize,
-                                  pdata, pw, ph, lfsparms))){
-         /* If system error ... */
-         if(ret < 0){
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
-
-         /* Otherwise, block is low contrast ... */
-         print2log("LOW CONTRAST\n");
-         low_contrast_map[bi] = TRUE;
-         /* Direction Map's block is already set to INVALID. */
-      }
-      /* Otherwise, sufficient contrast for DFT processing ... */
-      else {
-         print2log("\n");
-
-         /* Compute DFT powers */
-         if((ret = dft_dir_powers(powers, pdata, low_contrast_offset, pw, ph,
-                               dftwaves, dftgrids))){
-            /* Free memory allocated to this point. */
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
-
-         /* Compute DFT power statistics, skipping first applied DFT  */
-         /* wave.  This is dependent on how the primary and secondary */
-         /* direction tests work below.                               */
-         if((ret = dft_power_stats(wis, powmaxs, powmax_dirs, pownorms, powers,
-                                1, dftwaves->nwaves, dftgrids->ngrids))){
-            /* Free memory allocated to this point. */
-            g_free(direction_map);
-            g_free(low_contrast_map);
-            g_free(low_flow_map);
-            free_dir_powers(powers, dftwaves->nwaves);
-            g_free(wis);
-            g_free(powmaxs);
-            g_free(powmax_dirs);
-            g_free(pownorms);
-            return(ret);
-         }
-
-#ifdef LOG_REPORT /*vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv*/
-         {  int _w;
-            fprintf(logfp, "      Power\n");
-            for(_w = 0; _w < nstats; _w++){
-               /* Add 1 to wis[w] to create index to original g_dft_coefs[] */
-               fprintf(logfp, "         wis[%d] %d %12.3f %2d %9.3f %12.3f\n",
-                    _w, wis[_w]+1,
-                    powmaxs[wis[_w]], powmax_dirs[wis[_w]], pownorms[wis[_w]],
-                    powers[0][powmax_dirs[wis[_w]]]);
-            }
-         }
-#endif /*^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^*/
-
-         /* Conduct primary direction test */
-         blkdir = primary_dir_test(powers, wis, powmaxs, powmax_dirs,
-                                  pownorms, nstats, lfsparms);
-
-         if(blkdir != INVALID_DIR)
-            direction_map[bi] = blkdir;
-         else{
-            /* Conduct secondary (fork) direction test */
-            blkdir = secondary_fork_test(powers, wis, powmaxs, powmax_dirs,
-                                  pownorms, nstats, lfsparms);
-            if(blkdir != INVALID_DIR)
-               direction_map[bi] = blkdir;
-            /* Otherwise current direction in Direction Map remains INVALID */
-            else
-               /* Flag the block as having LOW RIDGE FLOW. */
-               low_flow_map[bi] = TRUE;
-         }
-
-      } /* End DFT */
-   } /* bi */
-
-   /* Deallocate working memory */
-   free_dir_powers(powers, dftwaves->nwaves);
-   g_free(wis);
-   g_free(powmaxs);
-   g_free(powmax_dirs);
-   g_free(pownorms);
-
    *odmap = direction_map;
    *olcmap = low_contrast_map;
    *olfmap = low_flow_map;
@@ -72,6 +72,8 @@ of the software.
                         free_minutiae()
                         free_minutia()
                         remove_minutia()
+                        remove_minutia_deferred()
+                        compact_minutiae()
                         join_minutia()
                         minutia_type()
                         is_minutia_appearing()
@@ -766,9 +768,11 @@ void free_minutiae(MINUTIAE *minutiae)
 {
    int i;
 
-   /* Deallocate minutia structures in the list. */
+   /* Deallocate minutia structures in the list, skipping positions */
+   /* left empty by remove_minutia_deferred().                       */
    for(i = 0; i < minutiae->num; i++)
-      free_minutia(minutiae->list[i]);
+      if(minutiae->list[i] != (MINUTIA *)NULL)
+         free_minutia(minutiae->list[i]);
    /* Deallocate list of minutia pointers. */
    g_free(minutiae->list);
 
@@ -835,6 +839,63 @@ int remove_minutia(const int index, MINUTIAE *minutiae)
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: remove_minutia_deferred - Deallocates the specified minutia point and
+#cat:                  leaves its position in the list empty, so that the
+#cat:                  following minutiae keep their indices.  Removal
+#cat:                  passes use this to avoid sliding the list for each
+#cat:                  removed minutia and call compact_minutiae() once done.
+
+   Input:
+      index      - position of minutia to be removed from list
+      minutiae   - input list of minutiae
+   Output:
+      minutiae   - list with an empty position at index
+   Return Code:
+      Zero      - successful completion
+      Negative  - system error
+**************************************************************************/
+int remove_minutia_deferred(const int index, MINUTIAE *minutiae)
+{
+   /* Make sure the requested index is within range. */
+   if((index < 0) || (index >= minutiae->num) ||
+      (minutiae->list[index] == (MINUTIA *)NULL)){
+      fprintf(stderr, "ERROR : remove_minutia_deferred : index out of range\n");
+      return(-381);
+   }
+
+   /* Deallocate the minutia structure to be removed. */
+   free_minutia(minutiae->list[index]);
+   minutiae->list[index] = (MINUTIA *)NULL;
+
+   /* Return normally. */
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: compact_minutiae - Removes the empty positions left in a list of
+#cat:                  minutiae by remove_minutia_deferred(), keeping the
+#cat:                  order of the remaining minutiae.
+
+   Input:
+      minutiae   - input list of minutiae
+   Output:
+      minutiae   - list without empty positions
+**************************************************************************/
+void compact_minutiae(MINUTIAE *minutiae)
+{
+   int fr, to;
+
+   for(to = 0, fr = 0; fr < minutiae->num; fr++){
+      if(minutiae->list[fr] != (MINUTIA *)NULL)
+         minutiae->list[to++] = minutiae->list[fr];
+   }
+
+   minutiae->num = to;
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: join_minutia - Takes 2 minutia points and connectes their features in
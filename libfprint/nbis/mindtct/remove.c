@@ -231,6 +231,11 @@ int remove_holes(MINUTIAE *minutiae,
    i = 0;
    /* Foreach minutia remaining in list ... */
    while(i < minutiae->num){
+      /* Skip slots vacated by minutiae removed earlier in this pass. */
+      if(minutiae->list[i] == (MINUTIA *)NULL){
+         i++;
+         continue;
+      }
       /* Assign a temporary pointer. */
       minutia = minutiae->list[i];
       /* If current minutia is a bifurcation ... */
@@ -243,12 +248,12 @@ int remove_holes(MINUTIAE *minutiae,
             print2log("%d,%d RM\n", minutia->x, minutia->y);
 
             /* Then remove the minutia from list. */
-            if((ret = remove_minutia(i, minutiae))){
+            if((ret = remove_minutia_deferred(i, minutiae))){
                /* Return error code. */
                return(ret);
             }
-            /* No need to advance because next minutia has "slid" */
-            /* into position pointed to by 'i'.                   */
+            /* No need to advance because the vacated slot at 'i' */
+            /* is skipped at the top of the loop.                */
          }
          /* If the minutia is NOT on a loop... */
          else if (ret == FALSE){
@@ -268,6 +273,9 @@ int remove_holes(MINUTIAE *minutiae,
       }
    }
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -478,7 +486,7 @@ int remove_hooks(MINUTIAE *minutiae,
       /* If the current minutia index is flagged for removal ... */
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
-         if((ret = remove_minutia(i, minutiae))){
+         if((ret = remove_minutia_deferred(i, minutiae))){
             g_free(to_remove);
             return(ret);
          }
@@ -488,6 +496,9 @@ int remove_hooks(MINUTIAE *minutiae,
    /* Deallocate flag list. */
    g_free(to_remove);
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -745,7 +756,7 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
       /* If the current minutia index is flagged for removal ... */
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
-         if((ret = remove_minutia(i, minutiae))){
+         if((ret = remove_minutia_deferred(i, minutiae))){
             g_free(to_remove);
             return(ret);
          }
@@ -755,6 +766,9 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
    /* Deallocate flag list. */
    g_free(to_remove);
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -836,7 +850,7 @@ int remove_malformations(MINUTIAE *minutiae,
          print2log("%d,%d RMA\n", minutia->x, minutia->y);
 
          /* Then remove the minutia. */
-         if((ret = remove_minutia(i, minutiae)))
+         if((ret = remove_minutia_deferred(i, minutiae)))
             /* If system error, return error code. */
             return(ret);
       }
@@ -880,7 +894,7 @@ int remove_malformations(MINUTIAE *minutiae,
             print2log("%d,%d RMB\n", minutia->x, minutia->y);
 
             /* Then remove the minutia. */
-            if((ret = remove_minutia(i, minutiae)))
+            if((ret = remove_minutia_deferred(i, minutiae)))
                /* If system error, return error code. */
                return(ret);
          }
@@ -911,7 +925,7 @@ int remove_malformations(MINUTIAE *minutiae,
             if((a_dist == 0.0) || (b_dist == 0.0)){
                /* Remove the malformation minutia. */
                print2log("%d,%d RMMAL1\n", minutia->x, minutia->y);
-               if((ret = remove_minutia(i, minutiae)))
+               if((ret = remove_minutia_deferred(i, minutiae)))
                   /* If system error, return error code. */
                   return(ret);
                removed = TRUE;
@@ -926,7 +940,7 @@ int remove_malformations(MINUTIAE *minutiae,
                   if(b_dist > lfsparms->max_malformation_dist){
                      /* Remove the malformation minutia. */
                      print2log("%d,%d RMMAL2\n", minutia->x, minutia->y);
-                     if((ret = remove_minutia(i, minutiae)))
+                     if((ret = remove_minutia_deferred(i, minutiae)))
                         /* If system error, return error code. */
                         return(ret);
                      removed = TRUE;
@@ -954,7 +968,7 @@ int remove_malformations(MINUTIAE *minutiae,
                         /* Then remove the minutia. */
                         print2log("%d,%d RMMAL3 (%f)\n",
                                   minutia->x, minutia->y, ratio);
-                        if((ret = remove_minutia(i, minutiae))){
+                        if((ret = remove_minutia_deferred(i, minutiae))){
                            g_free(x_list);
                            g_free(y_list);
                            /* If system error, return error code. */
@@ -974,6 +988,9 @@ int remove_malformations(MINUTIAE *minutiae,
       }
    }
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    return(0);
 }
 
@@ -1104,6 +1121,11 @@ int remove_near_invblock_V2(MINUTIAE *minutiae, int *direction_map,
    i = 0;
    /* Foreach minutia remaining in the list ... */
    while(i < minutiae->num){
+      /* Skip slots vacated by minutiae removed earlier in this pass. */
+      if(minutiae->list[i] == (MINUTIA *)NULL){
+         i++;
+         continue;
+      }
       /* Assign temporary minutia pointer. */
       minutia = minutiae->list[i];
 
@@ -1175,7 +1197,7 @@ int remove_near_invblock_V2(MINUTIAE *minutiae, int *direction_map,
                /* an even multiple, then some minutia may not be detected */
                /* as being in the margin of "the image" (not the block).  */
                /* In practice, I don't think this will impact performance.*/
-               if((ret = remove_minutia(i, minutiae)))
+               if((ret = remove_minutia_deferred(i, minutiae)))
                   /* If system error occurred while removing minutia, */
                   /* then return error code.                          */
                   return(ret);
@@ -1196,7 +1218,7 @@ int remove_near_invblock_V2(MINUTIAE *minutiae, int *direction_map,
                   print2log("%d,%d RM2\n", minutia->x, minutia->y);
 
                   /* Then remove the current minutia from the list. */
-                  if((ret = remove_minutia(i, minutiae)))
+                  if((ret = remove_minutia_deferred(i, minutiae)))
                      /* If system error occurred while removing minutia, */
                      /* then return error code.                          */
                      return(ret);
@@ -1218,10 +1240,13 @@ int remove_near_invblock_V2(MINUTIAE *minutiae, int *direction_map,
       if(!removed)
          /* Advance to the next minutia in the list. */
          i++;
-      /* Otherwise the next minutia has slid into the spot where current */
-      /* minutia was removed, so don't bump minutia index.               */
+      /* Otherwise the vacated slot is skipped at the top of the loop,  */
+      /* so don't bump minutia index.                                   */
    } /* End minutia loop */
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -1283,6 +1308,11 @@ int remove_pointing_invblock_V2(MINUTIAE *minutiae,
    i = 0;
    /* Foreach minutia remaining in list ... */
    while(i < minutiae->num){
+      /* Skip slots vacated by minutiae removed earlier in this pass. */
+      if(minutiae->list[i] == (MINUTIA *)NULL){
+         i++;
+         continue;
+      }
       /* Set temporary minutia pointer. */
       minutia = minutiae->list[i];
       /* Convert minutia's direction to radians. */
@@ -1319,10 +1349,10 @@ int remove_pointing_invblock_V2(MINUTIAE *minutiae,
          print2log("%d,%d RM\n", minutia->x, minutia->y);
 
          /* Remove the minutia from the minutiae list. */
-         if((ret = remove_minutia(i, minutiae))){
+         if((ret = remove_minutia_deferred(i, minutiae))){
             return(ret);
          }
-         /* No need to advance because next minutia has slid into slot. */
+         /* No need to advance because the vacated slot is skipped. */
       }
       else{
          /* Advance to next minutia in list. */
@@ -1330,6 +1360,9 @@ int remove_pointing_invblock_V2(MINUTIAE *minutiae,
       }
    }
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -1475,7 +1508,7 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
         if (to_remove[i]){
             removed ++;
             /* Remove the minutia from the minutiae list. */
-            if((ret = remove_minutia(i, minutiae))){
+            if((ret = remove_minutia_deferred(i, minutiae))){
                 free(to_remove);
                 return(ret);
             }
@@ -1484,6 +1517,8 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
 
     free(to_remove);
 
+    compact_minutiae(minutiae);
+
     return (0);
 }
 
@@ -1703,7 +1738,7 @@ int remove_overlaps(MINUTIAE *minutiae,
       /* If the current minutia index is flagged for removal ... */
       if(to_remove[i]){
          /* Remove the minutia from the minutiae list. */
-         if((ret = remove_minutia(i, minutiae))){
+         if((ret = remove_minutia_deferred(i, minutiae))){
             g_free(to_remove);
             return(ret);
          }
@@ -1713,6 +1748,9 @@ int remove_overlaps(MINUTIAE *minutiae,
    /* Deallocate flag list. */
    g_free(to_remove);
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -1820,6 +1858,11 @@ int remove_pores_V2(MINUTIAE *minutiae,
    i = 0;
    /* Foreach minutia remaining in the list ... */
    while(i < minutiae->num){
+      /* Skip slots vacated by minutiae removed earlier in this pass. */
+      if(minutiae->list[i] == (MINUTIA *)NULL){
+         i++;
+         continue;
+      }
       /* Set temporary minutia pointer. */
       minutia = minutiae->list[i];
 
@@ -1895,7 +1938,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                   print2log("%d,%d RMB\n", minutia->x, minutia->y);
 
                   /* Then remove the minutia. */
-                  if((ret = remove_minutia(i, minutiae)))
+                  if((ret = remove_minutia_deferred(i, minutiae)))
                      /* If system error, return error code. */
                      return(ret);
                   /* Set remove flag to TRUE. */
@@ -1939,7 +1982,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                      print2log("%d,%d RMD\n", minutia->x, minutia->y);
 
                      /* Then remove the minutia. */
-                     if((ret = remove_minutia(i, minutiae)))
+                     if((ret = remove_minutia_deferred(i, minutiae)))
                         /* If system error, return error code. */
                         return(ret);
                      /* Set remove flag to TRUE. */
@@ -1994,7 +2037,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                            print2log("%d,%d RMA\n", minutia->x, minutia->y);
 
                            /* Then remove the minutia. */
-                           if((ret = remove_minutia(i, minutiae)))
+                           if((ret = remove_minutia_deferred(i, minutiae)))
                               /* If system error, return error code. */
                               return(ret);
                            /* Set remove flag to TRUE. */
@@ -2040,7 +2083,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                                         minutia->x, minutia->y);
 
                               /* Then remove the minutia. */
-                              if((ret = remove_minutia(i, minutiae)))
+                              if((ret = remove_minutia_deferred(i, minutiae)))
                                  /* If system error, return error code. */
                                  return(ret);
                               /* Set remove flag to TRUE. */
@@ -2077,7 +2120,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                                     print2log("RMRATIO %f\n", ratio);
 
                                     /* Then assume pore & remove minutia. */
-                                    if((ret = remove_minutia(i, minutiae)))
+                                    if((ret = remove_minutia_deferred(i, minutiae)))
                                        /* If system error, return code. */
                                        return(ret);
                                     /* Set remove flag to TRUE. */
@@ -2095,7 +2138,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                         print2log("%d,%d RMQ\n", minutia->x, minutia->y);
 
                         /* Then remove the minutia. */
-                        if((ret = remove_minutia(i, minutiae)))
+                        if((ret = remove_minutia_deferred(i, minutiae)))
                            /* If system error, return error code. */
                            return(ret);
                         /* Set remove flag to TRUE. */
@@ -2110,7 +2153,7 @@ int remove_pores_V2(MINUTIAE *minutiae,
                print2log("%d,%d RMP\n", minutia->x, minutia->y);
 
                /* Then remove the minutia. */
-               if((ret = remove_minutia(i, minutiae)))
+               if((ret = remove_minutia_deferred(i, minutiae)))
                   /* If system error, return error code. */
                   return(ret);
                /* Set remove flag to TRUE. */
@@ -2124,10 +2167,13 @@ int remove_pores_V2(MINUTIAE *minutiae,
       if(!removed)
          /* Bump to next minutia in list. */
          i++;
-      /* Otherwise, next minutia has slid into slot of current removed one. */
+      /* Otherwise, the vacated slot is skipped at the top of the loop. */
 
    } /* End While minutia remaining in list. */
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -2200,6 +2246,11 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
    i = 0;
    /* Foreach minutia remaining in list ... */
    while(i < minutiae->num){
+      /* Skip slots vacated by minutiae removed earlier in this pass. */
+      if(minutiae->list[i] == (MINUTIA *)NULL){
+         i++;
+         continue;
+      }
       /* Assign a temporary pointer. */
       minutia = minutiae->list[i];
 
@@ -2228,14 +2279,14 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
          print2log("%d,%d RM1\n", minutia->x, minutia->y);
 
          /* Remove minutia from list. */
-         if((ret = remove_minutia(i, minutiae))){
+         if((ret = remove_minutia_deferred(i, minutiae))){
             /* Deallocate working memory. */
             g_free(rot_y);
             /* Return error code. */
             return(ret);
          }
-         /* No need to advance because next minutia has "slid" */
-         /* into position pointed to by 'i'.                   */
+         /* No need to advance because the vacated slot at 'i' */
+         /* is skipped at the top of the loop.                */
       }
       /* Otherwise, a complete contour was found and extracted ... */
       else{
@@ -2307,20 +2358,20 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
             by = minutia->y/lfsparms->blocksize;
             if(*(direction_map+(by*mw)+bx) == INVALID_DIR){
                /* Remove minutia from list. */
-               if((ret = remove_minutia(i, minutiae))){
+               if((ret = remove_minutia_deferred(i, minutiae))){
                   /* Deallocate working memory. */
                   g_free(rot_y);
                   free_contour(contour_x, contour_y, contour_ex, contour_ey);
                   if(minmax_alloc > 0){
-                     g_free(minmax_val);
-                     g_free(minmax_type);
-                     g_free(minmax_i);
+                     free_lfs_scratch(minmax_val);
+                     free_lfs_scratch(minmax_type);
+                     free_lfs_scratch(minmax_i);
                   }
                   /* Return error code. */
                   return(ret);
                }
-               /* No need to advance because next minutia has "slid" */
-               /* into position pointed to by 'i'.                   */
+               /* No need to advance because the vacated slot at 'i' */
+               /* is skipped at the top of the loop.                */
 
                print2log("RM2\n");
             }
@@ -2353,20 +2404,20 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
             by = minutia->y/lfsparms->blocksize;
             if(*(direction_map+(by*mw)+bx) == INVALID_DIR){
                /* Remove minutia from list. */
-               if((ret = remove_minutia(i, minutiae))){
+               if((ret = remove_minutia_deferred(i, minutiae))){
                   /* Deallocate working memory. */
                   g_free(rot_y);
                   free_contour(contour_x, contour_y, contour_ex, contour_ey);
                   if(minmax_alloc > 0){
-                     g_free(minmax_val);
-                     g_free(minmax_type);
-                     g_free(minmax_i);
+                     free_lfs_scratch(minmax_val);
+                     free_lfs_scratch(minmax_type);
+                     free_lfs_scratch(minmax_i);
                   }
                   /* Return error code. */
                   return(ret);
                }
-               /* No need to advance because next minutia has "slid" */
-               /* into position pointed to by 'i'.                   */
+               /* No need to advance because the vacated slot at 'i' */
+               /* is skipped at the top of the loop.                */
 
                print2log("RM3\n");
             }
@@ -2382,28 +2433,28 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
             print2log("%d,%d RM4\n", minutia->x, minutia->y);
 
             /* Remove minutia from list. */
-            if((ret = remove_minutia(i, minutiae))){
+            if((ret = remove_minutia_deferred(i, minutiae))){
                /* If system error, then deallocate working memories. */
                g_free(rot_y);
                free_contour(contour_x, contour_y, contour_ex, contour_ey);
                if(minmax_alloc > 0){
-                  g_free(minmax_val);
-                  g_free(minmax_type);
-                  g_free(minmax_i);
+                  free_lfs_scratch(minmax_val);
+                  free_lfs_scratch(minmax_type);
+                  free_lfs_scratch(minmax_i);
                }
                /* Return error code. */
                return(ret);
             }
-            /* No need to advance because next minutia has "slid" */
-            /* into position pointed to by 'i'.                   */
+            /* No need to advance because the vacated slot at 'i' */
+            /* is skipped at the top of the loop.                */
          }
 
          /* Deallocate contour and min/max buffers. */
          free_contour(contour_x, contour_y, contour_ex, contour_ey);
          if(minmax_alloc > 0){
-            g_free(minmax_val);
-            g_free(minmax_type);
-            g_free(minmax_i);
+            free_lfs_scratch(minmax_val);
+            free_lfs_scratch(minmax_type);
+            free_lfs_scratch(minmax_i);
          }
       } /* End else contour extracted. */
    } /* End while not end of minutiae list. */
@@ -2411,6 +2462,9 @@ int remove_or_adjust_side_minutiae_V2(MINUTIAE *minutiae,
    /* Deallocate working memory. */
    g_free(rot_y);
 
+   /* Close up the slots vacated during this pass. */
+   compact_minutiae(minutiae);
+
    /* Return normally. */
    return(0);
 }
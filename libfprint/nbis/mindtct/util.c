@@ -65,11 +65,52 @@ of the software.
                         angle2line()
                         line2direction()
                         closest_dir_dist()
+                        begin_lfs_scratch()
+                        reset_lfs_scratch()
+                        end_lfs_scratch()
+                        alloc_lfs_scratch()
+                        free_lfs_scratch()
 ***********************************************************************/
 
 #include <stdio.h>
 #include <lfs.h>
 
+/* Size of the first chunk of scratch memory of a detection.  Enough for */
+/* the contours traced while processing a typical image.               */
+#define LFS_SCRATCH_CHUNK_SIZE   (64 * 1024)
+
+/* Allocations are preceded by a header and aligned to its size. */
+#define LFS_SCRATCH_ALIGN        16
+
+typedef struct lfsscratchchunk{
+   struct lfsscratchchunk *next;
+   size_t size;
+   size_t used;
+   /* Offset of the header of the most recent allocation, or 0. */
+   size_t top;
+   unsigned char *data;
+} LFSSCRATCHCHUNK;
+
+typedef struct{
+   /* Offset of the header of the previous allocation, or 0. */
+   size_t prev;
+   int freed;
+} LFSSCRATCHHDR;
+
+G_STATIC_ASSERT(sizeof(LFSSCRATCHHDR) <= LFS_SCRATCH_ALIGN);
+
+/* Scratch memory of the detection running in the current thread, most */
+/* recently allocated chunk first.                                     */
+static GPrivate lfs_scratch = G_PRIVATE_INIT(NULL);
+
+/* Chunks of finished detections, so that the next detections do not */
+/* allocate scratch memory again.  One chunk per detection is kept.   */
+#define LFS_SCRATCH_POOL_SIZE    8
+
+G_LOCK_DEFINE_STATIC(lfs_scratch_pool);
+static LFSSCRATCHCHUNK *lfs_scratch_pool = NULL;
+static int lfs_scratch_pool_len = 0;
+
 /*************************************************************************
 **************************************************************************
 #cat: maxv - Determines the maximum value in the given list of integers.
@@ -151,6 +192,8 @@ int minv(const int *list, const int num)
       ominmax_i     - index of item's position in list
       ominmax_alloc - number of allocated minima and/or maxima
       ominmax_num   - number of detected minima and/or maxima
+                      (allocated lists are deallocated using
+                      free_lfs_scratch())
    Return Code:
       Zero     - successful completion
       Negative - system error
@@ -178,9 +221,9 @@ int minmaxs(int **ominmax_val, int **ominmax_type, int **ominmax_i,
    /* min or max.                                                */
    minmax_alloc = num - 2;
    /* Allocate the buffers. */
-   minmax_val = (int *)g_malloc(minmax_alloc * sizeof(int));
-   minmax_type = (int *)g_malloc(minmax_alloc * sizeof(int));
-   minmax_i = (int *)g_malloc(minmax_alloc * sizeof(int));
+   minmax_val = (int *)alloc_lfs_scratch(minmax_alloc * sizeof(int));
+   minmax_type = (int *)alloc_lfs_scratch(minmax_alloc * sizeof(int));
+   minmax_i = (int *)alloc_lfs_scratch(minmax_alloc * sizeof(int));
 
    /* Initialize number of min/max to 0. */
    minmax_num = 0;
@@ -587,3 +630,231 @@ int closest_dir_dist(const int dir1, const int dir2, const int ndirs)
    return(dist);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: new_lfs_scratch_chunk - Allocates a chunk of scratch memory.
+
+   Input:
+      size  - number of bytes in the chunk
+   Return Code:
+      The new chunk
+**************************************************************************/
+static LFSSCRATCHCHUNK *new_lfs_scratch_chunk(const size_t size)
+{
+   LFSSCRATCHCHUNK *chunk;
+
+   chunk = (LFSSCRATCHCHUNK *)g_malloc(sizeof(LFSSCRATCHCHUNK));
+   chunk->next = NULL;
+   chunk->size = size;
+   /* Offset 0 is reserved, so that it can mark the bottom of the stack. */
+   chunk->used = LFS_SCRATCH_ALIGN;
+   chunk->top = 0;
+   chunk->data = (unsigned char *)g_malloc(size);
+
+   return(chunk);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: free_lfs_scratch_chunks - Deallocates a list of scratch memory chunks.
+
+   Input:
+      chunk - first chunk of the list
+**************************************************************************/
+static void free_lfs_scratch_chunks(LFSSCRATCHCHUNK *chunk)
+{
+   LFSSCRATCHCHUNK *next;
+
+   while(chunk != NULL){
+      next = chunk->next;
+      g_free(chunk->data);
+      g_free(chunk);
+      chunk = next;
+   }
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: begin_lfs_scratch - Sets up scratch memory for the short lived
+#cat:                buffers of a minutiae detection in the current thread,
+#cat:                such as traced contours.  Until end_lfs_scratch() is
+#cat:                called, alloc_lfs_scratch() hands out memory from large
+#cat:                chunks instead of allocating each buffer separately.
+#cat:                A chunk released by a previous detection is reused
+#cat:                if there is one.
+
+**************************************************************************/
+void begin_lfs_scratch(void)
+{
+   LFSSCRATCHCHUNK *chunk;
+
+   G_LOCK(lfs_scratch_pool);
+   chunk = lfs_scratch_pool;
+   if(chunk != NULL){
+      lfs_scratch_pool = chunk->next;
+      lfs_scratch_pool_len--;
+   }
+   G_UNLOCK(lfs_scratch_pool);
+
+   if(chunk == NULL)
+      chunk = new_lfs_scratch_chunk(LFS_SCRATCH_CHUNK_SIZE);
+   else{
+      chunk->next = NULL;
+      chunk->used = LFS_SCRATCH_ALIGN;
+      chunk->top = 0;
+   }
+
+   free_lfs_scratch_chunks(g_private_get(&lfs_scratch));
+   g_private_set(&lfs_scratch, chunk);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: reset_lfs_scratch - Releases all scratch memory of the current thread
+#cat:                at once, between stages of a minutiae detection.  If
+#cat:                the previous stage needed several chunks, they are
+#cat:                replaced by a single one large enough for all of them.
+#cat:                No scratch buffers may be in use anymore.
+
+**************************************************************************/
+void reset_lfs_scratch(void)
+{
+   LFSSCRATCHCHUNK *chunk, *next;
+   size_t size;
+
+   chunk = g_private_get(&lfs_scratch);
+   if(chunk == NULL)
+      return;
+
+   if(chunk->next != NULL){
+      size = 0;
+      for(next = chunk; next != NULL; next = next->next)
+         size += next->size;
+      free_lfs_scratch_chunks(chunk);
+      chunk = new_lfs_scratch_chunk(size);
+      g_private_set(&lfs_scratch, chunk);
+   }
+   else{
+      chunk->used = LFS_SCRATCH_ALIGN;
+      chunk->top = 0;
+   }
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: end_lfs_scratch - Releases the scratch memory of the current thread.
+#cat:                The most recent chunk, which is the largest one, is
+#cat:                kept for the next detection, the others are
+#cat:                deallocated.  Buffers allocated afterwards use the
+#cat:                regular heap.
+
+**************************************************************************/
+void end_lfs_scratch(void)
+{
+   LFSSCRATCHCHUNK *chunk;
+
+   chunk = g_private_get(&lfs_scratch);
+   g_private_set(&lfs_scratch, NULL);
+   if(chunk == NULL)
+      return;
+
+   free_lfs_scratch_chunks(chunk->next);
+   chunk->next = NULL;
+
+   G_LOCK(lfs_scratch_pool);
+   if(lfs_scratch_pool_len < LFS_SCRATCH_POOL_SIZE){
+      chunk->next = lfs_scratch_pool;
+      lfs_scratch_pool = chunk;
+      lfs_scratch_pool_len++;
+      chunk = NULL;
+   }
+   G_UNLOCK(lfs_scratch_pool);
+
+   free_lfs_scratch_chunks(chunk);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: alloc_lfs_scratch - Allocates a short lived buffer.  Without scratch
+#cat:                memory set up in the current thread, this is the same
+#cat:                as g_malloc().  The buffer must be deallocated using
+#cat:                free_lfs_scratch().
+
+   Input:
+      size  - number of bytes to be allocated
+   Return Code:
+      The allocated buffer, or NULL if size is 0
+**************************************************************************/
+void *alloc_lfs_scratch(const size_t size)
+{
+   LFSSCRATCHCHUNK *chunk;
+   LFSSCRATCHHDR *hdr;
+   size_t need;
+
+   chunk = g_private_get(&lfs_scratch);
+   if((chunk == NULL) || (size == 0))
+      return(g_malloc(size));
+
+   need = LFS_SCRATCH_ALIGN +
+          ((size + LFS_SCRATCH_ALIGN - 1) & ~((size_t)LFS_SCRATCH_ALIGN - 1));
+
+   /* Start a new chunk if the current one is full.  The previous chunks */
+   /* are kept until the next reset, as they may still be in use.        */
+   if(chunk->size - chunk->used < need){
+      chunk = new_lfs_scratch_chunk(max(chunk->size * 2,
+                                        need + LFS_SCRATCH_ALIGN));
+      chunk->next = g_private_get(&lfs_scratch);
+      g_private_set(&lfs_scratch, chunk);
+   }
+
+   hdr = (LFSSCRATCHHDR *)(chunk->data + chunk->used);
+   hdr->prev = chunk->top;
+   hdr->freed = FALSE;
+   chunk->top = chunk->used;
+   chunk->used += need;
+
+   return(chunk->data + chunk->top + LFS_SCRATCH_ALIGN);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: free_lfs_scratch - Deallocates a buffer returned by alloc_lfs_scratch().
+#cat:                Scratch memory is used as a stack, the space of a buffer
+#cat:                is reused once all buffers allocated after it have been
+#cat:                deallocated as well.
+
+   Input:
+      ptr   - the buffer to be deallocated
+**************************************************************************/
+void free_lfs_scratch(void *ptr)
+{
+   LFSSCRATCHCHUNK *chunk;
+   LFSSCRATCHHDR *hdr;
+   unsigned char *p = ptr;
+
+   if(p == NULL)
+      return;
+
+   for(chunk = g_private_get(&lfs_scratch); chunk != NULL; chunk = chunk->next){
+      if((p > chunk->data) && (p < chunk->data + chunk->size))
+         break;
+   }
+
+   /* Buffer allocated from the heap. */
+   if(chunk == NULL){
+      g_free(ptr);
+      return;
+   }
+
+   hdr = (LFSSCRATCHHDR *)(p - LFS_SCRATCH_ALIGN);
+   hdr->freed = TRUE;
+
+   /* Pop all deallocated buffers from the top of the stack. */
+   while(chunk->top != 0){
+      hdr = (LFSSCRATCHHDR *)(chunk->data + chunk->top);
+      if(!hdr->freed)
+         break;
+      chunk->used = chunk->top;
+      chunk->top = hdr->prev;
+   }
+}
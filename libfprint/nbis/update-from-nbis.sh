@@ -198,3 +198,35 @@ patch -p0 < fix-scan-build-reports.patch
 
 # Add pass to remove perimeter points
 patch -p0 < remove-perimeter-pts.patch
+
+# Move the bozorth3 working tables into a context, so that matching is
+# reentrant and several matches can run in parallel
+patch -p0 < bozorth-context.patch
+
+# Allow keeping the sorted comparison table of a gallery fingerprint, so
+# that it does not need to be rebuilt for every match
+patch -p0 < bozorth-gallery-cache.patch
+
+# Use vectorized kernels for the DFT analysis on x86-64
+patch -p0 < mindtct-dft-simd.patch
+
+# Allow generating the initial maps using several threads
+patch -p0 < mindtct-threaded-maps.patch
+
+# Share the lookup tables between minutiae detections
+patch -p0 < mindtct-lfs-tables.patch
+
+# Compact the minutiae list once per removal pass instead of sliding it on every removal
+patch -p0 < mindtct-remove-compact.patch
+
+# Allocate contours and other short lived buffers from per-detection scratch memory
+patch -p0 < mindtct-scratch.patch
+
+# Select the vectorized DFT kernels and interleave the wave forms only once
+patch -p0 < mindtct-dft-table.patch
+
+# Generate the initial maps on a shared worker pool instead of new threads
+patch -p0 < mindtct-maps-pool.patch
+
+# Keep the scratch memory chunks of finished detections for the next ones
+patch -p0 < mindtct-scratch-pool.patch
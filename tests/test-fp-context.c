@@ -93,6 +93,78 @@ test_context_enumerates_new_devices (void)
   fpt_teardown_virtual_device_environment ();
 }
 
+static void
+test_context_probe_threads (void)
+{
+  g_autoptr(FpContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  FpDevice *device;
+  GPtrArray *devices;
+  guint probe_threads;
+
+  fpt_setup_virtual_device_environment (FPT_VIRTUAL_DEVICE_IMAGE);
+
+  context = g_object_new (FP_TYPE_CONTEXT,
+                          "probe-threads", 2,
+                          "probe-timeout", 10000,
+                          NULL);
+  g_object_get (context, "probe-threads", &probe_threads, NULL);
+  g_assert_cmpuint (probe_threads, ==, 2);
+
+  devices = fp_context_get_devices (context);
+
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, 1);
+
+  /* The device is used from the main context after probing in a worker */
+  device = g_ptr_array_index (devices, 0);
+  g_assert_cmpstr (fp_device_get_driver (device), ==, "virtual_image");
+
+  g_assert_true (fp_device_open_sync (device, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_true (fp_device_close_sync (device, NULL, &error));
+  g_assert_no_error (error);
+
+  fpt_teardown_virtual_device_environment ();
+}
+
+static void
+test_context_probe_timeout (void)
+{
+  g_autoptr(FpContext) context = NULL;
+  GPtrArray *devices;
+
+  fpt_setup_virtual_device_environment (FPT_VIRTUAL_DEVICE_NONIMAGE_STORAGE);
+
+  /* The probe succeeds, but only long after the timeout */
+  g_setenv ("FP_VIRTUAL_DEVICE_STORAGE_PROBE_DELAY", "500", TRUE);
+
+  context = g_object_new (FP_TYPE_CONTEXT,
+                          "probe-threads", 1,
+                          "probe-timeout", 50,
+                          NULL);
+
+  /* Driver classes are loaded by the context */
+  if (!g_type_from_name ("FpDeviceVirtualDeviceStorage"))
+    {
+      g_test_skip ("virtual_device_storage driver is not built");
+      g_unsetenv ("FP_VIRTUAL_DEVICE_STORAGE_PROBE_DELAY");
+      fpt_teardown_virtual_device_environment ();
+      return;
+    }
+
+  g_test_expect_message ("libfprint-context", G_LOG_LEVEL_MESSAGE,
+                         "*did not finish within 50 ms*");
+  devices = fp_context_get_devices (context);
+  g_test_assert_expected_messages ();
+
+  g_assert_nonnull (devices);
+  g_assert_cmpuint (devices->len, ==, 0);
+
+  g_unsetenv ("FP_VIRTUAL_DEVICE_STORAGE_PROBE_DELAY");
+  fpt_teardown_virtual_device_environment ();
+}
+
 #define DEV_REMOVED_CB 1
 #define CTX_DEVICE_REMOVED_CB 2
 
@@ -392,6 +464,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/context/no-devices", test_context_has_no_devices);
   g_test_add_func ("/context/has-virtual-device", test_context_has_virtual_device);
   g_test_add_func ("/context/enumerates-new-devices", test_context_enumerates_new_devices);
+  g_test_add_func ("/context/probe-threads", test_context_probe_threads);
+  g_test_add_func ("/context/probe-timeout", test_context_probe_timeout);
   g_test_add_func ("/context/remove-device-closed", test_context_remove_device_closed);
   g_test_add_func ("/context/remove-device-closing", test_context_remove_device_closing);
   g_test_add_func ("/context/remove-device-open", test_context_remove_device_open);
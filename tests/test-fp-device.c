@@ -141,6 +141,132 @@ test_device_close_sync_notify (void)
   g_assert_true (GPOINTER_TO_INT (tctx->user_data));
 }
 
+static void
+on_driver_thread_open_notify (FpDevice *rdev, GParamSpec *spec, GThread *thread)
+{
+  g_assert_true (g_thread_self () == thread);
+}
+
+static void
+on_driver_thread_device_opened (FpDevice *dev, GAsyncResult *res, FptContext *tctx)
+{
+  on_driver_thread_open_notify (dev, NULL, tctx->user_data);
+  on_device_opened (dev, res, tctx);
+}
+
+static void
+on_driver_thread_device_closed (FpDevice *dev, GAsyncResult *res, FptContext *tctx)
+{
+  on_driver_thread_open_notify (dev, NULL, tctx->user_data);
+  on_device_closed (dev, res, tctx);
+}
+
+static void
+test_device_driver_thread (void)
+{
+  g_autoptr(FptContext) tctx = fpt_context_new_with_virtual_device (FPT_VIRTUAL_DEVICE_IMAGE);
+  gboolean driver_thread = FALSE;
+
+  g_object_set (tctx->device, "driver-thread", TRUE, NULL);
+  g_object_get (tctx->device, "driver-thread", &driver_thread, NULL);
+  g_assert_true (driver_thread);
+
+  g_signal_connect (tctx->device, "notify::open",
+                    G_CALLBACK (on_driver_thread_open_notify), g_thread_self ());
+
+  tctx->user_data = g_thread_self ();
+  fp_device_open (tctx->device, NULL, (GAsyncReadyCallback) on_driver_thread_device_opened, tctx);
+  while (tctx->user_data != GUINT_TO_POINTER (TRUE))
+    g_main_context_iteration (NULL, TRUE);
+
+  /* Not possible while the device is open */
+  g_test_expect_message ("libfprint-device", G_LOG_LEVEL_WARNING, "*closed and idle*");
+  g_object_set (tctx->device, "driver-thread", FALSE, NULL);
+  g_test_assert_expected_messages ();
+
+  tctx->user_data = g_thread_self ();
+  fp_device_close (tctx->device, NULL, (GAsyncReadyCallback) on_driver_thread_device_closed, tctx);
+  while (tctx->user_data != GUINT_TO_POINTER (TRUE))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_object_set (tctx->device, "driver-thread", FALSE, NULL);
+  g_object_get (tctx->device, "driver-thread", &driver_thread, NULL);
+  g_assert_false (driver_thread);
+}
+
+static void
+test_device_driver_thread_finalize (void)
+{
+  g_autoptr(FptContext) tctx = fpt_context_new_with_virtual_device (FPT_VIRTUAL_DEVICE_IMAGE);
+
+  g_object_set (tctx->device, "driver-thread", TRUE, NULL);
+
+  g_assert_true (fp_device_open_sync (tctx->device, NULL, NULL));
+  g_assert_true (fp_device_close_sync (tctx->device, NULL, NULL));
+
+  /* The thread is still running when the device is destroyed */
+  g_clear_object (&tctx->fp_context);
+  g_assert_null (tctx->device);
+}
+
+static void
+on_driver_thread_capture_cancelled (FpDevice *dev, GAsyncResult *res, FptContext *tctx)
+{
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(GError) error = NULL;
+
+  image = fp_device_capture_finish (dev, res, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (image);
+
+  tctx->user_data = GUINT_TO_POINTER (TRUE);
+}
+
+static void
+test_device_driver_thread_cancel (void)
+{
+  g_autoptr(FptContext) tctx = fpt_context_new_with_virtual_device (FPT_VIRTUAL_DEVICE_IMAGE);
+  gint i;
+
+  g_object_set (tctx->device, "driver-thread", TRUE, NULL);
+  g_assert_true (fp_device_open_sync (tctx->device, NULL, NULL));
+
+  /* The cancellation is picked up by the driver thread while this thread
+   * completes the operation, repeat to give races a chance to show. */
+  for (i = 0; i < 20; i++)
+    {
+      g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+
+      tctx->user_data = NULL;
+      fp_device_capture (tctx->device, TRUE, cancellable,
+                         (GAsyncReadyCallback) on_driver_thread_capture_cancelled, tctx);
+
+      while (g_main_context_iteration (NULL, FALSE))
+        ;
+      g_cancellable_cancel (cancellable);
+
+      while (tctx->user_data != GUINT_TO_POINTER (TRUE))
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+  g_assert_true (fp_device_close_sync (tctx->device, NULL, NULL));
+}
+
+static void
+test_device_driver_thread_unsupported (void)
+{
+  g_autoptr(FptContext) tctx = fpt_context_new_with_virtual_device (FPT_VIRTUAL_DEVICE_NONIMAGE);
+  gboolean driver_thread = TRUE;
+
+  /* The virtual device uses the global default context */
+  g_test_expect_message ("libfprint-device", G_LOG_LEVEL_WARNING, "*does not support*");
+  g_object_set (tctx->device, "driver-thread", TRUE, NULL);
+  g_test_assert_expected_messages ();
+
+  g_object_get (tctx->device, "driver-thread", &driver_thread, NULL);
+  g_assert_false (driver_thread);
+}
+
 static void
 test_device_get_driver (void)
 {
@@ -243,6 +369,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/device/sync/open/notify", test_device_open_sync_notify);
   g_test_add_func ("/device/sync/close", test_device_close_sync);
   g_test_add_func ("/device/sync/close/notify", test_device_close_sync_notify);
+  g_test_add_func ("/device/async/driver_thread", test_device_driver_thread);
+  g_test_add_func ("/device/sync/driver_thread/finalize", test_device_driver_thread_finalize);
+  g_test_add_func ("/device/sync/driver_thread/unsupported", test_device_driver_thread_unsupported);
+  g_test_add_func ("/device/async/driver_thread/cancel", test_device_driver_thread_cancel);
   g_test_add_func ("/device/sync/get_driver", test_device_get_driver);
   g_test_add_func ("/device/sync/get_device_id", test_device_get_device_id);
   g_test_add_func ("/device/sync/get_name", test_device_get_name);
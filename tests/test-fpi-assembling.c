@@ -127,12 +127,196 @@ test_frame_assembling (void)
   g_assert (1);
 }
 
+static unsigned char
+linear_get_pixel (struct fpi_frame_asmbl_ctx *ctx,
+                  struct fpi_frame           *frame,
+                  unsigned int                x,
+                  unsigned int                y)
+{
+  return frame->data[x + y * ctx->frame_width];
+}
+
+static void
+check_frame_movement_linear (unsigned int frame_height)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *img = NULL;
+  int width, height, stride;
+  guchar *data;
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  GSList *frames = NULL;
+  GSList *linear_frames = NULL;
+  guint32 seed = 1;
+  int y, x;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", "vfs5011", "capture.png", NULL);
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  width = cairo_image_surface_get_width (img);
+  height = cairo_image_surface_get_height (img);
+  stride = cairo_image_surface_get_stride (img);
+
+  ctx.get_pixel = cairo_get_pixel;
+  ctx.frame_width = width - 16;
+  ctx.frame_height = frame_height;
+  ctx.image_width = width;
+
+  /* Frames with varying horizontal and vertical movement */
+  x = 8;
+  for (y = 0; y + ctx.frame_height < height; )
+    {
+      cairo_frame *frame = g_new0 (cairo_frame, 1);
+      struct fpi_frame *linear = g_malloc0 (sizeof (struct fpi_frame) +
+                                            ctx.frame_width * ctx.frame_height);
+
+      frame->surf = img;
+      frame->width = width;
+      frame->height = height;
+      frame->stride = stride;
+      frame->data = data;
+      frame->x = x;
+      frame->y = y;
+      frames = g_slist_append (frames, frame);
+
+      for (int fy = 0; fy < ctx.frame_height; fy++)
+        for (int fx = 0; fx < ctx.frame_width; fx++)
+          linear->data[fx + fy * ctx.frame_width] =
+            cairo_get_pixel (&ctx, (struct fpi_frame *) frame, fx, fy);
+      linear_frames = g_slist_append (linear_frames, linear);
+
+      seed = seed * 1103515245 + 12345;
+      y += 2 + (seed >> 16) % 12;
+      x = CLAMP (x + (int) ((seed >> 8) % 7) - 3, 0, 16);
+    }
+
+  fpi_do_movement_estimation (&ctx, frames);
+
+  /* The fast path for linear frames must give the same result */
+  ctx.get_pixel = linear_get_pixel;
+  ctx.linear_frames = TRUE;
+  fpi_do_movement_estimation (&ctx, linear_frames);
+
+  for (GSList *l = frames, *ll = linear_frames; l != NULL; l = l->next, ll = ll->next)
+    {
+      cairo_frame *frame = l->data;
+      struct fpi_frame *linear = ll->data;
+
+      g_assert_cmpint (frame->frame.delta_x, ==, linear->delta_x);
+      g_assert_cmpint (frame->frame.delta_y, ==, linear->delta_y);
+    }
+
+  g_slist_free_full (frames, g_free);
+  g_slist_free_full (linear_frames, g_free);
+  cairo_surface_destroy (img);
+}
+
+static void
+test_frame_movement_linear (void)
+{
+  check_frame_movement_linear (20);
+}
+
+static void
+test_frame_movement_linear_large (void)
+{
+  /* The normalized error overflows for frames this large */
+  check_frame_movement_linear (40);
+}
+
+static cairo_frame *
+cairo_frame_new (cairo_surface_t *img, guint y)
+{
+  cairo_frame *frame = g_new0 (cairo_frame, 1);
+
+  frame->surf = img;
+  frame->width = cairo_image_surface_get_width (img);
+  frame->height = cairo_image_surface_get_height (img);
+  frame->stride = cairo_image_surface_get_stride (img);
+  frame->data = cairo_image_surface_get_data (img);
+  frame->x = 0;
+  frame->y = y;
+
+  return frame;
+}
+
+static void
+test_frame_assembler (gconstpointer user_data)
+{
+  gboolean reverse = GPOINTER_TO_INT (user_data);
+  g_autofree char *path = NULL;
+  cairo_surface_t *img = NULL;
+  int height, offset, n_frames;
+  struct fpi_frame_asmbl_ctx ctx = { 0, };
+  gint xborder = 5;
+
+  g_autoptr(FpImage) expected = NULL;
+  g_autoptr(FpImage) fp_img = NULL;
+  g_autoptr(FpiFrameAssembler) assembler = NULL;
+  GSList *frames = NULL;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", "vfs5011", "capture.png", NULL);
+  img = cairo_image_surface_create_from_png (path);
+  height = cairo_image_surface_get_height (img);
+
+  ctx.get_pixel = cairo_get_pixel;
+  ctx.frame_width = cairo_image_surface_get_width (img);
+  ctx.frame_height = 20;
+  ctx.image_width = ctx.frame_width - 2 * xborder;
+
+  offset = 10;
+  n_frames = (height - ctx.frame_height - 1) / offset + 1;
+
+  assembler = fpi_frame_assembler_new (&ctx);
+
+  /* The assembler can be reused after finishing an image */
+  for (int round = 0; round < 2; round++)
+    {
+      for (int i = 0; i < n_frames; i++)
+        {
+          guint y = (reverse ? n_frames - 1 - i : i) * offset;
+
+          frames = g_slist_append (frames, cairo_frame_new (img, y));
+          fpi_frame_assembler_add_frame (assembler, (struct fpi_frame *) cairo_frame_new (img, y));
+        }
+      g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, n_frames);
+
+      /* The result must be identical to assembling all frames at the end */
+      fpi_do_movement_estimation (&ctx, frames);
+      expected = fpi_assemble_frames (&ctx, frames);
+      fp_img = fpi_frame_assembler_finish (assembler);
+      g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, 0);
+
+      g_assert_cmpint (fp_img->width, ==, expected->width);
+      g_assert_cmpint (fp_img->height, ==, expected->height);
+      g_assert_cmpint (fp_img->flags, ==, expected->flags);
+      g_assert_cmpmem (fp_img->data, fp_img->width * fp_img->height,
+                       expected->data, expected->width * expected->height);
+
+      g_clear_object (&expected);
+      g_clear_object (&fp_img);
+      g_slist_free_full (g_steal_pointer (&frames), g_free);
+    }
+
+  /* Resetting drops the frames */
+  fpi_frame_assembler_add_frame (assembler, (struct fpi_frame *) cairo_frame_new (img, 0));
+  fpi_frame_assembler_reset (assembler);
+  g_assert_cmpuint (fpi_frame_assembler_get_n_frames (assembler), ==, 0);
+
+  cairo_surface_destroy (img);
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/assembling/frames", test_frame_assembling);
+  g_test_add_func ("/assembling/frames/linear", test_frame_movement_linear);
+  g_test_add_func ("/assembling/frames/linear_large", test_frame_movement_linear_large);
+  g_test_add_data_func ("/assembling/frames/streaming", GINT_TO_POINTER (FALSE),
+                        test_frame_assembler);
+  g_test_add_data_func ("/assembling/frames/streaming/reverse", GINT_TO_POINTER (TRUE),
+                        test_frame_assembler);
 
   return g_test_run ();
 }
@@ -0,0 +1,296 @@
+/*
+ * Unit tests for the internal image device API
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define FP_COMPONENT "fake_test_image_dev"
+
+#include <libfprint/fprint.h>
+
+#include "fpi-device.h"
+#include "fpi-image.h"
+#include "fpi-image-device.h"
+
+#define IMAGE_SIZE 256
+
+/* An image device that reports a finger as soon as it is activated and
+ * hands a raw capture to fpi_image_device_process_capture(). */
+
+#define FPI_TYPE_DEVICE_FAKE_IMAGE (fpi_device_fake_image_get_type ())
+G_DECLARE_FINAL_TYPE (FpiDeviceFakeImage, fpi_device_fake_image, FPI, DEVICE_FAKE_IMAGE, FpImageDevice)
+
+struct _FpiDeviceFakeImage
+{
+  FpImageDevice       parent;
+
+  FpiImageProcessFunc process;
+  GCancellable       *cancel_on_capture;
+
+  gint                process_calls;
+  gint                data_destroyed;
+};
+
+G_DEFINE_TYPE (FpiDeviceFakeImage, fpi_device_fake_image, FP_TYPE_IMAGE_DEVICE)
+
+static const FpIdEntry driver_ids[] = {
+  { .virtual_envvar = "FP_VIRTUAL_FAKE_IMAGE_DEVICE" },
+  { .virtual_envvar = NULL }
+};
+
+static void
+fake_image_data_destroy (gpointer data)
+{
+  FpiDeviceFakeImage *self = data;
+
+  g_atomic_int_inc (&self->data_destroyed);
+}
+
+static void
+fake_image_finger_on (FpDevice *device, gpointer user_data)
+{
+  fpi_image_device_report_finger_status (FP_IMAGE_DEVICE (device), TRUE);
+}
+
+static void
+fake_image_finger_off (FpDevice *device, gpointer user_data)
+{
+  fpi_image_device_report_finger_status (FP_IMAGE_DEVICE (device), FALSE);
+}
+
+static void
+fake_image_capture (FpDevice *device, gpointer user_data)
+{
+  FpiDeviceFakeImage *self = FPI_DEVICE_FAKE_IMAGE (device);
+
+  fpi_image_device_process_capture (FP_IMAGE_DEVICE (device),
+                                    self->process,
+                                    self,
+                                    fake_image_data_destroy);
+
+  if (self->cancel_on_capture)
+    g_cancellable_cancel (self->cancel_on_capture);
+}
+
+static void
+fake_image_change_state (FpImageDevice *dev, FpiImageDeviceState state)
+{
+  FpiDeviceFakeImage *self = FPI_DEVICE_FAKE_IMAGE (dev);
+
+  switch (state)
+    {
+    case FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_ON:
+      fpi_device_add_timeout (FP_DEVICE (dev), 0, fake_image_finger_on, NULL, NULL);
+      break;
+
+    case FPI_IMAGE_DEVICE_STATE_CAPTURE:
+      fpi_device_add_timeout (FP_DEVICE (dev), 0, fake_image_capture, NULL, NULL);
+      break;
+
+    case FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_OFF:
+      /* Keep the finger on, the operation is cancelled instead */
+      if (!self->cancel_on_capture)
+        fpi_device_add_timeout (FP_DEVICE (dev), 0, fake_image_finger_off, NULL, NULL);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+fake_image_open (FpImageDevice *dev)
+{
+  fpi_image_device_open_complete (dev, NULL);
+}
+
+static void
+fake_image_close (FpImageDevice *dev)
+{
+  fpi_image_device_close_complete (dev, NULL);
+}
+
+static void
+fpi_device_fake_image_init (FpiDeviceFakeImage *self)
+{
+}
+
+static void
+fpi_device_fake_image_class_init (FpiDeviceFakeImageClass *klass)
+{
+  FpDeviceClass *dev_class = FP_DEVICE_CLASS (klass);
+  FpImageDeviceClass *img_class = FP_IMAGE_DEVICE_CLASS (klass);
+
+  dev_class->id = FP_COMPONENT;
+  dev_class->full_name = "Fake image device for debugging";
+  dev_class->type = FP_DEVICE_TYPE_VIRTUAL;
+  dev_class->id_table = driver_ids;
+
+  img_class->img_open = fake_image_open;
+  img_class->img_close = fake_image_close;
+  img_class->change_state = fake_image_change_state;
+}
+
+/* Processing functions, run in a worker thread */
+
+static FpImage *
+flat_image_new (void)
+{
+  FpImage *image;
+
+  image = fp_image_new (IMAGE_SIZE, IMAGE_SIZE);
+  memset (image->data, 0x80, IMAGE_SIZE * IMAGE_SIZE);
+
+  return image;
+}
+
+static FpImage *
+process_flat_image (gpointer data, GCancellable *cancellable, GError **error)
+{
+  FpiDeviceFakeImage *self = data;
+
+  g_atomic_int_inc (&self->process_calls);
+
+  return flat_image_new ();
+}
+
+static FpImage *
+process_too_short (gpointer data, GCancellable *cancellable, GError **error)
+{
+  FpiDeviceFakeImage *self = data;
+
+  g_atomic_int_inc (&self->process_calls);
+
+  g_set_error_literal (error, FP_DEVICE_RETRY, FP_DEVICE_RETRY_TOO_SHORT,
+                       "Swipe was too short");
+
+  return NULL;
+}
+
+static FpImage *
+process_until_cancelled (gpointer data, GCancellable *cancellable, GError **error)
+{
+  FpiDeviceFakeImage *self = data;
+
+  g_atomic_int_inc (&self->process_calls);
+
+  /* The device cancellable is passed on, and the cancellation is
+   * reported even though an image is returned. */
+  while (!g_cancellable_is_cancelled (cancellable))
+    g_usleep (1000);
+
+  return flat_image_new ();
+}
+
+static FpiDeviceFakeImage *
+fake_image_device_new_open (FpiImageProcessFunc process)
+{
+  g_autoptr(GError) error = NULL;
+  FpiDeviceFakeImage *self;
+
+  self = g_object_new (FPI_TYPE_DEVICE_FAKE_IMAGE, NULL);
+  self->process = process;
+
+  g_assert_true (fp_device_open_sync (FP_DEVICE (self), NULL, &error));
+  g_assert_no_error (error);
+
+  return self;
+}
+
+static void
+fake_image_device_close_free (FpiDeviceFakeImage *self)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true (fp_device_close_sync (FP_DEVICE (self), NULL, &error));
+  g_assert_no_error (error);
+
+  g_object_unref (self);
+}
+
+/* Tests */
+
+static void
+test_process_capture (void)
+{
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(GError) error = NULL;
+  FpiDeviceFakeImage *self = fake_image_device_new_open (process_flat_image);
+
+  image = fp_device_capture_sync (FP_DEVICE (self), TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (image);
+
+  /* The image created by the worker is what is reported */
+  g_assert_cmpuint (fp_image_get_width (image), ==, IMAGE_SIZE);
+  g_assert_cmpuint (fp_image_get_height (image), ==, IMAGE_SIZE);
+  g_assert_nonnull (fp_image_get_data (image, NULL));
+
+  g_assert_cmpint (self->process_calls, ==, 1);
+  g_assert_cmpint (self->data_destroyed, ==, 1);
+
+  fake_image_device_close_free (self);
+}
+
+static void
+test_process_capture_retry (void)
+{
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(GError) error = NULL;
+  FpiDeviceFakeImage *self = fake_image_device_new_open (process_too_short);
+
+  /* Not replaced by a generic retry, which would also warn */
+  image = fp_device_capture_sync (FP_DEVICE (self), TRUE, NULL, &error);
+  g_assert_error (error, FP_DEVICE_RETRY, FP_DEVICE_RETRY_TOO_SHORT);
+  g_assert_null (image);
+
+  g_assert_cmpint (self->process_calls, ==, 1);
+  g_assert_cmpint (self->data_destroyed, ==, 1);
+
+  fake_image_device_close_free (self);
+}
+
+static void
+test_process_capture_cancel (void)
+{
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(GError) error = NULL;
+  FpiDeviceFakeImage *self = fake_image_device_new_open (process_until_cancelled);
+
+  self->cancel_on_capture = cancellable;
+
+  image = fp_device_capture_sync (FP_DEVICE (self), TRUE, cancellable, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (image);
+
+  g_assert_cmpint (self->process_calls, ==, 1);
+  g_assert_cmpint (self->data_destroyed, ==, 1);
+
+  self->cancel_on_capture = NULL;
+  fake_image_device_close_free (self);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image-device/process_capture", test_process_capture);
+  g_test_add_func ("/image-device/process_capture/retry", test_process_capture_retry);
+  g_test_add_func ("/image-device/process_capture/cancel", test_process_capture_cancel);
+
+  return g_test_run ();
+}
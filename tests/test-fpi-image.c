@@ -0,0 +1,219 @@
+/*
+ * Unit tests for the internal image handling API
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+
+#include "fpi-image.h"
+
+/* Straightforward two pass implementations to compare against */
+static gint
+ref_std_sq_dev (const guint8 *buf, gint size)
+{
+  guint64 res = 0, mean = 0;
+  gint i;
+
+  for (i = 0; i < size; i++)
+    mean += buf[i];
+
+  mean /= size;
+
+  for (i = 0; i < size; i++)
+    {
+      gint64 dev = (gint64) buf[i] - (gint64) mean;
+      res += dev * dev;
+    }
+
+  return res / size;
+}
+
+static gint
+ref_mean_sq_diff_norm (const guint8 *buf1, const guint8 *buf2, gint size)
+{
+  guint64 res = 0;
+  gint i;
+
+  for (i = 0; i < size; i++)
+    {
+      gint dev = (gint) buf1[i] - (gint) buf2[i];
+      res += dev * dev;
+    }
+
+  return res / size;
+}
+
+static void
+fill_line (guint8 *buf, gint size, gint pattern)
+{
+  gint i;
+
+  for (i = 0; i < size; i++)
+    {
+      switch (pattern)
+        {
+        case 0:
+          buf[i] = 0;
+          break;
+
+        case 1:
+          buf[i] = 255;
+          break;
+
+        case 2:
+          buf[i] = i & 1 ? 255 : 0;
+          break;
+
+        default:
+          buf[i] = g_test_rand_int_range (0, 256);
+        }
+    }
+}
+
+static void
+test_line_stats (void)
+{
+  /* Sizes around the vector width and the accumulation block */
+  const gint sizes[] = { 1, 15, 16, 17, 144, 160, 1000, 65536, 65553, 300000 };
+  g_autofree guint8 *line = g_malloc (300000);
+  g_autofree guint8 *prev = g_malloc (300000);
+  guint i;
+  gint pattern, mean;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      for (pattern = 0; pattern < 4; pattern++)
+        {
+          gint size = sizes[i];
+          gint std_sq_dev, mean_sq_diff;
+          FpiLineFlags flags;
+
+          fill_line (line, size, pattern);
+          fill_line (prev, size, 3 - pattern);
+
+          g_assert_cmpint (fpi_std_sq_dev (line, size), ==,
+                           ref_std_sq_dev (line, size));
+          g_assert_cmpint (fpi_mean_std_sq_dev (line, size, &mean), ==,
+                           ref_std_sq_dev (line, size));
+          g_assert_cmpint (fpi_mean_sq_diff_norm (line, prev, size), ==,
+                           ref_mean_sq_diff_norm (line, prev, size));
+
+          flags = fpi_line_classify (line, prev, size, 250, 13,
+                                     &std_sq_dev, &mean_sq_diff);
+          g_assert_cmpint (std_sq_dev, ==, ref_std_sq_dev (line, size));
+          g_assert_cmpint (mean_sq_diff, ==,
+                           ref_mean_sq_diff_norm (line, prev, size));
+          g_assert_cmpint (!!(flags & FPI_LINE_BLANK), ==, std_sq_dev < 250);
+          g_assert_cmpint (!!(flags & FPI_LINE_DIFFERS), ==, mean_sq_diff >= 13);
+        }
+    }
+
+  fill_line (line, 16, 2);
+  g_assert_cmpint (fpi_mean_std_sq_dev (line, 16, &mean), ==, 16256);
+  g_assert_cmpint (mean, ==, 127);
+}
+
+static void
+test_line_classify_first (void)
+{
+  guint8 line[160];
+  gint mean_sq_diff = -1;
+  FpiLineFlags flags;
+
+  fill_line (line, sizeof (line), 0);
+  flags = fpi_line_classify (line, NULL, sizeof (line), 250, 13,
+                             NULL, &mean_sq_diff);
+  g_assert_cmpint (flags, ==, FPI_LINE_BLANK | FPI_LINE_DIFFERS);
+  g_assert_cmpint (mean_sq_diff, ==, 0);
+
+  flags = fpi_line_classify (line, line, sizeof (line), 250, 13, NULL, NULL);
+  g_assert_cmpint (flags, ==, FPI_LINE_BLANK);
+}
+
+static void
+test_buffer_shared (void)
+{
+  guint8 *buffer = fpi_image_buffer_new (100);
+
+  g_assert_false (fpi_image_buffer_is_shared (buffer));
+  g_assert_true (fpi_image_buffer_ref (buffer) == buffer);
+  g_assert_true (fpi_image_buffer_is_shared (buffer));
+
+  fpi_image_buffer_unref (buffer);
+  g_assert_false (fpi_image_buffer_is_shared (buffer));
+
+  fpi_image_buffer_unref (buffer);
+}
+
+static void
+test_buffer_pool_reuse (void)
+{
+  guint8 *a, *b, *c;
+
+  a = fpi_image_buffer_new (1000);
+  b = fpi_image_buffer_new (1000);
+  c = fpi_image_buffer_new (2000);
+  fpi_image_buffer_unref (a);
+  fpi_image_buffer_unref (b);
+  fpi_image_buffer_unref (c);
+
+  /* Only buffers of the same size are reused, most recent first */
+  g_assert_true (fpi_image_buffer_new (1000) == b);
+  g_assert_true (fpi_image_buffer_new (1000) == a);
+  g_assert_true (fpi_image_buffer_new (2000) == c);
+
+  fpi_image_buffer_unref (a);
+  fpi_image_buffer_unref (b);
+  fpi_image_buffer_unref (c);
+}
+
+static void
+test_buffer_pool_limit (void)
+{
+  guint8 *buffers[FPI_IMAGE_BUFFER_POOL_SIZE + 2];
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (buffers); i++)
+    buffers[i] = fpi_image_buffer_new (3000);
+  for (i = 0; i < G_N_ELEMENTS (buffers); i++)
+    {
+      fpi_image_buffer_unref (buffers[i]);
+      g_assert_cmpuint (fpi_image_buffer_pool_get_length (), <=, FPI_IMAGE_BUFFER_POOL_SIZE);
+    }
+
+  /* The least recently released buffers were dropped */
+  g_assert_cmpuint (fpi_image_buffer_pool_get_length (), ==, FPI_IMAGE_BUFFER_POOL_SIZE);
+  for (i = G_N_ELEMENTS (buffers) - 1; i >= 2; i--)
+    g_assert_true (fpi_image_buffer_new (3000) == buffers[i]);
+  g_assert_cmpuint (fpi_image_buffer_pool_get_length (), ==, 0);
+
+  for (i = 2; i < G_N_ELEMENTS (buffers); i++)
+    fpi_image_buffer_unref (buffers[i]);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image/line/stats", test_line_stats);
+  g_test_add_func ("/image/line/classify_first", test_line_classify_first);
+  g_test_add_func ("/image/buffer/shared", test_buffer_shared);
+  g_test_add_func ("/image/buffer/pool_reuse", test_buffer_pool_reuse);
+  g_test_add_func ("/image/buffer/pool_limit", test_buffer_pool_limit);
+
+  return g_test_run ();
+}
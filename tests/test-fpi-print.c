@@ -0,0 +1,990 @@
+/*
+ * Unit tests for the internal print handling API
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "fpi-device.h"
+#include "fpi-image.h"
+#include "fpi-minutiae.h"
+#include "fpi-print.h"
+#include "fp-print-private.h"
+#include "test-device-fake.h"
+
+#define BZ3_THRESHOLD 40
+
+static FpDevice *fake_device = NULL;
+
+/* Utility functions */
+
+/* Creates a pseudo random set of minutiae. Using the same seed with a
+ * smaller number of minutiae results in a subset of the larger set, which
+ * gives a lower, but still matching score. */
+static struct xyt_struct *
+make_xyt_spread (guint32 seed, gint n, gint spread)
+{
+  struct xyt_struct *xyt = g_new0 (struct xyt_struct, 1);
+  struct minutiae_struct c[MAX_BOZORTH_MINUTIAE];
+  guint32 state = seed;
+  gint i;
+
+  g_assert_cmpint (n, <=, MAX_BOZORTH_MINUTIAE);
+
+  for (i = 0; i < n; i++)
+    {
+      state = state * 1103515245 + 12345;
+      c[i].col[0] = (state >> 16) % 256 * spread / 256;
+      state = state * 1103515245 + 12345;
+      c[i].col[1] = (state >> 16) % 256 * spread / 256;
+      state = state * 1103515245 + 12345;
+      c[i].col[2] = (gint) ((state >> 16) % 360) - 179;
+      c[i].col[3] = 0;
+    }
+
+  /* bozorth3 expects the minutiae to be sorted */
+  qsort (c, n, sizeof (struct minutiae_struct), sort_x_y);
+
+  for (i = 0; i < n; i++)
+    {
+      xyt->xcol[i] = c[i].col[0];
+      xyt->ycol[i] = c[i].col[1];
+      xyt->thetacol[i] = c[i].col[2];
+    }
+  xyt->nrows = n;
+
+  return xyt;
+}
+
+static struct xyt_struct *
+make_xyt (guint32 seed, gint n)
+{
+  return make_xyt_spread (seed, n, 256);
+}
+
+static FpPrint *
+make_nbis_print (guint32 seed, gint n)
+{
+  FpPrint *print = g_object_ref_sink (fp_print_new (fake_device));
+
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+  g_ptr_array_add (print->prints, make_xyt (seed, n));
+
+  return print;
+}
+
+static struct fp_minutia *
+make_minutia (gint x, gint y, gint direction, gdouble reliability)
+{
+  struct fp_minutia *minutia = g_new0 (struct fp_minutia, 1);
+
+  minutia->x = x;
+  minutia->y = y;
+  minutia->direction = direction;
+  minutia->reliability = reliability;
+
+  return minutia;
+}
+
+static FpImage *
+make_minutiae_image (GPtrArray *minutiae)
+{
+  FpImage *image = fp_image_new (400, 400);
+
+  image->minutiae = minutiae;
+
+  return image;
+}
+
+/* Simulates a noisy scan of the finger @finger. The true minutiae have a
+ * high reliability and are slightly displaced on every scan, the spurious
+ * ones have a low reliability and are different on every @scan. The
+ * spurious minutiae come first, so detection order favours them. */
+static FpImage *
+make_noisy_scan (guint32 finger, guint32 scan, gint n_true, gint n_noise)
+{
+  GPtrArray *minutiae = g_ptr_array_new_with_free_func (g_free);
+  guint32 finger_state = finger;
+  guint32 scan_state = scan * 7919 + finger;
+  gint i;
+
+  for (i = 0; i < n_noise; i++)
+    {
+      gint x, y, dir;
+
+      scan_state = scan_state * 1103515245 + 12345;
+      x = (scan_state >> 16) % 400;
+      scan_state = scan_state * 1103515245 + 12345;
+      y = (scan_state >> 16) % 400;
+      scan_state = scan_state * 1103515245 + 12345;
+      dir = (scan_state >> 16) % 32;
+
+      g_ptr_array_add (minutiae, make_minutia (x, y, dir, 0.1 + 0.3 * (i % 4) / 4.0));
+    }
+
+  for (i = 0; i < n_true; i++)
+    {
+      gint x, y, dir;
+
+      finger_state = finger_state * 1103515245 + 12345;
+      x = 20 + (finger_state >> 16) % 360;
+      finger_state = finger_state * 1103515245 + 12345;
+      y = 20 + (finger_state >> 16) % 360;
+      finger_state = finger_state * 1103515245 + 12345;
+      dir = (finger_state >> 16) % 32;
+
+      scan_state = scan_state * 1103515245 + 12345;
+      x += (gint) ((scan_state >> 16) % 3) - 1;
+      scan_state = scan_state * 1103515245 + 12345;
+      y += (gint) ((scan_state >> 16) % 3) - 1;
+
+      g_ptr_array_add (minutiae, make_minutia (x, y, dir, 0.5 + 0.5 * (i % 8) / 8.0));
+    }
+
+  return make_minutiae_image (minutiae);
+}
+
+static FpPrint *
+make_print_from_image (FpImage *image, gint max_minutiae)
+{
+  FpPrint *print = g_object_ref_sink (fp_print_new (fake_device));
+  g_autoptr(GError) error = NULL;
+
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+  g_assert_true (fpi_print_add_from_image (print, image, max_minutiae, &error));
+  g_assert_no_error (error);
+
+  return print;
+}
+
+static GPtrArray *
+make_gallery (void)
+{
+  return g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+typedef struct
+{
+  gboolean completed;
+  FpPrint *match;
+  GError  *error;
+} IdentifyResult;
+
+static void
+on_identify_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  IdentifyResult *result = user_data;
+
+  result->match = fpi_print_bz3_identify_finish (FP_PRINT (source_object),
+                                                 res, &result->error);
+  result->completed = TRUE;
+}
+
+static FpPrint *
+identify_sync_prefilter (GPtrArray    *gallery,
+                         FpPrint      *probe,
+                         gboolean      best_match,
+                         gdouble       min_similarity,
+                         GCancellable *cancellable,
+                         GError      **error)
+{
+  IdentifyResult result = { 0, };
+
+  fpi_print_bz3_identify (gallery, probe, BZ3_THRESHOLD, best_match, min_similarity,
+                          cancellable, on_identify_done, &result);
+
+  while (!result.completed)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_propagate_error (error, result.error);
+
+  return result.match;
+}
+
+static FpPrint *
+identify_sync (GPtrArray    *gallery,
+               FpPrint      *probe,
+               gboolean      best_match,
+               GCancellable *cancellable,
+               GError      **error)
+{
+  return identify_sync_prefilter (gallery, probe, best_match, -1,
+                                  cancellable, error);
+}
+
+/* Tests */
+
+static void
+test_print_bz3_match (void)
+{
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) same = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) other = make_nbis_print (2, 40);
+  g_autoptr(GError) error = NULL;
+
+  g_assert_cmpint (fpi_print_bz3_match (same, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+
+  g_assert_cmpint (fpi_print_bz3_match (other, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_FAIL);
+  g_assert_no_error (error);
+}
+
+static void
+test_print_bz3_match_cached (void)
+{
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) other_probe = make_nbis_print (3, 40);
+  g_autoptr(FpPrint) template = make_nbis_print (2, 40);
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (template->prints, make_xyt (1, 30));
+  g_assert_null (template->bz3_galleries);
+
+  g_assert_cmpint (fpi_print_bz3_match (template, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+  g_assert_nonnull (template->bz3_galleries);
+  g_assert_cmpuint (template->bz3_galleries->len, ==, 2);
+  g_assert_nonnull (g_ptr_array_index (template->bz3_galleries, 1));
+
+  /* Matching again uses the cached tables with the same result */
+  g_assert_cmpint (fpi_print_bz3_match (template, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+
+  /* Newly added prints are picked up */
+  g_ptr_array_add (template->prints, make_xyt (3, 40));
+  g_assert_cmpint (fpi_print_bz3_match (template, other_probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+  g_assert_cmpuint (template->bz3_galleries->len, ==, 3);
+}
+
+static void
+test_print_bz3_match_cached_scores (void)
+{
+  g_autoptr(GPtrArray) prints = g_ptr_array_new_with_free_func (g_free);
+  BozorthContext *ctx = bozorth_context_new ();
+  guint i, j;
+
+  /* Prints of the same seed share minutiae and give a range of scores */
+  for (i = 0; i < 40; i++)
+    g_ptr_array_add (prints, make_xyt (i % 10 + 1, 15 + (i * 7) % 40));
+
+  for (j = 0; j < prints->len; j++)
+    {
+      struct xyt_struct *gstruct = g_ptr_array_index (prints, j);
+      BozorthGallery *gallery = bozorth_gallery_new (ctx, gstruct);
+
+      for (i = 0; i < prints->len; i++)
+        {
+          struct xyt_struct *pstruct = g_ptr_array_index (prints, i);
+          gint probe_len = bozorth_probe_init_ctx (ctx, pstruct);
+          gint cached = bozorth_to_gallery_cached_ctx (ctx, probe_len, pstruct,
+                                                       gstruct, gallery);
+          gint uncached = bozorth_to_gallery_ctx (ctx, probe_len, pstruct, gstruct);
+
+          g_assert_cmpint (cached, ==, uncached);
+        }
+
+      bozorth_gallery_free (gallery);
+    }
+
+  bozorth_context_free (ctx);
+}
+
+static void
+test_print_bz3_match_replaced_prints (void)
+{
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) template = make_nbis_print (1, 30);
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  GPtrArray *prints;
+
+  g_ptr_array_add (gallery, g_object_ref (template));
+  match = identify_sync_prefilter (gallery, probe, FALSE, 0, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == template);
+  g_assert_nonnull (template->bz3_galleries);
+  g_assert_nonnull (template->bz3_descriptors);
+
+  /* The caches are indexed like the prints and must not outlive them */
+  prints = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (prints, make_xyt (2, 30));
+  g_object_set (template, "fpi-prints", prints, NULL);
+  g_assert_null (template->bz3_galleries);
+  g_assert_null (template->bz3_descriptors);
+
+  g_clear_object (&match);
+  match = identify_sync_prefilter (gallery, probe, FALSE, 0, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_null (match);
+  g_assert_cmpint (fpi_print_bz3_match (template, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_FAIL);
+  g_assert_no_error (error);
+}
+
+static void
+test_print_bz3_identify_first_match (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (gallery, make_nbis_print (2, 40));
+  g_ptr_array_add (gallery, make_nbis_print (1, 20));
+  g_ptr_array_add (gallery, make_nbis_print (3, 40));
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+
+  match = identify_sync (gallery, probe, FALSE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 1));
+}
+
+static void
+test_print_bz3_identify_best_match (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (gallery, make_nbis_print (2, 40));
+  g_ptr_array_add (gallery, make_nbis_print (1, 20));
+  g_ptr_array_add (gallery, make_nbis_print (3, 40));
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+  g_ptr_array_add (gallery, make_nbis_print (1, 30));
+
+  match = identify_sync (gallery, probe, TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 3));
+}
+
+static void
+test_print_bz3_identify_large_gallery (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  gint i;
+
+  for (i = 0; i < 100; i++)
+    {
+      if (i == 73)
+        g_ptr_array_add (gallery, make_nbis_print (1, 30));
+      else
+        g_ptr_array_add (gallery, make_nbis_print (1000 + i, 40));
+    }
+
+  match = identify_sync (gallery, probe, FALSE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 73));
+
+  g_clear_object (&match);
+  match = identify_sync (gallery, probe, TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 73));
+}
+
+static void
+test_print_bz3_identify_prefilter (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  gint i;
+
+  for (i = 0; i < 100; i++)
+    {
+      if (i == 73)
+        g_ptr_array_add (gallery, make_nbis_print (1, 30));
+      else
+        g_ptr_array_add (gallery, make_nbis_print (1000 + i, 40));
+    }
+
+  match = identify_sync_prefilter (gallery, probe, FALSE, 0, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 73));
+  g_assert_nonnull (FP_PRINT (g_ptr_array_index (gallery, 73))->bz3_descriptors);
+
+  g_clear_object (&match);
+  match = identify_sync_prefilter (gallery, probe, TRUE, 0, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 73));
+
+  /* Nothing in the gallery is that similar to the probe */
+  g_clear_object (&match);
+  match = identify_sync_prefilter (gallery, probe, TRUE, 1, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_null (match);
+}
+
+static void
+test_print_bz3_identify_prefilter_order (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (gallery, make_nbis_print (1, 20));
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+
+  /* Both match, but the identical print is ranked first */
+  match = identify_sync_prefilter (gallery, probe, FALSE, 0, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 1));
+
+  g_clear_object (&match);
+  match = identify_sync (gallery, probe, FALSE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, 0));
+}
+
+/* A gallery of fingers that differ in the spread of their minutiae, which
+ * is what the prefilter picks up. */
+static GPtrArray *
+make_spread_gallery (gint n_templates, gint *spreads)
+{
+  GPtrArray *gallery = make_gallery ();
+  guint32 state = 1;
+  gint i;
+
+  for (i = 0; i < n_templates; i++)
+    {
+      FpPrint *print = g_object_ref_sink (fp_print_new (fake_device));
+
+      state = state * 1103515245 + 12345;
+      spreads[i] = 128 + (state >> 16) % 256;
+      fpi_print_set_type (print, FPI_PRINT_NBIS);
+      g_ptr_array_add (print->prints, make_xyt_spread (i + 1, 40, spreads[i]));
+      g_ptr_array_add (gallery, print);
+    }
+
+  return gallery;
+}
+
+/* A partial scan of the finger at @idx of a spread gallery */
+static FpPrint *
+make_spread_probe (gint idx, gint *spreads)
+{
+  FpPrint *probe = g_object_ref_sink (fp_print_new (fake_device));
+
+  fpi_print_set_type (probe, FPI_PRINT_NBIS);
+  g_ptr_array_add (probe->prints, make_xyt_spread (idx + 1, 30, spreads[idx]));
+
+  return probe;
+}
+
+/* The bozorth3 table of a template is built the first time it is scored */
+static guint
+count_scored_templates (GPtrArray *gallery)
+{
+  guint n = 0;
+  guint i;
+
+  for (i = 0; i < gallery->len; i++)
+    {
+      FpPrint *template = g_ptr_array_index (gallery, i);
+
+      if (template->bz3_galleries && template->bz3_galleries->len > 0 &&
+          g_ptr_array_index (template->bz3_galleries, 0))
+        n += 1;
+    }
+
+  return n;
+}
+
+static void
+test_print_bz3_identify_prefilter_scored (void)
+{
+  const gint n_templates = 200;
+  const gint idx = 37;
+  g_autofree gint *spreads = g_new (gint, n_templates);
+  g_autoptr(GPtrArray) gallery = make_spread_gallery (n_templates, spreads);
+  g_autoptr(GPtrArray) ranked_gallery = make_spread_gallery (n_templates, spreads);
+  g_autoptr(FpPrint) probe = make_spread_probe (idx, spreads);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  guint scored;
+
+  /* Without the prefilter, a best match search scores everything */
+  match = identify_sync (gallery, probe, TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (gallery, idx));
+  g_assert_cmpuint (count_scored_templates (gallery), ==, n_templates);
+
+  /* With it, only the templates that pass the prefilter are scored */
+  g_clear_object (&match);
+  match = identify_sync_prefilter (ranked_gallery, probe, TRUE, 0.8, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (match == g_ptr_array_index (ranked_gallery, idx));
+
+  scored = count_scored_templates (ranked_gallery);
+  g_test_message ("%u of %d templates scored", scored, n_templates);
+  g_assert_cmpuint (scored, >=, 1);
+  g_assert_cmpuint (scored, <=, n_templates / 3);
+}
+
+/* Run with -m perf to compare first match identification in a large
+ * gallery with and without the prefilter. The probe is a partial scan of
+ * one of the fingers. */
+static void
+test_print_bz3_identify_benchmark (void)
+{
+  const gint n_templates = 2000;
+  const gint n_probes = 20;
+  const gdouble min_similarities[] = { -1, 0, 0.8 };
+  g_autoptr(GPtrArray) gallery = NULL;
+  g_autofree gint *spreads = g_new (gint, n_templates);
+  g_autoptr(GError) error = NULL;
+  guint m;
+  gint i;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in perf mode");
+      return;
+    }
+
+  gallery = make_spread_gallery (n_templates, spreads);
+
+  for (m = 0; m < G_N_ELEMENTS (min_similarities); m++)
+    {
+      gint found = 0;
+
+      g_test_timer_start ();
+      for (i = 0; i < n_probes; i++)
+        {
+          gint idx = (i * 7919) % n_templates;
+          g_autoptr(FpPrint) probe = make_spread_probe (idx, spreads);
+          g_autoptr(FpPrint) match = NULL;
+
+          match = identify_sync_prefilter (gallery, probe, FALSE, min_similarities[m], NULL, &error);
+          g_assert_no_error (error);
+          found += match == g_ptr_array_index (gallery, idx);
+        }
+
+      g_test_message ("min similarity %4.1f: %.2f ms per identification, %d of %d found",
+                      min_similarities[m],
+                      g_test_timer_elapsed () * 1000 / n_probes,
+                      found, n_probes);
+    }
+}
+
+static void
+test_print_bz3_identify_no_match (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+
+  match = identify_sync (gallery, probe, FALSE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_null (match);
+
+  g_ptr_array_add (gallery, make_nbis_print (2, 40));
+  g_ptr_array_add (gallery, make_nbis_print (3, 40));
+
+  match = identify_sync (gallery, probe, TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_null (match);
+}
+
+static void
+test_print_bz3_identify_cancelled (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(GError) error = NULL;
+
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+  g_cancellable_cancel (cancellable);
+
+  match = identify_sync (gallery, probe, FALSE, cancellable, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (match);
+}
+
+static void
+test_print_bz3_identify_not_nbis (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(FpPrint) probe = make_nbis_print (1, 40);
+  g_autoptr(FpPrint) match = NULL;
+  g_autoptr(GError) error = NULL;
+  FpPrint *raw_print;
+
+  raw_print = g_object_ref_sink (fp_print_new (fake_device));
+  fpi_print_set_type (raw_print, FPI_PRINT_RAW);
+
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+  g_ptr_array_add (gallery, raw_print);
+
+  match = identify_sync (gallery, probe, FALSE, NULL, &error);
+  g_assert_error (error, FP_DEVICE_ERROR, FP_DEVICE_ERROR_NOT_SUPPORTED);
+  g_assert_null (match);
+}
+
+static GPtrArray *
+make_mixed_gallery (void)
+{
+  GPtrArray *gallery = make_gallery ();
+  g_autoptr(GDate) date = g_date_new_dmy (1, G_DATE_MARCH, 2021);
+  FpPrint *print;
+  guint i;
+  gint j;
+
+  for (i = 0; i < 10; i++)
+    {
+      print = make_nbis_print (i, 10 + i * 4);
+      g_ptr_array_add (print->prints, make_xyt (100 + i, 30));
+      fp_print_set_finger (print, FP_FINGER_FIRST + i);
+      fp_print_set_username (print, i % 2 ? "user" : NULL);
+      g_ptr_array_add (gallery, print);
+    }
+
+  /* Small values are stored more compactly */
+  print = make_nbis_print (20, 40);
+  for (j = 0; j < 40; j++)
+    {
+      struct xyt_struct *xyt = g_ptr_array_index (print->prints, 0);
+
+      xyt->xcol[j] /= 4;
+      xyt->ycol[j] /= 4;
+      xyt->thetacol[j] /= 2;
+    }
+  g_ptr_array_add (gallery, print);
+
+  print = g_object_ref_sink (fp_print_new (fake_device));
+  fpi_print_set_type (print, FPI_PRINT_RAW);
+  fpi_print_set_device_stored (print, TRUE);
+  g_object_set (print, "fpi-data", g_variant_new ("(us)", 42, "template"), NULL);
+  fp_print_set_description (print, "stored on device");
+  g_ptr_array_add (gallery, print);
+
+  for (i = 0; i < gallery->len; i++)
+    fp_print_set_enroll_date (g_ptr_array_index (gallery, i), date);
+
+  return gallery;
+}
+
+static void
+assert_galleries_equal (GPtrArray *gallery, GPtrArray *loaded)
+{
+  guint i;
+
+  g_assert_cmpuint (gallery->len, ==, loaded->len);
+  for (i = 0; i < gallery->len; i++)
+    {
+      FpPrint *a = g_ptr_array_index (gallery, i);
+      FpPrint *b = g_ptr_array_index (loaded, i);
+
+      g_assert_true (fp_print_equal (a, b));
+      g_assert_cmpint (fp_print_get_finger (a), ==, fp_print_get_finger (b));
+      g_assert_cmpstr (fp_print_get_username (a), ==, fp_print_get_username (b));
+      g_assert_cmpstr (fp_print_get_description (a), ==, fp_print_get_description (b));
+      g_assert_cmpint (fp_print_get_device_stored (a), ==, fp_print_get_device_stored (b));
+      g_assert_cmpint (g_date_compare (fp_print_get_enroll_date (a),
+                                       fp_print_get_enroll_date (b)), ==, 0);
+    }
+}
+
+static void
+test_print_gallery_roundtrip (void)
+{
+  g_autoptr(GPtrArray) gallery = make_mixed_gallery ();
+  g_autoptr(GPtrArray) loaded = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(FpPrint) probe = make_nbis_print (3, 22);
+  g_autoptr(GError) error = NULL;
+  guchar *data;
+  gsize length;
+  FpPrint *print;
+
+  g_assert_true (fp_print_serialize_gallery (gallery, &data, &length, &error));
+  g_assert_no_error (error);
+  bytes = g_bytes_new_take (data, length);
+
+  loaded = fp_print_deserialize_gallery (bytes, &error);
+  g_assert_no_error (error);
+  assert_galleries_equal (gallery, loaded);
+
+  /* The minutiae of all prints are shared */
+  print = g_ptr_array_index (loaded, 3);
+  g_assert_nonnull (print->prints_storage);
+  g_assert_cmpint (fpi_print_bz3_match (print, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+
+  /* Modifying a loaded print does not affect the others */
+  fpi_print_add_print (print, probe);
+  g_assert_null (print->prints_storage);
+  g_assert_cmpuint (print->prints->len, ==, 3);
+  g_assert_true (fp_print_equal (g_ptr_array_index (gallery, 4),
+                                 g_ptr_array_index (loaded, 4)));
+}
+
+static void
+test_print_gallery_load (void)
+{
+  g_autoptr(GPtrArray) gallery = make_mixed_gallery ();
+  g_autoptr(GPtrArray) loaded = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree guchar *data = NULL;
+  g_autofree gchar *filename = NULL;
+  gsize length;
+  gint fd;
+
+  g_assert_true (fp_print_serialize_gallery (gallery, &data, &length, &error));
+  g_assert_no_error (error);
+
+  fd = g_file_open_tmp ("libfprint-gallery-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_assert_true (g_file_set_contents (filename, (gchar *) data, length, &error));
+  g_assert_no_error (error);
+
+  loaded = fp_print_load_gallery (filename, &error);
+  g_assert_no_error (error);
+  g_unlink (filename);
+
+  /* The raw data is still usable after the file is gone */
+  assert_galleries_equal (gallery, loaded);
+}
+
+static void
+test_print_gallery_fp3 (void)
+{
+  g_autoptr(GPtrArray) gallery = make_gallery ();
+  g_autoptr(GPtrArray) loaded = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GDate) date = g_date_new_dmy (1, G_DATE_MARCH, 2021);
+  g_autoptr(GError) error = NULL;
+  guchar *data;
+  gsize length;
+
+  g_ptr_array_add (gallery, make_nbis_print (1, 40));
+  fp_print_set_enroll_date (g_ptr_array_index (gallery, 0), date);
+  g_assert_true (fp_print_serialize (g_ptr_array_index (gallery, 0), &data, &length, &error));
+  g_assert_no_error (error);
+  bytes = g_bytes_new_take (data, length);
+
+  loaded = fp_print_deserialize_gallery (bytes, &error);
+  g_assert_no_error (error);
+  assert_galleries_equal (gallery, loaded);
+}
+
+static void
+test_print_minutiae_reliability (void)
+{
+  GPtrArray *minutiae = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(FpPrint) print = NULL;
+  g_autoptr(FpPrint) all = NULL;
+  g_autoptr(FpPrint) first = NULL;
+  struct xyt_struct *xyt;
+  gint i;
+
+  /* The reliability rank is a permutation of the detection order */
+  for (i = 0; i < 250; i++)
+    g_ptr_array_add (minutiae, make_minutia (i, 100, 0, (i * 37 % 250) / 250.0));
+  image = make_minutiae_image (minutiae);
+
+  print = make_print_from_image (image, 100);
+  xyt = g_ptr_array_index (print->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, 100);
+  for (i = 0; i < xyt->nrows; i++)
+    g_assert_cmpint (xyt->xcol[i] * 37 % 250, >=, 150);
+
+  /* Never more than bozorth3 can handle */
+  all = make_print_from_image (image, 1000);
+  xyt = g_ptr_array_index (all->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, MAX_BOZORTH_MINUTIAE);
+  for (i = 0; i < xyt->nrows; i++)
+    g_assert_cmpint (xyt->xcol[i] * 37 % 250, >=, 50);
+
+  /* Without a limit, the first ones in detection order are kept */
+  first = make_print_from_image (image, 0);
+  xyt = g_ptr_array_index (first->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, MAX_BOZORTH_MINUTIAE);
+  for (i = 0; i < xyt->nrows; i++)
+    g_assert_cmpint (xyt->xcol[i], ==, i);
+
+  /* Nothing is dropped below the limit */
+  g_ptr_array_set_size (minutiae, 150);
+  g_clear_object (&all);
+  all = make_print_from_image (image, 0);
+  xyt = g_ptr_array_index (all->prints, 0);
+  g_assert_cmpint (xyt->nrows, ==, 150);
+}
+
+static void
+test_print_minutiae_noisy_match (void)
+{
+  g_autoptr(FpImage) enroll_image = make_noisy_scan (1, 1, 40, 250);
+  g_autoptr(FpImage) verify_image = make_noisy_scan (1, 2, 40, 250);
+  g_autoptr(FpPrint) enrolled = make_print_from_image (enroll_image, 60);
+  g_autoptr(FpPrint) probe = make_print_from_image (verify_image, 60);
+  g_autoptr(GError) error = NULL;
+
+  g_assert_cmpint (fpi_print_bz3_match (enrolled, probe, BZ3_THRESHOLD, &error),
+                   ==, FPI_MATCH_SUCCESS);
+  g_assert_no_error (error);
+}
+
+/* Run with -m perf to compare the match time and scores for different
+ * minutiae limits on simulated noisy scans. A limit of 0 keeps the
+ * minutiae in detection order. */
+static void
+test_print_minutiae_benchmark (void)
+{
+  const gint limits[] = { 0, MAX_BOZORTH_MINUTIAE, 120, 80, 50 };
+  const gint n_fingers = 8;
+  guint l;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in perf mode");
+      return;
+    }
+
+  for (l = 0; l < G_N_ELEMENTS (limits); l++)
+    {
+      gint genuine_min = G_MAXINT, impostor_max = 0, failures = 0;
+      gdouble elapsed = 0;
+      gint f, g;
+
+      for (f = 0; f < n_fingers; f++)
+        {
+          g_autoptr(FpImage) enroll_image = make_noisy_scan (f + 1, 1, 40, 250);
+          g_autoptr(FpPrint) enrolled = make_print_from_image (enroll_image, limits[l]);
+
+          for (g = 0; g < n_fingers; g++)
+            {
+              g_autoptr(FpImage) verify_image = make_noisy_scan (g + 1, 2, 40, 250);
+              g_autoptr(FpPrint) probe = make_print_from_image (verify_image, limits[l]);
+              struct xyt_struct *a = g_ptr_array_index (enrolled->prints, 0);
+              struct xyt_struct *b = g_ptr_array_index (probe->prints, 0);
+              gint score;
+
+              g_test_timer_start ();
+              score = bozorth_to_gallery (bozorth_probe_init (b), b, a);
+              elapsed += g_test_timer_elapsed ();
+
+              if (f == g)
+                {
+                  genuine_min = MIN (genuine_min, score);
+                  failures += score < BZ3_THRESHOLD;
+                }
+              else
+                {
+                  impostor_max = MAX (impostor_max, score);
+                  failures += score >= BZ3_THRESHOLD;
+                }
+            }
+        }
+
+      g_test_message ("%-16s limit %3d: %.3f ms per match, lowest genuine score %d, highest impostor score %d, %d errors",
+                      limits[l] ? "reliability" : "detection order",
+                      limits[l] ? limits[l] : MAX_BOZORTH_MINUTIAE,
+                      elapsed * 1000 / (n_fingers * n_fingers),
+                      genuine_min, impostor_max, failures);
+    }
+}
+
+static void
+test_print_gallery_invalid (void)
+{
+  g_autoptr(GPtrArray) gallery = make_mixed_gallery ();
+  g_autofree guchar *data = NULL;
+  g_autoptr(GError) error = NULL;
+  gsize length, i;
+
+  g_assert_true (fp_print_serialize_gallery (gallery, &data, &length, &error));
+  g_assert_no_error (error);
+
+  /* Any truncation is detected */
+  for (i = 0; i < length; i++)
+    {
+      g_autoptr(GBytes) bytes = g_bytes_new_static (data, i);
+      g_autoptr(GPtrArray) loaded = NULL;
+
+      loaded = fp_print_deserialize_gallery (bytes, &error);
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+      g_assert_null (loaded);
+      g_clear_error (&error);
+    }
+
+  /* Future versions are rejected */
+  data[3] += 1;
+  {
+    g_autoptr(GBytes) bytes = g_bytes_new_static (data, length);
+    g_autoptr(GPtrArray) loaded = NULL;
+
+    loaded = fp_print_deserialize_gallery (bytes, &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+    g_assert_null (loaded);
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr(FpDevice) device = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  fake_device = device;
+  g_object_add_weak_pointer (G_OBJECT (device), (gpointer) & fake_device);
+
+  g_test_add_func ("/print/bz3/match", test_print_bz3_match);
+  g_test_add_func ("/print/bz3/match_cached", test_print_bz3_match_cached);
+  g_test_add_func ("/print/bz3/match_cached/scores", test_print_bz3_match_cached_scores);
+  g_test_add_func ("/print/bz3/match_cached/replaced_prints", test_print_bz3_match_replaced_prints);
+  g_test_add_func ("/print/bz3/identify/first_match", test_print_bz3_identify_first_match);
+  g_test_add_func ("/print/bz3/identify/best_match", test_print_bz3_identify_best_match);
+  g_test_add_func ("/print/bz3/identify/large_gallery", test_print_bz3_identify_large_gallery);
+  g_test_add_func ("/print/bz3/identify/prefilter", test_print_bz3_identify_prefilter);
+  g_test_add_func ("/print/bz3/identify/prefilter_order", test_print_bz3_identify_prefilter_order);
+  g_test_add_func ("/print/bz3/identify/prefilter_scored", test_print_bz3_identify_prefilter_scored);
+  g_test_add_func ("/print/bz3/identify/benchmark", test_print_bz3_identify_benchmark);
+  g_test_add_func ("/print/bz3/identify/no_match", test_print_bz3_identify_no_match);
+  g_test_add_func ("/print/bz3/identify/cancelled", test_print_bz3_identify_cancelled);
+  g_test_add_func ("/print/bz3/identify/not_nbis", test_print_bz3_identify_not_nbis);
+  g_test_add_func ("/print/minutiae/reliability", test_print_minutiae_reliability);
+  g_test_add_func ("/print/minutiae/noisy_match", test_print_minutiae_noisy_match);
+  g_test_add_func ("/print/minutiae/benchmark", test_print_minutiae_benchmark);
+  g_test_add_func ("/print/gallery/roundtrip", test_print_gallery_roundtrip);
+  g_test_add_func ("/print/gallery/load", test_print_gallery_load);
+  g_test_add_func ("/print/gallery/fp3", test_print_gallery_fp3);
+  g_test_add_func ("/print/gallery/invalid", test_print_gallery_invalid);
+
+  return g_test_run ();
+}
@@ -0,0 +1,310 @@
+/*
+ * FpiSpiTransfer Unit tests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "fp-device.h"
+#define FP_COMPONENT "spi-transfer"
+
+#include "drivers_api.h"
+#include "test-device-fake.h"
+
+#include <errno.h>
+#include <linux/spi/spidev.h>
+
+#define FAKE_SPIDEV_FD 42
+#define READ_VALUE 0xa5
+
+/* Larger than the biggest possible spidev block size */
+#define LARGE_TRANSFER_LENGTH (G_MAXUINT16 + 1000)
+
+/* The messages are not sent to a spidev device, the ioctl is replaced
+ * and only records what would have been passed to the kernel. */
+
+static FpDevice *fake_device = NULL;
+
+typedef struct
+{
+  guint  n_xfers;
+  gsize  length;
+  /* Bit n is set if the chip is deselected after the n-th message */
+  guint  cs_change;
+} RecordedIoctl;
+
+static GMutex ioctl_lock;
+static GArray *recorded_ioctls = NULL;
+static gboolean ioctl_fail = FALSE;
+
+static int
+fake_ioctl (int spidev_fd, guint n_xfers, struct spi_ioc_transfer *xfers)
+{
+  RecordedIoctl rec = { 0 };
+  guint i;
+
+  g_assert_cmpint (spidev_fd, ==, FAKE_SPIDEV_FD);
+  g_assert_cmpuint (n_xfers, >, 0);
+
+  rec.n_xfers = n_xfers;
+  for (i = 0; i < n_xfers; i++)
+    {
+      g_assert_true (xfers[i].tx_buf != 0 || xfers[i].rx_buf != 0);
+      g_assert_cmpuint (i, <, sizeof (rec.cs_change) * 8);
+
+      if (xfers[i].rx_buf)
+        memset (GSIZE_TO_POINTER (xfers[i].rx_buf), READ_VALUE, xfers[i].len);
+      if (xfers[i].cs_change)
+        rec.cs_change |= 1 << i;
+
+      rec.length += xfers[i].len;
+    }
+
+  g_mutex_lock (&ioctl_lock);
+  g_array_append_val (recorded_ioctls, rec);
+  g_mutex_unlock (&ioctl_lock);
+
+  if (ioctl_fail)
+    {
+      errno = EBUSY;
+      return -1;
+    }
+
+  return rec.length;
+}
+
+static void
+setup_ioctls (void)
+{
+  recorded_ioctls = g_array_new (FALSE, TRUE, sizeof (RecordedIoctl));
+  ioctl_fail = FALSE;
+  fpi_spi_transfer_set_ioctl_func (fake_ioctl);
+}
+
+static void
+teardown_ioctls (void)
+{
+  fpi_spi_transfer_set_ioctl_func (NULL);
+  g_clear_pointer (&recorded_ioctls, g_array_unref);
+}
+
+static RecordedIoctl *
+get_ioctl (guint idx)
+{
+  g_assert_cmpuint (idx, <, recorded_ioctls->len);
+
+  return &g_array_index (recorded_ioctls, RecordedIoctl, idx);
+}
+
+static FpiSpiTransfer *
+new_write_read (gsize length_wr, gsize length_rd)
+{
+  FpiSpiTransfer *transfer = fpi_spi_transfer_new (fake_device, FAKE_SPIDEV_FD);
+
+  if (length_wr)
+    fpi_spi_transfer_write (transfer, length_wr);
+  if (length_rd)
+    fpi_spi_transfer_read (transfer, length_rd);
+
+  return transfer;
+}
+
+static void
+assert_read_buffer (FpiSpiTransfer *transfer)
+{
+  gssize i;
+
+  for (i = 0; i < transfer->length_rd; i++)
+    g_assert_cmpuint (transfer->buffer_rd[i], ==, READ_VALUE);
+}
+
+typedef struct
+{
+  guint           n_callbacks;
+  FpiSpiTransfer *transfer;
+  GError         *error;
+} CallbackData;
+
+static void
+transfer_cb (FpiSpiTransfer *transfer, FpDevice *dev,
+             gpointer user_data, GError *error)
+{
+  CallbackData *data = user_data;
+
+  g_assert_true (dev == fake_device);
+
+  data->n_callbacks += 1;
+  data->transfer = fpi_spi_transfer_ref (transfer);
+  data->error = error;
+}
+
+static void
+submit_and_wait (FpiSpiTransfer *transfer, CallbackData *data)
+{
+  fpi_spi_transfer_submit (transfer, NULL, transfer_cb, data);
+
+  while (data->n_callbacks == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* Nothing else may come in */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert_cmpuint (data->n_callbacks, ==, 1);
+}
+
+static void
+test_spi_transfer_single (void)
+{
+  g_autoptr(FpiSpiTransfer) transfer = new_write_read (2, 8);
+  g_autoptr(GError) error = NULL;
+
+  setup_ioctls ();
+
+  g_assert_true (fpi_spi_transfer_submit_sync (transfer, &error));
+  g_assert_no_error (error);
+
+  /* The write and the read share one selection of the chip */
+  g_assert_cmpuint (recorded_ioctls->len, ==, 1);
+  g_assert_cmpuint (get_ioctl (0)->n_xfers, ==, 2);
+  g_assert_cmpuint (get_ioctl (0)->length, ==, 10);
+  g_assert_cmpuint (get_ioctl (0)->cs_change, ==, 0);
+  assert_read_buffer (transfer);
+
+  teardown_ioctls ();
+}
+
+static void
+test_spi_transfer_batch (void)
+{
+  CallbackData data = { 0 };
+  FpiSpiTransfer *batch[4];
+  FpiSpiTransfer *transfer;
+  guint i;
+
+  setup_ioctls ();
+
+  transfer = new_write_read (2, 0);
+  batch[0] = fpi_spi_transfer_ref (transfer);
+  batch[1] = new_write_read (1, 4);
+  batch[2] = new_write_read (2, 0);
+  batch[3] = new_write_read (1, 4);
+
+  for (i = 1; i < G_N_ELEMENTS (batch); i++)
+    fpi_spi_transfer_batch_add (transfer, fpi_spi_transfer_ref (batch[i]));
+
+  submit_and_wait (transfer, &data);
+  g_assert_no_error (data.error);
+  g_assert_true (data.transfer == batch[0]);
+
+  /* Everything goes out in one ioctl, with the chip being deselected
+   * after each transfer, as if they were submitted separately. */
+  g_assert_cmpuint (recorded_ioctls->len, ==, 1);
+  g_assert_cmpuint (get_ioctl (0)->n_xfers, ==, 6);
+  g_assert_cmpuint (get_ioctl (0)->length, ==, 14);
+  g_assert_cmpuint (get_ioctl (0)->cs_change, ==, (1 << 0) | (1 << 2) | (1 << 3));
+
+  for (i = 0; i < G_N_ELEMENTS (batch); i++)
+    {
+      assert_read_buffer (batch[i]);
+      fpi_spi_transfer_unref (batch[i]);
+    }
+
+  fpi_spi_transfer_unref (data.transfer);
+  teardown_ioctls ();
+}
+
+static void
+test_spi_transfer_batch_split (void)
+{
+  CallbackData data = { 0 };
+  FpiSpiTransfer *transfer;
+  gsize length = 0;
+  guint i;
+
+  setup_ioctls ();
+
+  transfer = new_write_read (1, 4);
+  fpi_spi_transfer_batch_add (transfer, new_write_read (1, 4));
+  fpi_spi_transfer_batch_add (transfer, new_write_read (LARGE_TRANSFER_LENGTH, 0));
+  fpi_spi_transfer_batch_add (transfer, new_write_read (1, 4));
+  fpi_spi_transfer_batch_add (transfer, new_write_read (1, 4));
+
+  submit_and_wait (transfer, &data);
+  g_assert_no_error (data.error);
+
+  /* The two small transfers on either side are batched */
+  g_assert_cmpuint (recorded_ioctls->len, >=, 4);
+  g_assert_cmpuint (get_ioctl (0)->n_xfers, ==, 4);
+  g_assert_cmpuint (get_ioctl (0)->length, ==, 10);
+  g_assert_cmpuint (get_ioctl (0)->cs_change, ==, 1 << 1);
+
+  i = recorded_ioctls->len - 1;
+  g_assert_cmpuint (get_ioctl (i)->n_xfers, ==, 4);
+  g_assert_cmpuint (get_ioctl (i)->length, ==, 10);
+  g_assert_cmpuint (get_ioctl (i)->cs_change, ==, 1 << 1);
+
+  /* The large one does not fit and is run on its own in multiple blocks */
+  for (i = 1; i < recorded_ioctls->len - 1; i++)
+    {
+      g_assert_cmpuint (get_ioctl (i)->n_xfers, ==, 1);
+      length += get_ioctl (i)->length;
+    }
+  g_assert_cmpuint (length, ==, LARGE_TRANSFER_LENGTH);
+
+  fpi_spi_transfer_unref (data.transfer);
+  teardown_ioctls ();
+}
+
+static void
+test_spi_transfer_batch_error (void)
+{
+  CallbackData data = { 0 };
+  FpiSpiTransfer *transfer;
+
+  setup_ioctls ();
+  ioctl_fail = TRUE;
+
+  /* The first error stops the batch */
+  transfer = new_write_read (LARGE_TRANSFER_LENGTH, 0);
+  fpi_spi_transfer_batch_add (transfer, new_write_read (1, 4));
+  fpi_spi_transfer_batch_add (transfer, new_write_read (1, 4));
+
+  submit_and_wait (transfer, &data);
+  g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_BUSY);
+  g_assert_cmpuint (recorded_ioctls->len, ==, 1);
+
+  g_clear_error (&data.error);
+  fpi_spi_transfer_unref (data.transfer);
+  teardown_ioctls ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr(FpDevice) device = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  fake_device = device;
+  g_object_add_weak_pointer (G_OBJECT (device), (gpointer) & fake_device);
+
+  g_test_add_func ("/spi-transfer/single", test_spi_transfer_single);
+  g_test_add_func ("/spi-transfer/batch", test_spi_transfer_batch);
+  g_test_add_func ("/spi-transfer/batch_split", test_spi_transfer_batch_split);
+  g_test_add_func ("/spi-transfer/batch_error", test_spi_transfer_batch_error);
+
+  return g_test_run ();
+}
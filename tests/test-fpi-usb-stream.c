@@ -0,0 +1,271 @@
+/*
+ * FpiUsbStream Unit tests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "fp-device.h"
+#define FP_COMPONENT "usb-stream"
+
+#include "drivers_api.h"
+#include "test-device-fake.h"
+
+#define N_TRANSFERS 3
+#define TRANSFER_LENGTH 16
+
+/* Transfers are not sent to a USB device, they are queued here and the
+ * tests complete them in the order they like. */
+
+static FpDevice *fake_device = NULL;
+static GQueue pending_transfers = G_QUEUE_INIT;
+
+typedef struct
+{
+  FpiUsbTransfer        *transfer;
+  GCancellable          *cancellable;
+  FpiUsbTransferCallback callback;
+  gpointer               user_data;
+} PendingTransfer;
+
+static void
+fake_submit (FpiUsbTransfer        *transfer,
+             guint                  timeout_ms,
+             GCancellable          *cancellable,
+             FpiUsbTransferCallback callback,
+             gpointer               user_data)
+{
+  PendingTransfer *pending = g_new0 (PendingTransfer, 1);
+
+  pending->transfer = transfer;
+  pending->cancellable = g_object_ref (cancellable);
+  pending->callback = callback;
+  pending->user_data = user_data;
+
+  g_queue_push_tail (&pending_transfers, pending);
+}
+
+/* Completes the n-th pending transfer, its buffer is filled with @value */
+static void
+complete_transfer (guint n, guint8 value)
+{
+  PendingTransfer *pending = g_queue_pop_nth (&pending_transfers, n);
+  FpiUsbTransfer *transfer;
+
+  g_assert_nonnull (pending);
+  transfer = pending->transfer;
+
+  memset (transfer->buffer, value, transfer->length);
+  transfer->actual_length = transfer->length;
+  pending->callback (transfer, transfer->device, pending->user_data, NULL);
+
+  fpi_usb_transfer_unref (transfer);
+  g_object_unref (pending->cancellable);
+  g_free (pending);
+}
+
+/* Returns all pending transfers as cancelled, as GUsb would */
+static void
+cancel_pending_transfers (void)
+{
+  PendingTransfer *pending;
+
+  while ((pending = g_queue_pop_head (&pending_transfers)))
+    {
+      FpiUsbTransfer *transfer = pending->transfer;
+
+      g_assert_true (g_cancellable_is_cancelled (pending->cancellable));
+
+      transfer->actual_length = -1;
+      pending->callback (transfer, transfer->device, pending->user_data,
+                         g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                              "Transfer was cancelled"));
+
+      fpi_usb_transfer_unref (transfer);
+      g_object_unref (pending->cancellable);
+      g_free (pending);
+    }
+}
+
+typedef struct
+{
+  GByteArray *received;
+  guint       stopped;
+  gboolean    free_in_callback;
+} StreamTestData;
+
+static void
+stream_cb (FpiUsbStream   *stream,
+           FpiUsbTransfer *transfer,
+           FpDevice       *dev,
+           gpointer        user_data,
+           GError         *error)
+{
+  StreamTestData *data = user_data;
+
+  g_assert_no_error (error);
+  g_assert_true (dev == fake_device);
+  g_assert_cmpint (transfer->actual_length, ==, TRANSFER_LENGTH);
+
+  g_byte_array_append (data->received, transfer->buffer, 1);
+
+  if (data->free_in_callback)
+    fpi_usb_stream_free (stream);
+}
+
+static void
+stream_stopped_cb (FpiUsbStream *stream,
+                   FpDevice     *dev,
+                   gpointer      user_data)
+{
+  StreamTestData *data = user_data;
+
+  data->stopped += 1;
+}
+
+static FpiUsbStream *
+stream_new_started (StreamTestData *data)
+{
+  FpiUsbStream *stream;
+
+  stream = fpi_usb_stream_new (fake_device, 0x81, TRANSFER_LENGTH, N_TRANSFERS);
+  fpi_usb_stream_set_submit_func (stream, fake_submit);
+  fpi_usb_stream_start (stream, 0, stream_cb, stream_stopped_cb, data);
+
+  g_assert_cmpuint (pending_transfers.length, ==, N_TRANSFERS);
+
+  return stream;
+}
+
+static void
+assert_received (StreamTestData *data, const gchar *expected)
+{
+  g_assert_cmpmem (data->received->data, data->received->len,
+                   expected, strlen (expected));
+}
+
+/* Tests */
+
+static void
+test_stream_in_order (void)
+{
+  g_autoptr(GByteArray) received = g_byte_array_new ();
+  StreamTestData data = { received, };
+  FpiUsbStream *stream = stream_new_started (&data);
+
+  /* Later transfers are held back until the first one returns */
+  complete_transfer (2, 'c');
+  complete_transfer (1, 'b');
+  assert_received (&data, "");
+
+  complete_transfer (0, 'a');
+  assert_received (&data, "abc");
+
+  /* Each delivered transfer was resubmitted */
+  g_assert_cmpuint (pending_transfers.length, ==, N_TRANSFERS);
+
+  complete_transfer (1, 'e');
+  complete_transfer (0, 'd');
+  complete_transfer (0, 'f');
+  assert_received (&data, "abcdef");
+  g_assert_cmpuint (pending_transfers.length, ==, N_TRANSFERS);
+
+  fpi_usb_stream_stop (stream);
+  g_assert_cmpuint (data.stopped, ==, 0);
+
+  cancel_pending_transfers ();
+  g_assert_cmpuint (data.stopped, ==, 1);
+  assert_received (&data, "abcdef");
+
+  fpi_usb_stream_free (stream);
+}
+
+static void
+test_stream_stop_queued (void)
+{
+  g_autoptr(GByteArray) received = g_byte_array_new ();
+  StreamTestData data = { received, };
+  FpiUsbStream *stream = stream_new_started (&data);
+
+  /* Data of the later transfers is queued, the first is still in flight */
+  complete_transfer (1, 'b');
+  complete_transfer (1, 'c');
+  g_assert_cmpuint (pending_transfers.length, ==, 1);
+
+  /* The queued data is dropped and not delivered on stop */
+  fpi_usb_stream_stop (stream);
+  g_assert_cmpuint (data.stopped, ==, 0);
+
+  cancel_pending_transfers ();
+  g_assert_cmpuint (data.stopped, ==, 1);
+  assert_received (&data, "");
+
+  /* A restarted stream does not deliver the stale data either */
+  fpi_usb_stream_start (stream, 0, stream_cb, stream_stopped_cb, &data);
+  g_assert_cmpuint (pending_transfers.length, ==, N_TRANSFERS);
+
+  complete_transfer (0, 'x');
+  assert_received (&data, "x");
+
+  fpi_usb_stream_stop (stream);
+  cancel_pending_transfers ();
+  g_assert_cmpuint (data.stopped, ==, 2);
+
+  /* Stopping without transfers in flight notifies right away */
+  fpi_usb_stream_stop (stream);
+  g_assert_cmpuint (data.stopped, ==, 3);
+
+  fpi_usb_stream_free (stream);
+}
+
+static void
+test_stream_free_in_callback (void)
+{
+  g_autoptr(GByteArray) received = g_byte_array_new ();
+  StreamTestData data = { received, };
+
+  data.free_in_callback = TRUE;
+  stream_new_started (&data);
+
+  /* Queued data must not be delivered after the stream was freed */
+  complete_transfer (1, 'b');
+  complete_transfer (0, 'a');
+  assert_received (&data, "a");
+
+  /* Nothing was resubmitted, the remaining transfers are cancelled and
+   * the stream is released once they return. */
+  g_assert_cmpuint (pending_transfers.length, ==, 1);
+  cancel_pending_transfers ();
+
+  assert_received (&data, "a");
+  g_assert_cmpuint (data.stopped, ==, 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr(FpDevice) device = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  fake_device = device;
+  g_object_add_weak_pointer (G_OBJECT (device), (gpointer) & fake_device);
+
+  g_test_add_func ("/usb-stream/in_order", test_stream_in_order);
+  g_test_add_func ("/usb-stream/stop_queued", test_stream_stop_queued);
+  g_test_add_func ("/usb-stream/free_in_callback", test_stream_free_in_callback);
+
+  return g_test_run ();
+}
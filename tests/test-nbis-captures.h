@@ -0,0 +1,642 @@
+/*
+ * Minutiae of the driver test captures, as detected by the unmodified NBIS
+ * code. Regenerate only if the detection is meant to change, by running
+ *
+ *   <builddir>/tests/test-nbis --regenerate > test-nbis-captures.h.new
+ *   mv test-nbis-captures.h.new tests/test-nbis-captures.h
+ *
+ * from the source directory, the comment and types above the tables are kept.
+ * Captures without an entry are skipped.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct
+{
+  gint    x, y;
+  gint    direction;
+  gdouble reliability;
+  gint    type;
+} CaptureMinutia;
+
+typedef struct
+{
+  const gchar          *name;
+  gint                  num;
+  const CaptureMinutia *minutiae;
+} CaptureMinutiae;
+
+static const CaptureMinutia aes2501_minutiae[] = {
+  { 153, 61, 2, 0.140771, 1 },
+  { 155, 100, 11, 0.089748, 0 },
+  { 156, 37, 18, 0.162699, 1 },
+  { 164, 36, 19, 0.206556, 1 },
+  { 185, 60, 1, 0.382391, 0 },
+  { 186, 61, 1, 0.403282, 1 },
+  { 208, 55, 2, 0.159723, 1 },
+};
+
+static const CaptureMinutia aes3500_minutiae[] = {
+  { 16, 80, 11, 0.086504, 0 },
+  { 26, 197, 18, 0.228272, 1 },
+  { 39, 68, 11, 0.435275, 0 },
+  { 44, 45, 11, 0.435318, 0 },
+  { 49, 203, 4, 0.208492, 1 },
+  { 57, 56, 27, 0.425762, 0 },
+  { 57, 84, 27, 0.792951, 0 },
+  { 97, 40, 27, 0.424462, 0 },
+  { 154, 115, 12, 0.232248, 1 },
+  { 173, 123, 26, 0.212512, 1 },
+  { 183, 137, 11, 0.198279, 1 },
+  { 194, 105, 27, 0.079026, 0 },
+  { 201, 25, 29, 0.451419, 0 },
+  { 201, 39, 13, 0.475093, 1 },
+};
+
+static const CaptureMinutia egis0570_minutiae[] = {
+  { 62, 471, 26, 0.062882, 0 },
+  { 63, 438, 29, 0.060983, 0 },
+  { 63, 481, 26, 0.144459, 0 },
+  { 65, 522, 27, 0.067080, 0 },
+  { 69, 282, 18, 0.285550, 0 },
+  { 69, 409, 14, 0.131014, 1 },
+  { 73, 238, 19, 0.296563, 0 },
+  { 75, 459, 11, 0.058857, 0 },
+  { 96, 302, 17, 0.609127, 1 },
+  { 99, 352, 15, 0.322437, 0 },
+  { 99, 423, 28, 0.136055, 1 },
+  { 103, 257, 18, 0.634954, 0 },
+  { 106, 419, 12, 0.136863, 1 },
+  { 116, 355, 14, 0.300737, 0 },
+  { 121, 156, 5, 0.652686, 0 },
+  { 122, 395, 27, 0.126504, 0 },
+  { 126, 430, 28, 0.128872, 0 },
+  { 129, 379, 11, 0.131802, 0 },
+  { 130, 351, 12, 0.143723, 0 },
+  { 131, 69, 6, 0.670629, 0 },
+  { 133, 330, 13, 0.305721, 0 },
+  { 139, 50, 6, 0.652060, 0 },
+  { 142, 532, 26, 0.336302, 1 },
+  { 144, 435, 29, 0.143509, 0 },
+  { 145, 447, 28, 0.142947, 0 },
+  { 146, 524, 10, 0.329041, 1 },
+  { 155, 303, 31, 0.136192, 0 },
+  { 160, 262, 4, 0.131168, 0 },
+  { 162, 298, 4, 0.062276, 0 },
+  { 164, 62, 23, 0.652496, 1 },
+  { 165, 347, 24, 0.130616, 1 },
+  { 167, 361, 8, 0.131657, 0 },
+  { 172, 202, 7, 0.671430, 0 },
+  { 175, 103, 23, 0.675803, 1 },
+  { 180, 263, 3, 0.321456, 0 },
+  { 186, 114, 8, 0.668815, 1 },
+  { 190, 345, 22, 0.131521, 1 },
+  { 191, 262, 19, 0.138083, 0 },
+  { 196, 269, 17, 0.061936, 0 },
+  { 197, 248, 8, 0.143846, 0 },
+  { 199, 82, 8, 0.649815, 1 },
+  { 199, 171, 24, 0.677905, 0 },
+  { 204, 62, 8, 0.639141, 0 },
+  { 207, 553, 9, 0.321595, 0 },
+  { 208, 345, 21, 0.124182, 0 },
+  { 220, 166, 9, 0.651448, 1 },
+  { 225, 524, 9, 0.058148, 0 },
+  { 230, 249, 13, 0.624415, 0 },
+  { 238, 150, 26, 0.307587, 0 },
+  { 246, 56, 25, 0.293658, 0 },
+  { 249, 85, 25, 0.058497, 0 },
+  { 258, 304, 0, 0.068287, 0 },
+  { 259, 51, 25, 0.062471, 0 },
+};
+
+static const CaptureMinutia elan_cobo_minutiae[] = {
+  { 16, 92, 1, 0.232229, 0 },
+  { 22, 227, 7, 0.157008, 1 },
+  { 24, 112, 10, 0.167533, 0 },
+  { 24, 178, 3, 0.230416, 0 },
+  { 25, 103, 0, 0.160391, 1 },
+  { 32, 60, 8, 0.164305, 0 },
+  { 36, 85, 14, 0.066107, 0 },
+  { 39, 163, 7, 0.157398, 1 },
+  { 43, 43, 4, 0.380701, 1 },
+  { 46, 184, 20, 0.164139, 1 },
+  { 47, 146, 1, 0.149009, 1 },
+  { 50, 128, 17, 0.161657, 1 },
+  { 52, 41, 4, 0.383113, 1 },
+  { 59, 184, 3, 0.162172, 1 },
+  { 60, 246, 29, 0.149390, 0 },
+  { 64, 105, 28, 0.149939, 0 },
+  { 65, 168, 17, 0.159798, 1 },
+  { 66, 86, 12, 0.375631, 0 },
+  { 66, 151, 1, 0.159625, 0 },
+  { 71, 55, 20, 0.159209, 1 },
+  { 73, 111, 0, 0.158125, 0 },
+  { 75, 176, 1, 0.148258, 1 },
+  { 77, 73, 28, 0.366339, 0 },
+  { 77, 129, 20, 0.151031, 1 },
+  { 78, 88, 30, 0.370321, 0 },
+  { 79, 218, 27, 0.152689, 0 },
+  { 80, 30, 6, 0.369044, 0 },
+  { 82, 111, 1, 0.151082, 0 },
+  { 83, 46, 8, 0.169226, 1 },
+  { 85, 56, 13, 0.164374, 0 },
+  { 86, 202, 7, 0.168133, 1 },
+  { 89, 122, 17, 0.162715, 0 },
+  { 89, 160, 17, 0.148244, 0 },
+  { 91, 107, 17, 0.156728, 0 },
+  { 92, 73, 14, 0.355130, 0 },
+  { 95, 58, 12, 0.155680, 0 },
+  { 96, 245, 27, 0.168364, 1 },
+  { 98, 145, 17, 0.162252, 1 },
+  { 104, 235, 12, 0.073057, 0 },
+  { 108, 121, 17, 0.073011, 0 },
+  { 114, 47, 9, 0.068317, 0 },
+  { 114, 94, 15, 0.068175, 1 },
+  { 121, 245, 24, 0.065438, 0 },
+  { 141, 237, 21, 0.060862, 1 },
+  { 148, 98, 16, 0.054690, 0 },
+  { 154, 247, 18, 0.060690, 1 },
+};
+
+static const CaptureMinutia elan_minutiae[] = {
+  { 70, 189, 21, 0.082023, 0 },
+  { 77, 80, 9, 0.072793, 1 },
+  { 90, 55, 7, 0.076625, 0 },
+  { 91, 79, 9, 0.071784, 0 },
+  { 93, 120, 23, 0.182010, 0 },
+  { 97, 231, 3, 0.010000, 1 },
+  { 101, 176, 23, 0.196429, 0 },
+  { 101, 189, 21, 0.416912, 0 },
+  { 102, 42, 23, 0.195004, 1 },
+  { 105, 164, 7, 0.200262, 1 },
+  { 106, 24, 24, 0.192120, 0 },
+  { 110, 195, 20, 0.408680, 1 },
+  { 115, 185, 21, 0.412259, 1 },
+  { 117, 65, 23, 0.180416, 1 },
+  { 119, 221, 18, 0.183744, 1 },
+  { 120, 74, 8, 0.179475, 0 },
+  { 122, 120, 24, 0.179077, 0 },
+  { 129, 141, 9, 0.182656, 1 },
+  { 129, 176, 9, 0.203780, 1 },
+  { 130, 65, 24, 0.169940, 1 },
+  { 131, 134, 25, 0.178816, 0 },
+  { 131, 191, 21, 0.183805, 1 },
+  { 137, 196, 11, 0.185791, 0 },
+  { 138, 25, 25, 0.193070, 0 },
+  { 139, 86, 9, 0.185034, 0 },
+  { 142, 29, 2, 0.187397, 0 },
+  { 142, 111, 9, 0.179842, 0 },
+  { 144, 116, 9, 0.186111, 0 },
+  { 150, 100, 25, 0.180551, 0 },
+  { 158, 194, 29, 0.382725, 0 },
+  { 163, 12, 14, 0.077401, 1 },
+  { 163, 106, 25, 0.188626, 0 },
+  { 163, 183, 12, 0.193920, 1 },
+  { 168, 197, 15, 0.392832, 1 },
+  { 169, 226, 17, 0.050000, 0 },
+};
+
+static const CaptureMinutia elanspi_minutiae[] = {
+  { 13, 209, 1, 0.058513, 1 },
+  { 24, 230, 4, 0.080842, 0 },
+  { 25, 88, 24, 0.192798, 1 },
+  { 40, 367, 7, 0.195741, 0 },
+  { 43, 111, 24, 0.407397, 1 },
+  { 55, 221, 24, 0.424676, 1 },
+  { 55, 456, 8, 0.078023, 1 },
+  { 60, 24, 9, 0.071011, 0 },
+  { 60, 407, 23, 0.199076, 0 },
+  { 64, 179, 24, 0.189646, 1 },
+  { 65, 64, 10, 0.412032, 1 },
+  { 67, 242, 23, 0.377676, 0 },
+  { 68, 422, 8, 0.209743, 1 },
+  { 72, 83, 25, 0.405563, 1 },
+  { 73, 20, 24, 0.074734, 0 },
+  { 76, 35, 24, 0.181262, 0 },
+  { 77, 354, 24, 0.197741, 0 },
+  { 81, 97, 24, 0.396570, 1 },
+  { 86, 13, 24, 0.069747, 0 },
+  { 92, 103, 24, 0.194808, 1 },
+  { 93, 90, 9, 0.190367, 0 },
+  { 94, 401, 8, 0.216666, 0 },
+  { 96, 76, 9, 0.346321, 1 },
+  { 104, 367, 24, 0.197046, 0 },
+  { 105, 523, 24, 0.075826, 1 },
+  { 106, 335, 25, 0.191817, 0 },
+  { 107, 169, 25, 0.172724, 1 },
+  { 114, 208, 9, 0.189789, 0 },
+  { 115, 274, 8, 0.239233, 0 },
+  { 117, 17, 8, 0.177528, 0 },
+  { 116, 338, 25, 0.191235, 1 },
+  { 117, 114, 8, 0.208138, 0 },
+  { 122, 242, 24, 0.196322, 0 },
+  { 124, 310, 8, 0.182180, 1 },
+  { 125, 217, 9, 0.196253, 0 },
+  { 126, 56, 24, 0.193544, 0 },
+  { 125, 452, 25, 0.395594, 1 },
+  { 127, 35, 8, 0.190922, 0 },
+  { 130, 417, 8, 0.154267, 1 },
+  { 132, 145, 24, 0.180803, 0 },
+  { 133, 127, 8, 0.201308, 1 },
+  { 134, 268, 8, 0.203804, 0 },
+  { 135, 536, 8, 0.204950, 1 },
+  { 143, 15, 24, 0.075491, 0 },
+  { 143, 164, 8, 0.200797, 0 },
+  { 143, 362, 8, 0.386513, 1 },
+  { 144, 423, 23, 0.178274, 1 },
+  { 145, 432, 8, 0.180786, 1 },
+  { 146, 179, 24, 0.159694, 1 },
+  { 153, 151, 24, 0.178968, 1 },
+  { 153, 316, 24, 0.396248, 1 },
+  { 156, 372, 24, 0.406025, 1 },
+  { 157, 213, 24, 0.155778, 1 },
+  { 157, 335, 24, 0.220070, 0 },
+  { 160, 179, 7, 0.145313, 1 },
+  { 161, 76, 25, 0.196389, 0 },
+  { 163, 448, 8, 0.198512, 1 },
+  { 168, 425, 23, 0.212354, 0 },
+  { 169, 223, 24, 0.179002, 0 },
+  { 169, 536, 8, 0.168703, 1 },
+  { 174, 359, 9, 0.207718, 0 },
+  { 175, 382, 24, 0.200638, 0 },
+  { 179, 186, 23, 0.202001, 0 },
+  { 179, 217, 8, 0.171650, 1 },
+  { 181, 127, 23, 0.177407, 1 },
+  { 183, 104, 25, 0.158071, 1 },
+  { 183, 112, 25, 0.183976, 1 },
+  { 184, 91, 25, 0.073506, 0 },
+  { 187, 543, 24, 0.161291, 1 },
+  { 188, 476, 24, 0.075091, 1 },
+  { 190, 451, 6, 0.186354, 1 },
+  { 191, 165, 22, 0.173790, 0 },
+  { 193, 357, 24, 0.208412, 1 },
+  { 196, 371, 9, 0.182110, 0 },
+  { 199, 137, 20, 0.192590, 0 },
+  { 199, 307, 24, 0.202676, 0 },
+  { 204, 404, 7, 0.198314, 1 },
+};
+
+static const CaptureMinutia nb1010_minutiae[] = {
+  { 12, 54, 14, 0.073944, 1 },
+  { 12, 76, 14, 0.071570, 1 },
+  { 12, 117, 14, 0.072244, 1 },
+  { 13, 99, 14, 0.076386, 1 },
+  { 22, 13, 13, 0.065423, 1 },
+  { 28, 92, 30, 0.907736, 0 },
+  { 28, 146, 14, 0.199744, 1 },
+  { 33, 162, 30, 0.161957, 1 },
+  { 46, 76, 14, 0.878176, 1 },
+  { 54, 106, 30, 0.907073, 1 },
+  { 60, 98, 14, 0.898401, 1 },
+  { 61, 165, 30, 0.160620, 1 },
+  { 72, 14, 14, 0.080938, 1 },
+  { 75, 100, 30, 0.896147, 1 },
+  { 82, 164, 31, 0.145459, 1 },
+  { 87, 153, 31, 0.366780, 1 },
+  { 99, 116, 30, 0.919851, 1 },
+  { 102, 166, 31, 0.147814, 1 },
+  { 105, 111, 15, 0.905424, 1 },
+  { 129, 61, 31, 0.972517, 1 },
+  { 130, 121, 31, 0.239558, 1 },
+  { 135, 12, 14, 0.069628, 1 },
+  { 152, 41, 0, 0.987331, 1 },
+  { 152, 95, 0, 0.449801, 1 },
+  { 156, 106, 0, 0.409962, 1 },
+  { 162, 104, 16, 0.193015, 1 },
+  { 169, 120, 0, 0.165667, 1 },
+  { 172, 37, 0, 0.410816, 1 },
+  { 174, 73, 1, 0.834597, 1 },
+  { 185, 43, 2, 0.783594, 1 },
+  { 219, 42, 19, 0.143061, 1 },
+};
+
+static const CaptureMinutia upektc_img_minutiae[] = {
+  { 21, 191, 3, 0.126934, 1 },
+  { 21, 205, 3, 0.124338, 1 },
+  { 25, 92, 4, 0.291674, 1 },
+  { 29, 226, 3, 0.126512, 1 },
+  { 41, 103, 20, 0.587434, 1 },
+  { 56, 310, 4, 0.133367, 1 },
+  { 62, 311, 4, 0.131003, 1 },
+  { 71, 146, 19, 0.592757, 1 },
+  { 70, 343, 7, 0.059747, 0 },
+  { 90, 65, 20, 0.122887, 1 },
+  { 89, 318, 5, 0.115053, 1 },
+  { 116, 208, 19, 0.054815, 0 },
+};
+
+static const CaptureMinutia uru4000_4500_minutiae[] = {
+  { 86, 161, 8, 0.129556, 1 },
+  { 89, 142, 9, 0.133891, 1 },
+  { 89, 171, 24, 0.130283, 1 },
+  { 96, 77, 9, 0.153350, 0 },
+  { 107, 61, 9, 0.350443, 0 },
+  { 107, 150, 24, 0.132980, 1 },
+  { 110, 133, 8, 0.141264, 0 },
+  { 110, 162, 8, 0.130845, 0 },
+  { 112, 107, 25, 0.148097, 1 },
+  { 118, 149, 24, 0.131238, 0 },
+  { 130, 106, 24, 0.145914, 1 },
+  { 132, 40, 25, 0.137761, 0 },
+  { 136, 44, 9, 0.143224, 1 },
+  { 139, 53, 25, 0.154018, 1 },
+  { 139, 165, 24, 0.122991, 0 },
+  { 141, 39, 25, 0.139093, 1 },
+  { 149, 116, 8, 0.160940, 0 },
+  { 155, 33, 8, 0.136270, 0 },
+  { 156, 150, 24, 0.057875, 0 },
+  { 161, 175, 24, 0.057831, 0 },
+  { 162, 182, 24, 0.058632, 0 },
+  { 164, 37, 8, 0.133367, 0 },
+  { 165, 83, 24, 0.141647, 1 },
+  { 168, 123, 24, 0.060803, 1 },
+  { 176, 70, 24, 0.064278, 0 },
+};
+
+static const CaptureMinutia uru4000_msv2_minutiae[] = {
+  { 16, 149, 2, 0.055061, 0 },
+  { 16, 177, 3, 0.053444, 0 },
+  { 26, 142, 3, 0.121110, 1 },
+  { 28, 128, 3, 0.121940, 0 },
+  { 28, 198, 20, 0.054801, 1 },
+  { 44, 119, 21, 0.131366, 1 },
+  { 46, 174, 6, 0.127038, 0 },
+  { 48, 123, 6, 0.131494, 0 },
+  { 52, 111, 5, 0.138804, 1 },
+  { 55, 44, 8, 0.062283, 0 },
+  { 58, 162, 23, 0.127495, 0 },
+  { 61, 195, 8, 0.125900, 0 },
+  { 62, 128, 7, 0.133756, 1 },
+  { 65, 40, 24, 0.062456, 0 },
+  { 67, 146, 24, 0.131519, 1 },
+  { 87, 110, 7, 0.157499, 1 },
+  { 89, 75, 22, 0.198205, 0 },
+  { 91, 56, 23, 0.178731, 1 },
+  { 95, 103, 7, 0.151254, 1 },
+  { 97, 94, 22, 0.158221, 0 },
+  { 107, 84, 7, 0.169427, 0 },
+  { 112, 24, 25, 0.150035, 0 },
+  { 119, 39, 9, 0.146667, 0 },
+  { 120, 176, 24, 0.128599, 0 },
+  { 126, 133, 24, 0.146833, 0 },
+  { 132, 52, 25, 0.143900, 1 },
+  { 138, 86, 8, 0.152432, 1 },
+  { 140, 80, 24, 0.151230, 0 },
+  { 148, 149, 25, 0.146001, 0 },
+  { 150, 27, 8, 0.057718, 0 },
+  { 151, 13, 8, 0.055633, 0 },
+  { 151, 88, 8, 0.147395, 1 },
+  { 154, 117, 9, 0.143196, 1 },
+  { 158, 82, 24, 0.144801, 1 },
+  { 160, 72, 8, 0.152557, 1 },
+  { 161, 127, 25, 0.141600, 1 },
+  { 164, 181, 24, 0.120015, 1 },
+  { 165, 95, 24, 0.146284, 1 },
+  { 167, 154, 24, 0.142126, 0 },
+  { 168, 39, 9, 0.141228, 1 },
+  { 170, 159, 8, 0.138854, 1 },
+  { 173, 171, 8, 0.124948, 0 },
+  { 174, 177, 8, 0.123735, 0 },
+  { 179, 122, 8, 0.062282, 1 },
+  { 225, 76, 22, 0.056135, 1 },
+  { 234, 93, 6, 0.058444, 1 },
+  { 240, 175, 8, 0.126593, 1 },
+  { 248, 45, 9, 0.057222, 0 },
+  { 254, 91, 6, 0.130042, 0 },
+  { 255, 152, 24, 0.140915, 1 },
+  { 260, 79, 22, 0.129925, 0 },
+  { 269, 50, 25, 0.127617, 1 },
+  { 278, 126, 8, 0.144792, 0 },
+  { 280, 145, 8, 0.139345, 1 },
+  { 291, 44, 25, 0.056743, 1 },
+  { 293, 73, 21, 0.057896, 0 },
+  { 295, 106, 22, 0.060291, 0 },
+  { 328, 87, 18, 0.060255, 1 },
+  { 351, 17, 29, 0.060363, 0 },
+  { 368, 25, 29, 0.054498, 1 },
+  { 368, 47, 30, 0.054645, 1 },
+};
+
+static const CaptureMinutia vfs0050_minutiae[] = {
+  { 16, 289, 11, 0.231091, 1 },
+  { 16, 1040, 1, 0.205261, 1 },
+  { 18, 956, 2, 0.223077, 0 },
+  { 22, 803, 21, 0.229802, 1 },
+  { 23, 768, 6, 0.237941, 1 },
+  { 26, 489, 26, 0.460235, 0 },
+  { 27, 530, 25, 0.934839, 1 },
+  { 29, 359, 12, 0.479897, 1 },
+  { 30, 273, 10, 0.472888, 0 },
+  { 27, 670, 9, 0.477822, 0 },
+  { 28, 653, 25, 0.230400, 1 },
+  { 26, 921, 19, 0.918968, 1 },
+  { 26, 990, 18, 0.972189, 0 },
+  { 31, 558, 8, 0.484556, 1 },
+  { 33, 412, 28, 0.477705, 0 },
+  { 32, 633, 9, 0.223223, 0 },
+  { 31, 802, 5, 0.980190, 1 },
+  { 37, 746, 24, 0.483559, 1 },
+  { 35, 977, 2, 0.473074, 0 },
+  { 35, 1021, 17, 0.439676, 0 },
+  { 39, 786, 22, 0.985121, 0 },
+  { 40, 722, 25, 0.236345, 1 },
+  { 37, 1031, 17, 0.459198, 0 },
+  { 39, 1046, 17, 0.960918, 0 },
+  { 48, 328, 28, 0.465306, 1 },
+  { 42, 928, 19, 0.969869, 1 },
+  { 42, 1024, 1, 0.450170, 1 },
+  { 47, 647, 27, 0.231137, 0 },
+  { 46, 769, 24, 0.459946, 1 },
+  { 44, 1035, 1, 0.937405, 1 },
+  { 52, 386, 28, 0.456845, 1 },
+  { 48, 849, 21, 0.487292, 0 },
+  { 56, 330, 12, 0.442349, 1 },
+  { 53, 916, 3, 0.904856, 0 },
+  { 56, 741, 10, 0.442567, 0 },
+  { 62, 276, 11, 0.224559, 0 },
+  { 59, 589, 27, 0.920070, 1 },
+  { 58, 752, 26, 0.429292, 0 },
+  { 63, 385, 12, 0.460575, 0 },
+  { 62, 679, 27, 0.443170, 1 },
+  { 60, 888, 20, 0.861306, 1 },
+  { 64, 561, 27, 0.449111, 1 },
+  { 66, 526, 27, 0.422322, 0 },
+  { 62, 928, 18, 0.881020, 1 },
+  { 63, 856, 21, 0.459124, 0 },
+  { 61, 1091, 0, 0.809354, 0 },
+  { 63, 943, 17, 0.909275, 0 },
+  { 69, 402, 28, 0.861313, 1 },
+  { 66, 795, 26, 0.872057, 1 },
+  { 66, 951, 16, 0.456577, 0 },
+  { 68, 812, 25, 0.878212, 1 },
+  { 73, 327, 28, 0.810003, 1 },
+  { 68, 960, 17, 0.449772, 0 },
+  { 72, 979, 17, 0.442163, 1 },
+  { 77, 583, 11, 0.852525, 1 },
+  { 73, 1026, 1, 0.413023, 1 },
+  { 74, 943, 0, 0.422808, 0 },
+  { 75, 953, 0, 0.436922, 0 },
+  { 78, 746, 28, 0.428638, 1 },
+  { 76, 965, 1, 0.449951, 1 },
+  { 78, 865, 20, 0.879715, 1 },
+  { 82, 466, 28, 0.218551, 1 },
+  { 84, 282, 12, 0.216535, 1 },
+  { 79, 828, 23, 0.451133, 1 },
+  { 78, 959, 0, 0.448865, 0 },
+  { 79, 1005, 17, 0.483809, 0 },
+  { 83, 822, 24, 0.224715, 1 },
+  { 82, 973, 1, 0.232587, 0 },
+  { 83, 882, 20, 0.195539, 0 },
+  { 88, 391, 29, 0.085520, 1 },
+  { 82, 1012, 16, 0.227270, 0 },
+  { 85, 928, 18, 0.230514, 0 },
+  { 86, 844, 21, 0.223683, 0 },
+  { 86, 1015, 16, 0.226440, 0 },
+  { 88, 817, 23, 0.089366, 1 },
+  { 90, 632, 12, 0.050000, 1 },
+  { 88, 917, 4, 0.085729, 1 },
+  { 90, 795, 28, 0.050000, 0 },
+  { 89, 946, 16, 0.050000, 0 },
+  { 90, 1010, 0, 0.050000, 1 },
+  { 94, 799, 27, 0.010000, 1 },
+  { 95, 835, 21, 0.010000, 1 },
+};
+
+static const CaptureMinutia vfs301_minutiae[] = {
+  { 20, 71, 19, 0.056998, 1 },
+  { 21, 118, 1, 0.057222, 1 },
+  { 32, 134, 3, 0.177553, 1 },
+  { 46, 127, 4, 0.337544, 1 },
+  { 48, 77, 4, 0.339501, 0 },
+  { 49, 94, 3, 0.332110, 0 },
+  { 59, 93, 4, 0.392833, 0 },
+  { 59, 171, 1, 0.175017, 0 },
+  { 62, 21, 5, 0.071695, 1 },
+  { 65, 184, 2, 0.157938, 0 },
+  { 68, 28, 21, 0.074865, 1 },
+  { 71, 59, 21, 0.076698, 1 },
+  { 71, 67, 5, 0.196810, 1 },
+  { 73, 151, 19, 0.195812, 0 },
+  { 78, 140, 4, 0.420441, 0 },
+  { 85, 121, 6, 0.408774, 0 },
+  { 88, 137, 20, 0.401664, 0 },
+  { 91, 156, 4, 0.174973, 1 },
+  { 95, 56, 5, 0.229366, 1 },
+  { 103, 105, 6, 0.439361, 0 },
+  { 104, 43, 5, 0.227203, 0 },
+  { 108, 32, 5, 0.233719, 0 },
+  { 109, 90, 22, 0.442964, 1 },
+  { 111, 179, 5, 0.187871, 0 },
+  { 114, 165, 21, 0.416026, 0 },
+  { 119, 59, 6, 0.420170, 0 },
+  { 120, 51, 22, 0.224616, 0 },
+  { 123, 23, 21, 0.206304, 0 },
+  { 125, 112, 22, 0.181472, 0 },
+  { 128, 123, 21, 0.189847, 0 },
+  { 133, 172, 5, 0.201272, 0 },
+  { 134, 160, 21, 0.427606, 0 },
+  { 135, 64, 23, 0.397890, 0 },
+  { 136, 137, 6, 0.184358, 0 },
+  { 141, 154, 21, 0.196616, 1 },
+  { 142, 34, 5, 0.441883, 0 },
+  { 142, 108, 23, 0.190082, 1 },
+  { 143, 19, 7, 0.206044, 1 },
+  { 144, 135, 7, 0.190289, 1 },
+  { 146, 65, 7, 0.203553, 0 },
+  { 150, 163, 5, 0.206214, 0 },
+  { 153, 93, 25, 0.190149, 0 },
+  { 154, 40, 6, 0.430299, 0 },
+  { 156, 74, 9, 0.208900, 0 },
+  { 158, 178, 20, 0.183376, 0 },
+  { 167, 97, 25, 0.206835, 1 },
+  { 170, 109, 9, 0.212260, 1 },
+  { 173, 122, 24, 0.194591, 0 },
+  { 173, 155, 5, 0.205418, 0 },
+  { 175, 43, 24, 0.183171, 1 },
+  { 177, 140, 24, 0.078580, 0 },
+  { 183, 169, 22, 0.083606, 0 },
+  { 185, 160, 22, 0.077396, 0 },
+  { 187, 113, 27, 0.072137, 0 },
+};
+
+static const CaptureMinutia vfs5011_minutiae[] = {
+  { 62, 120, 14, 0.893084, 0 },
+  { 94, 307, 14, 0.953379, 0 },
+  { 114, 15, 14, 0.084586, 1 },
+  { 126, 94, 30, 0.950141, 0 },
+  { 134, 313, 29, 0.149829, 1 },
+};
+
+static const CaptureMinutia vfs7552_minutiae[] = {
+  { 16, 93, 24, 0.155181, 1 },
+  { 39, 95, 24, 0.232796, 0 },
+  { 65, 85, 24, 0.146003, 0 },
+  { 70, 26, 8, 0.059007, 0 },
+  { 71, 164, 8, 0.165016, 0 },
+  { 75, 17, 7, 0.054349, 0 },
+  { 78, 110, 8, 0.192598, 0 },
+  { 80, 73, 24, 0.145095, 0 },
+  { 89, 174, 8, 0.351340, 0 },
+  { 93, 56, 8, 0.156464, 0 },
+  { 93, 137, 24, 0.198083, 0 },
+  { 99, 47, 24, 0.158423, 0 },
+  { 105, 177, 7, 0.320804, 0 },
+  { 115, 146, 8, 0.165133, 0 },
+  { 117, 50, 8, 0.163474, 1 },
+  { 122, 86, 24, 0.329806, 0 },
+  { 123, 188, 7, 0.321704, 0 },
+  { 125, 177, 24, 0.336236, 0 },
+  { 127, 67, 8, 0.151563, 0 },
+  { 129, 183, 24, 0.305385, 0 },
+  { 130, 61, 24, 0.179562, 0 },
+  { 131, 159, 24, 0.156706, 0 },
+  { 134, 80, 24, 0.326148, 0 },
+  { 146, 87, 24, 0.328491, 0 },
+  { 149, 145, 24, 0.173002, 1 },
+  { 156, 70, 8, 0.355670, 1 },
+  { 156, 86, 8, 0.681229, 0 },
+  { 156, 116, 24, 0.384210, 1 },
+  { 158, 17, 24, 0.115404, 0 },
+  { 161, 178, 8, 0.317446, 0 },
+  { 167, 17, 8, 0.111119, 0 },
+  { 167, 113, 8, 0.379604, 1 },
+  { 171, 125, 24, 0.358099, 0 },
+  { 177, 35, 24, 0.316131, 1 },
+  { 179, 71, 24, 0.326276, 1 },
+  { 185, 34, 8, 0.299327, 1 },
+  { 191, 50, 24, 0.335022, 0 },
+  { 205, 176, 24, 0.125256, 0 },
+};
+
+static const CaptureMinutiae capture_minutiae[] = {
+  { "aes2501", G_N_ELEMENTS (aes2501_minutiae), aes2501_minutiae },
+  { "aes3500", G_N_ELEMENTS (aes3500_minutiae), aes3500_minutiae },
+  { "egis0570", G_N_ELEMENTS (egis0570_minutiae), egis0570_minutiae },
+  { "elan-cobo", G_N_ELEMENTS (elan_cobo_minutiae), elan_cobo_minutiae },
+  { "elan", G_N_ELEMENTS (elan_minutiae), elan_minutiae },
+  { "elanspi", G_N_ELEMENTS (elanspi_minutiae), elanspi_minutiae },
+  { "nb1010", G_N_ELEMENTS (nb1010_minutiae), nb1010_minutiae },
+  { "upektc_img", G_N_ELEMENTS (upektc_img_minutiae), upektc_img_minutiae },
+  { "uru4000-4500", G_N_ELEMENTS (uru4000_4500_minutiae), uru4000_4500_minutiae },
+  { "uru4000-msv2", G_N_ELEMENTS (uru4000_msv2_minutiae), uru4000_msv2_minutiae },
+  { "vfs0050", G_N_ELEMENTS (vfs0050_minutiae), vfs0050_minutiae },
+  { "vfs301", G_N_ELEMENTS (vfs301_minutiae), vfs301_minutiae },
+  { "vfs5011", G_N_ELEMENTS (vfs5011_minutiae), vfs5011_minutiae },
+  { "vfs7552", G_N_ELEMENTS (vfs7552_minutiae), vfs7552_minutiae },
+};
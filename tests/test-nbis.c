@@ -0,0 +1,798 @@
+/*
+ * Unit tests for the modifications to the NBIS algorithms
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <cairo.h>
+#include <math.h>
+
+#include <nbis.h>
+
+#include "fpi-image.h"
+#include "test-config.h"
+#include "test-nbis-captures.h"
+
+/* Tests */
+
+static void
+test_dft_dir_powers (void)
+{
+  const LFSPARMS *lfsparms = &g_lfsparms_V2;
+  const gint iw = 160;
+  const gint ih = 120;
+  g_autofree guchar *pdata = NULL;
+  g_autofree gint *rowsums = NULL;
+  DFTWAVES *dftwaves;
+  ROTGRIDS *dftgrids;
+  double **powers;
+  double expected;
+  gint pw, ph;
+  gint x, y, w, dir;
+  gint i;
+
+  g_assert_cmpint (init_dftwaves (&dftwaves, g_dft_coefs, lfsparms->num_dft_waves,
+                                  lfsparms->windowsize), ==, 0);
+  g_assert_cmpint (init_rotgrids (&dftgrids, iw, ih, UNDEFINED,
+                                  lfsparms->start_dir_angle, lfsparms->num_directions,
+                                  lfsparms->windowsize, lfsparms->windowsize,
+                                  RELATIVE2ORIGIN), ==, 0);
+  g_assert_cmpint (alloc_dir_powers (&powers, dftwaves->nwaves,
+                                     lfsparms->num_directions), ==, 0);
+
+  pw = iw + 2 * dftgrids->pad;
+  ph = ih + 2 * dftgrids->pad;
+  pdata = g_malloc (pw * ph);
+  rowsums = g_new (gint, dftgrids->grid_w);
+
+  /* Worst case input, so that the sums and powers are as large as possible */
+  for (i = 0; i < pw * ph; i++)
+    pdata[i] = g_test_rand_bit () ? 255 : g_test_rand_int_range (0, 256);
+
+  /* Every window position, including those at the very end of the image */
+  for (y = dftgrids->pad; y + lfsparms->windowsize <= ih + dftgrids->pad; y++)
+    {
+      for (x = dftgrids->pad; x + lfsparms->windowsize <= iw + dftgrids->pad; x += 3)
+        {
+          gint blkoffset = y * pw + x;
+
+          g_assert_cmpint (dft_dir_powers (powers, pdata, blkoffset, pw, ph,
+                                           dftwaves, dftgrids), ==, 0);
+
+          /* Compare against the plain C implementation */
+          for (dir = 0; dir < dftgrids->ngrids; dir++)
+            {
+              sum_rot_block_rows (rowsums, pdata + blkoffset,
+                                  dftgrids->grids[dir], dftgrids->grid_w);
+
+              for (w = 0; w < dftwaves->nwaves; w++)
+                {
+                  dft_power (&expected, rowsums, dftwaves->waves[w],
+                             dftwaves->wavelen);
+#ifdef __FMA__
+                  /* The compiler may contract the scalar code differently */
+                  g_assert_cmpfloat (fabs (powers[w][dir] - expected), <=,
+                                     expected * 1e-12);
+#else
+                  /* Otherwise, results must be exactly identical, as any
+                   * change would affect the detected minutiae. */
+                  g_assert_cmpfloat (powers[w][dir], ==, expected);
+#endif
+                }
+            }
+        }
+    }
+
+  free_dir_powers (powers, dftwaves->nwaves);
+  free_rotgrids (dftgrids);
+  free_dftwaves (dftwaves);
+}
+
+typedef struct
+{
+  MINUTIAE *minutiae;
+  gint     *quality_map;
+  gint     *direction_map;
+  gint     *low_contrast_map;
+  gint     *low_flow_map;
+  gint     *high_curve_map;
+  gint      map_w, map_h;
+  guchar   *bdata;
+  gint      bw, bh, bd;
+} DetectResult;
+
+static void
+detect_result_clear (DetectResult *result)
+{
+  g_clear_pointer (&result->minutiae, free_minutiae);
+  g_clear_pointer (&result->quality_map, g_free);
+  g_clear_pointer (&result->direction_map, g_free);
+  g_clear_pointer (&result->low_contrast_map, g_free);
+  g_clear_pointer (&result->low_flow_map, g_free);
+  g_clear_pointer (&result->high_curve_map, g_free);
+  g_clear_pointer (&result->bdata, g_free);
+}
+
+/* Creates an image of concentric ridges with some noise, similar enough to
+ * a fingerprint for the minutiae detection to find a flow and minutiae. */
+static guchar *
+make_ridge_image (gint width, gint height)
+{
+  guchar *image = g_malloc (width * height);
+  gint x, y;
+
+  for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width; x++)
+        {
+          gdouble dx = x - width / 2.0;
+          gdouble dy = y - height / 3.0;
+          gdouble v = 128 + 90 * sin (sqrt (dx * dx + dy * dy) / 1.6 +
+                                      0.3 * sin (x / 17.0));
+
+          image[y * width + x] = CLAMP (v + g_test_rand_int_range (-20, 20), 0, 255);
+        }
+    }
+
+  return image;
+}
+
+static void
+detect (DetectResult *result, guchar *image, gint width, gint height,
+        gint map_threads)
+{
+  g_autofree LFSPARMS *lfsparms = g_memdup (&g_lfsparms_V2, sizeof (LFSPARMS));
+
+  lfsparms->map_threads = map_threads;
+
+  g_assert_cmpint (get_minutiae (&result->minutiae, &result->quality_map,
+                                 &result->direction_map, &result->low_contrast_map,
+                                 &result->low_flow_map, &result->high_curve_map,
+                                 &result->map_w, &result->map_h, &result->bdata,
+                                 &result->bw, &result->bh, &result->bd,
+                                 image, width, height, 8, 19.685, lfsparms), ==, 0);
+}
+
+static void
+test_maps_threaded (void)
+{
+  const gint width = 384;
+  const gint height = 290;
+  g_autofree guchar *image = make_ridge_image (width, height);
+  DetectResult serial = { 0, };
+  DetectResult threaded = { 0, };
+  gsize map_size;
+  gint i;
+
+  detect (&serial, image, width, height, 1);
+  detect (&threaded, image, width, height, 4);
+
+  g_assert_cmpint (serial.map_w, ==, threaded.map_w);
+  g_assert_cmpint (serial.map_h, ==, threaded.map_h);
+  map_size = serial.map_w * serial.map_h * sizeof (gint);
+  g_assert_cmpmem (serial.direction_map, map_size, threaded.direction_map, map_size);
+  g_assert_cmpmem (serial.low_contrast_map, map_size, threaded.low_contrast_map, map_size);
+  g_assert_cmpmem (serial.low_flow_map, map_size, threaded.low_flow_map, map_size);
+  g_assert_cmpmem (serial.high_curve_map, map_size, threaded.high_curve_map, map_size);
+  g_assert_cmpmem (serial.quality_map, map_size, threaded.quality_map, map_size);
+  g_assert_cmpmem (serial.bdata, serial.bw * serial.bh,
+                   threaded.bdata, threaded.bw * threaded.bh);
+
+  g_assert_cmpint (serial.minutiae->num, >, 0);
+  g_assert_cmpint (serial.minutiae->num, ==, threaded.minutiae->num);
+  for (i = 0; i < serial.minutiae->num; i++)
+    {
+      MINUTIA *a = serial.minutiae->list[i];
+      MINUTIA *b = threaded.minutiae->list[i];
+
+      g_assert_cmpint (a->x, ==, b->x);
+      g_assert_cmpint (a->y, ==, b->y);
+      g_assert_cmpint (a->direction, ==, b->direction);
+      g_assert_cmpfloat (a->reliability, ==, b->reliability);
+      g_assert_cmpint (a->type, ==, b->type);
+    }
+
+  detect_result_clear (&serial);
+  detect_result_clear (&threaded);
+}
+
+static void
+test_tables_shared (void)
+{
+  const LFSPARMS *lfsparms = &g_lfsparms_V2;
+  g_autofree LFSPARMS *other_parms = g_memdup (&g_lfsparms_V2, sizeof (LFSPARMS));
+  LFSTABLES *tables, *same, *other;
+  ROTGRIDS *dftgrids;
+  gint i;
+
+  g_assert_cmpint (get_lfs_tables (&tables, 384, 12, lfsparms), ==, 0);
+  g_assert_cmpint (get_lfs_tables (&same, 384, 12, lfsparms), ==, 0);
+  g_assert_true (tables == same);
+  release_lfs_tables (same);
+
+  /* The tables must be the same as computed for a single image */
+  g_assert_cmpint (init_rotgrids (&dftgrids, 384, 290, 12,
+                                  lfsparms->start_dir_angle, lfsparms->num_directions,
+                                  lfsparms->windowsize, lfsparms->windowsize,
+                                  RELATIVE2ORIGIN), ==, 0);
+  g_assert_cmpint (tables->dftgrids->ngrids, ==, dftgrids->ngrids);
+  g_assert_cmpint (tables->dftgrids->grid_w, ==, dftgrids->grid_w);
+  g_assert_cmpint (tables->dftgrids->grid_h, ==, dftgrids->grid_h);
+  for (i = 0; i < dftgrids->ngrids; i++)
+    g_assert_cmpmem (tables->dftgrids->grids[i], dftgrids->grid_w * dftgrids->grid_h * sizeof (gint),
+                     dftgrids->grids[i], dftgrids->grid_w * dftgrids->grid_h * sizeof (gint));
+  free_rotgrids (dftgrids);
+
+  /* A different geometry or different parameters need other tables */
+  g_assert_cmpint (get_lfs_tables (&other, 256, 12, lfsparms), ==, 0);
+  g_assert_true (other != tables);
+  release_lfs_tables (other);
+
+  other_parms->dirbin_grid_h += 2;
+  g_assert_cmpint (get_lfs_tables (&other, 384, 12, other_parms), ==, 0);
+  g_assert_true (other != tables);
+  g_assert_cmpint (other->dirbingrids->grid_h, ==, other_parms->dirbin_grid_h);
+  release_lfs_tables (other);
+
+  /* Tables stay usable while referenced, even if evicted from the cache */
+  for (i = 0; i < 8; i++)
+    {
+      g_assert_cmpint (get_lfs_tables (&other, 100 + i, 12, lfsparms), ==, 0);
+      release_lfs_tables (other);
+    }
+  g_assert_cmpint (tables->iw, ==, 384);
+  g_assert_cmpint (tables->dir2rad->ndirs, ==, lfsparms->num_directions);
+  release_lfs_tables (tables);
+}
+
+/* Loads a capture from the driver tests as 8 bit greyscale */
+static guchar *
+load_capture (const gchar *path, gint *width, gint *height)
+{
+  cairo_surface_t *img;
+  guchar *image;
+  guchar *data;
+  gint stride;
+  gint x, y;
+
+  img = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (img), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  data = cairo_image_surface_get_data (img);
+  stride = cairo_image_surface_get_stride (img);
+  *width = cairo_image_surface_get_width (img);
+  *height = cairo_image_surface_get_height (img);
+
+  image = g_malloc (*width * *height);
+  for (y = 0; y < *height; y++)
+    for (x = 0; x < *width; x++)
+      image[y * *width + x] = data[y * stride + x * 4];
+
+  cairo_surface_destroy (img);
+
+  return image;
+}
+
+static const CaptureMinutiae *
+find_capture_minutiae (const gchar *name)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (capture_minutiae); i++)
+    if (g_str_equal (capture_minutiae[i].name, name))
+      return &capture_minutiae[i];
+
+  return NULL;
+}
+
+static void
+check_remove_compact (guchar *image, gint width, gint height,
+                      const CaptureMinutiae *expected)
+{
+  DetectResult sliding = { 0, };
+  DetectResult compact = { 0, };
+  g_autofree gboolean *remove = NULL;
+  gint i;
+
+  /* Detection is deterministic, so both lists start out identical */
+  detect (&sliding, image, width, height, 1);
+  detect (&compact, image, width, height, 1);
+  g_assert_cmpint (sliding.minutiae->num, ==, compact.minutiae->num);
+  for (i = 0; i < compact.minutiae->num; i++)
+    g_assert_nonnull (compact.minutiae->list[i]);
+
+  /* And the same as with the unmodified NBIS code */
+  g_assert_cmpint (compact.minutiae->num, ==, expected->num);
+  for (i = 0; i < expected->num; i++)
+    {
+      MINUTIA *m = compact.minutiae->list[i];
+
+      g_assert_cmpint (m->x, ==, expected->minutiae[i].x);
+      g_assert_cmpint (m->y, ==, expected->minutiae[i].y);
+      g_assert_cmpint (m->direction, ==, expected->minutiae[i].direction);
+      g_assert_cmpint (m->type, ==, expected->minutiae[i].type);
+      g_assert_cmpfloat (fabs (m->reliability - expected->minutiae[i].reliability), <=, 1e-6);
+    }
+
+  if (sliding.minutiae->num == 0)
+    {
+      detect_result_clear (&sliding);
+      detect_result_clear (&compact);
+      return;
+    }
+
+  remove = g_new0 (gboolean, sliding.minutiae->num);
+  for (i = 0; i < sliding.minutiae->num; i++)
+    remove[i] = g_test_rand_bit ();
+  remove[0] = TRUE;
+  remove[sliding.minutiae->num - 1] = TRUE;
+
+  /* Removing one at a time slides the tail of the list every time */
+  for (i = sliding.minutiae->num - 1; i >= 0; i--)
+    if (remove[i])
+      g_assert_cmpint (remove_minutia (i, sliding.minutiae), ==, 0);
+
+  /* Deferred removal leaves holes that are closed up in one pass */
+  for (i = 0; i < compact.minutiae->num; i++)
+    if (remove[i])
+      g_assert_cmpint (remove_minutia_deferred (i, compact.minutiae), ==, 0);
+  g_assert_cmpint (remove_minutia_deferred (0, compact.minutiae), <, 0);
+  compact_minutiae (compact.minutiae);
+
+  g_assert_cmpint (compact.minutiae->num, ==, sliding.minutiae->num);
+  for (i = 0; i < compact.minutiae->num; i++)
+    {
+      MINUTIA *a = sliding.minutiae->list[i];
+      MINUTIA *b = compact.minutiae->list[i];
+
+      g_assert_cmpint (a->x, ==, b->x);
+      g_assert_cmpint (a->y, ==, b->y);
+      g_assert_cmpint (a->direction, ==, b->direction);
+      g_assert_cmpint (a->type, ==, b->type);
+      g_assert_cmpfloat (a->reliability, ==, b->reliability);
+    }
+
+  detect_result_clear (&sliding);
+  detect_result_clear (&compact);
+}
+
+static void
+test_remove_compact (void)
+{
+  g_autofree gchar *tests_dir = NULL;
+  const gchar *name;
+  GDir *dir;
+  guint checked = 0;
+
+  g_assert_false (SOURCE_ROOT == NULL);
+  tests_dir = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", NULL);
+  dir = g_dir_open (tests_dir, 0, NULL);
+  g_assert_nonnull (dir);
+
+  /* Run over every capture image of the driver tests */
+  while ((name = g_dir_read_name (dir)))
+    {
+      const CaptureMinutiae *expected;
+      g_autofree gchar *path = NULL;
+      g_autofree guchar *image = NULL;
+      gint width, height;
+
+      path = g_build_path (G_DIR_SEPARATOR_S, tests_dir, name, "capture.png", NULL);
+      if (!g_file_test (path, G_FILE_TEST_EXISTS))
+        continue;
+
+      /* New captures are skipped until test-nbis-captures.h is regenerated */
+      expected = find_capture_minutiae (name);
+      if (!expected)
+        {
+          g_test_message ("No minutiae for capture %s, skipping", name);
+          continue;
+        }
+
+      image = load_capture (path, &width, &height);
+      check_remove_compact (image, width, height, expected);
+      checked += 1;
+    }
+  g_dir_close (dir);
+
+  g_assert_cmpuint (checked, ==, G_N_ELEMENTS (capture_minutiae));
+}
+
+static void
+test_scratch (void)
+{
+  gint *a, *b, *c, *d;
+  gint *heap;
+  gint i;
+
+  /* Without scratch memory, buffers come from the heap */
+  heap = alloc_lfs_scratch (16 * sizeof (gint));
+  heap[15] = 1;
+
+  begin_lfs_scratch ();
+
+  a = alloc_lfs_scratch (10 * sizeof (gint));
+  b = alloc_lfs_scratch (3 * sizeof (gint));
+  g_assert_true (b > a);
+  g_assert_cmpuint (GPOINTER_TO_SIZE (b) % 16, ==, 0);
+  for (i = 0; i < 10; i++)
+    a[i] = i;
+  for (i = 0; i < 3; i++)
+    b[i] = -1;
+
+  /* Space is only reused once all later buffers are deallocated */
+  free_lfs_scratch (a);
+  c = alloc_lfs_scratch (sizeof (gint));
+  g_assert_true (c > b);
+  free_lfs_scratch (c);
+  free_lfs_scratch (b);
+  c = alloc_lfs_scratch (sizeof (gint));
+  g_assert_true (c == a);
+  c[0] = 5;
+
+  /* Buffers that do not fit in a chunk continue in a new one */
+  d = alloc_lfs_scratch (1024 * 1024);
+  memset (d, 0xff, 1024 * 1024);
+  g_assert_cmpint (c[0], ==, 5);
+
+  /* Heap buffers can still be deallocated */
+  free_lfs_scratch (heap);
+
+  free_lfs_scratch (d);
+  free_lfs_scratch (c);
+
+  reset_lfs_scratch ();
+  a = alloc_lfs_scratch (1024 * 1024);
+  memset (a, 0, 1024 * 1024);
+  free_lfs_scratch (a);
+
+  end_lfs_scratch ();
+
+  /* The next detection reuses the chunk */
+  begin_lfs_scratch ();
+  b = alloc_lfs_scratch (1024 * 1024);
+  g_assert_true (b == a);
+  free_lfs_scratch (b);
+  end_lfs_scratch ();
+
+  heap = alloc_lfs_scratch (sizeof (gint));
+  free_lfs_scratch (heap);
+}
+
+typedef struct
+{
+  GThread *caller;
+  guint progress_calls;
+  guint completed;
+  gboolean done;
+  GPtrArray *errors;
+} BatchResult;
+
+static void
+batch_progress_cb (FpImage *image, guint completed, guint total,
+                   gpointer user_data, GError *error)
+{
+  BatchResult *result = user_data;
+
+  /* Reported on the context of the caller, never from a worker */
+  g_assert_true (g_thread_self () == result->caller);
+  g_assert_no_error (error);
+  g_assert_nonnull (fp_image_get_minutiae (image));
+  g_assert_cmpuint (completed, ==, result->completed + 1);
+  g_assert_cmpuint (total, ==, 6);
+
+  result->progress_calls += 1;
+  result->completed = completed;
+}
+
+static void
+batch_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  BatchResult *result = user_data;
+  GError *error = NULL;
+
+  result->errors = fp_image_detect_minutiae_batch_finish (res, &error);
+  g_assert_no_error (error);
+  result->done = TRUE;
+}
+
+static void
+single_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  gboolean *done = user_data;
+  GError *error = NULL;
+
+  g_assert_true (fp_image_detect_minutiae_finish (FP_IMAGE (source_object), res, &error));
+  g_assert_no_error (error);
+  *done = TRUE;
+}
+
+static void
+test_detect_copy_on_write (void)
+{
+  const gint width = 256;
+  const gint height = 256;
+  g_autofree guchar *ridges = make_ridge_image (width, height);
+  g_autoptr(FpImage) image = fp_image_new (width, height);
+  g_autoptr(FpImage) unshared = fp_image_new (width, height);
+  guint8 *shared, *data;
+  gboolean done = FALSE;
+  gint i;
+
+  memcpy (image->data, ridges, width * height);
+  memcpy (unshared->data, ridges, width * height);
+  image->ppmm = unshared->ppmm = 19.685;
+  image->flags = unshared->flags = FPI_IMAGE_COLORS_INVERTED;
+
+  /* Another user of the buffer must not see the normalization */
+  shared = fpi_image_buffer_ref (image->data);
+
+  fp_image_detect_minutiae (image, NULL, single_done_cb, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_true (image->data != shared);
+  g_assert_cmpmem (shared, width * height, ridges, width * height);
+  for (i = 0; i < width * height; i++)
+    g_assert_cmpuint (image->data[i], ==, 0xff - ridges[i]);
+  g_assert_cmpuint (image->flags & FPI_IMAGE_COLORS_INVERTED, ==, 0);
+
+  fpi_image_buffer_unref (shared);
+
+  /* Without other users, the buffer is normalized in place */
+  data = unshared->data;
+  done = FALSE;
+  fp_image_detect_minutiae (unshared, NULL, single_done_cb, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_true (unshared->data == data);
+  g_assert_cmpmem (unshared->data, width * height, image->data, width * height);
+}
+
+static void
+test_detect_batch (void)
+{
+  const gint width = 256;
+  const gint height = 256;
+  g_autoptr(GPtrArray) images = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr(GPtrArray) singles = g_ptr_array_new_with_free_func (g_object_unref);
+  BatchResult result = { 0, };
+  guint i, j;
+
+  for (i = 0; i < 6; i++)
+    {
+      g_autofree guchar *data = make_ridge_image (width, height);
+      FpImage *image = fp_image_new (width, height);
+      FpImage *single = fp_image_new (width, height);
+
+      memcpy (image->data, data, width * height);
+      memcpy (single->data, data, width * height);
+      image->ppmm = single->ppmm = 19.685;
+      /* Normalization must happen for some of them */
+      if (i % 2)
+        image->flags = single->flags = FPI_IMAGE_COLORS_INVERTED | FPI_IMAGE_V_FLIPPED;
+
+      g_ptr_array_add (images, image);
+      g_ptr_array_add (singles, single);
+    }
+
+  result.caller = g_thread_self ();
+  fp_image_detect_minutiae_batch (images, 3, NULL,
+                                  batch_progress_cb, &result, NULL,
+                                  batch_done_cb, &result);
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (result.progress_calls, ==, images->len);
+  g_assert_cmpuint (result.errors->len, ==, images->len);
+
+  /* The results must be the same as detecting each image on its own */
+  for (i = 0; i < images->len; i++)
+    {
+      FpImage *image = g_ptr_array_index (images, i);
+      FpImage *single = g_ptr_array_index (singles, i);
+      GPtrArray *minutiae, *single_minutiae;
+      gboolean done = FALSE;
+
+      g_assert_null (g_ptr_array_index (result.errors, i));
+
+      fp_image_detect_minutiae (single, NULL, single_done_cb, &done);
+      while (!done)
+        g_main_context_iteration (NULL, TRUE);
+
+      g_assert_cmpuint (image->flags, ==, single->flags);
+      g_assert_cmpmem (fp_image_get_data (image, NULL), width * height,
+                       fp_image_get_data (single, NULL), width * height);
+
+      minutiae = fp_image_get_minutiae (image);
+      single_minutiae = fp_image_get_minutiae (single);
+      g_assert_cmpuint (minutiae->len, ==, single_minutiae->len);
+      for (j = 0; j < minutiae->len; j++)
+        {
+          gint x, y, sx, sy;
+
+          fp_minutia_get_coords (g_ptr_array_index (minutiae, j), &x, &y);
+          fp_minutia_get_coords (g_ptr_array_index (single_minutiae, j), &sx, &sy);
+          g_assert_cmpint (x, ==, sx);
+          g_assert_cmpint (y, ==, sy);
+        }
+    }
+
+  g_ptr_array_unref (result.errors);
+}
+
+static void
+test_detect_batch_progress_thread (void)
+{
+  const gint width = 256;
+  const gint height = 256;
+  g_autoptr(GPtrArray) images = g_ptr_array_new_with_free_func (g_object_unref);
+  BatchResult result = { 0, };
+  guint i;
+
+  for (i = 0; i < 6; i++)
+    {
+      g_autofree guchar *data = make_ridge_image (width, height);
+      FpImage *image = fp_image_new (width, height);
+
+      memcpy (image->data, data, width * height);
+      image->ppmm = 19.685;
+      g_ptr_array_add (images, image);
+    }
+
+  result.caller = g_thread_self ();
+  fp_image_detect_minutiae_batch (images, 3, NULL,
+                                  batch_progress_cb, &result, NULL,
+                                  batch_done_cb, &result);
+
+  /* The workers may well be done while the context is not iterated, the
+   * context is then free to be acquired by them. The progress must still
+   * only be reported once the caller iterates the context. */
+  g_usleep (G_USEC_PER_SEC / 2);
+  g_assert_cmpuint (result.progress_calls, ==, 0);
+
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (result.progress_calls, ==, images->len);
+  g_ptr_array_unref (result.errors);
+}
+
+static gint
+compare_strings (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Prints test-nbis-captures.h for the current captures and minutiae
+ * detection, keeping everything before the first table of the existing
+ * file. */
+static int
+regenerate_captures (void)
+{
+  g_autofree gchar *tests_dir = NULL;
+  g_autofree gchar *header_path = NULL;
+  g_autofree gchar *header = NULL;
+  g_autoptr(GPtrArray) names = NULL;
+  g_autoptr(GError) error = NULL;
+  const gchar *name;
+  gchar *tables;
+  GDir *dir;
+  guint i;
+  gint j;
+
+  tests_dir = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", NULL);
+  header_path = g_build_path (G_DIR_SEPARATOR_S, tests_dir, "test-nbis-captures.h", NULL);
+  if (!g_file_get_contents (header_path, &header, NULL, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  tables = strstr (header, "static const CaptureMinutia ");
+  if (tables)
+    *tables = '\0';
+  g_print ("%s", header);
+
+  dir = g_dir_open (tests_dir, 0, &error);
+  if (!dir)
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  /* Sorted by the path of the captures, with the separator appended */
+  names = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)))
+    {
+      g_autofree gchar *path = NULL;
+
+      path = g_build_path (G_DIR_SEPARATOR_S, tests_dir, name, "capture.png", NULL);
+      if (g_file_test (path, G_FILE_TEST_EXISTS))
+        g_ptr_array_add (names, g_strconcat (name, G_DIR_SEPARATOR_S, NULL));
+    }
+  g_dir_close (dir);
+
+  g_ptr_array_sort (names, compare_strings);
+  for (i = 0; i < names->len; i++)
+    {
+      gchar *capture = g_ptr_array_index (names, i);
+
+      capture[strlen (capture) - 1] = '\0';
+    }
+
+  for (i = 0; i < names->len; i++)
+    {
+      const gchar *capture = g_ptr_array_index (names, i);
+      g_autofree gchar *ident = g_strdelimit (g_strdup (capture), "-", '_');
+      g_autofree gchar *path = NULL;
+      g_autofree guchar *image = NULL;
+      DetectResult result = { 0, };
+      gint width, height;
+
+      path = g_build_path (G_DIR_SEPARATOR_S, tests_dir, capture, "capture.png", NULL);
+      image = load_capture (path, &width, &height);
+      detect (&result, image, width, height, 1);
+
+      g_print ("static const CaptureMinutia %s_minutiae[] = {\n", ident);
+      for (j = 0; j < result.minutiae->num; j++)
+        {
+          MINUTIA *m = result.minutiae->list[j];
+
+          g_print ("  { %d, %d, %d, %f, %d },\n",
+                   m->x, m->y, m->direction, m->reliability, m->type);
+        }
+      g_print ("};\n\n");
+
+      detect_result_clear (&result);
+    }
+
+  g_print ("static const CaptureMinutiae capture_minutiae[] = {\n");
+  for (i = 0; i < names->len; i++)
+    {
+      const gchar *capture = g_ptr_array_index (names, i);
+      g_autofree gchar *ident = g_strdelimit (g_strdup (capture), "-", '_');
+
+      g_print ("  { \"%s\", G_N_ELEMENTS (%s_minutiae), %s_minutiae },\n",
+               capture, ident, ident);
+    }
+  g_print ("};\n");
+
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* Not a test, see test-nbis-captures.h */
+  if (argc == 2 && g_str_equal (argv[1], "--regenerate"))
+    return regenerate_captures ();
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/nbis/dft/dir_powers", test_dft_dir_powers);
+  g_test_add_func ("/nbis/maps/threaded", test_maps_threaded);
+  g_test_add_func ("/nbis/tables/shared", test_tables_shared);
+  g_test_add_func ("/nbis/remove/compact", test_remove_compact);
+  g_test_add_func ("/nbis/scratch", test_scratch);
+  g_test_add_func ("/nbis/detect/copy_on_write", test_detect_copy_on_write);
+  g_test_add_func ("/nbis/detect/batch", test_detect_batch);
+  g_test_add_func ("/nbis/detect/batch/progress_thread", test_detect_batch_progress_thread);
+
+  return g_test_run ();
+}
@@ -0,0 +1,113 @@
+/*
+ * Unit tests for the uru4000 image decryption
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+
+#include "drivers/uru4000_decode.h"
+
+/* Same as the driver, a block holds a number of lines */
+#define IMAGE_WIDTH 384
+
+/* Produced by the decoder from before the table based one */
+static const uint8_t known_output[20] = {
+  0x13, 0x08, 0x67, 0x8d, 0x54, 0xe2, 0x03, 0x11, 0x53, 0x33,
+  0x8b, 0x49, 0x44, 0x09, 0xbd, 0xc5, 0xbb, 0xd8, 0x44, 0x00,
+};
+#define KNOWN_KEY 0x12345678
+#define KNOWN_NEXT_KEY 0x7bb02123
+
+static void
+fill_known_input (uint8_t *data)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (known_output); i++)
+    data[i] = i * 37 + 5;
+}
+
+/* Tests */
+
+static void
+test_decode_known (void)
+{
+  uint8_t data[G_N_ELEMENTS (known_output)];
+
+  fill_known_input (data);
+  g_assert_cmpuint (uru4000_decode_bitwise (data, sizeof (data), KNOWN_KEY), ==, KNOWN_NEXT_KEY);
+  g_assert_cmpmem (data, sizeof (data), known_output, sizeof (known_output));
+
+  fill_known_input (data);
+  g_assert_cmpuint (uru4000_decode (data, sizeof (data), KNOWN_KEY), ==, KNOWN_NEXT_KEY);
+  g_assert_cmpmem (data, sizeof (data), known_output, sizeof (known_output));
+}
+
+static void
+check_decode_block (int num_bytes, uint32_t key)
+{
+  g_autofree uint8_t *bitwise = g_malloc (num_bytes);
+  g_autofree uint8_t *table = NULL;
+  uint32_t bitwise_key, table_key;
+  int i;
+
+  for (i = 0; i < num_bytes; i++)
+    bitwise[i] = g_test_rand_int_range (0, 256);
+  table = g_memdup (bitwise, num_bytes);
+
+  bitwise_key = uru4000_decode_bitwise (bitwise, num_bytes, key);
+  table_key = uru4000_decode (table, num_bytes, key);
+
+  g_assert_cmpuint (table_key, ==, bitwise_key);
+  g_assert_cmpmem (table, num_bytes, bitwise, num_bytes);
+}
+
+static void
+test_decode_short_blocks (void)
+{
+  int num_bytes;
+
+  /* Every split between the table and the bitwise part */
+  for (num_bytes = 1; num_bytes <= 64; num_bytes++)
+    check_decode_block (num_bytes, g_test_rand_int ());
+}
+
+static void
+test_decode_image_blocks (void)
+{
+  int i;
+
+  check_decode_block (IMAGE_WIDTH, 0);
+  check_decode_block (IMAGE_WIDTH, 0xffffffff);
+
+  for (i = 0; i < 100; i++)
+    check_decode_block (IMAGE_WIDTH * g_test_rand_int_range (1, 16),
+                        g_test_rand_int ());
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  uru4000_decode_init ();
+
+  g_test_add_func ("/uru4000/decode/known", test_decode_known);
+  g_test_add_func ("/uru4000/decode/short_blocks", test_decode_short_blocks);
+  g_test_add_func ("/uru4000/decode/image_blocks", test_decode_image_blocks);
+
+  return g_test_run ();
+}